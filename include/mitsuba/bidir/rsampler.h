@@ -58,11 +58,11 @@ public:
     /// Manually set the current sample index
     virtual void setSampleIndex(size_t sampleIndex);
 
-    /// Retrieve the next component value from the current sample
-    virtual Float next1D();
+    /// Compute the next component value of the current sample
+    virtual Float fetch1D();
 
-    /// Retrieve the next two component values from the current sample
-    virtual Point2 next2D();
+    /// Compute the next two component values of the current sample
+    virtual Point2 fetch2D();
 
     /* Unsupported by this implementation */
     virtual void request2DArray(size_t size);
@@ -0,0 +1,150 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+#if !defined(__MITSUBA_CORE_ARENA_H_)
+#define __MITSUBA_CORE_ARENA_H_
+
+#include <mitsuba/mitsuba.h>
+
+MTS_NAMESPACE_BEGIN
+
+/// Default size of the blocks requested by a memory arena (64 KiB)
+#define MTS_ARENA_BLOCK_SIZE 65536
+
+/// Alignment of all allocations made from a memory arena
+#define MTS_ARENA_ALIGNMENT 16
+
+/**
+ * \brief Bump allocator for short-lived scratch memory
+ *
+ * Allocations simply advance a pointer within a large block of memory
+ * and are never freed individually. Instead, \ref rewind() or \ref reset()
+ * release everything that was allocated after a certain point. Once
+ * the arena has grown to its working set size, it stops interacting
+ * with the underlying allocator entirely.
+ *
+ * Objects placed in the arena are neither constructed nor destroyed,
+ * hence it should only be used for plain data types.
+ *
+ * Every thread has its own arena (see \ref getThreadArena()), which
+ * the work processors of the rendering code reset after each work unit.
+ * Code that needs temporary storage while processing a single sample
+ * should acquire it inside a \ref MemoryArena::Scope.
+ *
+ * \ingroup libcore
+ */
+class MTS_EXPORT_CORE MemoryArena {
+public:
+    /// Position within the arena that can later be returned to
+    struct Marker {
+        size_t block;
+        size_t offset;
+    };
+
+    /// Rewinds the arena to its state at construction time upon destruction
+    class Scope {
+    public:
+        inline Scope(MemoryArena &arena)
+            : m_arena(arena), m_marker(arena.getMarker()) { }
+        inline ~Scope() { m_arena.rewind(m_marker); }
+    private:
+        MemoryArena &m_arena;
+        Marker m_marker;
+    };
+
+    /// Create an empty arena that requests memory in blocks of the given size
+    MemoryArena(size_t blockSize = MTS_ARENA_BLOCK_SIZE);
+
+    /// Release all memory
+    ~MemoryArena();
+
+    /// Allocate \c size bytes of uninitialized memory
+    inline void *alloc(size_t size) {
+        size = (size + MTS_ARENA_ALIGNMENT - 1) & ~((size_t) MTS_ARENA_ALIGNMENT - 1);
+        if (EXPECT_NOT_TAKEN(m_block >= m_blocks.size() ||
+                m_offset + size > m_blocks[m_block].size))
+            nextBlock(size);
+        uint8_t *result = m_blocks[m_block].data + m_offset;
+        m_offset += size;
+        return result;
+    }
+
+    /// Allocate uninitialized storage for \c count instances of type \c T
+    template <typename T> inline T *alloc(size_t count = 1) {
+        return static_cast<T *>(alloc(sizeof(T) * count));
+    }
+
+    /// Return the current position within the arena
+    inline Marker getMarker() const {
+        Marker marker;
+        marker.block = m_block;
+        marker.offset = m_offset;
+        return marker;
+    }
+
+    /// Release everything that was allocated after \c marker was taken
+    inline void rewind(const Marker &marker) {
+        m_block = marker.block;
+        m_offset = marker.offset;
+    }
+
+    /**
+     * \brief Release all allocations
+     *
+     * If the arena had to request more than one block so far, they
+     * are merged into a single block of the combined size.
+     */
+    void reset();
+
+    /// Return the number of bytes that are currently allocated
+    size_t getUsedMemory() const;
+
+    /// Return the number of bytes requested from the underlying allocator
+    size_t getCapacity() const;
+
+    /// Return the number of blocks requested from the underlying allocator
+    inline size_t getBlockCount() const { return m_blocks.size(); }
+
+    /// Return the arena of the calling thread
+    static MemoryArena &getThreadArena();
+
+    /// Return a human-readable description
+    std::string toString() const;
+private:
+    struct Block {
+        uint8_t *data;
+        size_t size;
+    };
+
+    /// Continue in a block that can hold at least \c size bytes
+    void nextBlock(size_t size);
+
+    /// Arenas are not copyable
+    MemoryArena(const MemoryArena &);
+    MemoryArena &operator=(const MemoryArena &);
+private:
+    std::vector<Block> m_blocks;
+    size_t m_block, m_offset;
+    size_t m_blockSize;
+};
+
+MTS_NAMESPACE_END
+
+#endif /* __MITSUBA_CORE_ARENA_H_ */
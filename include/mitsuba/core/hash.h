@@ -0,0 +1,70 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+#if !defined(__MITSUBA_CORE_HASH_H_)
+#define __MITSUBA_CORE_HASH_H_
+
+#include <mitsuba/mitsuba.h>
+
+MTS_NAMESPACE_BEGIN
+
+/**
+ * \brief Incremental 64-bit FNV-1a hash
+ *
+ * Used to key on-disk caches by the inputs that determine their contents.
+ * Values are hashed using their in-memory representation, hence the result
+ * is only meaningful on machines with the same byte order.
+ */
+class FNV1aHash {
+public:
+    /// Create an empty hash
+    inline FNV1aHash() : m_hash(0xcbf29ce484222325ULL) { }
+
+    /// Append a sequence of bytes
+    inline void append(const void *data, size_t size) {
+        const uint8_t *ptr = (const uint8_t *) data;
+        for (size_t i=0; i<size; ++i)
+            m_hash = (m_hash ^ ptr[i]) * 0x100000001b3ULL;
+    }
+
+    inline void append(int value) { append(&value, sizeof(int)); }
+    inline void append(bool value) { append((int) value); }
+    inline void append(uint64_t value) { append(&value, sizeof(uint64_t)); }
+    inline void append(Float value) { append(&value, sizeof(Float)); }
+    inline void append(const std::string &value) { append(value.c_str(), value.length()); }
+
+    inline void append(const Point &p) {
+        append(p.x); append(p.y); append(p.z);
+    }
+
+    inline void append(const Spectrum &value) {
+        for (int i=0; i<SPECTRUM_SAMPLES; ++i)
+            append(value[i]);
+    }
+
+    /// Return the current hash value
+    inline uint64_t getValue() const { return m_hash; }
+protected:
+    uint64_t m_hash;
+};
+
+MTS_NAMESPACE_END
+
+#endif /* __MITSUBA_CORE_HASH_H_ */
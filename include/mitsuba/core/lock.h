@@ -40,6 +40,13 @@ public:
     /// Lock the mutex
     void lock();
 
+    /**
+     * \brief Try to lock the mutex without blocking
+     *
+     * \return \c true if the lock was acquired
+     */
+    bool tryLock();
+
     /// Unlock the mutex
     void unlock();
 
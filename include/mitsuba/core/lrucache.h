@@ -121,16 +121,24 @@ public:
         return it->info;
     }
 
-    // Obtain the cached keys, most recently used element
-    // at head, least recently used at tail.
-    // This method is provided purely to support testing.
-    template <typename IT> void get_keys(IT dst) const {
-        typename cache_type::right_const_reverse_iterator
-            src = m_cache.right.rbegin();
-        while (src != m_cache.right.rend())
-            *dst++=(*src++).second;
+    // Look up the record for k without generating it on a miss.
+    // Returns false if there is no such record.
+    bool find(const K& k, V &v) {
+        const typename cache_type::left_iterator it
+            = m_cache.left.find(k);
+        if (it == m_cache.left.end())
+            return false;
+
+        m_cache.right.relocate(
+            m_cache.right.end(),
+            m_cache.project_right(it)
+        );
+        v = it->info;
+        return true;
     }
-protected:
+
+    // Insert a new record for k, which must not be
+    // part of the cache yet
     void insert(const K& k,const V& v) {
         SAssert(m_cache.size() <= m_capacity);
         if (m_cache.size() == m_capacity) {
@@ -145,6 +153,15 @@ protected:
         m_cache.insert(typename cache_type::value_type(k,0,v));
     }
 
+    // Obtain the cached keys, most recently used element
+    // at head, least recently used at tail.
+    // This method is provided purely to support testing.
+    template <typename IT> void get_keys(IT dst) const {
+        typename cache_type::right_const_reverse_iterator
+            src = m_cache.right.rbegin();
+        while (src != m_cache.right.rend())
+            *dst++=(*src++).second;
+    }
 private:
     size_t m_capacity;
     boost::function<V(const K&)> m_generatorFunction;
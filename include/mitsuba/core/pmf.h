@@ -24,12 +24,123 @@
 
 MTS_NAMESPACE_BEGIN
 
+namespace math {
+    /// Alias sampling data structure (see \ref makeAliasTable() for details)
+    template <typename QuantizedScalar, typename Index> struct AliasTableEntry {
+        /// Probability of sampling the current entry
+        QuantizedScalar prob;
+        /// Index of the alias entry
+        Index index;
+    };
+
+    /**
+     * \brief Create the lookup table needed for Walker's alias sampling
+     * method implemented in \ref sampleAlias(). Runs in linear time.
+     *
+     * The basic idea of this method is that one can "redistribute" the
+     * probability mass of a distribution to make it uniform. This
+     * this can be done in a way such that the probability of each entry in
+     * the "flattened" PMF consists of probability mass from at most *two*
+     * entries in the original PMF. That then leads to an efficient O(1)
+     * sampling algorithm with a O(n) preprocessing step to set up this
+     * special decomposition.
+     *
+     * The downside of this method is that it generally does not preserve
+     * the nice stratification properties of QMC number sequences.
+     *
+     * \return The original (un-normalized) sum of all probabilities
+     * in \c pmf.
+     */
+    template <typename Scalar, typename QuantizedScalar, typename Index> float makeAliasTable(
+            AliasTableEntry<QuantizedScalar, Index> *tbl, Scalar *pmf, Index size) {
+        /* Allocate temporary storage for classification purposes */
+        Index *c = new Index[size],
+              *c_short = c - 1, *c_long  = c + size;
+
+        /* Begin by computing the normalization constant */
+        Scalar sum = 0;
+        for (size_t i=0; i<size; ++i)
+            sum += pmf[i];
+
+        Scalar normalization = (Scalar) 1 / sum;
+        for (Index i=0; i<size; ++i) {
+            /* For each entry, determine whether there is
+               "too little" or "too much" probability mass */
+            Scalar value = size * normalization * pmf[i];
+            if (value < 1)
+                *++c_short = i;
+            else
+                *--c_long  = i;
+            tbl[i].prob  = value;
+            tbl[i].index = i;
+        }
+
+        /* Perform pairwise exchanges while there are entries
+           with too much probability mass */
+        for (Index i=0; i < size-1 && c_long - c < size; ++i) {
+            Index short_index = c[i],
+                  long_index  = *c_long;
+
+            tbl[short_index].index = long_index;
+            tbl[long_index].prob  -= (Scalar) 1 - tbl[short_index].prob;
+
+            if (tbl[long_index].prob <= 1)
+                ++c_long;
+        }
+
+        delete[] c;
+
+        return sum;
+    }
+
+    /// Generate a sample in constant time using the alias method
+    template <typename Scalar, typename QuantizedScalar, typename Index> Index sampleAlias(
+            const AliasTableEntry<QuantizedScalar, Index> *tbl, Index size, Scalar sample) {
+        Index l = std::min((Index) (sample * size), (Index) (size - 1));
+        Scalar prob = (Scalar) tbl[l].prob;
+
+        sample = sample * size - l;
+
+        if (prob == 1 || (prob != 0 && sample < prob))
+            return l;
+        else
+            return tbl[l].index;
+    }
+
+    /**
+     * \brief Generate a sample in constant time using the alias method
+     *
+     * This variation shifts and scales the uniform random sample so
+     * that it can be reused for another sampling operation
+     */
+    template <typename Scalar, typename QuantizedScalar, typename Index> Index sampleAliasReuse(
+            const AliasTableEntry<QuantizedScalar, Index> *tbl, Index size, Scalar &sample) {
+        Index l = std::min((Index) (sample * size), (Index) (size - 1));
+        Scalar prob = (Scalar) tbl[l].prob;
+
+        sample = sample * size - l;
+
+        if (prob == 1 || (prob != 0 && sample < prob)) {
+            sample /= prob;
+            return l;
+        } else {
+            sample = (sample - prob) / (1 - prob);
+            return tbl[l].index;
+        }
+    }
+};
+
 /**
  * \brief Discrete probability distribution
  *
  * This data structure can be used to transform uniformly distributed
  * samples to a stored discrete probability distribution.
  *
+ * By default, sampling performs a binary search over the cumulative
+ * distribution function, which preserves the stratification of the input
+ * samples. Following a call to \ref buildAliasTable(), samples are instead
+ * generated in constant time using Walker's alias method.
+ *
  * \ingroup libcore
  */
 struct DiscreteDistribution {
@@ -44,6 +155,7 @@ public:
     inline void clear() {
         m_cdf.clear();
         m_cdf.push_back(0.0f);
+        m_alias.clear();
         m_normalized = false;
     }
 
@@ -55,6 +167,7 @@ public:
     /// Append an entry with the specified discrete probability
     inline void append(Float pdfValue) {
         m_cdf.push_back(m_cdf[m_cdf.size()-1] + pdfValue);
+        m_alias.clear();
     }
 
     /// Return the number of entries so far
@@ -113,6 +226,36 @@ public:
         return m_sum;
     }
 
+    /**
+     * \brief Prepare the distribution for constant-time sampling
+     * using the alias method (see \ref math::makeAliasTable())
+     *
+     * Afterwards, all \c sample*() functions use the alias table instead
+     * of a binary search. This is preferable for large distributions that
+     * are sampled frequently, but it does not preserve the stratification
+     * of QMC sample sequences. Appending further entries discards the table.
+     *
+     * This assumes that \ref normalize() has previously been called
+     */
+    inline void buildAliasTable() {
+        size_t n = size();
+        m_alias.clear();
+        if (!m_normalized || n > (size_t) std::numeric_limits<uint32_t>::max())
+            return;
+
+        std::vector<Float> pmf(n);
+        for (size_t i=0; i<n; ++i)
+            pmf[i] = operator[](i);
+
+        m_alias.resize(n);
+        math::makeAliasTable(&m_alias[0], &pmf[0], (uint32_t) n);
+    }
+
+    /// Does the distribution use the alias method for sampling?
+    inline bool hasAliasTable() const {
+        return !m_alias.empty();
+    }
+
     /**
      * \brief %Transform a uniformly distributed sample to the stored distribution
      *
@@ -122,6 +265,9 @@ public:
      *     The discrete index associated with the sample
      */
     inline size_t sample(Float sampleValue) const {
+        if (!m_alias.empty())
+            return math::sampleAlias(&m_alias[0], (uint32_t) m_alias.size(), sampleValue);
+
         std::vector<Float>::const_iterator entry =
                 std::lower_bound(m_cdf.begin(), m_cdf.end(), sampleValue);
         size_t index = std::min(m_cdf.size()-2,
@@ -162,6 +308,9 @@ public:
      *     The discrete index associated with the sample
      */
     inline size_t sampleReuse(Float &sampleValue) const {
+        if (!m_alias.empty())
+            return math::sampleAliasReuse(&m_alias[0], (uint32_t) m_alias.size(), sampleValue);
+
         size_t index = sample(sampleValue);
         sampleValue = (sampleValue - m_cdf[index])
             / (m_cdf[index + 1] - m_cdf[index]);
@@ -181,6 +330,13 @@ public:
      *     The discrete index associated with the sample
      */
     inline size_t sampleReuse(Float &sampleValue, Float &pdf) const {
+        if (!m_alias.empty()) {
+            size_t index = math::sampleAliasReuse(&m_alias[0],
+                (uint32_t) m_alias.size(), sampleValue);
+            pdf = operator[](index);
+            return index;
+        }
+
         size_t index = sample(sampleValue, pdf);
         sampleValue = (sampleValue - m_cdf[index])
             / (m_cdf[index + 1] - m_cdf[index]);
@@ -194,7 +350,7 @@ public:
     std::string toString() const {
         std::ostringstream oss;
         oss << "DiscreteDistribution[sum=" << m_sum << ", normalized="
-            << (int) m_normalized << ", cdf={";
+            << (int) m_normalized << ", alias=" << (int) hasAliasTable() << ", cdf={";
         for (size_t i=0; i<m_cdf.size(); ++i) {
             oss << m_cdf[i];
             if (i != m_cdf.size()-1)
@@ -205,116 +361,11 @@ public:
     }
 private:
     std::vector<Float> m_cdf;
+    std::vector<math::AliasTableEntry<Float, uint32_t> > m_alias;
     Float m_sum, m_normalization;
     bool m_normalized;
 };
 
-namespace math {
-    /// Alias sampling data structure (see \ref makeAliasTable() for details)
-    template <typename QuantizedScalar, typename Index> struct AliasTableEntry {
-        /// Probability of sampling the current entry
-        QuantizedScalar prob;
-        /// Index of the alias entry
-        Index index;
-    };
-
-    /**
-     * \brief Create the lookup table needed for Walker's alias sampling
-     * method implemented in \ref sampleAlias(). Runs in linear time.
-     *
-     * The basic idea of this method is that one can "redistribute" the
-     * probability mass of a distribution to make it uniform. This
-     * this can be done in a way such that the probability of each entry in
-     * the "flattened" PMF consists of probability mass from at most *two*
-     * entries in the original PMF. That then leads to an efficient O(1)
-     * sampling algorithm with a O(n) preprocessing step to set up this
-     * special decomposition.
-     *
-     * The downside of this method is that it generally does not preserve
-     * the nice stratification properties of QMC number sequences.
-     *
-     * \return The original (un-normalized) sum of all probabilities
-     * in \c pmf.
-     */
-    template <typename Scalar, typename QuantizedScalar, typename Index> float makeAliasTable(
-            AliasTableEntry<QuantizedScalar, Index> *tbl, Scalar *pmf, Index size) {
-        /* Allocate temporary storage for classification purposes */
-        Index *c = new Index[size],
-              *c_short = c - 1, *c_long  = c + size;
-
-        /* Begin by computing the normalization constant */
-        Scalar sum = 0;
-        for (size_t i=0; i<size; ++i)
-            sum += pmf[i];
-
-        Scalar normalization = (Scalar) 1 / sum;
-        for (Index i=0; i<size; ++i) {
-            /* For each entry, determine whether there is
-               "too little" or "too much" probability mass */
-            Scalar value = size * normalization * pmf[i];
-            if (value < 1)
-                *++c_short = i;
-            else if (value > 1)
-                *--c_long  = i;
-            tbl[i].prob  = value;
-            tbl[i].index = i;
-        }
-
-        /* Perform pairwise exchanges while there are entries
-           with too much probability mass */
-        for (Index i=0; i < size-1 && c_long - c < size; ++i) {
-            Index short_index = c[i],
-                  long_index  = *c_long;
-
-            tbl[short_index].index = long_index;
-            tbl[long_index].prob  -= (Scalar) 1 - tbl[short_index].prob;
-
-            if (tbl[long_index].prob <= 1)
-                ++c_long;
-        }
-
-        delete[] c;
-
-        return sum;
-    }
-
-    /// Generate a sample in constant time using the alias method
-    template <typename Scalar, typename QuantizedScalar, typename Index> Index sampleAlias(
-            const AliasTableEntry<QuantizedScalar, Index> *tbl, Index size, Scalar sample) {
-        Index l = std::min((Index) (sample * size), (Index) (size - 1));
-        Scalar prob = (Scalar) tbl[l].prob;
-
-        sample = sample * size - l;
-
-        if (prob == 1 || (prob != 0 && sample < prob))
-            return l;
-        else
-            return tbl[l].index;
-    }
-
-    /**
-     * \brief Generate a sample in constant time using the alias method
-     *
-     * This variation shifts and scales the uniform random sample so
-     * that it can be reused for another sampling operation
-     */
-    template <typename Scalar, typename QuantizedScalar, typename Index> Index sampleAliasReuse(
-            const AliasTableEntry<QuantizedScalar, Index> *tbl, Index size, Scalar &sample) {
-        Index l = std::min((Index) (sample * size), (Index) (size - 1));
-        Scalar prob = (Scalar) tbl[l].prob;
-
-        sample = sample * size - l;
-
-        if (prob == 1 || (prob != 0 && sample < prob)) {
-            sample /= prob;
-            return l;
-        } else {
-            sample = (sample - prob) / (1 - prob);
-            return tbl[l].index;
-        }
-    }
-};
-
 MTS_NAMESPACE_END
 
 #endif /* __MITSUBA_CORE_PMF_H_ */
@@ -92,6 +92,14 @@ public:
     /// Copy constructor
     Properties(const Properties &props);
 
+    /**
+     * \brief Unserialize a property container from a binary data stream
+     *
+     * The stream must have been written by \ref serialize() on a build
+     * with the same floating point precision and spectral discretization.
+     */
+    Properties(Stream *stream);
+
     /// Release all memory
     ~Properties();
 
@@ -245,6 +253,14 @@ public:
     /// Merge a properties record into the current one
     void merge(const Properties &props);
 
+    /**
+     * \brief Serialize the property container to a binary data stream
+     *
+     * The queried flags are not part of the output. Properties of
+     * type \ref EData cannot be serialized and raise an error.
+     */
+    void serialize(Stream *stream) const;
+
     /// Return a string representation
     std::string toString() const;
 private:
@@ -284,6 +284,40 @@ extern MTS_EXPORT_CORE Float radicalInverseFast(uint16_t baseIndex, uint64_t ind
 extern MTS_EXPORT_CORE Float scrambledRadicalInverseFast(uint16_t baseIndex,
         uint64_t index, uint16_t *perm);
 
+/**
+ * \brief Evaluate the (optionally scrambled) radical inverse function
+ * for an arithmetic progression of indices
+ *
+ * Computes <tt>out[i] = radicalInverseFast(baseIndex, offset + i*stride)</tt>
+ * for <tt>i = 0, ..., count-1</tt>, or the corresponding values of
+ * \ref scrambledRadicalInverseFast() when a permutation is specified.
+ * The results are identical to those functions, but the base-b digits
+ * of the index are updated incrementally from one entry to the next,
+ * which avoids most of the (expensive) 64-bit divisions.
+ *
+ * This is useful to generate a dimension of a Halton or Hammersley
+ * point set for many samples at once.
+ *
+ * \param baseIndex
+ *    Prime number index starting at 0 (i.e. 3 would cause 7 to be
+ *    used as the basis)
+ * \param offset
+ *    Index of the first entry
+ * \param stride
+ *    Index increment between subsequent entries
+ * \param count
+ *    Number of entries to compute
+ * \param out
+ *    Output array with room for \c count entries
+ * \param perm
+ *    Optional digit permutation (or \c NULL)
+ *
+ * \remark This function is not available in the Python API
+ */
+extern MTS_EXPORT_CORE void radicalInverseArray(uint16_t baseIndex,
+        uint64_t offset, uint64_t stride, size_t count, Float *out,
+        const uint16_t *perm = NULL);
+
 //! @}
 // -----------------------------------------------------------------------
 
@@ -69,6 +69,17 @@ public:
     /// Return the block border size required when rendering with this filter
     inline int getBorderSize() const { return m_borderSize; }
 
+    /// Is the filter constant within its radius (i.e. a box filter)?
+    inline bool isBox() const { return m_box; }
+
+    /**
+     * \brief Does every sample only contribute to the pixel that contains it?
+     *
+     * This is the case for box filters with the default radius of
+     * half a pixel. Such filters need no block border.
+     */
+    inline bool isSinglePixel() const { return m_box && m_radius < 0.5f + 1e-3f; }
+
     /// Evaluate the filter function
     virtual Float eval(Float x) const = 0;
 
@@ -96,6 +107,7 @@ protected:
     Float m_radius, m_scaleFactor;
     Float m_values[MTS_FILTER_RESOLUTION+1];
     int m_borderSize;
+    bool m_box;
 };
 
 /**
@@ -21,6 +21,9 @@
 #define __MITSUBA_CORE_SPECTRUM_H_
 
 #include <mitsuba/mitsuba.h>
+#if defined(MTS_SSE)
+#include <mitsuba/core/ssemath.h>
+#endif
 
 #if !defined(SPECTRUM_SAMPLES)
 #error The desired number of spectral samples must be \
@@ -282,6 +285,148 @@ protected:
     std::vector<Float> m_wavelengths, m_values;
 };
 
+namespace detail {
+    /**
+     * \brief Component-wise kernels that implement the arithmetic of \ref TSpectrum
+     *
+     * The generic version simply loops over the samples; a SIMD
+     * version for single precision spectra is provided below.
+     */
+    template <typename T, int N> struct SpectrumOps {
+        static inline void add(T *r, const T *a, const T *b) {
+            for (int i=0; i<N; i++)
+                r[i] = a[i] + b[i];
+        }
+
+        static inline void sub(T *r, const T *a, const T *b) {
+            for (int i=0; i<N; i++)
+                r[i] = a[i] - b[i];
+        }
+
+        static inline void mul(T *r, const T *a, const T *b) {
+            for (int i=0; i<N; i++)
+                r[i] = a[i] * b[i];
+        }
+
+        static inline void div(T *r, const T *a, const T *b) {
+            for (int i=0; i<N; i++)
+                r[i] = a[i] / b[i];
+        }
+
+        static inline void scale(T *r, const T *a, T f) {
+            for (int i=0; i<N; i++)
+                r[i] = a[i] * f;
+        }
+
+        static inline void addWeighted(T *r, T weight, const T *a) {
+            for (int i=0; i<N; i++)
+                r[i] += weight * a[i];
+        }
+
+        static inline void sqrt(T *r, const T *a) {
+            for (int i=0; i<N; i++)
+                r[i] = std::sqrt(a[i]);
+        }
+
+        static inline void exp(T *r, const T *a) {
+            for (int i=0; i<N; i++)
+                r[i] = math::fastexp(a[i]);
+        }
+    };
+
+#if defined(MTS_SSE) && defined(SINGLE_PRECISION)
+    /**
+     * \brief SSE version of the spectral kernels
+     *
+     * The samples are processed in groups of four using unaligned loads, so
+     * that the memory layout of \ref TSpectrum (which is e.g. aliased with
+     * \ref Bitmap storage) does not change. Leftover samples are handled
+     * using scalar code, except for \c exp(), where one additional padded
+     * group is cheaper than calls to the scalar function.
+     */
+    template <int N> struct SpectrumOps<float, N> {
+        enum { NVec = N - N % 4 };
+
+        static inline void add(float *r, const float *a, const float *b) {
+            for (int i=0; i<NVec; i+=4)
+                _mm_storeu_ps(r+i, _mm_add_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+            for (int i=NVec; i<N; i++)
+                r[i] = a[i] + b[i];
+        }
+
+        static inline void sub(float *r, const float *a, const float *b) {
+            for (int i=0; i<NVec; i+=4)
+                _mm_storeu_ps(r+i, _mm_sub_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+            for (int i=NVec; i<N; i++)
+                r[i] = a[i] - b[i];
+        }
+
+        static inline void mul(float *r, const float *a, const float *b) {
+            for (int i=0; i<NVec; i+=4)
+                _mm_storeu_ps(r+i, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+            for (int i=NVec; i<N; i++)
+                r[i] = a[i] * b[i];
+        }
+
+        static inline void div(float *r, const float *a, const float *b) {
+            for (int i=0; i<NVec; i+=4)
+                _mm_storeu_ps(r+i, _mm_div_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+            for (int i=NVec; i<N; i++)
+                r[i] = a[i] / b[i];
+        }
+
+        static inline void scale(float *r, const float *a, float f) {
+            const __m128 factor = _mm_set1_ps(f);
+            for (int i=0; i<NVec; i+=4)
+                _mm_storeu_ps(r+i, _mm_mul_ps(_mm_loadu_ps(a+i), factor));
+            for (int i=NVec; i<N; i++)
+                r[i] = a[i] * f;
+        }
+
+        static inline void addWeighted(float *r, float weight, const float *a) {
+            const __m128 factor = _mm_set1_ps(weight);
+            for (int i=0; i<NVec; i+=4)
+                _mm_storeu_ps(r+i, _mm_add_ps(_mm_loadu_ps(r+i),
+                    _mm_mul_ps(_mm_loadu_ps(a+i), factor)));
+            for (int i=NVec; i<N; i++)
+                r[i] += weight * a[i];
+        }
+
+        static inline void sqrt(float *r, const float *a) {
+            for (int i=0; i<NVec; i+=4)
+                _mm_storeu_ps(r+i, _mm_sqrt_ps(_mm_loadu_ps(a+i)));
+            for (int i=NVec; i<N; i++)
+                r[i] = std::sqrt(a[i]);
+        }
+
+        static inline void exp(float *r, const float *a) {
+            for (int i=0; i<NVec; i+=4)
+                _mm_storeu_ps(r+i, exp4(_mm_loadu_ps(a+i)));
+            if (NVec < N) {
+                const int rem = N - NVec;
+                __m128 x = _mm_setr_ps(a[NVec], rem > 1 ? a[NVec+1] : 0.0f,
+                    rem > 2 ? a[NVec+2] : 0.0f, 0.0f);
+                x = exp4(x);
+                r[NVec] = _mm_cvtss_f32(x);
+                if (rem > 1)
+                    r[NVec+1] = _mm_cvtss_f32(_mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+                if (rem > 2)
+                    r[NVec+2] = _mm_cvtss_f32(_mm_movehl_ps(x, x));
+            }
+        }
+
+        /// \c exp_ps() clamps its argument -- restore the IEEE behavior of \c std::exp()
+        static inline __m128 exp4(__m128 x) {
+            __m128 result = math::exp_ps(x);
+            result = _mm_andnot_ps(_mm_cmplt_ps(x, _mm_set1_ps(-88.3762626647949f)), result);
+            result = mux_ps(_mm_cmpgt_ps(x, _mm_set1_ps(88.3762626647949f)),
+                _mm_set1_ps(std::numeric_limits<float>::infinity()), result);
+            return mux_ps(_mm_cmpunord_ps(x, x), x, result);
+        }
+    };
+#endif
+};
+
 /**
  * \brief Abstract spectral power distribution data type
  *
@@ -295,6 +440,7 @@ protected:
 template <typename T, int N> struct TSpectrum {
 public:
     typedef T          Scalar;
+    typedef detail::SpectrumOps<T, N> Ops;
 
     /// Number of dimensions
     const static int dim = N;
@@ -333,39 +479,34 @@ public:
 
     /// Add two spectral power distributions
     inline TSpectrum operator+(const TSpectrum &spec) const {
-        TSpectrum value = *this;
-        for (int i=0; i<N; i++)
-            value.s[i] += spec.s[i];
+        TSpectrum value;
+        Ops::add(value.s, s, spec.s);
         return value;
     }
 
     /// Add a spectral power distribution to this instance
     inline TSpectrum& operator+=(const TSpectrum &spec) {
-        for (int i=0; i<N; i++)
-            s[i] += spec.s[i];
+        Ops::add(s, s, spec.s);
         return *this;
     }
 
     /// Subtract a spectral power distribution
     inline TSpectrum operator-(const TSpectrum &spec) const {
-        TSpectrum value = *this;
-        for (int i=0; i<N; i++)
-            value.s[i] -= spec.s[i];
+        TSpectrum value;
+        Ops::sub(value.s, s, spec.s);
         return value;
     }
 
     /// Subtract a spectral power distribution from this instance
     inline TSpectrum& operator-=(const TSpectrum &spec) {
-        for (int i=0; i<N; i++)
-            s[i] -= spec.s[i];
+        Ops::sub(s, s, spec.s);
         return *this;
     }
 
     /// Multiply by a scalar
     inline TSpectrum operator*(Scalar f) const {
-        TSpectrum value = *this;
-        for (int i=0; i<N; i++)
-            value.s[i] *= f;
+        TSpectrum value;
+        Ops::scale(value.s, s, f);
         return value;
     }
 
@@ -376,51 +517,44 @@ public:
 
     /// Multiply by a scalar
     inline TSpectrum& operator*=(Scalar f) {
-        for (int i=0; i<N; i++)
-            s[i] *= f;
+        Ops::scale(s, s, f);
         return *this;
     }
 
     /// Perform a component-wise multiplication by another spectrum
     inline TSpectrum operator*(const TSpectrum &spec) const {
-        TSpectrum value = *this;
-        for (int i=0; i<N; i++)
-            value.s[i] *= spec.s[i];
+        TSpectrum value;
+        Ops::mul(value.s, s, spec.s);
         return value;
     }
 
     /// Perform a component-wise multiplication by another spectrum
     inline TSpectrum& operator*=(const TSpectrum &spec) {
-        for (int i=0; i<N; i++)
-            s[i] *= spec.s[i];
+        Ops::mul(s, s, spec.s);
         return *this;
     }
 
     /// Perform a component-wise division by another spectrum
     inline TSpectrum& operator/=(const TSpectrum &spec) {
-        for (int i=0; i<N; i++)
-            s[i] /= spec.s[i];
+        Ops::div(s, s, spec.s);
         return *this;
     }
 
     /// Perform a component-wise division by another spectrum
     inline TSpectrum operator/(const TSpectrum &spec) const {
-        TSpectrum value = *this;
-        for (int i=0; i<N; i++)
-            value.s[i] /= spec.s[i];
+        TSpectrum value;
+        Ops::div(value.s, s, spec.s);
         return value;
     }
 
     /// Divide by a scalar
     inline TSpectrum operator/(Scalar f) const {
-        TSpectrum value = *this;
+        TSpectrum value;
 #ifdef MTS_DEBUG
         if (f == 0)
             SLog(EWarn, "TSpectrum: Division by zero!");
 #endif
-        Scalar recip = 1.0f / f;
-        for (int i=0; i<N; i++)
-            value.s[i] *= recip;
+        Ops::scale(value.s, s, 1.0f / f);
         return value;
     }
 
@@ -449,9 +583,7 @@ public:
         if (f == 0)
             SLog(EWarn, "TTSpectrum: Division by zero!");
 #endif
-        Scalar recip = 1.0f / f;
-        for (int i=0; i<N; i++)
-            s[i] *= recip;
+        Ops::scale(s, s, 1.0f / f);
         return *this;
     }
 
@@ -473,8 +605,7 @@ public:
 
     /// Multiply-accumulate operation, adds \a weight * \a spec
     inline void addWeighted(Scalar weight, const TSpectrum &spec) {
-        for (int i=0; i<N; i++)
-            s[i] += weight * spec.s[i];
+        Ops::addWeighted(s, weight, spec.s);
     }
 
     /// Return the average over all wavelengths
@@ -496,8 +627,7 @@ public:
     /// Component-wise square root
     inline TSpectrum sqrt() const {
         TSpectrum value;
-        for (int i=0; i<N; i++)
-            value.s[i] = std::sqrt(s[i]);
+        Ops::sqrt(value.s, s);
         return value;
     }
 
@@ -520,8 +650,7 @@ public:
     /// Component-wise exponentation
     inline TSpectrum exp() const {
         TSpectrum value;
-        for (int i=0; i<N; i++)
-            value.s[i] = math::fastexp(s[i]);
+        Ops::exp(value.s, s);
         return value;
     }
 
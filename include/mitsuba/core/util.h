@@ -104,6 +104,16 @@ extern MTS_EXPORT_CORE void * __restrict allocAligned(size_t size);
 /// Free an aligned region of memory
 extern MTS_EXPORT_CORE void freeAligned(void *ptr);
 
+/**
+ * \brief Return the number of heap allocations made by the calling thread
+ *
+ * The allocations are only counted when Mitsuba was compiled with the
+ * \c MTS_DEBUG_ALLOCATIONS flag, in which case calls to \ref allocAligned()
+ * and (except on Windows) <tt>operator new</tt> are included. Otherwise,
+ * this function always returns zero.
+ */
+extern MTS_EXPORT_CORE uint64_t getAllocationCount();
+
 #if defined(WIN32)
 /// Return a string version of GetLastError()
 extern std::string MTS_EXPORT_CORE lastErrorText();
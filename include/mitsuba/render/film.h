@@ -22,6 +22,7 @@
 
 #include <mitsuba/render/sampler.h>
 #include <mitsuba/render/imageblock.h>
+#include <mitsuba/render/filmsink.h>
 
 MTS_NAMESPACE_BEGIN
 
@@ -60,9 +61,29 @@ public:
     /// Set the target filename (with or without extension)
     virtual void setDestinationFile(const fs::path &filename, uint32_t blockSize) = 0;
 
-    /// Develop the film and write the result to the previously specified filename
+    /**
+     * \brief Develop the film and write the result to the previously specified
+     * filename, or hand it to the registered sink (see \ref setSink())
+     */
     virtual void develop(const Scene *scene, Float renderTime) = 0;
 
+    /**
+     * \brief Register a sink that receives the developed image instead
+     * of the destination file
+     *
+     * Films that stream blocks to disk query the sink when the destination
+     * file is set (see \ref FilmSink::createTileWriter()), hence the sink
+     * should be registered before rendering starts. Passing \c NULL
+     * restores the default behavior.
+     */
+    inline void setSink(FilmSink *sink) { m_sink = sink; }
+
+    /// Return the registered sink (or \c NULL)
+    inline FilmSink *getSink() { return m_sink.get(); }
+
+    /// Return the registered sink (or \c NULL, const version)
+    inline const FilmSink *getSink() const { return m_sink.get(); }
+
     /**
      * \brief Develop the contents of a subregion of the film and store
      * it inside the given bitmap
@@ -91,6 +112,14 @@ public:
     /// Return whether or not this film records the alpha channel
     virtual bool hasAlpha() const = 0;
 
+    /**
+     * \brief Should the rendering process accumulate per-pixel sample
+     * statistics (see \ref ImageBlock::setStatistics())?
+     *
+     * The default implementation returns \c false.
+     */
+    virtual bool hasStatistics() const;
+
     /// Return the image reconstruction filter
     inline ReconstructionFilter *getReconstructionFilter() { return m_filter.get(); }
 
@@ -131,6 +160,7 @@ protected:
     Vector2i m_size, m_cropSize;
     bool m_highQualityEdges;
     ref<ReconstructionFilter> m_filter;
+    ref<FilmSink> m_sink;
 };
 
 MTS_NAMESPACE_END
@@ -0,0 +1,134 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#if !defined(__MITSUBA_RENDER_FILMSINK_H_)
+#define __MITSUBA_RENDER_FILMSINK_H_
+
+#include <mitsuba/render/tilestream.h>
+#include <mitsuba/core/mstream.h>
+#include <mitsuba/core/lock.h>
+
+MTS_NAMESPACE_BEGIN
+
+/**
+ * \brief Receives the developed output of a film in memory
+ *
+ * Films normally write their result to the destination file in
+ * \ref Film::develop(). When a sink is registered using \ref Film::setSink(),
+ * the developed bitmap is instead handed to the sink, and no file is
+ * written. This avoids a filesystem round trip when the image is consumed
+ * by the same process (e.g. through the buffer protocol of the Python
+ * bindings) or forwarded elsewhere (e.g. through shared memory or a pipe).
+ *
+ * \ingroup librender
+ */
+class MTS_EXPORT_RENDER FilmSink : public Object {
+public:
+    /**
+     * \brief Receive the developed image of a film
+     *
+     * This function is called from the thread that develops the film. When
+     * a sink is shared by several films, it must therefore be thread-safe.
+     *
+     * \param film
+     *    The film that produced the image
+     * \param bitmap
+     *    The image in the film's output pixel and component format,
+     *    including channel names and metadata. The film does not modify
+     *    it afterwards, hence the sink may keep a reference.
+     */
+    virtual void put(const Film *film, Bitmap *bitmap) = 0;
+
+    /**
+     * \brief Create a destination for films that stream their image
+     * blocks instead of storing the full image (e.g. \c tiledhdrfilm)
+     *
+     * The default implementation assembles the tiles into a bitmap and
+     * passes it to \ref put() when the writer is closed. Sinks that can
+     * consume tiles directly may override this function.
+     *
+     * \param film
+     *    The film that produces the tiles
+     * \param size
+     *    Size of the crop window
+     * \param tile
+     *    Prototype bitmap specifying the pixel format, component format
+     *    and channel names of the tiles
+     */
+    virtual ref<TileWriter> createTileWriter(const Film *film,
+        const Vector2i &size, const Bitmap *tile);
+
+    MTS_DECLARE_CLASS()
+protected:
+    /// Virtual destructor
+    virtual ~FilmSink() { }
+};
+
+/**
+ * \brief Film sink that encodes images into a stream
+ *
+ * Each image is preceded by its encoded size in bytes (a 64-bit unsigned
+ * integer in the byte order of the stream), which allows the receiver to
+ * separate consecutive images. Together with \ref SocketStream, a
+ * \ref FileStream that refers to a named pipe, or a \ref MemoryStream that
+ * wraps a shared memory region, this transfers the output of many
+ * renderings without creating intermediate files.
+ *
+ * \ingroup librender
+ */
+class MTS_EXPORT_RENDER StreamFilmSink : public FilmSink {
+public:
+    /**
+     * \brief Create a new stream sink
+     *
+     * \param stream
+     *    Destination stream
+     * \param format
+     *    File format used to encode the images. The default
+     *    (\ref Bitmap::EAuto) selects PNG for 8 and 16 bit integer
+     *    images and OpenEXR otherwise.
+     */
+    StreamFilmSink(Stream *stream, Bitmap::EFileFormat format = Bitmap::EAuto);
+
+    void put(const Film *film, Bitmap *bitmap);
+
+    /// Return the destination stream
+    inline Stream *getStream() { return m_stream; }
+
+    /// Return the number of images that have been written so far
+    inline size_t getImageCount() const { return m_imageCount; }
+
+    /// Return a string representation
+    std::string toString() const;
+
+    MTS_DECLARE_CLASS()
+protected:
+    /// Virtual destructor
+    virtual ~StreamFilmSink() { }
+private:
+    ref<Stream> m_stream;
+    ref<MemoryStream> m_buffer;
+    ref<Mutex> m_mutex;
+    Bitmap::EFileFormat m_format;
+    size_t m_imageCount;
+};
+
+MTS_NAMESPACE_END
+
+#endif /* __MITSUBA_RENDER_FILMSINK_H_ */
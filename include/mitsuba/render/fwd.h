@@ -31,6 +31,7 @@ struct DirectionSamplingRecord;
 struct DirectSamplingRecord;
 class Emitter;
 class Film;
+class FilmSink;
 class GatherPhotonProcess;
 class HemisphereSampler;
 class HWResource;
@@ -70,11 +71,14 @@ class SamplingIntegrator;
 class Sampler;
 class Sensor;
 class Scene;
+class SceneDescription;
 class SceneHandler;
+class SceneTemplate;
 class Shader;
 class Shape;
 class SparseMipmap3D;
 class Spiral;
+class StreamFilmSink;
 class Subsurface;
 class Texture;
 struct TriAccel;
@@ -23,6 +23,9 @@
 #include <mitsuba/core/bitmap.h>
 #include <mitsuba/core/sched.h>
 #include <mitsuba/core/rfilter.h>
+#if defined(MTS_SSE)
+#include <mitsuba/core/sse.h>
+#endif
 
 MTS_NAMESPACE_BEGIN
 
@@ -35,6 +38,10 @@ MTS_NAMESPACE_BEGIN
  * border region storing contribuctions that are slightly outside of the block,
  * which is required to support image reconstruction filters.
  *
+ * When the reconstruction filter only covers a single pixel (i.e. the default
+ * box filter), blocks have no border, and samples are directly accumulated
+ * into the pixel that contains them.
+ *
  * \ingroup librender
  */
 class MTS_EXPORT_RENDER ImageBlock : public WorkResult {
@@ -96,14 +103,110 @@ public:
     /// Return a pointer to the underlying bitmap representation (const version)
     inline const Bitmap *getBitmap() const { return m_bitmap.get(); }
 
+    /**
+     * \brief Enable or disable the accumulation of per-pixel sample statistics
+     *
+     * When enabled, the block maintains a second bitmap with the same
+     * dimensions, which stores three channels per pixel: the filter-weighted
+     * sum of the squared sample luminance, the sum of the squared filter
+     * weights, and the number of samples that were taken inside the pixel.
+     * Together with the weighted sum of the sample values, this is enough
+     * to estimate the variance of every pixel from a single rendering
+     * (see \ref getVariance()).
+     *
+     * The luminance is computed from the leading spectrum, RGB, XYZ or
+     * luminance channels of the pixel format, or from the first channel
+     * of \ref Bitmap::EMultiChannel blocks.
+     */
+    void setStatistics(bool enabled);
+
+    /// Does this block accumulate per-pixel sample statistics?
+    inline bool hasStatistics() const { return m_statistics.get() != NULL; }
+
+    /// Return the sample statistics (or \c NULL, see \ref setStatistics())
+    inline Bitmap *getStatistics() { return m_statistics; }
+
+    /// Return the sample statistics (const version)
+    inline const Bitmap *getStatistics() const { return m_statistics.get(); }
+
+    /// Compute the luminance of a sample or pixel value in the block's pixel format
+    inline Float getLuminance(const Float *value) const {
+        Float result = 0;
+        for (int i=0; i<m_lumChannels; ++i)
+            result += m_lumWeights[i] * value[i];
+        return result;
+    }
+
+    /**
+     * \brief Estimate the variance of the luminance of the given pixel
+     *
+     * This is the variance of the pixel's final (normalized) value rather
+     * than that of an individual sample. It requires sample statistics
+     * and a pixel format with a reconstruction filter weight channel.
+     *
+     * \param pos
+     *    Pixel position in the coordinates of the underlying bitmap
+     *    (i.e. including the border region)
+     */
+    Float getVariance(const Point2i &pos) const;
+
+    /**
+     * \brief Develop the block into an 8-bit low dynamic range image
+     *
+     * This performs the work of a \ref Bitmap::convert() call in a single
+     * fused pass: normalization by the reconstruction filter weight,
+     * conversion to luminance or linear RGB, an exposure multiplier, gamma
+     * correction, and quantization. Rows are processed in parallel, and
+     * the border region is skipped.
+     *
+     * \param target
+     *    Destination bitmap with the same size as the block, the
+     *    \ref Bitmap::EUInt8 component format, and a luminance(-alpha) or
+     *    RGB(A) pixel format. Its gamma value is set to \c gamma.
+     * \param multiplier
+     *    Exposure multiplier applied to the normalized values
+     * \param gamma
+     *    Gamma value of the output, where -1 denotes sRGB
+     * \param dither
+     *    Add an ordered dither pattern of up to half a quantization step
+     *    before rounding to break up banding in smooth gradients
+     *
+     * \remark Requires the \ref Bitmap::ESpectrumAlphaWeight pixel format
+     */
+    void developLDR(Bitmap *target, Float multiplier, Float gamma, bool dither) const;
+
+    /**
+     * \brief Develop the block into an 8-bit low dynamic range image
+     * using Reinhard et al.'s photographic tonemapper
+     *
+     * Equivalent to converting the block to floating point, applying
+     * \ref Bitmap::tonemapReinhard(), and converting the result to 8 bit.
+     * Since the tonemapper preserves chromaticities, it reduces to a
+     * per-pixel scale factor that is folded into \ref developLDR()'s pass.
+     * When the luminance statistics are not provided, they are computed
+     * by an additional parallel reduction pass.
+     *
+     * See \ref developLDR() and \ref Bitmap::tonemapReinhard() for a
+     * description of the parameters.
+     */
+    void developLDRReinhard(Bitmap *target, Float &logAvgLuminance,
+            Float &maxLuminance, Float key, Float burn, Float gamma,
+            bool dither) const;
+
     /// Clear everything to zero
-    inline void clear() { m_bitmap->clear(); }
+    inline void clear() {
+        m_bitmap->clear();
+        if (m_statistics)
+            m_statistics->clear();
+    }
 
     /// Accumulate another image block into this one
     inline void put(const ImageBlock *block) {
-        m_bitmap->accumulate(block->getBitmap(),
-            Point2i(block->getOffset() - m_offset
-                - Vector2i(block->getBorderSize() - m_borderSize)));
+        Point2i targetOffset(block->getOffset() - m_offset
+                - Vector2i(block->getBorderSize() - m_borderSize));
+        m_bitmap->accumulate(block->getBitmap(), targetOffset);
+        if (hasStatistics() && block->hasStatistics())
+            m_statistics->accumulate(block->getStatistics(), targetOffset);
     }
 
     /**
@@ -144,13 +247,38 @@ public:
     FINLINE bool put(const Point2 &_pos, const Float *value) {
         const int channels = m_bitmap->getChannelCount();
 
-        /* Check if all sample values are valid */
-        for (int i=0; i<channels; ++i) {
-            if (EXPECT_NOT_TAKEN((!std::isfinite(value[i]) || value[i] < 0) && m_warn))
+        /* Check if all sample values are valid. The comparisons are
+           false for NaNs, and the loop is free of branches */
+        if (m_warn) {
+            bool valid = true;
+            for (int i=0; i<channels; ++i)
+                valid &= value[i] >= 0 && value[i] <= std::numeric_limits<Float>::max();
+            if (EXPECT_NOT_TAKEN(!valid))
                 goto bad_sample;
         }
 
-        {
+        if (m_singlePixel) {
+            /* Fast path: accumulate into the pixel containing the sample */
+            const int x = math::floorToInt(_pos.x) - m_offset.x,
+                      y = math::floorToInt(_pos.y) - m_offset.y;
+            const Vector2i &size = m_bitmap->getSize();
+
+            if (EXPECT_TAKEN(x >= 0 && y >= 0 && x < size.x && y < size.y)) {
+                const Float weight = m_filter->evalDiscretized(0);
+                const size_t index = y * (size_t) size.x + x;
+                Float *dest = m_bitmap->getFloatData() + index * channels;
+                for (int k=0; k<channels; ++k)
+                    dest[k] += weight * value[k];
+
+                if (EXPECT_NOT_TAKEN(m_statistics.get() != NULL)) {
+                    const Float lum = getLuminance(value);
+                    Float *stats = m_statistics->getFloatData() + index * 3;
+                    stats[0] += weight * lum * lum;
+                    stats[1] += weight * weight;
+                    stats[2] += 1;
+                }
+            }
+        } else {
             const Float filterRadius = m_filter->getRadius();
             const Vector2i &size = m_bitmap->getSize();
 
@@ -165,25 +293,34 @@ public:
                           max(std::min((int) std::floor(pos.x + filterRadius), size.x - 1),
                               std::min((int) std::floor(pos.y + filterRadius), size.y - 1));
 
-            /* Lookup values from the pre-rasterized filter */
-            for (int x=min.x, idx = 0; x<=max.x; ++x)
-                m_weightsX[idx++] = m_filter->evalDiscretized(x-pos.x);
-            for (int y=min.y, idx = 0; y<=max.y; ++y)
-                m_weightsY[idx++] = m_filter->evalDiscretized(y-pos.y);
-
-            /* Rasterize the filtered sample into the framebuffer */
-            for (int y=min.y, yr=0; y<=max.y; ++y, ++yr) {
-                const Float weightY = m_weightsY[yr];
-                Float *dest = m_bitmap->getFloatData()
-                    + (y * (size_t) size.x + min.x) * channels;
-
-                for (int x=min.x, xr=0; x<=max.x; ++x, ++xr) {
-                    const Float weight = m_weightsX[xr] * weightY;
-
-                    for (int k=0; k<channels; ++k)
-                        *dest++ += weight * value[k];
-                }
+            if (m_filter->isBox()) {
+                /* Constant filter: no table lookups are needed */
+                const Float weight = m_filter->evalDiscretized(0);
+                for (int x=min.x, idx = 0; x<=max.x; ++x)
+                    m_weightsX[idx++] = weight;
+                for (int y=min.y, idx = 0; y<=max.y; ++y)
+                    m_weightsY[idx++] = weight;
+            } else {
+                /* Lookup values from the pre-rasterized filter */
+                for (int x=min.x, idx = 0; x<=max.x; ++x)
+                    m_weightsX[idx++] = m_filter->evalDiscretized(x-pos.x);
+                for (int y=min.y, idx = 0; y<=max.y; ++y)
+                    m_weightsY[idx++] = m_filter->evalDiscretized(y-pos.y);
             }
+
+            /* Rasterize the filtered sample into the framebuffer using
+               a kernel that is specialized for common channel counts */
+            if (channels == SPECTRUM_SAMPLES + 2)
+                splat<SPECTRUM_SAMPLES + 2>(min, max, value, channels);
+            else if (channels == 5)
+                splat<5>(min, max, value, channels);
+            else if (channels == 7)
+                splat<7>(min, max, value, channels);
+            else
+                splat<0>(min, max, value, channels);
+
+            if (EXPECT_NOT_TAKEN(m_statistics.get() != NULL))
+                splatStatistics(_pos, min, max, value);
         }
 
         return true;
@@ -207,6 +344,7 @@ public:
     ref<ImageBlock> clone() const {
         ref<ImageBlock> clone = new ImageBlock(m_bitmap->getPixelFormat(),
             m_bitmap->getSize() - Vector2i(2*m_borderSize, 2*m_borderSize), m_filter, m_bitmap->getChannelCount());
+        clone->setStatistics(hasStatistics());
         copyTo(clone);
         return clone;
     }
@@ -214,6 +352,9 @@ public:
     /// Copy the contents of this image block to another one with the same configuration
     void copyTo(ImageBlock *copy) const {
         memcpy(copy->getBitmap()->getUInt8Data(), m_bitmap->getUInt8Data(), m_bitmap->getBufferSize());
+        if (hasStatistics() && copy->hasStatistics())
+            memcpy(copy->getStatistics()->getUInt8Data(), m_statistics->getUInt8Data(),
+                m_statistics->getBufferSize());
         copy->m_size = m_size;
         copy->m_offset = m_offset;
         copy->m_warn = m_warn;
@@ -234,6 +375,42 @@ public:
 protected:
     /// Virtual destructor
     virtual ~ImageBlock();
+
+    /**
+     * \brief Accumulate a weighted sample into the pixels <tt>[min, max]</tt>
+     * using the weights in \c m_weightsX and \c m_weightsY
+     *
+     * When \c Channels is nonzero, it must match \c channels; the loop over
+     * the channels then has a fixed trip count and is fully unrolled.
+     */
+    template <int Channels> FINLINE void splat(const Point2i &min, const Point2i &max,
+            const Float *value, int channels) {
+        const int n = Channels > 0 ? Channels : channels;
+        const size_t stride = (size_t) m_bitmap->getWidth() * n;
+        Float *row = m_bitmap->getFloatData() + (min.y * (size_t) m_bitmap->getWidth() + min.x) * n;
+
+        for (int y=min.y, yr=0; y<=max.y; ++y, ++yr, row += stride) {
+            const Float weightY = m_weightsY[yr];
+            Float *dest = row;
+
+            for (int x=min.x, xr=0; x<=max.x; ++x, ++xr, dest += n) {
+                const Float weight = m_weightsX[xr] * weightY;
+                int k = 0;
+#if defined(MTS_SSE) && defined(SINGLE_PRECISION)
+                const __m128 w = _mm_set1_ps(weight);
+                for (; k+4 <= n; k += 4)
+                    _mm_storeu_ps(dest + k, _mm_add_ps(_mm_loadu_ps(dest + k),
+                        _mm_mul_ps(w, _mm_loadu_ps(value + k))));
+#endif
+                for (; k<n; ++k)
+                    dest[k] += weight * value[k];
+            }
+        }
+    }
+
+    /// Accumulate the statistics of a sample into the pixels <tt>[min, max]</tt>
+    void splatStatistics(const Point2 &pos, const Point2i &min,
+            const Point2i &max, const Float *value);
 protected:
     ref<Bitmap> m_bitmap;
     Point2i m_offset;
@@ -241,7 +418,10 @@ protected:
     int m_borderSize;
     const ReconstructionFilter *m_filter;
     Float *m_weightsX, *m_weightsY;
-    bool m_warn;
+    bool m_warn, m_singlePixel;
+    ref<Bitmap> m_statistics;
+    Float m_lumWeights[SPECTRUM_SAMPLES];
+    int m_lumChannels;
 };
 
 
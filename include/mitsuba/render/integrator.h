@@ -369,6 +369,18 @@ public:
      */
     void cancel();
 
+    /**
+     * \brief Does this integrator render progressively?
+     *
+     * This is the case when a time limit, an error target, or more than
+     * one sample pass was specified. The image is then rendered in
+     * successive passes over all pixels, each of which takes the
+     * sampler's sample count (see \ref BlockedRenderProcess::setProgressive()).
+     */
+    inline bool isProgressive() const {
+        return m_timeLimit > 0 || m_errorTarget > 0 || m_passes != 1;
+    }
+
     /**
      * This method does the main work of <tt>render()</tt> and
      * runs in parallel for a series of image blocks, which are
@@ -430,9 +442,31 @@ protected:
 
     /// Virtual destructor
     virtual ~SamplingIntegrator() { }
+
+    /**
+     * \brief Execute a rendering process and wait for it to finish
+     *
+     * In progressive mode, this also writes intermediate results and
+     * stops the process once the time limit or error target has been
+     * reached. All resources must already have been bound.
+     *
+     * \return \c true if the rendering finished or stopped at its budget,
+     * and \c false if it was canceled
+     */
+    bool runProcess(Scene *scene, const RenderJob *job, Film *film,
+        BlockedRenderProcess *proc);
 protected:
     /// Used to temporarily cache a parallel process while it is in operation
     ref<ParallelProcess> m_process;
+
+    /// Wall-clock budget of a progressive rendering in seconds (0 = none)
+    Float m_timeLimit;
+    /// Target relative RMS error of a progressive rendering (0 = none)
+    Float m_errorTarget;
+    /// Interval between intermediate results in seconds (0 = none)
+    Float m_outputInterval;
+    /// Maximum number of sample passes (0 = unlimited)
+    size_t m_passes;
 };
 
 /*
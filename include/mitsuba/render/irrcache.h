@@ -194,6 +194,12 @@ public:
     /**
      * Add a sample to the irradiance cache
      *
+     * The new record is placed into a staging area that belongs to the
+     * calling thread. It is immediately visible to lookups performed by
+     * the same thread, while other threads will only see it after the
+     * next call to \ref mergeStaged(). This permits concurrent insertion
+     * without any locking on the shared part of the cache.
+     *
      * \param ray
      *      Ray differentials (if they exist)
      * \param its
@@ -212,9 +218,31 @@ public:
      */
     bool get(const Intersection &its, Spectrum &E) const;
 
-    /// Manually insert an irradiance record
+    /// Manually insert an irradiance record into the shared cache
     void insert(Record *rec);
 
+    /**
+     * \brief Move the records staged by all threads into the shared cache
+     *
+     * Neighbor clamping between the staged and the shared records is
+     * performed at this point. Must not be called while other threads
+     * are accessing the cache. Returns the number of merged records.
+     */
+    size_t mergeStaged();
+
+    /**
+     * \brief Discard all records that were staged by \ref put()
+     *
+     * Must not be called while other threads are accessing the cache.
+     */
+    void discardStaged();
+
+    /// Return the number of records in the shared cache
+    inline size_t getRecordCount() const { return m_records.size(); }
+
+    /// Return the bounding box of the cache
+    inline const AABB &getAABB() const { return m_octree.getAABB(); }
+
     /**
      * Serialize an irradiance cache to a binary data stream
      */
@@ -322,8 +350,27 @@ public:
 
     MTS_DECLARE_CLASS()
 protected:
+    /// Records that were created by one thread since the last merge
+    struct StagingArea : public Object {
+        DynamicOctree<Record *> octree;
+        std::vector<Record *> records;
+        uint32_t generation;
+
+        inline StagingArea(const AABB &aabb, uint32_t generation)
+            : octree(aabb), generation(generation) { }
+    };
+
     /// Release all memory
     virtual ~IrradianceCache();
+
+    /// Return the staging area of the calling thread (if there is one)
+    const StagingArea *getStagingArea() const;
+
+    /// Return the staging area of the calling thread and create it if necessary
+    StagingArea *getOrCreateStagingArea();
+
+    /// Insert a record into an octree, using its current radius
+    void insert(DynamicOctree<Record *> &octree, Record *record) const;
 protected:
     /* ===================================================================== */
     /*                        Protected attributes                           */
@@ -336,6 +383,9 @@ protected:
     Float m_minDist, m_maxDist;
     bool m_clampScreen, m_clampNeighbor, m_useGradients;
     ref<Mutex> m_mutex;
+    mutable ThreadLocal<StagingArea> m_staging;
+    std::vector<ref<StagingArea> > m_stagingAreas;
+    uint32_t m_generation;
 };
 
 MTS_NAMESPACE_END
@@ -193,17 +193,23 @@ public:
 
         stats::mipStorage += cacheSize;
 
-        /* Potentially create a MIP map cache file */
+        /* Potentially create a MIP map cache file. It is written under a
+           temporary name and renamed once complete, so that concurrent
+           loaders of the same texture never map a partially written file */
         uint8_t *mmapData = NULL, *mmapPtr = NULL;
+        fs::path tempFile;
         if (!cacheFilename.empty()) {
             Log(EInfo, "Generating MIP map cache file \"%s\" ..", cacheFilename.string().c_str());
             try {
-                m_mmap = new MemoryMappedFile(cacheFilename, cacheSize);
+                tempFile = cacheFilename.parent_path() /
+                    fs::unique_path("%%%%-%%%%-%%%%.mip-tmp");
+                m_mmap = new MemoryMappedFile(tempFile, cacheSize);
             } catch (std::runtime_error &e) {
                 Log(EWarn, "Unable to create MIP map cache file \"%s\" -- "
                     "retrying with a temporary file. Error message was: %s",
                     cacheFilename.string().c_str(), e.what());
                 m_mmap = MemoryMappedFile::createTemporary(cacheSize);
+                tempFile = fs::path();
             }
             mmapData = mmapPtr = (uint8_t *) m_mmap->getData();
         }
@@ -290,6 +296,28 @@ public:
             memcpy(mmapData, &header, sizeof(MIPMapHeader));
         }
 
+        if (!tempFile.empty()) {
+            /* Publish the cache file under its final name. The mapping is
+               closed first, since Windows can't rename mapped files */
+            m_mmap = NULL;
+            boost::system::error_code ec;
+            fs::rename(tempFile, cacheFilename, ec);
+            if (ec) {
+                Log(EWarn, "Unable to create MIP map cache file \"%s\": %s",
+                    cacheFilename.string().c_str(), ec.message().c_str());
+                m_mmap = new MemoryMappedFile(tempFile);
+                fs::remove(tempFile, ec); /* Keeps the mapping on POSIX systems */
+            } else {
+                m_mmap = new MemoryMappedFile(cacheFilename);
+            }
+
+            mmapPtr = (uint8_t *) m_mmap->getData() + sizeof(MIPMapHeader) + padding;
+            for (int i=0; i<m_levels; ++i) {
+                m_pyramid[i].map(mmapPtr, m_pyramid[i].getSize());
+                mmapPtr += m_pyramid[i].getBufferSize();
+            }
+        }
+
         Log(EDebug, "Created %s of MIP maps in %i ms", memString(
             getBufferSize()).c_str(), timer->getMilliseconds());
 
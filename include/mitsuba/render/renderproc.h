@@ -62,6 +62,42 @@ public:
     void setPixelFormat(Bitmap::EPixelFormat pixelFormat,
         int channelCount = -1, bool warnInvalid = false);
 
+    /**
+     * \brief Render the image progressively
+     *
+     * In this mode, the process sweeps over the image in a sequence of
+     * passes, each of which renders every block with the sampler's full
+     * sample count (see \ref Sampler::setSamplePass()). The film
+     * accumulates the samples of all passes, hence it provides a
+     * complete image at any point in time.
+     *
+     * \param maxPasses
+     *    Number of passes, after which the process finishes. When
+     *    set to zero, the process runs until it is canceled.
+     */
+    void setProgressive(size_t maxPasses);
+
+    /// Is the process rendering progressively?
+    inline bool isProgressive() const { return m_progressive; }
+
+    /**
+     * \brief Return the number of completed passes
+     *
+     * This is the number of finished blocks divided by the number of
+     * blocks per pass, hence it is generally fractional.
+     */
+    inline Float getCompletedPasses() const {
+        return m_numBlocksTotal > 0 ? (Float) m_resultCount / (Float) m_numBlocksTotal : 0;
+    }
+
+    /**
+     * \brief Return the mutex that protects the film
+     *
+     * It must be held while accessing the film during rendering,
+     * e.g. to write intermediate results.
+     */
+    inline Mutex *getResultMutex() { return m_resultMutex; }
+
     // ======================================================================
     //! @{ \name Implementation of the ParallelProcess interface
     // ======================================================================
@@ -78,6 +114,9 @@ public:
 protected:
     /// Virtual destructor
     virtual ~BlockedRenderProcess();
+
+    /// (Re-)create the progress reporter for the current configuration
+    void resetProgress();
 protected:
     ref<RenderQueue> m_queue;
     ref<Scene> m_scene;
@@ -90,6 +129,9 @@ protected:
     Bitmap::EPixelFormat m_pixelFormat;
     int m_channelCount;
     bool m_warnInvalid;
+    bool m_statistics;
+    bool m_progressive;
+    size_t m_maxPasses, m_pass;
 };
 
 MTS_NAMESPACE_END
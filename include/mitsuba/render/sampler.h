@@ -110,11 +110,26 @@ public:
     /// Manually set the current sample index
     virtual void setSampleIndex(size_t sampleIndex);
 
-    /// Retrieve the next component value from the current sample
-    virtual Float next1D() = 0;
-
-    /// Retrieve the next two component values from the current sample
-    virtual Point2 next2D() = 0;
+    /**
+     * \brief Retrieve the next component value from the current sample
+     *
+     * This function is not virtual: values that the sampler has already
+     * computed for the current sample (see \ref m_cache1D) are returned
+     * directly, and only the remaining ones are obtained from the
+     * implementation via \ref fetch1D().
+     */
+    inline Float next1D() {
+        if (EXPECT_TAKEN(m_cache1D != m_cacheEnd1D))
+            return *m_cache1D++;
+        return fetch1D();
+    }
+
+    /// Retrieve the next two component values from the current sample (see \ref next1D())
+    inline Point2 next2D() {
+        if (EXPECT_TAKEN(m_cache2D != m_cacheEnd2D))
+            return *m_cache2D++;
+        return fetch2D();
+    }
 
     /**
      * \brief Retrieve the next 2D array of values from the current sample.
@@ -152,12 +167,34 @@ public:
     /// Same as \ref request2DArray(), but in 1D
     virtual void request1DArray(size_t size);
 
+    /// Return the number of requested 2D arrays (see \ref request2DArray())
+    inline size_t get2DArrayCount() const { return m_req2D.size(); }
+
+    /// Return the number of requested 1D arrays (see \ref request1DArray())
+    inline size_t get1DArrayCount() const { return m_req1D.size(); }
+
     /// Return total number of samples
     inline size_t getSampleCount() const { return m_sampleCount; }
 
     /// Return the current sample index
     inline size_t getSampleIndex() const { return m_sampleIndex; }
 
+    /**
+     * \brief Set the sample pass that the following calls to
+     * \ref generate() refer to
+     *
+     * Progressive rendering visits every pixel once per pass and
+     * draws \ref getSampleCount() samples each time. Deterministic
+     * samplers use the pass index to continue their sequence with
+     * the next set of points instead of repeating the previous ones,
+     * while randomized samplers can simply ignore it. The default
+     * pass is zero.
+     */
+    inline void setSamplePass(size_t pass) { m_samplePass = pass; }
+
+    /// Return the current sample pass (see \ref setSamplePass())
+    inline size_t getSamplePass() const { return m_samplePass; }
+
     /// Serialize this sampler to a binary data stream
     virtual void serialize(Stream *stream, InstanceManager *manager) const;
 
@@ -171,9 +208,32 @@ protected:
 
     /// Virtual destructor
     virtual ~Sampler();
+
+    /**
+     * \brief Compute the next component value of the current sample
+     *
+     * Called by \ref next1D() when the cache of precomputed
+     * values is exhausted (or when the sampler does not use it).
+     */
+    virtual Float fetch1D() = 0;
+
+    /// Compute the next two component values of the current sample (see \ref fetch1D())
+    virtual Point2 fetch2D() = 0;
 protected:
+    /**
+     * \brief Precomputed component values of the current sample
+     *
+     * Implementations that know upcoming component values in advance can
+     * point these ranges to them so that \ref next1D() and \ref next2D()
+     * avoid a virtual function call. They must be updated whenever the
+     * current sample changes. Both ranges are empty by default.
+     */
+    const Float *m_cache1D, *m_cacheEnd1D;
+    const Point2 *m_cache2D, *m_cacheEnd2D;
+
     size_t m_sampleCount;
     size_t m_sampleIndex;
+    size_t m_samplePass;
     std::vector<size_t> m_req1D, m_req2D;
     std::vector<Float *> m_sampleArrays1D;
     std::vector<Point2 *> m_sampleArrays2D;
@@ -0,0 +1,175 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+#if !defined(__MITSUBA_RENDER_SCENEDESC_H_)
+#define __MITSUBA_RENDER_SCENEDESC_H_
+
+#include <mitsuba/core/properties.h>
+
+MTS_NAMESPACE_BEGIN
+
+/**
+ * \brief Compact binary description of a scene's plugin graph
+ *
+ * A scene description stores every object that \ref SceneHandler creates
+ * while parsing an XML file: its class, its fully resolved \ref Properties
+ * (with parameters substituted, spectra discretized and transformations
+ * composed), and the names and indices of its children. Objects that are
+ * referenced several times are stored only once.
+ *
+ * Loading a binary description skips the XML parser and the schema
+ * validation, and goes straight to instantiating the plugins. This makes
+ * it useful for large, automatically generated scenes that are rendered
+ * many times. Use \ref SceneHandler::loadSceneDescription() or the
+ * \c scene2bin utility to convert an XML scene.
+ *
+ * The nodes are stored in creation order, hence children always precede
+ * their parents, and the last node is the scene itself.
+ *
+ * \remark The binary format is tied to the floating point precision and
+ *         spectral discretization of the build that wrote it.
+ * \ingroup librender
+ */
+class MTS_EXPORT_RENDER SceneDescription : public Object {
+public:
+    /// A single object of the plugin graph
+    struct Node {
+        /// Class of the object (e.g. \c Shape or \c BSDF)
+        const Class *cls;
+        /// Parameters that are passed to the plugin
+        Properties props;
+        /// Named children, specified as indices of earlier nodes
+        std::vector<std::pair<std::string, uint32_t> > children;
+        /// Should \ref ConfigurableObject::configure() be called?
+        bool configure;
+        /// Name of the XML element that defined the object (not serialized)
+        std::string element;
+        /// XML file that defined the object, if known (not serialized)
+        std::string sourceFile;
+        /// Line of the element within \c sourceFile (not serialized)
+        int sourceLine;
+    };
+
+    /// Create an empty scene description
+    SceneDescription();
+
+    /// Unserialize a scene description from a binary data stream
+    SceneDescription(Stream *stream);
+
+    /// Serialize the scene description to a binary data stream
+    void serialize(Stream *stream) const;
+
+    /// Write the scene description to a file
+    void write(const fs::path &filename) const;
+
+    /**
+     * \brief Append a node to the plugin graph
+     *
+     * \param cls
+     *    Class of the object
+     * \param props
+     *    Parameters that are passed to the plugin
+     * \param configure
+     *    Should \ref ConfigurableObject::configure() be called
+     *    once the children have been added?
+     * \return The index of the new node
+     */
+    uint32_t appendNode(const Class *cls, const Properties &props,
+        bool configure = true);
+
+    /// Register a child of the node with index \c parent
+    void addChild(uint32_t parent, const std::string &name, uint32_t child);
+
+    /**
+     * \brief Record where the node with index \c index was defined
+     *
+     * The location is only used to point error messages and warnings
+     * to the XML source, and it is not part of the serialized data.
+     */
+    void setSource(uint32_t index, const std::string &element,
+        const std::string &file, int line);
+
+    /**
+     * \brief Replace relative \c filename properties by absolute paths
+     *
+     * Plugins look up their files relative to the directory of the XML
+     * scene, which is no longer known once the description is stored
+     * elsewhere. Files that the resolver cannot find are left unchanged.
+     */
+    void resolveFilenames(const FileResolver *resolver);
+
+    /// Return the number of nodes
+    inline size_t getNodeCount() const { return m_nodes.size(); }
+
+    /// Return a node of the plugin graph
+    inline const Node &getNode(size_t index) const { return m_nodes[index]; }
+
+    /**
+     * \brief Instantiate all plugins and return the resulting scene
+     *
+     * Objects that don't depend on each other (e.g. shapes loading their
+     * geometry, or textures building MIP maps) are created and configured
+     * in parallel on the OpenMP worker threads.
+     */
+    ref<Scene> instantiate() const;
+
+    /**
+     * \brief Instantiate all plugins, reusing the objects that were
+     * created for a previous, similar scene description
+     *
+     * An object is reused when the node with the same index in
+     * \c previous has the same class and properties, and when all of
+     * its children were reused as well. The scene itself, sensors,
+     * samplers, integrators and subsurface integrators are always
+     * recreated. Reused objects are shared by both scenes, which should
+     * therefore not be rendered at the same time.
+     *
+     * \param previous
+     *    Previously instantiated scene description
+     * \param objects
+     *    On input, the objects created for the nodes of \c previous.
+     *    On output, the objects created for the nodes of this description.
+     */
+    ref<Scene> instantiate(const SceneDescription *previous,
+        ref_vector<ConfigurableObject> &objects) const;
+
+    /// Load a binary scene description and instantiate it
+    static ref<Scene> loadScene(const fs::path &filename);
+
+    /// Check whether the given file contains a binary scene description
+    static bool isSceneDescription(const fs::path &filename);
+
+    /// Return a string representation
+    std::string toString() const;
+
+    MTS_DECLARE_CLASS()
+protected:
+    /// Virtual destructor
+    virtual ~SceneDescription() { }
+    /// Create and configure a single node whose children already exist
+    ref<ConfigurableObject> instantiateNode(size_t index,
+        ref_vector<ConfigurableObject> &objects, Mutex *mutex) const;
+private:
+    std::vector<Node> m_nodes;
+};
+
+MTS_NAMESPACE_END
+
+#endif /* __MITSUBA_RENDER_SCENEDESC_H_ */
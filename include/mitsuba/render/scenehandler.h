@@ -25,6 +25,7 @@
 #include <mitsuba/core/plugin.h>
 #include <mitsuba/core/properties.h>
 #include <mitsuba/core/version.h>
+#include <mitsuba/render/scenedesc.h>
 #include <boost/unordered_map.hpp>
 #include <stack>
 #include <map>
@@ -71,10 +72,18 @@ private:
 /// Push a cleanup handler to be executed after loading the scene is done
 extern MTS_EXPORT_RENDER void pushSceneCleanupHandler(void (*cleanup)());
 
+/// Run (and then remove) the cleanup handlers registered while loading a scene
+extern MTS_EXPORT_RENDER void runSceneCleanupHandlers();
+
 /**
  * \brief XML parser for Mitsuba scene files. To be used with the
  * SAX interface of Xerces-C++.
  *
+ * While parsing, the handler only records the plugin graph of the scene
+ * in a \ref SceneDescription. Once the document has been read, the graph
+ * is instantiated, and independent objects (e.g. shapes loading their
+ * geometry) are created and configured in parallel.
+ *
  * \remark In the Python bindings, only the static function
  *         \ref loadScene() is exposed.
  * \ingroup librender
@@ -82,10 +91,13 @@ extern MTS_EXPORT_RENDER void pushSceneCleanupHandler(void (*cleanup)());
  */
 class MTS_EXPORT_RENDER SceneHandler : public xercesc::HandlerBase {
 public:
-    typedef std::map<std::string, ConfigurableObject *> NamedObjectMap;
+    /// Maps object IDs to node indices of the scene description (-1 for \c null)
+    typedef std::map<std::string, int64_t> NamedNodeMap;
     typedef std::map<std::string, std::string, SimpleStringOrdering> ParameterMap;
+    /// List of (name, value) pairs of an element's attributes
+    typedef std::vector<std::pair<std::string, std::string> > AttributeVector;
 
-    SceneHandler(const ParameterMap &params, NamedObjectMap *objects = NULL,
+    SceneHandler(const ParameterMap &params, NamedNodeMap *nodes = NULL,
             bool isIncludedFile = false);
     virtual ~SceneHandler();
 
@@ -97,6 +109,17 @@ public:
     static ref<Scene> loadSceneFromString(const std::string &string,
         const ParameterMap &params= ParameterMap());
 
+    /**
+     * \brief Convenience method -- parse a scene from a given filename
+     * and return a binary description of its plugin graph
+     *
+     * No plugins are instantiated. The resulting description can be
+     * written to disk and later loaded without parsing any XML (see
+     * \ref SceneDescription).
+     */
+    static ref<SceneDescription> loadSceneDescription(const fs::path &filename,
+        const ParameterMap &params= ParameterMap());
+
     /// Initialize Xerces-C++ (needs to be called once at program startup)
     static void staticInitialization();
 
@@ -113,12 +136,27 @@ public:
         xercesc::AttributeList& attributes
     );
     virtual void endElement(const XMLCh* const name);
+
+    /**
+     * \brief Process the start of an element, whose name and attributes
+     * have already been transcoded (e.g. when replaying a \ref SceneTemplate)
+     *
+     * Parameter references in the attribute values are substituted here.
+     */
+    void startElement(const std::string &name, const AttributeVector &attributes);
+
+    /// Process the end of an element (see \ref startElement())
+    void endElement(const std::string &name);
     virtual void characters(const XMLCh* const chars, const XMLSize_t length);
     virtual void setDocumentLocator(const xercesc::Locator* const locator);
 
     inline const Scene *getScene() const { return m_scene.get(); }
     inline Scene *getScene() { return m_scene; }
 
+    /// Return the plugin graph recorded while parsing the last document
+    inline const SceneDescription *getDescription() const { return m_description.get(); }
+    inline SceneDescription *getDescription() { return m_description; }
+
     // -----------------------------------------------------------------------
     //  Implementation of the SAX ErrorHandler interface
     // -----------------------------------------------------------------------
@@ -133,7 +171,20 @@ protected:
 
     void clear();
 
+    uint32_t recordNode(const std::string &element, const Class *cls,
+        const Properties &props,
+        const std::vector<std::pair<std::string, uint32_t> > &children,
+        bool configure = true);
+
+    /// Return the file containing the element being processed (for messages)
+    std::string getSourceFile() const;
+
+    /// Return the line of the element being processed (for messages)
+    int getSourceLine() const;
+
 private:
+    friend class SceneTemplate;
+
     /**
      * Enumeration of all possible tags that can be encountered in a
      * Mitsuba scene file
@@ -159,7 +210,7 @@ private:
         ETag tag;
         Properties properties;
         std::map<std::string, std::string> attributes;
-        std::vector<std::pair<std::string, ConfigurableObject *> > children;
+        std::vector<std::pair<std::string, uint32_t> > children;
     };
 
 
@@ -170,13 +221,18 @@ private:
     xercesc::XMLTranscoder* m_transcoder;
     ref<Scene> m_scene;
     ParameterMap m_params;
-    NamedObjectMap *m_namedObjects;
-    PluginManager *m_pluginManager;
+    NamedNodeMap *m_namedNodes;
     std::stack<ParseContext> m_context;
     TagMap m_tags;
     Transform m_transform;
     ref<AnimatedTransform> m_animatedTransform;
+    ref<SceneDescription> m_description;
+    const SceneTemplate *m_template;
+    uint32_t m_sceneNode;
+    std::string m_sourceFile;
+    int m_sourceLine;
     bool m_isIncludedFile;
+    bool m_instantiate;
 };
 
 MTS_NAMESPACE_END
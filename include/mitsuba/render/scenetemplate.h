@@ -0,0 +1,127 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+#if !defined(__MITSUBA_RENDER_SCENETEMPLATE_H_)
+#define __MITSUBA_RENDER_SCENETEMPLATE_H_
+
+#include <mitsuba/render/scenedesc.h>
+#include <mitsuba/core/lock.h>
+#include <boost/filesystem.hpp>
+#include <map>
+
+MTS_NAMESPACE_BEGIN
+
+/**
+ * \brief Pre-parsed scene file that can be instantiated many times
+ * with different parameter values
+ *
+ * Loading a scene with \ref SceneHandler::loadScene() parses and validates
+ * the XML file again for every set of parameters. A scene template instead
+ * parses the file (and any included files) once and stores its elements
+ * with the parameter references left in place. Every call to
+ * \ref instantiate() substitutes the parameters and builds the scene
+ * from the stored elements.
+ *
+ * In addition, objects that don't depend on any of the changed parameters
+ * (e.g. emitters, materials, or meshes) are carried over from the
+ * previous instantiation instead of being created and configured again.
+ * Only the parameterized parts of the scene, the sensors and their
+ * samplers, and the (subsurface) integrators, whose precomputations
+ * depend on the entire scene, are rebuilt. As a consequence, scenes created from the same
+ * template share the remaining objects and should be rendered one
+ * after another.
+ *
+ * \ingroup librender
+ * \ingroup libpython
+ */
+class MTS_EXPORT_RENDER SceneTemplate : public Object {
+public:
+    typedef std::map<std::string, std::string, SimpleStringOrdering> ParameterMap;
+    typedef std::vector<std::pair<std::string, std::string> > AttributeVector;
+
+    /// Start or end of an element of a scene file
+    struct Event {
+        /// Element name
+        std::string name;
+        /// Attributes with unsubstituted parameter references
+        AttributeVector attributes;
+        /// Is this the start of the element?
+        bool start;
+        /// Line number within the file (used in messages)
+        int line;
+    };
+
+    /// Sequence of all elements of a scene file
+    typedef std::vector<Event> Document;
+
+    /// Parse and validate the given scene file
+    SceneTemplate(const fs::path &filename);
+
+    /// Instantiate the scene using the given parameter values
+    ref<Scene> instantiate(const ParameterMap &params = ParameterMap());
+
+    /**
+     * \brief Return the plugin graph for the given parameter values
+     * without instantiating it
+     */
+    ref<SceneDescription> getDescription(const ParameterMap &params = ParameterMap()) const;
+
+    /**
+     * \brief Return the number of objects that were carried over
+     * from the previous call to \ref instantiate()
+     */
+    inline size_t getReusedObjectCount() const { return m_reusedObjectCount; }
+
+    /// Release all objects that are kept for reuse by \ref instantiate()
+    void clearCache();
+
+    /// Return the filename of the scene
+    inline const fs::path &getFilename() const { return m_filename; }
+
+    /**
+     * \brief Feed the stored elements of a scene file to a handler
+     *
+     * Included files are parsed the first time they are requested.
+     * (Used internally by \ref SceneHandler)
+     */
+    void replay(const fs::path &filename, SceneHandler *handler) const;
+
+    /// Return a string representation
+    std::string toString() const;
+
+    MTS_DECLARE_CLASS()
+protected:
+    /// Virtual destructor
+    virtual ~SceneTemplate() { }
+
+    /// Return the stored elements of a scene file (parsing it if necessary)
+    const Document &getDocument(const fs::path &filename) const;
+private:
+    fs::path m_filename;
+    mutable std::map<fs::path, Document> m_documents;
+    mutable ref<Mutex> m_mutex;
+    ref<SceneDescription> m_lastDescription;
+    ref_vector<ConfigurableObject> m_lastObjects;
+    size_t m_reusedObjectCount;
+};
+
+MTS_NAMESPACE_END
+
+#endif /* __MITSUBA_RENDER_SCENETEMPLATE_H_ */
@@ -0,0 +1,204 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#if !defined(__MITSUBA_RENDER_TILESTREAM_H_)
+#define __MITSUBA_RENDER_TILESTREAM_H_
+
+#include <mitsuba/render/imageblock.h>
+#include <map>
+
+MTS_NAMESPACE_BEGIN
+
+/**
+ * \brief Destination of the tiles produced by a \ref TileStream
+ *
+ * \ingroup librender
+ */
+class MTS_EXPORT_RENDER TileWriter : public Object {
+public:
+    /**
+     * \brief Write a developed tile to the destination file
+     *
+     * \param offset
+     *    Position of the tile's upper left corner relative
+     *    to the crop window
+     * \param size
+     *    Number of valid pixels in the tile (the bitmap may be
+     *    larger when the tile touches the right or bottom edge)
+     * \param tile
+     *    Tile contents in the pixel and component format that
+     *    was specified when creating the writer
+     */
+    virtual void writeTile(const Point2i &offset, const Vector2i &size,
+        const Bitmap *tile) = 0;
+
+    /// Flush all data and close the destination file
+    virtual void close() = 0;
+
+    /**
+     * \brief Create a writer that produces a tiled OpenEXR file
+     *
+     * \param filename
+     *    Destination file
+     * \param size
+     *    Full size of the film (used for the display window)
+     * \param cropOffset
+     *    Offset of the crop window (used for the data window)
+     * \param cropSize
+     *    Size of the crop window
+     * \param blockSize
+     *    Edge length of the tiles, which must match the block
+     *    size used by the rendering process
+     * \param tile
+     *    Prototype bitmap specifying the pixel format, component
+     *    format and channel names of the output
+     */
+    static ref<TileWriter> createOpenEXR(const fs::path &filename,
+        const Vector2i &size, const Point2i &cropOffset,
+        const Vector2i &cropSize, int blockSize, const Bitmap *tile);
+
+    /**
+     * \brief Create a writer that produces a NumPy (\c .npy) file
+     *
+     * The file is preallocated and memory-mapped; tiles are
+     * copied directly into their final location, and the
+     * operating system is responsible for paging the data out.
+     * The resulting array has the shape (height, width, channels),
+     * or (height, width) for single-channel images.
+     *
+     * \param filename
+     *    Destination file
+     * \param size
+     *    Size of the stored image (usually the crop window)
+     * \param tile
+     *    Prototype bitmap specifying the channel count and component
+     *    format (\c float16, \c float32, \c float64, or \c uint32)
+     */
+    static ref<TileWriter> createNumPy(const fs::path &filename,
+        const Vector2i &size, const Bitmap *tile);
+
+    MTS_DECLARE_CLASS()
+protected:
+    /// Virtual destructor
+    virtual ~TileWriter() { }
+};
+
+/**
+ * \brief Streams image blocks to disk as soon as their final value is known
+ *
+ * Films normally accumulate the entire image in memory, which becomes
+ * impractical for gigapixel renderings or renderings with many
+ * auxiliary channels. This class instead tracks the blocks submitted by a
+ * blocked rendering process. Blocks overlap their neighbors by the
+ * reconstruction filter's border region; once all neighbors of a block
+ * have arrived, the overlapping regions are merged, the block is converted
+ * into the output format and handed to a \ref TileWriter, and its memory
+ * is recycled. The peak memory usage is thus proportional to the size
+ * of the "wavefront" of blocks that are currently being rendered rather
+ * than to the image size.
+ *
+ * General multi-channel layouts (e.g. those produced by the
+ * \c multichannel integrator) are supported by providing more than one
+ * pixel format.
+ *
+ * \ingroup librender
+ */
+class MTS_EXPORT_RENDER TileStream : public Object {
+public:
+    /**
+     * \brief Create a new tile stream
+     *
+     * \param writer
+     *    Destination of the developed tiles
+     * \param size
+     *    Size of the crop window
+     * \param blockSize
+     *    Block size used by the rendering process. All submitted
+     *    blocks must be aligned to multiples of this value.
+     * \param tile
+     *    Prototype bitmap specifying the output format (see
+     *    \ref createTile())
+     * \param pixelFormats
+     *    Pixel format of each sub-image. When more than one
+     *    format is given, the image blocks are expected to have the
+     *    \ref Bitmap::EMultiSpectrumAlphaWeight layout
+     */
+    TileStream(TileWriter *writer, const Vector2i &size, int blockSize,
+        const Bitmap *tile, const std::vector<Bitmap::EPixelFormat> &pixelFormats);
+
+    /**
+     * \brief Create a prototype tile bitmap for the given output format
+     *
+     * This is a convenience function for films, which typically
+     * store their output configuration in exactly this form.
+     */
+    static ref<Bitmap> createTile(int blockSize,
+        const std::vector<Bitmap::EPixelFormat> &pixelFormats,
+        Bitmap::EComponentFormat componentFormat,
+        const std::vector<std::string> &channelNames);
+
+    /**
+     * \brief Submit a finished image block
+     *
+     * The block is copied, hence the caller may reuse it afterwards.
+     * Not thread-safe: films already serialize calls to \ref Film::put().
+     */
+    void put(const ImageBlock *block);
+
+    /**
+     * \brief Write all remaining tiles and close the destination
+     *
+     * Blocks whose neighbors never arrived (e.g. because the rendering
+     * was canceled) are written as they are.
+     */
+    void close();
+
+    /// Has the stream been closed?
+    inline bool isClosed() const { return m_writer.get() == NULL; }
+
+    /// Return the maximum number of blocks that were held in memory at the same time
+    inline int getPeakUsage() const { return m_peakUsage; }
+
+    /// Return a string representation
+    std::string toString() const;
+
+    MTS_DECLARE_CLASS()
+protected:
+    /// Virtual destructor
+    virtual ~TileStream();
+
+    /// Write the given block if all of its neighbors are available
+    void potentiallyWrite(int x, int y, bool force = false);
+
+    /// Acquire a copy of the given block (reusing released storage if possible)
+    ImageBlock *acquireCopy(const ImageBlock *block);
+private:
+    ref<TileWriter> m_writer;
+    ref<Bitmap> m_tile;
+    std::vector<Bitmap::EPixelFormat> m_pixelFormats;
+    std::vector<ImageBlock *> m_freeBlocks;
+    std::map<uint32_t, ImageBlock *> m_origBlocks, m_mergedBlocks;
+    Vector2i m_size;
+    int m_blockSize, m_blocksH, m_blocksV;
+    int m_peakUsage;
+};
+
+MTS_NAMESPACE_END
+
+#endif /* __MITSUBA_RENDER_TILESTREAM_H_ */
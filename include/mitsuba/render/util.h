@@ -54,6 +54,10 @@ protected:
     /// Load a scene from a string
     ref<Scene> loadSceneFromString(const std::string &content,
         const ParameterMap &params= ParameterMap());
+
+    /// Load a scene from an external file and record its plugin graph
+    ref<SceneDescription> loadSceneDescription(const fs::path &fname,
+        const ParameterMap &params= ParameterMap());
 };
 
 #define MTS_DECLARE_UTILITY() \
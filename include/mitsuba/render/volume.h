@@ -71,6 +71,25 @@ public:
      */
     virtual Float getMaximumFloatValue() const = 0;
 
+    /**
+     * \brief Compute conservative bounds on the values that could be
+     * returned by \ref lookupFloat at any position inside a
+     * world-space region.
+     *
+     * This is used to build coarse majorant grids for delta and ratio
+     * tracking, and to skip over empty space. The default implementation
+     * returns the interval <tt>[0, getMaximumFloatValue()]</tt>.
+     *
+     * \param aabb
+     *    Axis-aligned world-space region to be queried
+     * \param minValue
+     *    Used to return a lower bound on the float values in \c aabb
+     * \param maxValue
+     *    Used to return an upper bound on the float values in \c aabb
+     */
+    virtual void getFloatValueRange(const AABB &aabb,
+        Float &minValue, Float &maxValue) const;
+
     MTS_DECLARE_CLASS()
 protected:
     /// Virtual destructor
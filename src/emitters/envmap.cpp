@@ -28,6 +28,9 @@
 
 MTS_NAMESPACE_BEGIN
 
+/// Version of the file that caches the sampling hierarchy next to the MIP map
+#define ENVMAP_SAMPLING_CACHE_VERSION 0x01
+
 #if SPECTRUM_SAMPLES == 3
 # define ENVMAP_PIXELFORMAT Bitmap::ERGB
 #else
@@ -58,7 +61,9 @@ MTS_NAMESPACE_BEGIN
  *     }
  *     \parameter{cache}{\Boolean}{
  *        Preserve generated MIP map data in a cache file? This will cause a file named
- *        \emph{filename}\code{.mip} to be created.
+ *        \emph{filename}\code{.mip} to be created, along with a file named
+ *        \emph{filename}\code{.smp} that stores the data structures used for
+ *        importance sampling.
  *        \default{automatic---use caching for images larger than 1M pixels.}
  *     }
  *     \parameter{samplingWeight}{\Float}{
@@ -103,17 +108,25 @@ public:
     typedef TMIPMap<Spectrum, SpectrumHalf> MIPMap;
 
     EnvironmentMap(const Properties &props) : Emitter(props),
-            m_mipmap(NULL), m_cdfRows(NULL), m_cdfCols(NULL), m_rowWeights(NULL) {
+            m_mipmap(NULL), m_rowWeights(NULL), m_cacheKey(0), m_reuseSamplingCache(false) {
         m_type |= EOnSurface | EEnvironmentEmitter;
         uint64_t timestamp = 0;
         bool tryReuseCache = false;
         fs::path cacheFile;
         ref<Bitmap> bitmap;
 
+        if (props.hasProperty("cacheFile")) {
+            /* Plugins that generate their environment map procedurally (e.g. 'sky')
+               can provide a cache file that is keyed by a hash of their parameters */
+            cacheFile = props.getString("cacheFile");
+            timestamp = (uint64_t) props.getLong("cacheKey");
+            tryReuseCache = fs::exists(cacheFile) && props.getBoolean("cache", true);
+        }
+
         if (props.hasProperty("bitmap")) {
             /* Support initialization via raw data passed from another plugin */
             bitmap = reinterpret_cast<Bitmap *>(props.getData("bitmap").ptr);
-        } else {
+        } else if (cacheFile.empty()) {
             m_filename = Thread::getThread()->getFileResolver()->resolve(
                 props.getString("filename"));
 
@@ -146,7 +159,13 @@ public:
                 ReconstructionFilter::EClamp, filterType, m_gamma)) {
             /* Reuse an existing MIP map cache file */
             m_mipmap = new MIPMap(cacheFile, maxAnisotropy);
+            m_samplingCacheFile = fs::path(cacheFile).replace_extension(".smp");
+            m_reuseSamplingCache = true;
         } else {
+            if (bitmap == NULL && m_filename.empty())
+                Log(EError, "The environment map cache file \"%s\" is invalid, and no "
+                    "image data was provided!", cacheFile.string().c_str());
+
             if (bitmap == NULL) {
                 /* Load the input image if necessary */
                 ref<Timer> timer = new Timer();
@@ -179,7 +198,11 @@ public:
                 rfilter, ReconstructionFilter::ERepeat, ReconstructionFilter::EClamp,
                 filterType, maxAnisotropy, createCache ? cacheFile : fs::path(), timestamp,
                 std::numeric_limits<Float>::infinity(), Spectrum::EIlluminant);
+
+            if (createCache)
+                m_samplingCacheFile = fs::path(cacheFile).replace_extension(".smp");
         }
+        m_cacheKey = timestamp;
 
         if (props.hasProperty("intensityScale"))
             Log(EError, "The 'intensityScale' parameter has been deprecated and is now called scale.");
@@ -189,7 +212,7 @@ public:
     }
 
     EnvironmentMap(Stream *stream, InstanceManager *manager) : Emitter(stream, manager),
-            m_mipmap(NULL), m_cdfRows(NULL), m_cdfCols(NULL), m_rowWeights(NULL) {
+            m_mipmap(NULL), m_rowWeights(NULL), m_cacheKey(0), m_reuseSamplingCache(false) {
         m_filename = stream->readString();
         Log(EDebug, "Unserializing texture \"%s\"", m_filename.filename().string().c_str());
         m_gamma = stream->readFloat();
@@ -223,10 +246,6 @@ public:
     virtual ~EnvironmentMap() {
         if (m_mipmap)
             delete m_mipmap;
-        if (m_cdfRows)
-            delete[] m_cdfRows;
-        if (m_cdfCols)
-            delete[] m_cdfCols;
         if (m_rowWeights)
             delete[] m_rowWeights;
     }
@@ -260,54 +279,74 @@ public:
     void configure() {
         Emitter::configure();
 
-        if (!m_rowWeights) {
-            /// Build CDF tables to sample the environment map
+        if (!m_rowWeights && !(m_reuseSamplingCache && loadSamplingCache())) {
+            /// Build a sampling hierarchy over the environment map
             const MIPMap::Array2DType &array = m_mipmap->getArray();
             m_size = array.getSize();
 
-            size_t nEntries = (size_t) (m_size.x + 1) * (size_t) m_size.y,
-                totalStorage = sizeof(float) * (m_size.x + 1 + nEntries);
+            /* Pad to power-of-two dimensions and create one level per
+               halving of the larger dimension */
+            Vector2i size(
+                (int) math::roundToPowerOfTwo((uint32_t) m_size.x),
+                (int) math::roundToPowerOfTwo((uint32_t) m_size.y));
+            int nLevels = math::log2i((uint32_t) std::max(size.x, size.y)) + 1;
+            m_levels.resize(nLevels);
+
+            size_t totalStorage = sizeof(Float) * m_size.y;
+            for (int i=0; i<nLevels; ++i) {
+                m_levels[i].size = size;
+                totalStorage += sizeof(float) * (size_t) size.x * (size_t) size.y;
+                size = Vector2i(std::max(size.x / 2, 1), std::max(size.y / 2, 1));
+            }
 
             Log(EInfo, "Precomputing data structures for environment map sampling (%s)",
                 memString(totalStorage).c_str());
 
             ref<Timer> timer = new Timer();
-            m_cdfCols = new float[nEntries];
-            m_cdfRows = new float[m_size.y + 1];
             m_rowWeights = new Float[m_size.y];
 
-            size_t colPos = 0, rowPos = 0;
-            Float rowSum = 0.0f;
+            /* The finest level stores luminances weighted by sin(theta) */
+            SamplingLevel &finest = m_levels[0];
+            finest.data.resize((size_t) finest.size.x * (size_t) finest.size.y, 0.0f);
+            double rowSum = 0;
 
-            /* Build a marginal & conditional cumulative distribution
-               function over luminances weighted by sin(theta) */
-            m_cdfRows[rowPos++] = 0;
+            #if defined(MTS_OPENMP)
+                #pragma omp parallel for reduction(+:rowSum) schedule(static)
+            #endif
             for (int y=0; y<m_size.y; ++y) {
-                Float colSum = 0;
-
-                m_cdfCols[colPos++] = 0;
+                Float weight = std::sin((y + 0.5f) * M_PI / m_size.y);
+                float *row = &finest.data[(size_t) y * finest.size.x];
+                double colSum = 0;
                 for (int x=0; x<m_size.x; ++x) {
-                    Spectrum value(array(x, y));
-
-                    colSum += value.getLuminance();
-                    m_cdfCols[colPos++] = (float) colSum;
+                    Float value = Spectrum(array(x, y)).getLuminance() * weight;
+                    row[x] = (float) value;
+                    colSum += value;
                 }
-
-                float normalization = 1.0f / (float) colSum;
-                for (int x=1; x<m_size.x; ++x)
-                    m_cdfCols[colPos-x-1] *= normalization;
-                m_cdfCols[colPos-1] = 1.0f;
-
-                Float weight = std::sin((y + 0.5f) * M_PI / m_size.y);
                 m_rowWeights[y] = weight;
-                rowSum += colSum * weight;
-                m_cdfRows[rowPos++] = (float) rowSum;
+                rowSum += colSum;
             }
 
-            float normalization = 1.0f / (float) rowSum;
-            for (int y=1; y<m_size.y; ++y)
-                m_cdfRows[rowPos-y-1] *= normalization;
-            m_cdfRows[rowPos-1] = 1.0f;
+            /* Sum up 2x2 (or 2x1) blocks to build the coarser levels */
+            for (int i=1; i<nLevels; ++i) {
+                const SamplingLevel &child = m_levels[i-1];
+                SamplingLevel &level = m_levels[i];
+                level.data.resize((size_t) level.size.x * (size_t) level.size.y);
+                const int sx = child.size.x > level.size.x ? 2 : 1,
+                          sy = child.size.y > level.size.y ? 2 : 1;
+
+                #if defined(MTS_OPENMP)
+                    #pragma omp parallel for schedule(static)
+                #endif
+                for (int y=0; y<level.size.y; ++y) {
+                    for (int x=0; x<level.size.x; ++x) {
+                        double sum = 0;
+                        for (int dy=0; dy<sy; ++dy)
+                            for (int dx=0; dx<sx; ++dx)
+                                sum += child(x*sx + dx, y*sy + dy);
+                        level.data[(size_t) y * level.size.x + x] = (float) sum;
+                    }
+                }
+            }
 
             if (rowSum == 0)
                 Log(EError, "The environment map is completely black -- this is not allowed.");
@@ -315,13 +354,16 @@ public:
                 Log(EError, "The environment map contains an invalid floating"
                     " point value (nan/inf) -- giving up.");
 
-            m_normalization = 1.0f / (rowSum *
-                (2 * M_PI / m_size.x) * (M_PI / m_size.y));
+            m_normalization = (Float) (1.0 / (rowSum *
+                (2 * M_PI / m_size.x) * (M_PI / m_size.y)));
 
             /* Size of a pixel in spherical coordinates */
             m_pixelSize = Vector2(2 * M_PI / m_size.x, M_PI / m_size.y);
 
             Log(EInfo, "Done (took %i ms)", timer->getMilliseconds());
+
+            if (!m_samplingCacheFile.empty())
+                writeSamplingCache();
         }
         Float surfaceArea = 4 * M_PI * m_sceneBSphere.radius * m_sceneBSphere.radius;
         m_invSurfaceArea = 1 / surfaceArea;
@@ -566,8 +608,8 @@ public:
     /// Helper function that samples a direction from the environment map
     void internalSampleDirection(Point2 sample, Vector &d, Spectrum &value, Float &pdf) const {
         /* Sample a discrete pixel position */
-        uint32_t row = sampleReuse(m_cdfRows, m_size.y, sample.y),
-                 col = sampleReuse(m_cdfCols + row * (m_size.x+1), m_size.x, sample.x);
+        Point2i pixel = sampleHierarchy(sample);
+        uint32_t row = (uint32_t) pixel.y, col = (uint32_t) pixel.x;
 
         /* Using the remaining bits of precision to shift the sample by an offset
            drawn from a tent function. This effectively creates a sampling strategy
@@ -653,18 +695,141 @@ public:
 
     MTS_DECLARE_CLASS()
 private:
-    /// Sample from an array using the inversion method
-    inline uint32_t sampleReuse(float *cdf, uint32_t size, Float &sample) const {
-        float *entry = std::lower_bound(cdf, cdf+size+1, (float) sample);
-        uint32_t index = std::min((uint32_t) std::max((ptrdiff_t) 0, entry - cdf - 1), size-1);
-        sample = (sample - (Float) cdf[index]) / (Float) (cdf[index+1] - cdf[index]);
-        return index;
+    /// One level of the hierarchy of summed sampling weights
+    struct SamplingLevel {
+        Vector2i size;
+        std::vector<float> data;
+
+        inline float operator()(int x, int y) const {
+            return data[(size_t) y * size.x + x];
+        }
+    };
+
+    /**
+     * \brief Try to load the sampling hierarchy from the file that accompanies
+     * the MIP map cache. Returns \c false if it is missing or out of date.
+     */
+    bool loadSamplingCache() {
+        if (!fs::exists(m_samplingCacheFile))
+            return false;
+
+        ref<FileStream> fs = new FileStream(m_samplingCacheFile, FileStream::EReadOnly);
+        fs->setByteOrder(Stream::ELittleEndian);
+        char header[3];
+        fs->read(header, 3);
+        if (header[0] != 'S' || header[1] != 'M' || header[2] != 'P'
+            || fs->readUChar() != ENVMAP_SAMPLING_CACHE_VERSION
+            || fs->readULong() != m_cacheKey)
+            return false;
+
+        const Vector2i size = m_mipmap->getArray().getSize();
+        if (Vector2i(fs) != size)
+            return false;
+
+        int nLevels = fs->readInt();
+        std::vector<SamplingLevel> levels(nLevels);
+        for (int i=0; i<nLevels; ++i) {
+            levels[i].size = Vector2i(fs);
+            levels[i].data.resize((size_t) levels[i].size.x * (size_t) levels[i].size.y);
+            fs->readSingleArray(&levels[i].data[0], levels[i].data.size());
+        }
+
+        m_size = size;
+        m_normalization = fs->readFloat();
+        m_rowWeights = new Float[m_size.y];
+        fs->readFloatArray(m_rowWeights, m_size.y);
+        m_levels.swap(levels);
+        m_pixelSize = Vector2(2 * M_PI / m_size.x, M_PI / m_size.y);
+
+        Log(EDebug, "Loaded environment map sampling data from \"%s\"",
+            m_samplingCacheFile.filename().string().c_str());
+        return true;
+    }
+
+    /// Store the sampling hierarchy next to the MIP map cache file
+    void writeSamplingCache() const {
+        /* Write to a temporary file first so that concurrent
+           loads never observe a partially written cache */
+        fs::path tempFile = m_samplingCacheFile.parent_path() /
+            fs::unique_path("%%%%-%%%%-%%%%.smp-tmp");
+        {
+            ref<FileStream> fs = new FileStream(tempFile, FileStream::ETruncReadWrite);
+            fs->setByteOrder(Stream::ELittleEndian);
+            fs->write("SMP", 3);
+            fs->writeUChar(ENVMAP_SAMPLING_CACHE_VERSION);
+            fs->writeULong(m_cacheKey);
+            m_size.serialize(fs);
+            fs->writeInt((int) m_levels.size());
+            for (size_t i=0; i<m_levels.size(); ++i) {
+                m_levels[i].size.serialize(fs);
+                fs->writeSingleArray(&m_levels[i].data[0], m_levels[i].data.size());
+            }
+            fs->writeFloat(m_normalization);
+            fs->writeFloatArray(m_rowWeights, m_size.y);
+            fs->close();
+        }
+
+        boost::system::error_code ec;
+        fs::rename(tempFile, m_samplingCacheFile, ec);
+        if (ec.value()) {
+            Log(EWarn, "Could not create the sampling cache file \"%s\"",
+                m_samplingCacheFile.string().c_str());
+            fs::remove(tempFile, ec);
+        }
+    }
+
+    /// Choose between two options proportional to their weights and reuse the sample
+    inline static bool sampleReuse(Float w0, Float w1, Float &sample) {
+        Float p0 = w0 / (w0 + w1);
+        if (sample < p0) {
+            sample = std::min(sample / p0, ONE_MINUS_EPS);
+            return false;
+        } else {
+            sample = std::min((sample - p0) / (1 - p0), ONE_MINUS_EPS);
+            return true;
+        }
+    }
+
+    /**
+     * \brief Sample a pixel by descending through the hierarchy of summed
+     * weights. The sample is rescaled so that it can be reused.
+     */
+    inline Point2i sampleHierarchy(Point2 &sample) const {
+        int x = 0, y = 0;
+        for (int i=(int) m_levels.size()-2; i>=0; --i) {
+            const SamplingLevel &child = m_levels[i];
+            const SamplingLevel &parent = m_levels[i+1];
+
+            const bool splitX = child.size.x > parent.size.x,
+                       splitY = child.size.y > parent.size.y;
+            if (splitY)
+                y *= 2;
+
+            /* First choose a column, then a row within it */
+            if (splitX) {
+                x *= 2;
+                Float w0 = child(x, y), w1 = child(x+1, y);
+                if (splitY) {
+                    w0 += child(x, y+1);
+                    w1 += child(x+1, y+1);
+                }
+                if (sampleReuse(w0, w1, sample.x))
+                    ++x;
+            }
+
+            if (splitY && sampleReuse(child(x, y), child(x, y+1), sample.y))
+                ++y;
+        }
+        return Point2i(x, y);
     }
 private:
     MIPMap *m_mipmap;
-    float *m_cdfRows, *m_cdfCols;
+    std::vector<SamplingLevel> m_levels;
     Float *m_rowWeights;
     fs::path m_filename;
+    fs::path m_samplingCacheFile;
+    uint64_t m_cacheKey;
+    bool m_reuseSamplingCache;
     Float m_gamma, m_scale;
     Float m_normalization;
     Float m_power;
@@ -22,6 +22,7 @@
 #include <mitsuba/core/plugin.h>
 #include "sunsky/sunmodel.h"
 #include "sunsky/skymodel.h"
+#include "sunsky/skycache.h"
 
 MTS_NAMESPACE_BEGIN
 
@@ -67,6 +68,15 @@ MTS_NAMESPACE_BEGIN
  *         This parameter can be used to scale the amount of illumination
  *         emitted by the sky emitter. \default{1}
  *     }
+ *     \parameter{cache}{\Boolean}{
+ *         Store the precomputed environment map and its sampling data on disk,
+ *         so that later renderings with the same parameters can skip these
+ *         steps entirely. \default{\code{true}}
+ *     }
+ *     \parameter{cacheDir}{\String}{
+ *         Directory that holds the cache files
+ *         \default{\code{mitsuba-skycache} in the system's temporary directory}
+ *     }
  *     \parameter{samplingWeight}{\Float}{
  *         Specifies the relative amount of samples
  *         allocated to this emitter. \default{1}
@@ -161,7 +171,9 @@ MTS_NAMESPACE_BEGIN
  * \pluginref{envmap} plugin---this dramatically improves rendering
  * performance. This resolution is generally plenty since the sky radiance
  * distribution is so smooth, but it can be adjusted manually if
- * necessary using the \code{resolution} parameter.
+ * necessary using the \code{resolution} parameter. The resulting image and
+ * the associated sampling data structures are cached on disk and reused
+ * by later renderings that specify the same model parameters.
  *
  * Note that while the model encompasses sunrise and sunset configurations,
  * it does not extend to the night sky, where illumination from stars, galaxies,
@@ -226,6 +238,7 @@ public:
         m_albedo = props.getSpectrum("albedo", Spectrum(0.2f));
         m_sun = computeSunCoordinates(props);
         m_extend = props.getBoolean("extend", false);
+        m_cacheDir = getSkyCacheDirectory(props);
 
         if (m_turbidity < 1 || m_turbidity > 10)
             Log(EError, "The turbidity parameter must be in the range [1,10]!");
@@ -263,6 +276,7 @@ public:
         m_extend = stream->readBool();
         m_albedo = Spectrum(stream);
         m_sun = SphericalCoordinates(stream);
+        m_cacheDir = stream->readString();
 
         Float sunElevation = 0.5f * M_PI - m_sun.elevation;
         #if SPECTRUM_SAMPLES == 3
@@ -297,6 +311,7 @@ public:
         stream->writeBool(m_extend);
         m_albedo.serialize(stream);
         m_sun.serialize(stream);
+        stream->writeString(m_cacheDir.string());
     }
 
     bool isCompound() const {
@@ -307,6 +322,62 @@ public:
         if (i != 0)
             return NULL;
 
+        /* Check if this sky has been rasterized before */
+        fs::path cacheFile;
+        SkyCacheKey key("sky");
+        if (!m_cacheDir.empty()) {
+            key.append(m_turbidity);
+            key.append(m_albedo);
+            key.append(m_sun.elevation);
+            key.append(m_sun.azimuth);
+            key.append(m_stretch);
+            key.append(m_extend);
+            key.append(m_scale);
+            key.append(m_resolution);
+            cacheFile = key.getCacheFile(m_cacheDir, "sky");
+        }
+
+        if (!cacheFile.empty() && isSkyCacheValid(cacheFile, key.getValue())) {
+            Log(EDebug, "Reusing the precomputed skylight environment map \"%s\"",
+                cacheFile.filename().string().c_str());
+            try {
+                return createEnvmap(NULL, cacheFile, key.getValue());
+            } catch (const std::exception &ex) {
+                /* The nested envmap plugin checks the cache more thoroughly */
+                Log(EWarn, "Could not reuse the precomputed skylight "
+                    "environment map (%s), rasterizing it again", ex.what());
+            }
+        }
+
+        ref<Bitmap> bitmap = rasterize();
+        return createEnvmap(bitmap, cacheFile, key.getValue());
+    }
+
+    /// Instantiate a nested environment map plugin
+    Emitter *createEnvmap(Bitmap *bitmap, const fs::path &cacheFile, uint64_t key) const {
+        Properties props("envmap");
+        if (bitmap) {
+            Properties::Data bitmapData;
+            bitmapData.ptr = (uint8_t *) bitmap;
+            bitmapData.size = sizeof(Bitmap);
+            props.setData("bitmap", bitmapData);
+        }
+        if (!cacheFile.empty()) {
+            props.setString("cacheFile", cacheFile.string());
+            props.setLong("cacheKey", (int64_t) key);
+            props.setBoolean("cache", true);
+        }
+        props.setAnimatedTransform("toWorld", m_worldTransform.get());
+        props.setFloat("samplingWeight", m_samplingWeight);
+        Emitter *emitter = static_cast<Emitter *>(
+            PluginManager::getInstance()->createObject(
+            MTS_CLASS(Emitter), props));
+        emitter->configure();
+        return emitter;
+    }
+
+    /// Rasterize the sky model into a latitude-longitude environment map
+    ref<Bitmap> rasterize() const {
         ref<Timer> timer = new Timer();
         Log(EDebug, "Rasterizing skylight emitter to an %ix%i environment map ..",
                 m_resolution, m_resolution/2);
@@ -374,19 +445,7 @@ public:
         }
         #endif
 
-        /* Instantiate a nested environment map plugin */
-        Properties props("envmap");
-        Properties::Data bitmapData;
-        bitmapData.ptr = (uint8_t *) bitmap.get();
-        bitmapData.size = sizeof(Bitmap);
-        props.setData("bitmap", bitmapData);
-        props.setAnimatedTransform("toWorld", m_worldTransform);
-        props.setFloat("samplingWeight", m_samplingWeight);
-        Emitter *emitter = static_cast<Emitter *>(
-            PluginManager::getInstance()->createObject(
-            MTS_CLASS(Emitter), props));
-        emitter->configure();
-        return emitter;
+        return bitmap;
     }
 
     Spectrum evalEnvironment(const RayDifferential &ray) const {
@@ -463,6 +522,8 @@ protected:
     bool m_extend;
     /// Ground albedo
     Spectrum m_albedo;
+    /// Directory that stores precomputed environment maps (empty if disabled)
+    fs::path m_cacheDir;
 
     /// State vector for the sky model
     #if SPECTRUM_SAMPLES == 3
@@ -21,6 +21,7 @@
 #include <mitsuba/core/bitmap.h>
 #include <mitsuba/core/qmc.h>
 #include "sunsky/sunmodel.h"
+#include "sunsky/skycache.h"
 
 #if SPECTRUM_SAMPLES == 3
 # define SUNSKY_PIXELFORMAT Bitmap::ERGB
@@ -78,6 +79,11 @@ MTS_NAMESPACE_BEGIN
  *         Scale factor to adjust the radius of the sun, while preserving its power.
  *         Set to \code{0} to turn it into a directional light source.
  *     }
+ *     \parameter{cache, cacheDir}{\Boolean, \String}{
+ *         Controls the on-disk cache of precomputed environment maps;
+ *         see \pluginref{sky} for details. \default{\code{true}, system's
+ *         temporary directory}
+ *     }
  * }
  * \vspace{-3mm}
  *
@@ -120,13 +126,125 @@ public:
         props.markQueried("albedo");
 
         int resolution = props.getInteger("resolution", 512);
+        Float turbidity = props.getFloat("turbidity", 3.0f),
+              stretch = props.getFloat("stretch", 1.0f);
+
+        /* Check if the same configuration has been rasterized before */
+        fs::path cacheDir = getSkyCacheDirectory(props), cacheFile;
+        SkyCacheKey key("sunsky");
+        if (!cacheDir.empty()) {
+            SphericalCoordinates skySun = computeSunCoordinates(skyProps);
+            key.append(turbidity);
+            key.append(props.getSpectrum("albedo", Spectrum(0.2f)));
+            key.append(skySun.elevation);
+            key.append(skySun.azimuth);
+            key.append(stretch);
+            key.append(props.getBoolean("extend", false));
+            key.append(skyScale);
+            key.append(sunScale);
+            key.append(sunRadiusScale);
+            key.append(resolution);
+            cacheFile = key.getCacheFile(cacheDir, "sunsky");
+        }
+        bool reuseCache = !cacheFile.empty() && isSkyCacheValid(cacheFile, key.getValue());
+
+        /* Rasterizing the sphere to an environment map and checking the
+           individual pixels for coverage (which is what Mitsuba 0.3.0 did)
+           was slow and not very effective; for instance the power varied
+           dramatically with resolution changes. Since the sphere generally
+           just covers a few pixels, rasterize() does this much more
+           efficiently by generating a few thousand QMC samples. */
+        SphericalCoordinates sun = computeSunCoordinates(props);
+        Spectrum sunRadiance = computeSunRadiance(sun.elevation,
+            turbidity) * sunScale;
+        sun.elevation *= stretch;
+        Frame sunFrame = Frame(toSphere(sun));
+
+        Float theta = degToRad(SUN_APP_RADIUS * 0.5f);
+
+        if (sunRadiusScale == 0) {
+            Float solidAngle = 2 * M_PI * (1 - std::cos(theta));
+            Properties props("directional");
+            props.setVector("direction", -trafo(sunFrame.n));
+            props.setFloat("samplingWeight", m_samplingWeight);
+            props.setSpectrum("irradiance", sunRadiance * solidAngle);
+
+            m_dirEmitter = static_cast<Emitter *>(
+                PluginManager::getInstance()->createObject(
+                MTS_CLASS(Emitter), props));
+        }
+
+        if (reuseCache) {
+            Log(EDebug, "Reusing the precomputed sun & skylight environment map \"%s\"",
+                cacheFile.filename().string().c_str());
+            try {
+                m_envEmitter = createEnvmap(NULL, cacheFile, key.getValue());
+            } catch (const std::exception &ex) {
+                /* The nested envmap plugin checks the cache more thoroughly */
+                Log(EWarn, "Could not reuse the precomputed sun & skylight "
+                    "environment map (%s), rasterizing it again", ex.what());
+                reuseCache = false;
+            }
+        }
+
+        if (!reuseCache) {
+            ref<Bitmap> bitmap = rasterize(sky, resolution, sunRadiusScale,
+                theta, sunRadiance, sunFrame);
+            m_envEmitter = createEnvmap(bitmap, cacheFile, key.getValue());
+        }
+    }
+
+    SunSkyEmitter(Stream *stream, InstanceManager *manager)
+        : Emitter(stream, manager) {
+        m_envEmitter = static_cast<Emitter *>(manager->getInstance(stream));
+        if (stream->readBool())
+            m_dirEmitter = static_cast<Emitter *>(manager->getInstance(stream));
+    }
+
+    void serialize(Stream *stream, InstanceManager *manager) const {
+        Emitter::serialize(stream, manager);
+        manager->serialize(stream, m_envEmitter.get());
+        stream->writeBool(m_dirEmitter.get() != NULL);
+        if (m_dirEmitter.get())
+            manager->serialize(stream, m_dirEmitter.get());
+    }
+
+    void configure() {
+        Emitter::configure();
+        m_envEmitter->configure();
+        if (m_dirEmitter)
+            m_dirEmitter->configure();
+    }
+
+    bool isCompound() const {
+        return true;
+    }
+
+    AABB getAABB() const {
+        NotImplementedError("getAABB");
+    }
+
+    Emitter *getElement(size_t i) {
+        if (i == 0)
+            return m_envEmitter;
+        else if (i == 1)
+            return m_dirEmitter;
+        else
+            return NULL;
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    /// Rasterize the sky and (unless it is a separate emitter) the sun
+    ref<Bitmap> rasterize(Emitter *sky, int resolution, Float sunRadiusScale,
+            Float theta, const Spectrum &sunRadiance, const Frame &sunFrame) const {
         ref<Bitmap> bitmap = new Bitmap(SUNSKY_PIXELFORMAT, Bitmap::EFloat,
             Vector2i(resolution, resolution/2));
+        ref<Timer> timer = new Timer();
 
         Point2 factor((2*M_PI) / bitmap->getWidth(),
             M_PI / bitmap->getHeight());
 
-        ref<Timer> timer = new Timer();
         Log(EDebug, "Rasterizing sun & skylight emitter to an %ix%i environment map ..",
                 resolution, resolution/2);
 
@@ -150,36 +268,9 @@ public:
             }
         }
 
-        /* Rasterizing the sphere to an environment map and checking the
-           individual pixels for coverage (which is what Mitsuba 0.3.0 did)
-           was slow and not very effective; for instance the power varied
-           dramatically with resolution changes. Since the sphere generally
-           just covers a few pixels, the code below rasterizes it much more
-           efficiently by generating a few thousand QMC samples.
-
-           Step 1: compute a *very* rough estimate of how many
-           pixel in the output environment map will be covered
-           by the sun */
-
-        SphericalCoordinates sun = computeSunCoordinates(props);
-        Spectrum sunRadiance = computeSunRadiance(sun.elevation,
-            props.getFloat("turbidity", 3.0f)) * sunScale;
-        sun.elevation *= props.getFloat("stretch", 1.0f);
-        Frame sunFrame = Frame(toSphere(sun));
-
-        Float theta = degToRad(SUN_APP_RADIUS * 0.5f);
-
-        if (sunRadiusScale == 0) {
-            Float solidAngle = 2 * M_PI * (1 - std::cos(theta));
-            Properties props("directional");
-            props.setVector("direction", -trafo(sunFrame.n));
-            props.setFloat("samplingWeight", m_samplingWeight);
-            props.setSpectrum("irradiance", sunRadiance * solidAngle);
-
-            m_dirEmitter = static_cast<Emitter *>(
-                PluginManager::getInstance()->createObject(
-                MTS_CLASS(Emitter), props));
-        } else {
+        if (sunRadiusScale != 0) {
+            /* Compute a *very* rough estimate of how many pixel in the
+               output environment map will be covered by the sun */
             size_t pixelCount = resolution*resolution/2;
             Float cosTheta = std::cos(theta * sunRadiusScale);
 
@@ -212,70 +303,39 @@ public:
 
                 data[pos.x + pos.y * bitmap->getWidth()] += value / std::max((Float) 1e-3f, sinTheta);
             }
-
         }
 
         Log(EDebug, "Done (took %i ms)", timer->getMilliseconds());
 
-        /* Instantiate a nested envmap plugin */
-        Properties envProps("envmap");
-        Properties::Data bitmapData;
-        bitmapData.ptr = (uint8_t *) bitmap.get();
-        bitmapData.size = sizeof(Bitmap);
-        envProps.setData("bitmap", bitmapData);
-        envProps.setAnimatedTransform("toWorld", m_worldTransform);
-        envProps.setFloat("samplingWeight", m_samplingWeight);
-        m_envEmitter = static_cast<Emitter *>(
-            PluginManager::getInstance()->createObject(
-            MTS_CLASS(Emitter), envProps));
-
         #if 0
             /* For debugging purposes */
             ref<FileStream> fs = new FileStream("debug.exr", FileStream::ETruncReadWrite);
             bitmap->write(Bitmap::EOpenEXR, fs);
         #endif
-    }
-
-    SunSkyEmitter(Stream *stream, InstanceManager *manager)
-        : Emitter(stream, manager) {
-        m_envEmitter = static_cast<Emitter *>(manager->getInstance(stream));
-        if (stream->readBool())
-            m_dirEmitter = static_cast<Emitter *>(manager->getInstance(stream));
-    }
 
-    void serialize(Stream *stream, InstanceManager *manager) const {
-        Emitter::serialize(stream, manager);
-        manager->serialize(stream, m_envEmitter.get());
-        stream->writeBool(m_dirEmitter.get() != NULL);
-        if (m_dirEmitter.get())
-            manager->serialize(stream, m_dirEmitter.get());
-    }
-
-    void configure() {
-        Emitter::configure();
-        m_envEmitter->configure();
-        if (m_dirEmitter)
-            m_dirEmitter->configure();
-    }
-
-    bool isCompound() const {
-        return true;
-    }
-
-    AABB getAABB() const {
-        NotImplementedError("getAABB");
+        return bitmap;
     }
 
-    Emitter *getElement(size_t i) {
-        if (i == 0)
-            return m_envEmitter;
-        else if (i == 1)
-            return m_dirEmitter;
-        else
-            return NULL;
+    /// Instantiate a nested envmap plugin
+    Emitter *createEnvmap(Bitmap *bitmap, const fs::path &cacheFile, uint64_t key) const {
+        Properties envProps("envmap");
+        if (bitmap) {
+            Properties::Data bitmapData;
+            bitmapData.ptr = (uint8_t *) bitmap;
+            bitmapData.size = sizeof(Bitmap);
+            envProps.setData("bitmap", bitmapData);
+        }
+        if (!cacheFile.empty()) {
+            envProps.setString("cacheFile", cacheFile.string());
+            envProps.setLong("cacheKey", (int64_t) key);
+            envProps.setBoolean("cache", true);
+        }
+        envProps.setAnimatedTransform("toWorld", m_worldTransform.get());
+        envProps.setFloat("samplingWeight", m_samplingWeight);
+        return static_cast<Emitter *>(
+            PluginManager::getInstance()->createObject(
+            MTS_CLASS(Emitter), envProps));
     }
-
-    MTS_DECLARE_CLASS()
 private:
     ref<Emitter> m_dirEmitter;
     ref<Emitter> m_envEmitter;
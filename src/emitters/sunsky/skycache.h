@@ -0,0 +1,110 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__SKYCACHE_H)
+#define __SKYCACHE_H
+
+#include <mitsuba/mitsuba.h>
+#include <mitsuba/core/properties.h>
+#include <mitsuba/core/fstream.h>
+#include <mitsuba/core/hash.h>
+#include <boost/filesystem/fstream.hpp>
+
+/// Increase this when the rasterization of the sky models changes
+#define SKY_CACHE_VERSION 1
+
+MTS_NAMESPACE_BEGIN
+
+/**
+ * \brief Hash of all parameters that determine a rasterized sky
+ * environment map
+ *
+ * The hash is used to name the cache files, and it is also stored inside
+ * them, where the \c envmap plugin uses it in place of a file timestamp.
+ */
+class SkyCacheKey : public FNV1aHash {
+public:
+    SkyCacheKey(const std::string &type) {
+        append(type);
+        append((int) SKY_CACHE_VERSION);
+        append((int) SPECTRUM_SAMPLES);
+        append((int) sizeof(Float));
+    }
+
+    /// Return the name of the MIP map cache file within \c directory
+    fs::path getCacheFile(const fs::path &directory, const std::string &type) const {
+        return directory / formatString("%s-%016llx.mip", type.c_str(),
+            (unsigned long long) m_hash);
+    }
+};
+
+/**
+ * \brief Determine the directory that stores precomputed sky environment maps
+ *
+ * Returns an empty path when caching was disabled using \c cache=false or
+ * when the directory could not be created.
+ */
+inline fs::path getSkyCacheDirectory(const Properties &props) {
+    if (!props.getBoolean("cache", true))
+        return fs::path();
+
+    boost::system::error_code ec;
+    fs::path directory;
+    if (props.hasProperty("cacheDir"))
+        directory = props.getString("cacheDir");
+    else
+        directory = fs::temp_directory_path(ec) / "mitsuba-skycache";
+
+    if (ec.value() || (!fs::exists(directory) && !fs::create_directories(directory, ec))) {
+        SLog(EWarn, "Could not create the sky cache directory \"%s\" -- disabling the cache.",
+            directory.string().c_str());
+        return fs::path();
+    }
+    return directory;
+}
+
+/**
+ * \brief Check whether the \c envmap plugin has completely written the cache
+ * files (MIP map and sampling data) for the given key.
+ *
+ * The sampling data file is created last, so its header is used to decide
+ * whether rasterization of the sky can be skipped.
+ */
+inline bool isSkyCacheValid(const fs::path &cacheFile, uint64_t key) {
+    fs::path samplingFile = fs::path(cacheFile).replace_extension(".smp");
+    if (!fs::exists(cacheFile) || !fs::exists(samplingFile))
+        return false;
+
+    fs::ifstream is(samplingFile, std::ios::binary);
+    char header[4];
+    uint64_t storedKey;
+    is.read(header, 4);
+    is.read((char *) &storedKey, sizeof(uint64_t));
+    if (is.fail())
+        return false;
+
+    if (Stream::getHostByteOrder() != Stream::ELittleEndian)
+        storedKey = endianness_swap(storedKey);
+
+    return header[0] == 'S' && header[1] == 'M' && header[2] == 'P'
+        && storedKey == key;
+}
+
+MTS_NAMESPACE_END
+
+#endif /* __SKYCACHE_H */
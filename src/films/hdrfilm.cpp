@@ -17,6 +17,7 @@
 */
 
 #include <mitsuba/render/film.h>
+#include <mitsuba/render/tilestream.h>
 #include <mitsuba/core/fstream.h>
 #include <mitsuba/core/bitmap.h>
 #include <mitsuba/core/statistics.h>
@@ -74,6 +75,18 @@ MTS_NAMESPACE_BEGIN
  *        reconstruction filters. In general, this is not needed though.
  *        \default{\code{false}, i.e. disabled}
  *     }
+ *     \parameter{streaming}{\Boolean}{
+ *        Write finished image blocks to a tiled OpenEXR file while
+ *        rendering instead of keeping the image in memory
+ *        (see the discussion below).
+ *        \default{\code{false}}
+ *     }
+ *     \parameter{statistics}{\Boolean}{
+ *        Accumulate per-pixel sample statistics while rendering and
+ *        write the estimated variance and the number of samples of
+ *        every pixel as additional layers (see the discussion below).
+ *        \default{\code{false}}
+ *     }
  *     \parameter{\Unnamed}{\RFilter}{Reconstruction filter that should
  *     be used by the film. \default{\code{gaussian}, a windowed Gaussian filter}}
  * }
@@ -110,6 +123,31 @@ MTS_NAMESPACE_BEGIN
  * converted to linear RGB based on the CIE 1931 XYZ color matching curves and
  * the ITU-R Rec. BT.709-3 primaries with a D65 white point.
  *
+ * When \code{streaming} is enabled, the film behaves like \pluginref{tiledhdrfilm}:
+ * image blocks are written to a tiled OpenEXR file as soon as all of their
+ * neighbors are finished, and their memory is released afterwards. This keeps
+ * the memory usage bounded for very large images and for multi-channel
+ * renderings with many auxiliary outputs. In this mode, only the OpenEXR
+ * format is supported, the banner and annotations are not written, the log
+ * is not attached, and rendering techniques that update the entire image at
+ * once (e.g. \pluginref{bdpt} with light tracing) cannot be used. The preview
+ * in \texttt{mtsgui} remains black.
+ *
+ * When \code{statistics} is enabled, the film additionally keeps track of the
+ * second moment of the sample luminance and the number of samples in every
+ * pixel. The output file then contains two extra layers: \code{variance.Y}
+ * stores the estimated variance of each pixel's luminance (i.e. that of the
+ * final pixel value rather than that of an individual sample), and
+ * \code{sampleCount.Y} stores the number of samples that were taken inside
+ * the pixel. This makes it possible to feed denoisers or to decide whether
+ * a rendering has converged without rendering the image twice. For
+ * reconstruction filters other than the box filter, neighboring pixels are
+ * correlated, and the variance refers to the filtered estimate. The statistics
+ * require the OpenEXR format; the \code{float32} component format is
+ * recommended, since \code{float16} cannot represent large sample counts
+ * exactly. Statistics are only collected by the rendering techniques that
+ * are based on Mitsuba's \emph{SamplingIntegrator} interface.
+ *
  * \begin{xml}[caption=Instantiation of a film that writes a full-HD RGBA OpenEXR file without the Mitsuba banner]
  * <film type="hdrfilm">
  *     <string name="pixelFormat" value="rgba"/>
@@ -209,6 +247,10 @@ public:
         m_banner = props.getBoolean("banner", true);
         /* Attach the log file as the EXR comment attribute? */
         m_attachLog = props.getBoolean("attachLog", true);
+        /* Stream finished blocks to disk instead of storing the image? */
+        m_streaming = props.getBoolean("streaming", false);
+        /* Write the per-pixel variance and sample count as extra layers? */
+        m_statistics = props.getBoolean("statistics", false);
 
         std::string fileFormat = boost::to_lower_copy(
             props.getString("fileFormat", "openexr"));
@@ -348,11 +390,28 @@ public:
                 props.markQueried(keys[i]);
         }
 
-        if (m_pixelFormats.size() == 1) {
-            m_storage = new ImageBlock(Bitmap::ESpectrumAlphaWeight, m_cropSize);
+        if (m_statistics) {
+            if (m_fileFormat != Bitmap::EOpenEXR)
+                Log(EError, "Sample statistics can only be written to OpenEXR files!");
+            if (m_streaming)
+                Log(EError, "Sample statistics are not supported in streaming mode!");
+        }
+
+        if (m_streaming) {
+            if (m_fileFormat != Bitmap::EOpenEXR)
+                Log(EError, "Streaming output is only supported for OpenEXR files!");
+            if (m_highQualityEdges)
+                Log(EError, "The 'highQualityEdges' parameter is incompatible with "
+                    "streaming output. Please disable it.");
         } else {
-            m_storage = new ImageBlock(Bitmap::EMultiSpectrumAlphaWeight, m_cropSize,
-                NULL, (int) (SPECTRUM_SAMPLES * m_pixelFormats.size() + 2));
+            if (m_pixelFormats.size() == 1) {
+                m_storage = new ImageBlock(Bitmap::ESpectrumAlphaWeight, m_cropSize);
+            } else {
+                m_storage = new ImageBlock(Bitmap::EMultiSpectrumAlphaWeight, m_cropSize,
+                    NULL, (int) (SPECTRUM_SAMPLES * m_pixelFormats.size() + 2));
+            }
+            if (m_statistics)
+                m_storage->setStatistics(true);
         }
     }
 
@@ -368,6 +427,8 @@ public:
         for (size_t i=0; i<m_channelNames.size(); ++i)
             m_channelNames[i] = stream->readString();
         m_componentFormat = (Bitmap::EComponentFormat) stream->readUInt();
+        m_streaming = stream->readBool();
+        m_statistics = stream->readBool();
     }
 
     void serialize(Stream *stream, InstanceManager *manager) const {
@@ -382,17 +443,28 @@ public:
         for (size_t i=0; i<m_channelNames.size(); ++i)
             stream->writeString(m_channelNames[i]);
         stream->writeUInt(m_componentFormat);
+        stream->writeBool(m_streaming);
+        stream->writeBool(m_statistics);
     }
 
     void clear() {
-        m_storage->clear();
+        if (m_storage)
+            m_storage->clear();
     }
 
     void put(const ImageBlock *block) {
-        m_storage->put(block);
+        if (m_streaming) {
+            Assert(m_stream != NULL);
+            m_stream->put(block);
+        } else {
+            m_storage->put(block);
+        }
     }
 
     void setBitmap(const Bitmap *bitmap, Float multiplier) {
+        if (m_streaming)
+            Log(EError, "setBitmap(): Global image updates are not supported "
+                "in streaming mode! Please set 'streaming' to false.");
         bitmap->convert(m_storage->getBitmap(), multiplier);
     }
 
@@ -401,6 +473,10 @@ public:
            is supported. This function basically just exists to support the
            somewhat peculiar film updates done by BDPT */
 
+        if (m_streaming)
+            Log(EError, "addBitmap(): Global image updates are not supported "
+                "in streaming mode! Please set 'streaming' to false.");
+
         Vector2i size = bitmap->getSize();
         if (bitmap->getPixelFormat() != Bitmap::ESpectrum ||
             bitmap->getComponentFormat() != Bitmap::EFloat ||
@@ -426,6 +502,11 @@ public:
 
     bool develop(const Point2i &sourceOffset, const Vector2i &size,
             const Point2i &targetOffset, Bitmap *target) const {
+        if (m_streaming) {
+            target->fillRect(targetOffset, size, Spectrum(0.0f));
+            return false; /* The image is not kept in memory */
+        }
+
         const Bitmap *source = m_storage->getBitmap();
         const FormatConverter *cvt = FormatConverter::getInstance(
             std::make_pair(Bitmap::EFloat, target->getComponentFormat())
@@ -476,10 +557,40 @@ public:
 
     void setDestinationFile(const fs::path &destFile, uint32_t blockSize) {
         m_destFile = destFile;
+
+        if (m_streaming) {
+            if (m_stream)
+                m_stream->close();
+
+            ref<Bitmap> tile = TileStream::createTile((int) blockSize,
+                m_pixelFormats, m_componentFormat, m_channelNames);
+            ref<TileWriter> writer;
+            if (m_sink) {
+                writer = m_sink->createTileWriter(this, m_cropSize, tile);
+            } else {
+                fs::path filename = destFile;
+                if (boost::to_lower_copy(filename.extension().string()) != ".exr")
+                    filename.replace_extension(".exr");
+
+                Log(EInfo, "Streaming image blocks to \"%s\" ..", filename.string().c_str());
+                writer = TileWriter::createOpenEXR(filename, m_size, m_cropOffset,
+                    m_cropSize, (int) blockSize, tile);
+            }
+            m_stream = new TileStream(writer, m_cropSize, (int) blockSize,
+                tile, m_pixelFormats);
+        }
     }
 
     void develop(const Scene *scene, Float renderTime) {
-        if (m_destFile.empty())
+        if (m_streaming) {
+            if (m_stream) {
+                m_stream->close();
+                m_stream = NULL;
+            }
+            return;
+        }
+
+        if (m_destFile.empty() && !m_sink)
             return;
 
         Log(EDebug, "Developing film ..");
@@ -505,6 +616,26 @@ public:
             }
         }
 
+        if (m_pixelFormats.size() == 1)
+            annotate(scene, m_properties, bitmap, renderTime, 1.0f);
+
+        if (m_statistics)
+            bitmap = appendStatistics(bitmap);
+
+        /* Attach the log file to the image if this is requested */
+        Logger *logger = Thread::getThread()->getLogger();
+        std::string log;
+        if (m_attachLog && logger->readLog(log)) {
+            log += "\n\n";
+            log += Statistics::getInstance()->getStats();
+            bitmap->setMetadataString("log", log);
+        }
+
+        if (m_sink) {
+            m_sink->put(this, bitmap);
+            return;
+        }
+
         fs::path filename = m_destFile;
         std::string properExtension;
         if (m_fileFormat == Bitmap::EOpenEXR)
@@ -521,19 +652,35 @@ public:
         Log(EInfo, "Writing image to \"%s\" ..", filename.string().c_str());
         ref<FileStream> stream = new FileStream(filename, FileStream::ETruncWrite);
 
-        if (m_pixelFormats.size() == 1)
-            annotate(scene, m_properties, bitmap, renderTime, 1.0f);
+        bitmap->write(m_fileFormat, stream);
+    }
 
-        /* Attach the log file to the image if this is requested */
-        Logger *logger = Thread::getThread()->getLogger();
-        std::string log;
-        if (m_attachLog && logger->readLog(log)) {
-            log += "\n\n";
-            log += Statistics::getInstance()->getStats();
-            bitmap->setMetadataString("log", log);
+    /// Append the per-pixel variance and sample count to a developed image
+    ref<Bitmap> appendStatistics(Bitmap *bitmap) const {
+        ref<Bitmap> stats = new Bitmap(Bitmap::EMultiChannel, Bitmap::EFloat, m_cropSize, 2);
+        const Float *source = m_storage->getStatistics()->getFloatData();
+        Float *target = stats->getFloatData();
+        for (int y=0; y<m_cropSize.y; ++y) {
+            for (int x=0; x<m_cropSize.x; ++x) {
+                *target++ = m_storage->getVariance(Point2i(x, y));
+                *target++ = source[2];
+                source += 3;
+            }
         }
 
-        bitmap->write(m_fileFormat, stream);
+        std::vector<std::string> channelNames;
+        channelNames.push_back("variance.Y");
+        channelNames.push_back("sampleCount.Y");
+        stats->setChannelNames(channelNames);
+
+        std::vector<Bitmap *> layers;
+        layers.push_back(bitmap);
+        layers.push_back(stats->convert(Bitmap::EMultiChannel, m_componentFormat));
+        return Bitmap::join(Bitmap::EMultiChannel, layers);
+    }
+
+    bool hasStatistics() const {
+        return m_statistics;
     }
 
     bool hasAlpha() const {
@@ -579,6 +726,8 @@ public:
             << "  cropOffset = " << m_cropOffset.toString() << "," << endl
             << "  cropSize = " << m_cropSize.toString() << "," << endl
             << "  banner = " << m_banner << "," << endl
+            << "  streaming = " << m_streaming << "," << endl
+            << "  statistics = " << m_statistics << "," << endl
             << "  filter = " << indent(m_filter->toString()) << endl
             << "]";
         return oss.str();
@@ -592,8 +741,11 @@ protected:
     Bitmap::EComponentFormat m_componentFormat;
     bool m_banner;
     bool m_attachLog;
+    bool m_streaming;
+    bool m_statistics;
     fs::path m_destFile;
     ref<ImageBlock> m_storage;
+    ref<TileStream> m_stream;
 };
 
 MTS_IMPLEMENT_CLASS_S(HDRFilm, false, Film)
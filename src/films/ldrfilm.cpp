@@ -58,6 +58,10 @@ MTS_NAMESPACE_BEGIN
  *       The gamma curve applied to correct the output image,
  *       where the special value -1 indicates sRGB. \default{-1}
  *     }
+ *     \parameter{dither}{\Boolean}{
+ *       Apply ordered dithering before quantizing to 8 bit, which
+ *       breaks up banding in smooth gradients. \default{\code{false}}
+ *     }
  *     \parameter{exposure}{\Float}{
  *       When \code{gamma} tonemapping is active, this parameter specifies
  *       an exposure factor in f-stops that is applied to the image before
@@ -181,6 +185,7 @@ public:
         m_exposure = props.getFloat("exposure", 0.0f);
         m_reinhardKey = props.getFloat("key", 0.18f);
         m_reinhardBurn = props.getFloat("burn", 0.0);
+        m_dither = props.getBoolean("dither", false);
 
         std::vector<std::string> keys = props.getPropertyNames();
         for (size_t i=0; i<keys.size(); ++i) {
@@ -205,6 +210,7 @@ public:
         m_exposure = stream->readFloat();
         m_reinhardKey = stream->readFloat();
         m_reinhardBurn = stream->readFloat();
+        m_dither = stream->readBool();
     }
 
     void serialize(Stream *stream, InstanceManager *manager) const {
@@ -217,6 +223,7 @@ public:
         stream->writeFloat(m_exposure);
         stream->writeFloat(m_reinhardKey);
         stream->writeFloat(m_reinhardBurn);
+        stream->writeBool(m_dither);
     }
 
     void clear() {
@@ -298,28 +305,25 @@ public:
     }
 
     void develop(const Scene *scene, Float renderTime) {
-        if (m_destFile.empty())
+        if (m_destFile.empty() && !m_sink)
             return;
 
         Log(EDebug, "Developing film ..");
 
-        ref<Bitmap> bitmap = m_storage->getBitmap();
-        Float multiplier = 1.0f;
+        /* Normalize, tonemap, gamma-correct and quantize in a single pass */
+        ref<Bitmap> bitmap = new Bitmap(m_pixelFormat, Bitmap::EUInt8, m_cropSize);
 
         if (m_tonemapMethod == EReinhard) {
-            bitmap = bitmap->convert(m_pixelFormat, Bitmap::EFloat);
-
             Float logAvgLuminance = 0, maxLuminance = 0; /* Unused */
-            bitmap->tonemapReinhard(logAvgLuminance, maxLuminance,
-                m_reinhardKey, m_reinhardBurn);
+            m_storage->developLDRReinhard(bitmap, logAvgLuminance, maxLuminance,
+                m_reinhardKey, m_reinhardBurn, m_gamma, m_dither);
             Log(EInfo, "Tonemapping finished (log-avg luminance=%f, max luminance=%f)",
                 logAvgLuminance, maxLuminance);
         } else {
-            multiplier = std::pow((Float) 2, (Float) m_exposure);
+            m_storage->developLDR(bitmap, std::pow((Float) 2, (Float) m_exposure),
+                m_gamma, m_dither);
         }
 
-        bitmap = bitmap->convert(m_pixelFormat, Bitmap::EUInt8, m_gamma, multiplier);
-
         if (m_hasBanner && m_cropSize.x > bannerWidth+5 && m_cropSize.y > bannerHeight + 5) {
             int xoffs = m_cropSize.x - bannerWidth - 5,
                 yoffs = m_cropSize.y - bannerHeight - 5;
@@ -332,6 +336,13 @@ public:
             }
         }
 
+        annotate(scene, m_properties, bitmap, renderTime, m_gamma);
+
+        if (m_sink) {
+            m_sink->put(this, bitmap);
+            return;
+        }
+
         fs::path filename = m_destFile;
         std::string extension = boost::to_lower_copy(filename.extension().string());
         std::string expectedExtension;
@@ -346,9 +357,6 @@ public:
 
         Log(EInfo, "Writing image to \"%s\" ..", filename.string().c_str());
         ref<FileStream> stream = new FileStream(filename, FileStream::ETruncWrite);
-
-        annotate(scene, m_properties, bitmap, renderTime, m_gamma);
-
         bitmap->write(m_fileFormat, stream);
     }
 
@@ -387,6 +395,7 @@ public:
             << "  exposure = " << m_exposure << "," << endl
             << "  reinhardKey = " << m_reinhardKey << "," << endl
             << "  reinhardBurn = " << m_reinhardBurn << "," << endl
+            << "  dither = " << m_dither << "," << endl
             << "  filter = " << indent(m_filter->toString()) << endl
             << "]";
         return oss.str();
@@ -396,7 +405,7 @@ public:
 protected:
     Bitmap::EFileFormat m_fileFormat;
     Bitmap::EPixelFormat m_pixelFormat;
-    bool m_hasBanner;
+    bool m_hasBanner, m_dither;
     fs::path m_destFile;
     Float m_gamma;
     ref<ImageBlock> m_storage;
@@ -17,6 +17,7 @@
 */
 
 #include <mitsuba/render/film.h>
+#include <mitsuba/render/tilestream.h>
 #include <mitsuba/core/bitmap.h>
 #include <mitsuba/core/plugin.h>
 #include <boost/algorithm/string.hpp>
@@ -64,6 +65,12 @@ MTS_NAMESPACE_BEGIN
  *        default box filter), this is not needed though.
  *        \default{\code{false}, i.e. disabled}
  *     }
+ *     \parameter{streaming}{\Boolean}{
+ *        Write finished image blocks directly into a memory-mapped
+ *        NumPy file instead of keeping the image in memory. Only
+ *        supported when \code{fileFormat=numpy}.
+ *        \default{\code{false}}
+ *     }
  *     \parameter{\Unnamed}{\RFilter}{Reconstruction filter that should
  *     be used by the film. \default{\code{box}, a simple box filter}}
  * }
@@ -77,6 +84,13 @@ MTS_NAMESPACE_BEGIN
  * This is useful when running Mitsuba as simulation step as part of a
  * larger virtual experiment. It can also come in handy when
  * verifying parts of the renderer using an automated test suite.
+ *
+ * When rendering very large NumPy arrays, the \code{streaming} parameter
+ * avoids storing the whole image: the output file is preallocated and
+ * memory-mapped, and each image block is copied into it as soon as its
+ * neighbors are finished (the blocks overlap by the reconstruction filter
+ * radius). Rendering techniques that update the entire image at once
+ * are not supported in this mode.
  */
 class MFilm : public Film {
 public:
@@ -133,8 +147,17 @@ public:
 
         m_digits = props.getInteger("digits", 4);
         m_variable = props.getString("variable", "data");
-
-        m_storage = new ImageBlock(Bitmap::ESpectrumAlphaWeight, m_cropSize);
+        m_streaming = props.getBoolean("streaming", false);
+
+        if (m_streaming) {
+            if (m_fileFormat != ENumPy)
+                Log(EError, "Streaming output is only supported for NumPy files!");
+            if (m_highQualityEdges)
+                Log(EError, "The 'highQualityEdges' parameter is incompatible with "
+                    "streaming output. Please disable it.");
+        } else {
+            m_storage = new ImageBlock(Bitmap::ESpectrumAlphaWeight, m_cropSize);
+        }
     }
 
     MFilm(Stream *stream, InstanceManager *manager)
@@ -143,6 +166,7 @@ public:
         m_fileFormat = (EMode) stream->readUInt();
         m_digits = stream->readInt();
         m_variable = stream->readString();
+        m_streaming = stream->readBool();
     }
 
     void serialize(Stream *stream, InstanceManager *manager) const {
@@ -151,6 +175,7 @@ public:
         stream->writeUInt(m_fileFormat);
         stream->writeInt(m_digits);
         stream->writeString(m_variable);
+        stream->writeBool(m_streaming);
     }
 
     void configure() {
@@ -165,14 +190,23 @@ public:
     }
 
     void clear() {
-        m_storage->clear();
+        if (m_storage)
+            m_storage->clear();
     }
 
     void put(const ImageBlock *block) {
-        m_storage->put(block);
+        if (m_streaming) {
+            Assert(m_stream != NULL);
+            m_stream->put(block);
+        } else {
+            m_storage->put(block);
+        }
     }
 
     void setBitmap(const Bitmap *bitmap, Float multiplier) {
+        if (m_streaming)
+            Log(EError, "setBitmap(): Global image updates are not supported "
+                "in streaming mode! Please set 'streaming' to false.");
         bitmap->convert(m_storage->getBitmap(), multiplier);
     }
 
@@ -181,6 +215,10 @@ public:
            is supported. This function basically just exists to support the
            somewhat peculiar film updates done by BDPT */
 
+        if (m_streaming)
+            Log(EError, "addBitmap(): Global image updates are not supported "
+                "in streaming mode! Please set 'streaming' to false.");
+
         Vector2i size = bitmap->getSize();
         if (bitmap->getPixelFormat() != Bitmap::ESpectrum ||
             bitmap->getComponentFormat() != Bitmap::EFloat ||
@@ -205,6 +243,11 @@ public:
 
     bool develop(const Point2i &sourceOffset, const Vector2i &size,
             const Point2i &targetOffset, Bitmap *target) const {
+        if (m_streaming) {
+            target->fillRect(targetOffset, size, Spectrum(0.0f));
+            return false; /* The image is not kept in memory */
+        }
+
         const Bitmap *source = m_storage->getBitmap();
         const FormatConverter *cvt = FormatConverter::getInstance(
             std::make_pair(Bitmap::EFloat, target->getComponentFormat())
@@ -240,14 +283,52 @@ public:
 
     void setDestinationFile(const fs::path &destFile, uint32_t blockSize) {
         m_destFile = destFile;
+
+        if (m_streaming) {
+            if (m_stream)
+                m_stream->close();
+
+            std::vector<Bitmap::EPixelFormat> pixelFormats(1, m_pixelFormat);
+            ref<Bitmap> tile = TileStream::createTile((int) blockSize,
+                pixelFormats, Bitmap::EFloat, std::vector<std::string>());
+            ref<TileWriter> writer;
+            if (m_sink) {
+                writer = m_sink->createTileWriter(this, m_cropSize, tile);
+            } else {
+                fs::path filename = destFile;
+                if (boost::to_lower_copy(filename.extension().string()) != ".npy")
+                    filename.replace_extension(".npy");
+
+                Log(EInfo, "Streaming image blocks to \"%s\" ..", filename.string().c_str());
+                writer = TileWriter::createNumPy(filename, m_cropSize, tile);
+            }
+            m_stream = new TileStream(writer, m_cropSize, (int) blockSize,
+                tile, pixelFormats);
+        }
     }
 
     void develop(const Scene *scene, Float renderTime) {
-        if (m_destFile.empty())
+        if (m_streaming) {
+            if (m_stream) {
+                m_stream->close();
+                m_stream = NULL;
+            }
+            return;
+        }
+
+        if (m_destFile.empty() && !m_sink)
             return;
 
         Log(EDebug, "Developing film ..");
 
+        ref<Bitmap> bitmap = m_storage->getBitmap()->convert(
+            m_pixelFormat, Bitmap::EFloat);
+
+        if (m_sink) {
+            m_sink->put(this, bitmap);
+            return;
+        }
+
         fs::path filename = m_destFile;
         std::string extension = boost::to_lower_copy(filename.extension().string());
         std::string expectedExtension;
@@ -261,9 +342,6 @@ public:
         if (extension != expectedExtension)
             filename.replace_extension(expectedExtension);
 
-        ref<Bitmap> bitmap = m_storage->getBitmap()->convert(
-            m_pixelFormat, Bitmap::EFloat);
-
         Log(EInfo, "Writing image to \"%s\" ..", filename.filename().string().c_str());
 
         if (m_fileFormat == EMathematica || m_fileFormat == EMATLAB) {
@@ -378,6 +456,7 @@ public:
             << "  pixelFormat = " << m_pixelFormat << "," << endl
             << "  digits = " << m_digits << "," << endl
             << "  variable = \"" << m_variable << "\"," << endl
+            << "  streaming = " << m_streaming << "," << endl
             << "  cropOffset = " << m_cropOffset.toString() << "," << endl
             << "  cropSize = " << m_cropSize.toString() << "," << endl
             << "  filter = " << indent(m_filter->toString()) << endl
@@ -391,8 +470,10 @@ protected:
     EMode m_fileFormat;
     fs::path m_destFile;
     ref<ImageBlock> m_storage;
+    ref<TileStream> m_stream;
     std::string m_variable;
     int m_digits;
+    bool m_streaming;
 };
 
 MTS_IMPLEMENT_CLASS_S(MFilm, false, Film)
@@ -17,21 +17,11 @@
 */
 
 #include <mitsuba/render/film.h>
+#include <mitsuba/render/tilestream.h>
 #include <mitsuba/core/fstream.h>
 #include <mitsuba/core/bitmap.h>
-#include <mitsuba/core/version.h>
 #include <boost/algorithm/string.hpp>
 
-#if defined(_MSC_VER)
-#pragma warning(disable : 4231) // nonstandard extension used : 'extern' before template explicit instantiation
-#endif
-
-#include <ImfTiledOutputFile.h>
-#include <ImfChannelList.h>
-#include <ImfStringAttribute.h>
-#include <ImfFrameBuffer.h>
-#include <ImfStandardAttributes.h>
-
 MTS_NAMESPACE_BEGIN
 
 /*!\plugin{tiledhdrfilm}{Tiled high dynamic range film}
@@ -73,6 +63,11 @@ MTS_NAMESPACE_BEGIN
  * large output images that would otherwise not fit into memory (e.g.
  * 100K$\times$100K).
  *
+ * Like \pluginref{hdrfilm}, the film also supports general multi-channel
+ * output (e.g. for use with the \pluginref{multichannel} plugin). The same
+ * streaming functionality is also available via the \code{streaming} parameter
+ * of \pluginref{hdrfilm} and \pluginref{mfilm} (the latter producing NumPy files).
+ *
  * When the image can fit into memory, usage of this plugin is discouraged:
  * due to the extra overhead of tracking image tiles, the rendering process
  * will be slower, and the output files also generally do not compress as
@@ -100,7 +95,7 @@ MTS_NAMESPACE_BEGIN
 
 class TiledHDRFilm : public Film {
 public:
-    TiledHDRFilm(const Properties &props) : Film(props), m_output(NULL), m_frameBuffer(NULL) {
+    TiledHDRFilm(const Properties &props) : Film(props) {
         std::vector<std::string> pixelFormats = tokenize(boost::to_lower_copy(
             props.getString("pixelFormat", "rgb")), " ,");
         std::vector<std::string> channelNames = tokenize(
@@ -192,7 +187,7 @@ public:
     }
 
     TiledHDRFilm(Stream *stream, InstanceManager *manager)
-        : Film(stream, manager), m_output(NULL), m_frameBuffer(NULL) {
+        : Film(stream, manager) {
         m_pixelFormats.resize((size_t) stream->readUInt());
         for (size_t i=0; i<m_pixelFormats.size(); ++i)
             m_pixelFormats[i] = (Bitmap::EPixelFormat) stream->readUInt();
@@ -208,6 +203,7 @@ public:
 
     void serialize(Stream *stream, InstanceManager *manager) const {
         Film::serialize(stream, manager);
+        stream->writeUInt((uint32_t) m_pixelFormats.size());
         for (size_t i=0; i<m_pixelFormats.size(); ++i)
             stream->writeUInt(m_pixelFormats[i]);
         stream->writeUInt((uint32_t) m_channelNames.size());
@@ -217,129 +213,31 @@ public:
     }
 
     void setDestinationFile(const fs::path &destFile, uint32_t blockSize) {
-        if (m_output)
+        if (m_stream)
             develop(NULL, 0);
 
-        fs::path filename = destFile;
-        std::string extension = boost::to_lower_copy(filename.extension().string());
-        if (extension != ".exr")
-            filename.replace_extension(".exr");
-
-        Log(EInfo, "Commencing creation of a tiled EXR image at \"%s\" ..", filename.string().c_str());
-
-        Imf::Header header(m_size.x, m_size.y);
-        header.setTileDescription(Imf::TileDescription(blockSize, blockSize, Imf::ONE_LEVEL));
-        header.insert("generated-by", Imf::StringAttribute("Mitsuba version " MTS_VERSION));
-
-        if (m_pixelFormats.size() == 1) {
-            /* Write a chromaticity tag when this is possible */
-            Bitmap::EPixelFormat pixelFormat = m_pixelFormats[0];
-            if (pixelFormat == Bitmap::EXYZ || pixelFormat == Bitmap::EXYZA) {
-                Imf::addChromaticities(header, Imf::Chromaticities(
-                    Imath::V2f(1.0f, 0.0f),
-                    Imath::V2f(0.0f, 1.0f),
-                    Imath::V2f(0.0f, 0.0f),
-                    Imath::V2f(1.0f/3.0f, 1.0f/3.0f)));
-            } else if (pixelFormat == Bitmap::ERGB || pixelFormat == Bitmap::ERGBA) {
-                Imf::addChromaticities(header, Imf::Chromaticities());
-            }
-        }
-
-        Imf::PixelType compType;
-        size_t compStride;
-
-        if (m_componentFormat == Bitmap::EFloat16) {
-            compType = Imf::HALF;
-            compStride = 2;
-        } else if (m_componentFormat == Bitmap::EFloat32) {
-            compType = Imf::FLOAT;
-            compStride = 4;
-        } else if (m_componentFormat == Bitmap::EUInt32) {
-            compType = Imf::UINT;
-            compStride = 4;
-        } else {
-            Log(EError, "Invalid component type (must be "
-                "float16, float32, or uint32)");
-            return;
-        }
-
-        Imf::ChannelList &channels = header.channels();
-        for (size_t i=0; i<m_channelNames.size(); ++i)
-            channels.insert(m_channelNames[i].c_str(), Imf::Channel(compType));
-
-        m_output = new Imf::TiledOutputFile(filename.string().c_str(), header);
-        m_frameBuffer = new Imf::FrameBuffer();
-        m_blockSize = (int) blockSize;
-        m_blocksH = (m_size.x + blockSize - 1) / blockSize;
-        m_blocksV = (m_size.y + blockSize - 1) / blockSize;
-
-        m_pixelStride = m_channelNames.size() * compStride;
-        m_rowStride = m_pixelStride * m_blockSize;
-
-        if (m_pixelFormats.size() == 1) {
-            m_tile = new Bitmap(m_pixelFormats[0], m_componentFormat,
-                    Vector2i(m_blockSize, m_blockSize));
+        ref<Bitmap> tile = TileStream::createTile((int) blockSize,
+            m_pixelFormats, m_componentFormat, m_channelNames);
+        ref<TileWriter> writer;
+        if (m_sink) {
+            writer = m_sink->createTileWriter(this, m_cropSize, tile);
         } else {
-            m_tile = new Bitmap(Bitmap::EMultiChannel, m_componentFormat,
-                    Vector2i(m_blockSize, m_blockSize), (uint8_t) m_channelNames.size());
-            m_tile->setChannelNames(m_channelNames);
+            fs::path filename = destFile;
+            std::string extension = boost::to_lower_copy(filename.extension().string());
+            if (extension != ".exr")
+                filename.replace_extension(".exr");
+
+            Log(EInfo, "Commencing creation of a tiled EXR image at \"%s\" ..", filename.string().c_str());
+            writer = TileWriter::createOpenEXR(filename,
+                m_size, m_cropOffset, m_cropSize, (int) blockSize, tile);
         }
-
-        char *ptr = (char *) m_tile->getUInt8Data();
-
-        for (size_t i=0; i<m_channelNames.size(); ++i) {
-            m_frameBuffer->insert(m_channelNames[i].c_str(),
-                Imf::Slice(compType, ptr, m_pixelStride, m_rowStride));
-            ptr += compStride;
-        }
-
-        m_output->setFrameBuffer(*m_frameBuffer);
-        m_peakUsage = 0;
+        m_stream = new TileStream(writer, m_cropSize, (int) blockSize,
+            tile, m_pixelFormats);
     }
 
     void put(const ImageBlock *block) {
-        Assert(m_output != NULL);
-
-        if ((block->getOffset().x % m_blockSize) != 0 ||
-            (block->getOffset().y % m_blockSize) != 0)
-            Log(EError, "Encountered an unaligned block!");
-
-        if (block->getSize().x > m_blockSize ||
-            block->getSize().y > m_blockSize)
-            Log(EError, "Encountered an oversized block!");
-
-        int x = block->getOffset().x / (int) m_blockSize;
-        int y = block->getOffset().y / (int) m_blockSize;
-
-        /* Create two copies: a clean one, and one that is used for accumulation */
-        ref<ImageBlock> copy1, copy2;
-        if (m_freeBlocks.size() > 0) {
-            copy1 = m_freeBlocks.back();
-            block->copyTo(copy1);
-            m_freeBlocks.pop_back();
-        } else {
-            copy1 = block->clone();
-            copy1->incRef();
-            ++m_peakUsage;
-        }
-
-        if (m_freeBlocks.size() > 0) {
-            copy2 = m_freeBlocks.back();
-            block->copyTo(copy2);
-            m_freeBlocks.pop_back();
-        } else {
-            copy2 = block->clone();
-            copy2->incRef();
-            ++m_peakUsage;
-        }
-
-        uint32_t idx = (uint32_t) x + (uint32_t) y * m_blocksH;
-        m_origBlocks[idx]   = copy1;
-        m_mergedBlocks[idx] = copy2;
-
-        for (int yo = -1; yo <= 1; ++yo)
-            for (int xo = -1; xo <= 1; ++xo)
-                potentiallyWrite(x + xo, y + yo);
+        Assert(m_stream != NULL);
+        m_stream->put(block);
     }
 
     void setBitmap(const Bitmap *bitmap, Float multiplier) {
@@ -354,103 +252,6 @@ public:
             "rendering technique or use a non-tiled film. (e.g. 'hdrfilm')");
     }
 
-    void potentiallyWrite(int x, int y) {
-        if (x < 0 || y < 0 || x >= m_blocksH || y >= m_blocksV)
-            return;
-
-        uint32_t idx = (uint32_t) x + (uint32_t) y * m_blocksH;
-        std::map<uint32_t, ImageBlock *>::iterator it = m_origBlocks.find(idx);
-        if (it == m_origBlocks.end())
-            return;
-
-        ImageBlock *origBlock = it->second;
-        if (origBlock == NULL)
-            return;
-
-        /* This could be accelerated using some counters */
-        for (int yo = -1; yo <= 1; ++yo) {
-            for (int xo = -1; xo <= 1; ++xo) {
-                int xp = x + xo, yp = y + yo;
-                if (xp < 0 || yp < 0 || xp >= m_blocksH || yp >= m_blocksV
-                   || (xp == x && yp == y))
-                    continue;
-
-                uint32_t idx2 = (uint32_t) xp + (uint32_t) yp * m_blocksH;
-                if (m_origBlocks.find(idx2) == m_origBlocks.end())
-                    return; /* Not all neighboring blocks are there yet */
-            }
-        }
-
-        ImageBlock *mergedBlock = m_mergedBlocks[idx];
-        if (mergedBlock == NULL)
-            return;
-
-        /* All neighboring blocks are there -- join overlapping regions */
-        for (int yo = -1; yo <= 1; ++yo) {
-            for (int xo = -1; xo <= 1; ++xo) {
-                int xp = x + xo, yp = y + yo;
-                if (xp < 0 || yp < 0 || xp >= m_blocksH || yp >= m_blocksV
-                   || (xp == x && yp == y))
-                    continue;
-                uint32_t idx2 = (uint32_t) xp + (uint32_t) yp * m_blocksH;
-                ImageBlock *origBlock2   = m_origBlocks[idx2];
-                ImageBlock *mergedBlock2 = m_mergedBlocks[idx2];
-                if (!origBlock2 || !mergedBlock2)
-                    continue;
-
-                mergedBlock->put(origBlock2);
-                mergedBlock2->put(origBlock);
-            }
-        }
-
-        const Bitmap *source = mergedBlock->getBitmap();
-
-        size_t sourceBpp = source->getBytesPerPixel();
-        size_t targetBpp = m_tile->getBytesPerPixel();
-
-        const uint8_t *sourceData = source->getUInt8Data()
-            + mergedBlock->getBorderSize() * sourceBpp * (1 + source->getWidth());
-        uint8_t *targetData = m_tile->getUInt8Data();
-
-        const FormatConverter *cvt = FormatConverter::getInstance(
-            std::make_pair(Bitmap::EFloat, m_tile->getComponentFormat())
-        );
-
-        for (int i=0; i<m_blockSize; ++i) {
-            if (m_pixelFormats.size() == 1)
-                cvt->convert(source->getPixelFormat(), 1.0f, sourceData,
-                    m_tile->getPixelFormat(), m_tile->getGamma(), targetData,
-                    m_tile->getWidth());
-            else
-                Bitmap::convertMultiSpectrumAlphaWeight(source, sourceData,
-                    m_tile, targetData, m_pixelFormats, m_componentFormat, m_tile->getWidth());
-
-            sourceData += source->getWidth() * sourceBpp;
-            targetData += m_tile->getWidth() * targetBpp;
-        }
-
-        /* Commit to disk */
-        size_t ptrOffset = mergedBlock->getOffset().x * m_pixelStride +
-            mergedBlock->getOffset().y * m_rowStride;
-
-        for (Imf::FrameBuffer::Iterator it = m_frameBuffer->begin();
-            it != m_frameBuffer->end(); ++it)
-            it.slice().base -= ptrOffset;
-
-        m_output->setFrameBuffer(*m_frameBuffer);
-        m_output->writeTile(x, y);
-
-        for (Imf::FrameBuffer::Iterator it = m_frameBuffer->begin();
-            it != m_frameBuffer->end(); ++it)
-            it.slice().base += ptrOffset;
-
-        /* Release the block */
-        m_freeBlocks.push_back(origBlock);
-        m_freeBlocks.push_back(mergedBlock);
-        m_origBlocks[idx] = NULL;
-        m_mergedBlocks[idx] = NULL;
-    }
-
     bool develop(const Point2i &sourceOffset, const Vector2i &size,
             const Point2i &targetOffset, Bitmap *target) const {
         target->fillRect(targetOffset, size, Spectrum(0.0f));
@@ -458,33 +259,9 @@ public:
     }
 
     void develop(const Scene *scene, Float renderTime) {
-        if (m_output) {
-            Log(EInfo, "Closing EXR file (%u tiles in total, peak memory usage: %u tiles)..",
-                m_blocksH * m_blocksV, m_peakUsage);
-            delete m_output;
-            delete m_frameBuffer;
-            m_output = NULL;
-            m_frameBuffer = NULL;
-            m_tile = NULL;
-
-            for (std::vector<ImageBlock *>::iterator it = m_freeBlocks.begin();
-                it != m_freeBlocks.end(); ++it)
-                (*it)->decRef();
-            m_freeBlocks.clear();
-
-            for (std::map<uint32_t, ImageBlock *>::iterator it = m_origBlocks.begin();
-                it != m_origBlocks.end(); ++it) {
-                if ((*it).second)
-                    (*it).second->decRef();
-            }
-            m_origBlocks.clear();
-
-            for (std::map<uint32_t, ImageBlock *>::iterator it = m_mergedBlocks.begin();
-                it != m_mergedBlocks.end(); ++it) {
-                if ((*it).second)
-                    (*it).second->decRef();
-            }
-            m_mergedBlocks.clear();
+        if (m_stream) {
+            m_stream->close();
+            m_stream = NULL;
         }
     }
 
@@ -533,14 +310,7 @@ protected:
     std::vector<Bitmap::EPixelFormat> m_pixelFormats;
     std::vector<std::string> m_channelNames;
     Bitmap::EComponentFormat m_componentFormat;
-    std::vector<ImageBlock *> m_freeBlocks;
-    std::map<uint32_t, ImageBlock *> m_origBlocks, m_mergedBlocks;
-    Imf::TiledOutputFile *m_output;
-    Imf::FrameBuffer *m_frameBuffer;
-    ref<Bitmap> m_tile;
-    size_t m_pixelStride, m_rowStride;
-    int m_blocksH, m_blocksV, m_peakUsage;
-    int m_blockSize;
+    ref<TileStream> m_stream;
 };
 
 MTS_IMPLEMENT_CLASS_S(TiledHDRFilm, false, Film)
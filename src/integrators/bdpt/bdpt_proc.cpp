@@ -18,11 +18,17 @@
 
 #include <mitsuba/core/statistics.h>
 #include <mitsuba/core/sfcurve.h>
+#include <mitsuba/core/arena.h>
 #include <mitsuba/bidir/util.h>
 #include "bdpt_proc.h"
 
 MTS_NAMESPACE_BEGIN
 
+#if defined(MTS_DEBUG_ALLOCATIONS)
+static StatsCounter allocationsPerSample("General",
+    "Heap allocations per sample", EAverage);
+#endif
+
 /* ==================================================================== */
 /*                         Worker implementation                        */
 /* ==================================================================== */
@@ -73,13 +79,16 @@ public:
         result->setSize(rect->getSize());
         result->clear();
         m_hilbertCurve.initialize(TVector2<uint8_t>(rect->getSize()));
+        MemoryArena::getThreadArena().reset();
 
         #if defined(MTS_DEBUG_FP)
             enableFPExceptions();
         #endif
 
-        Path emitterSubpath;
-        Path sensorSubpath;
+        #if defined(MTS_DEBUG_ALLOCATIONS)
+            uint64_t allocations = getAllocationCount();
+            size_t sampleCount = 0;
+        #endif
 
         /* Determine the necessary random walk depths based on properties of
            the endpoints */
@@ -106,20 +115,23 @@ public:
                     time = m_sensor->sampleTime(m_sampler->next1D());
 
                 /* Start new emitter and sensor subpaths */
-                emitterSubpath.initialize(m_scene, time, EImportance, m_pool);
-                sensorSubpath.initialize(m_scene, time, ERadiance, m_pool);
+                m_emitterSubpath.initialize(m_scene, time, EImportance, m_pool);
+                m_sensorSubpath.initialize(m_scene, time, ERadiance, m_pool);
 
                 /* Perform a random walk using alternating steps on each path */
                 Path::alternatingRandomWalkFromPixel(m_scene, m_sampler,
-                    emitterSubpath, emitterDepth, sensorSubpath,
+                    m_emitterSubpath, emitterDepth, m_sensorSubpath,
                     sensorDepth, offset, m_config.rrDepth, m_pool);
 
-                evaluate(result, emitterSubpath, sensorSubpath);
+                evaluate(result, m_emitterSubpath, m_sensorSubpath);
 
-                emitterSubpath.release(m_pool);
-                sensorSubpath.release(m_pool);
+                m_emitterSubpath.release(m_pool);
+                m_sensorSubpath.release(m_pool);
 
                 m_sampler->advance();
+                #if defined(MTS_DEBUG_ALLOCATIONS)
+                    ++sampleCount;
+                #endif
             }
         }
 
@@ -127,6 +139,11 @@ public:
             disableFPExceptions();
         #endif
 
+        #if defined(MTS_DEBUG_ALLOCATIONS)
+            allocationsPerSample += (size_t) (getAllocationCount() - allocations);
+            allocationsPerSample.incrementBase(sampleCount);
+        #endif
+
         /* Make sure that there were no memory leaks */
         Assert(m_pool.unused());
     }
@@ -324,6 +341,8 @@ private:
     ref<Sampler> m_sampler;
     ref<ReconstructionFilter> m_rfilter;
     MemoryPool m_pool;
+    /* Kept across work units so that their storage is reused */
+    Path m_emitterSubpath, m_sensorSubpath;
     BDPTConfiguration m_config;
     HilbertCurve2D<uint8_t> m_hilbertCurve;
 };
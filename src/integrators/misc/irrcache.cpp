@@ -17,8 +17,12 @@
 */
 
 #include <mitsuba/core/plugin.h>
+#include <mitsuba/core/fstream.h>
 #include "irrcache_proc.h"
 
+/// Increase this when the format of the persistent cache file changes
+#define IRRCACHE_FILE_VERSION 0x01
+
 MTS_NAMESPACE_BEGIN
 
 /*!\plugin{irrcache}{Irradiance caching integrator}
@@ -39,6 +43,10 @@ MTS_NAMESPACE_BEGIN
  *     \parameter{indirectOnly}{\Boolean}{Only show the indirect illumination? This can be useful to check
  *      the interpolation quality. \default{\code{false}}}
  *     \parameter{debug}{\Boolean}{Visualize the sample placement? \default{\code{false}}}
+ *     \parameter{cacheFile}{\String}{Optional file name, from which the irradiance cache is
+ *      loaded before rendering and to which it is written afterwards. This allows
+ *      rendering several views of a static scene without recomputing the cache
+ *      records that they share. \default{none}}
  * }
  * \renderings{
  *  \unframedbigrendering{Illustration of the effect of the different optimizatations
@@ -78,6 +86,17 @@ MTS_NAMESPACE_BEGIN
  * improve the achieved interpolation quality, namely irradiance gradients
  * \cite{Ward1992Irradiance}, neighbor clamping \cite{Krivanek2006Making}, a screen-space
  * clamping metric and an improved error function \cite{Tabellion2004Approximate}.
+ *
+ * Cache records that are created while rendering are first stored in a staging
+ * area that belongs to the thread which computed them. This avoids any locking,
+ * but other threads only see these records after the current pass has finished.
+ * The overture pass is therefore especially important when many cores are used.
+ *
+ * When the \code{cacheFile} parameter is specified, the contents of the cache
+ * are stored on disk after rendering and reused when rendering further views.
+ * The file is ignored when the bounding box of the scene has changed, but
+ * other modifications (e.g. to materials or emitters) are not detected---in this
+ * case, the file must be deleted manually.
  */
 
 class IrradianceCacheIntegrator : public SamplingIntegrator {
@@ -115,6 +134,8 @@ public:
         /* If set to true, direct illumination will be suppressed -
            useful for checking the interpolation quality */
         m_indirectOnly = props.getBoolean("indirectOnly", false);
+        /* Optional file, which persists the cache across renderings */
+        m_cacheFile = props.getString("cacheFile", "");
 
         if (m_debug)
             m_overture = false;
@@ -193,7 +214,9 @@ public:
             return false;
 
         ref<Scheduler> sched = Scheduler::getInstance();
-        m_irrCache = new IrradianceCache(scene->getAABB());
+        m_irrCache = loadCache(scene);
+        if (!m_irrCache)
+            m_irrCache = new IrradianceCache(scene->getAABB());
         m_irrCache->clampNeighbor(m_clampNeighbor);
         m_irrCache->clampScreen(m_clampScreen);
         m_irrCache->useGradients(m_gradients);
@@ -217,18 +240,25 @@ public:
 
         if (m_overture) {
             int subIntegratorResID = sched->registerResource(m_subIntegrator);
-            ref<OvertureProcess> proc = new OvertureProcess(job, m_resolution, m_gradients,
-                m_clampNeighbor, m_clampScreen, m_quality);
+            int irrCacheResID = sched->registerResource(m_irrCache);
+            ref<OvertureProcess> proc = new OvertureProcess(job, m_resolution);
             m_proc = proc;
             proc->bindResource("scene", sceneResID);
             proc->bindResource("sensor", sensorResID);
             proc->bindResource("subIntegrator", subIntegratorResID);
+            proc->bindResource("irrCache", irrCacheResID);
             bindUsedResources(proc);
             sched->schedule(proc);
             sched->unregisterResource(subIntegratorResID);
+            sched->unregisterResource(irrCacheResID);
             sched->wait(proc);
             m_proc = NULL;
 
+            /* Local workers staged their records in the shared cache. They
+               are discarded here, since all records (including those of
+               remote workers) are also returned as work results */
+            m_irrCache->discardStaged();
+
             if (proc->getReturnStatus() != ParallelProcess::ESuccess) {
                 Log(EWarn, "The overture pass did not complete sucessfully!");
                 return false;
@@ -244,6 +274,78 @@ public:
         return true;
     }
 
+    void postprocess(const Scene *scene, RenderQueue *queue, const RenderJob *job,
+            int sceneResID, int sensorResID, int samplerResID) {
+        SamplingIntegrator::postprocess(scene, queue, job, sceneResID, sensorResID, samplerResID);
+        m_subIntegrator->postprocess(scene, queue, job, sceneResID, sensorResID, samplerResID);
+
+        if (!m_irrCache)
+            return;
+
+        size_t merged = m_irrCache->mergeStaged();
+        Log(EDebug, "Merged %i irradiance samples created during rendering", (int) merged);
+
+        if (!m_cacheFile.empty())
+            saveCache(scene);
+    }
+
+    /// Load the irradiance cache from \c m_cacheFile, if it is valid for this scene
+    ref<IrradianceCache> loadCache(const Scene *scene) const {
+        if (m_cacheFile.empty() || !fs::exists(m_cacheFile))
+            return NULL;
+
+        ref<FileStream> stream = new FileStream(m_cacheFile, FileStream::EReadOnly);
+        stream->setByteOrder(Stream::ELittleEndian);
+        char header[3];
+        stream->read(header, 3);
+        uint8_t version = stream->readUChar();
+        if (header[0] != 'I' || header[1] != 'R' || header[2] != 'C' ||
+                version != IRRCACHE_FILE_VERSION || stream->readInt() != SPECTRUM_SAMPLES) {
+            Log(EWarn, "Ignoring the incompatible irradiance cache file \"%s\"",
+                m_cacheFile.c_str());
+            return NULL;
+        }
+
+        ref<IrradianceCache> irrCache = new IrradianceCache(stream, NULL);
+        if (irrCache->getAABB() != scene->getAABB()) {
+            Log(EWarn, "The scene geometry has changed -- ignoring the irradiance "
+                "cache file \"%s\"", m_cacheFile.c_str());
+            return NULL;
+        }
+
+        Log(EInfo, "Loaded %i irradiance samples from \"%s\"",
+            (int) irrCache->getRecordCount(), m_cacheFile.c_str());
+        return irrCache;
+    }
+
+    /// Write the irradiance cache to \c m_cacheFile
+    void saveCache(const Scene *scene) const {
+        /* Write to a temporary file first, so that concurrent renderings
+           never observe a partially written cache */
+        fs::path cacheFile(m_cacheFile),
+            tempFile = cacheFile.parent_path() / fs::unique_path("%%%%-%%%%-%%%%.irc");
+
+        try {
+            ref<FileStream> stream = new FileStream(tempFile, FileStream::ETruncReadWrite);
+            stream->setByteOrder(Stream::ELittleEndian);
+            stream->write("IRC", 3);
+            stream->writeUChar(IRRCACHE_FILE_VERSION);
+            stream->writeInt(SPECTRUM_SAMPLES);
+            m_irrCache->serialize(stream, NULL);
+            stream->close();
+            fs::rename(tempFile, cacheFile);
+        } catch (const std::exception &ex) {
+            Log(EWarn, "Could not write the irradiance cache file \"%s\": %s",
+                m_cacheFile.c_str(), ex.what());
+            boost::system::error_code ec;
+            fs::remove(tempFile, ec);
+            return;
+        }
+
+        Log(EInfo, "Wrote %i irradiance samples to \"%s\"",
+            (int) m_irrCache->getRecordCount(), m_cacheFile.c_str());
+    }
+
     void cancel() {
         if (m_proc) {
             Scheduler::getInstance()->cancel(m_proc);
@@ -382,6 +484,7 @@ private:
     bool m_clampScreen, m_clampNeighbor;
     bool m_overture, m_gradients, m_debug, m_indirectOnly;
     int m_resolution;
+    std::string m_cacheFile;
 };
 
 MTS_IMPLEMENT_CLASS_S(IrradianceCacheIntegrator, false, SamplingIntegrator)
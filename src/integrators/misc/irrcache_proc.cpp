@@ -25,26 +25,15 @@ MTS_NAMESPACE_BEGIN
 /* Parallel overture pass implementation (worker) */
 class OvertureWorker : public WorkProcessor {
 public:
-    OvertureWorker(int resolution, bool gradients, bool clampNeighbor,
-        bool clampScreen, Float quality) : m_resolution(resolution), m_gradients(gradients),
-        m_clampNeighbor(clampNeighbor), m_clampScreen(clampScreen),
-        m_quality(quality) {
+    OvertureWorker(int resolution) : m_resolution(resolution) {
     }
 
     OvertureWorker(Stream *stream, InstanceManager *manager) {
         m_resolution = stream->readInt();
-        m_gradients = stream->readBool();
-        m_clampNeighbor = stream->readBool();
-        m_clampScreen = stream->readBool();
-        m_quality = stream->readFloat();
     }
 
     void serialize(Stream *stream, InstanceManager *manager) const {
         stream->writeInt(m_resolution);
-        stream->writeBool(m_gradients);
-        stream->writeBool(m_clampNeighbor);
-        stream->writeBool(m_clampScreen);
-        stream->writeFloat(m_quality);
     }
 
     ref<WorkUnit> createWorkUnit() const {
@@ -65,11 +54,9 @@ public:
             createObject(MTS_CLASS(Sampler), props));
         m_subIntegrator->wakeup(NULL, m_resources);
 
-        m_irrCache = new IrradianceCache(m_scene->getAABB());
-        m_irrCache->clampNeighbor(m_clampNeighbor);
-        m_irrCache->clampScreen(m_clampScreen);
-        m_irrCache->useGradients(m_gradients);
-        m_irrCache->setQuality(m_quality);
+        /* The cache is shared by all local workers. New records are staged
+           per thread, and the integrator merges them after the pass */
+        m_irrCache = static_cast<IrradianceCache *>(getResource("irrCache"));
         m_hs = new HemisphereSampler(m_resolution, 3*m_resolution);
     }
 
@@ -133,8 +120,7 @@ public:
     }
 
     ref<WorkProcessor> clone() const {
-        return new OvertureWorker(m_resolution, m_gradients, m_clampNeighbor,
-            m_clampScreen, m_quality);
+        return new OvertureWorker(m_resolution);
     }
 
     MTS_DECLARE_CLASS()
@@ -148,8 +134,6 @@ private:
     ref<SamplingIntegrator> m_subIntegrator;
     ref<IrradianceCache> m_irrCache;
     int m_resolution;
-    bool m_gradients, m_clampNeighbor, m_clampScreen;
-    Float m_quality;
 };
 
 void IrradianceRecordVector::load(Stream *stream) {
@@ -177,10 +161,8 @@ std::string IrradianceRecordVector::toString() const {
     return oss.str();
 }
 
-OvertureProcess::OvertureProcess(const RenderJob *job, int resolution, bool gradients,
-    bool clampNeighbor, bool clampScreen, Float quality) : m_job(job), m_resolution(resolution),
-    m_gradients(gradients), m_clampNeighbor(clampNeighbor),
-    m_clampScreen(clampScreen), m_quality(quality), m_progress(NULL) {
+OvertureProcess::OvertureProcess(const RenderJob *job, int resolution)
+    : m_job(job), m_resolution(resolution), m_progress(NULL) {
     m_resultCount = 0;
     m_resultMutex = new Mutex();
     m_samples = new IrradianceRecordVector();
@@ -192,8 +174,7 @@ OvertureProcess::~OvertureProcess() {
 }
 
 ref<WorkProcessor> OvertureProcess::createWorkProcessor() const {
-    return new OvertureWorker(m_resolution, m_gradients, m_clampNeighbor,
-        m_clampScreen, m_quality);
+    return new OvertureWorker(m_resolution);
 }
 
 void OvertureProcess::processResult(const WorkResult *wr, bool cancelled) {
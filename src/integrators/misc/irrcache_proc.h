@@ -71,8 +71,7 @@ private:
  */
 class OvertureProcess : public BlockedImageProcess {
 public:
-    OvertureProcess(const RenderJob *job, int resolution, bool gradients,
-        bool clampNeighbor, bool clampScreen, Float quality);
+    OvertureProcess(const RenderJob *job, int resolution);
 
     inline const IrradianceRecordVector *getSamples() const {
         return m_samples.get();
@@ -93,8 +92,6 @@ private:
     ref<Mutex> m_resultMutex;
     ref<IrradianceRecordVector> m_samples;
     int m_resolution;
-    bool m_gradients, m_clampNeighbor, m_clampScreen;
-    Float m_quality;
     ProgressReporter *m_progress;
 };
 
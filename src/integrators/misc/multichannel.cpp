@@ -151,14 +151,11 @@ public:
         proc->bindResource("sampler", samplerResID);
         scene->bindUsedResources(proc);
         bindUsedResources(proc);
-        sched->schedule(proc);
 
-        m_process = proc;
-        sched->wait(proc);
-        m_process = NULL;
+        bool success = runProcess(scene, job, film, proc);
         sched->unregisterResource(integratorResID);
 
-        return proc->getReturnStatus() == ParallelProcess::ESuccess;
+        return success;
     }
 
     void renderBlock(const Scene *scene,
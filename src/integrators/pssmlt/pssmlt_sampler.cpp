@@ -118,11 +118,11 @@ ref<Sampler> PSSMLTSampler::clone() {
     return sampler.get();
 }
 
-Float PSSMLTSampler::next1D() {
+Float PSSMLTSampler::fetch1D() {
     return primarySample(m_sampleIndex++);
 }
 
-Point2 PSSMLTSampler::next2D() {
+Point2 PSSMLTSampler::fetch2D() {
     /// Enforce a specific order of evaluation
     Float value1 = primarySample(m_sampleIndex++);
     Float value2 = primarySample(m_sampleIndex++);
@@ -57,11 +57,11 @@ public:
     /// Check if the current step is a large step
     inline bool isLargeStep() const { return m_largeStep; }
 
-    /// Retrieve the next component value from the current sample
-    virtual Float next1D();
+    /// Compute the next component value of the current sample
+    virtual Float fetch1D();
 
-    /// Retrieve the next two component values from the current sample
-    virtual Point2 next2D();
+    /// Compute the next two component values of the current sample
+    virtual Point2 fetch2D();
 
     /// Return a string description
     virtual std::string toString() const;
@@ -0,0 +1,665 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/render/scene.h>
+#include <mitsuba/render/vpl.h>
+#include <mitsuba/core/statistics.h>
+#include <mitsuba/core/timer.h>
+#include <mitsuba/core/qmc.h>
+#include <mitsuba/core/arena.h>
+
+MTS_NAMESPACE_BEGIN
+
+static StatsCounter avgCutSize("Lightcuts", "Average cut size", EAverage);
+static StatsCounter avgShadowRays("Lightcuts", "Average VPL evaluations per query", EAverage);
+
+/*!\plugin{lightcuts}{Lightcuts-style virtual point light integrator}
+ * \order{18}
+ * \parameters{
+ *     \parameter{maxDepth}{\Integer}{Specifies the longest path depth
+ *         in the generated output image (where \code{-1} corresponds to $\infty$).
+ *         A value of \code{2} will lead to direct-only illumination.
+ *         \default{\code{5}}
+ *     }
+ *     \parameter{vplCount}{\Integer}{Approximate number of virtual
+ *         point lights that should be generated \default{10000}
+ *     }
+ *     \parameter{relError}{\Float}{
+ *         Relative error threshold: a cluster of lights is refined until its
+ *         error bound drops below this fraction of the total estimate
+ *         \default{0.02}
+ *     }
+ *     \parameter{maxCutSize}{\Integer}{
+ *         Upper limit on the number of clusters used per shading point
+ *         \default{1000}
+ *     }
+ *     \parameter{clamping}{\Float}{
+ *         Minimum distance used in the geometric term, relative to the radius
+ *         of the scene's bounding sphere. This suppresses the bright blotches
+ *         near corners and creases that are typical for VPL methods.
+ *         \default{0.01}
+ *     }
+ *     \parameter{maxSpecularDepth}{\Integer}{
+ *         Number of specular (delta) bounces that are followed from
+ *         the camera before shading with the VPLs \default{8}
+ *     }
+ * }
+ *
+ * This integrator is a CPU-based alternative to the \pluginref{vpl} integrator
+ * that follows the Lightcuts method by Walter et al. \cite{Walter2005Lightcuts}.
+ * During a pre-process pass, direct and indirect illumination is converted
+ * into a set of virtual point lights (VPLs), which are then organized into
+ * binary light trees (one each for oriented, omnidirectional, and directional
+ * lights). Every inner node of a tree represents a cluster of lights by
+ * one of its members, whose contribution is scaled by the total intensity
+ * of the cluster.
+ *
+ * For each shading point, the integrator starts with the roots of the trees
+ * and repeatedly refines the cluster with the largest upper bound on its
+ * error until all bounds are below \code{relError} times the total estimate.
+ * The cost is thus roughly logarithmic in the number of VPLs, so that tens
+ * of thousands of them are affordable. Representatives are chosen randomly
+ * in proportion to intensity, which makes the estimate unbiased with
+ * respect to the (clamped) VPL solution.
+ *
+ * The error bounds are exact for diffuse materials. For glossy materials,
+ * the peak value of the BSDF is approximated by its value in the mirror
+ * direction, which works well in practice but is not strictly conservative.
+ * Like other VPL methods, the integrator is not suitable for scenes that are
+ * dominated by glossy interreflections. Network rendering is not supported.
+ */
+class LightcutsIntegrator : public SamplingIntegrator {
+public:
+    /// Light trees for the different kinds of VPLs
+    enum ETreeType {
+        EOrientedTree = 0,
+        EOmniTree,
+        EDirectionalTree,
+        ETreeCount
+    };
+
+    /// Node of a binary light tree
+    struct LightNode {
+        /// Bounding box of the VPL positions (or directions)
+        AABB bounds;
+        /// Normal cone of oriented lights
+        Vector axis;
+        Float angle;
+        /// Sum of the intensities of all VPLs in this cluster
+        Float intensity;
+        /// Index of the representative VPL
+        uint32_t rep;
+        /// Child nodes (-1 for leaves)
+        int32_t children[2];
+
+        inline bool isLeaf() const { return children[0] < 0; }
+    };
+
+    /// Entry of the cut through the light trees
+    struct CutEntry {
+        Float bound;
+        int tree;
+        int32_t node;
+        Spectrum estimate, repContribution;
+
+        inline bool operator<(const CutEntry &entry) const {
+            return bound < entry.bound;
+        }
+    };
+
+    LightcutsIntegrator(const Properties &props) : SamplingIntegrator(props) {
+        /* Max. depth (expressed as path length) */
+        m_maxDepth = props.getInteger("maxDepth", 5);
+        /* Approximate number of VPLs */
+        m_vplCount = props.getSize("vplCount", 10000);
+        /* Relative error threshold of the light cuts */
+        m_relError = props.getFloat("relError", 0.02f);
+        /* Upper limit on the number of clusters per shading point */
+        m_maxCutSize = props.getInteger("maxCutSize", 1000);
+        /* Relative clamping distance */
+        m_clamping = props.getFloat("clamping", 0.01f);
+        /* Number of specular bounces followed from the camera */
+        m_maxSpecularDepth = props.getInteger("maxSpecularDepth", 8);
+
+        for (int i=0; i<ETreeCount; ++i)
+            m_roots[i] = -1;
+
+        if (m_relError <= 0)
+            Log(EError, "The 'relError' parameter must be positive!");
+        if (m_maxCutSize < 1)
+            Log(EError, "The 'maxCutSize' parameter must be at least 1!");
+    }
+
+    LightcutsIntegrator(Stream *stream, InstanceManager *manager)
+     : SamplingIntegrator(stream, manager) {
+        Log(EError, "Network rendering is not supported by the lightcuts integrator!");
+    }
+
+    void serialize(Stream *stream, InstanceManager *manager) const {
+        Log(EError, "Network rendering is not supported by the lightcuts integrator!");
+    }
+
+    bool preprocess(const Scene *scene, RenderQueue *queue, const RenderJob *job,
+            int sceneResID, int sensorResID, int samplerResID) {
+        SamplingIntegrator::preprocess(scene, queue, job, sceneResID, sensorResID, samplerResID);
+
+        ref<Timer> timer = new Timer();
+        ref<Random> random = new Random();
+
+        std::deque<VPL> vpls;
+        size_t offset = generateVPLs(scene, random, 0, m_vplCount, m_maxDepth, true, vpls);
+        Float normalization = offset > 0 ? (Float) 1 / offset : (Float) 0;
+
+        m_vpls.clear();
+        m_intensity.clear();
+        m_vpls.reserve(vpls.size());
+        m_intensity.reserve(vpls.size());
+
+        std::vector<uint32_t> indices[ETreeCount];
+        for (size_t i=0; i<vpls.size(); ++i) {
+            VPL &vpl = vpls[i];
+            vpl.P *= normalization;
+
+            int tree;
+            Float intensity = vpl.P.getLuminance() * emissionBound(vpl, tree);
+            if (!(intensity > 0))
+                continue;
+
+            indices[tree].push_back((uint32_t) m_vpls.size());
+            m_vpls.push_back(vpl);
+            m_intensity.push_back(intensity);
+        }
+
+        BSphere bsphere = scene->getKDTree()->getAABB().getBSphere();
+        m_minDist = m_clamping * bsphere.radius;
+
+        for (int i=0; i<ETreeCount; ++i) {
+            m_nodes[i].clear();
+            m_roots[i] = -1;
+            if (indices[i].empty())
+                continue;
+            m_nodes[i].reserve(2 * indices[i].size());
+            m_roots[i] = buildTree((ETreeType) i, random, bsphere.radius,
+                &indices[i][0], &indices[i][0] + indices[i].size());
+        }
+
+        Log(EInfo, "Generated %i virtual point lights and built light trees "
+            "(%i oriented, %i omnidirectional, %i directional) in %i ms",
+            (int) m_vpls.size(), (int) indices[EOrientedTree].size(),
+            (int) indices[EOmniTree].size(), (int) indices[EDirectionalTree].size(),
+            timer->getMilliseconds());
+
+        return true;
+    }
+
+    Spectrum Li(const RayDifferential &r, RadianceQueryRecord &rRec) const {
+        const Scene *scene = rRec.scene;
+        Intersection &its = rRec.its;
+        RayDifferential ray(r);
+        Spectrum Li(0.0f), throughput(1.0f);
+
+        for (int depth = 0; ; ++depth) {
+            if (!rRec.rayIntersect(ray)) {
+                if (rRec.type & RadianceQueryRecord::EEmittedRadiance)
+                    Li += throughput * scene->evalEnvironment(ray);
+                break;
+            }
+
+            /* Emitters are only visible directly or via specular chains */
+            if (its.isEmitter() && (rRec.type & RadianceQueryRecord::EEmittedRadiance))
+                Li += throughput * its.Le(-ray.d);
+
+            if (its.hasSubsurface() && (rRec.type & RadianceQueryRecord::ESubsurfaceRadiance))
+                Li += throughput * its.LoSub(scene, rRec.sampler, -ray.d, rRec.depth);
+
+            const BSDF *bsdf = its.getBSDF(ray);
+
+            if (bsdf->hasComponent(BSDF::ESmooth) && (rRec.type &
+                    (RadianceQueryRecord::EDirectSurfaceRadiance |
+                     RadianceQueryRecord::EIndirectSurfaceRadiance)))
+                Li += throughput * evalLightcut(scene, its, bsdf);
+
+            if (depth >= m_maxSpecularDepth || !bsdf->hasComponent(BSDF::EDelta))
+                break;
+
+            /* Continue along a specular reflection or refraction */
+            BSDFSamplingRecord bRec(its, rRec.sampler, ERadiance);
+            bRec.typeMask = BSDF::EDelta;
+            Spectrum bsdfWeight = bsdf->sample(bRec, rRec.nextSample2D());
+            if (bsdfWeight.isZero())
+                break;
+
+            throughput *= bsdfWeight;
+            ray = RayDifferential(its.p, its.toWorld(bRec.wo), ray.time);
+            rRec.type = RadianceQueryRecord::ERadiance;
+        }
+
+        return Li;
+    }
+
+    std::string toString() const {
+        std::ostringstream oss;
+        oss << "LightcutsIntegrator[" << endl
+            << "  maxDepth = " << m_maxDepth << "," << endl
+            << "  vplCount = " << m_vplCount << "," << endl
+            << "  relError = " << m_relError << "," << endl
+            << "  maxCutSize = " << m_maxCutSize << "," << endl
+            << "  clamping = " << m_clamping << "," << endl
+            << "  maxSpecularDepth = " << m_maxSpecularDepth << endl
+            << "]";
+        return oss.str();
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    /**
+     * \brief Determine the tree of a VPL and an upper bound on its
+     * directional emission profile (without the cosine factor for
+     * oriented lights)
+     */
+    Float emissionBound(const VPL &vpl, int &tree) const {
+        if (vpl.type == EDirectionalEmitterVPL) {
+            tree = EDirectionalTree;
+            return 1.0f;
+        } else if (vpl.type == ESurfaceVPL) {
+            const BSDF *bsdf = vpl.its.getBSDF();
+            tree = bsdf->hasComponent(BSDF::ETransmission) ? EOmniTree : EOrientedTree;
+            Float bound = bsdf->getDiffuseReflectance(vpl.its).max() * INV_PI;
+
+            /* Glossy lobes are approximated by their value in the mirror direction */
+            Vector wo(-vpl.its.wi.x, -vpl.its.wi.y, vpl.its.wi.z);
+            Float cosTheta = std::abs(Frame::cosTheta(wo));
+            if (cosTheta > 0) {
+                BSDFSamplingRecord bRec(vpl.its, vpl.its.wi, wo, EImportance);
+                bound = std::max(bound, bsdf->eval(bRec).max() / cosTheta);
+            }
+            if (tree == EOmniTree) {
+                BSDFSamplingRecord bRec(vpl.its, vpl.its.wi, -vpl.its.wi, EImportance);
+                cosTheta = std::abs(Frame::cosTheta(vpl.its.wi));
+                if (cosTheta > 0)
+                    bound = std::max(bound, bsdf->eval(bRec).max() / cosTheta);
+            }
+            return bound;
+        } else {
+            /* Probe the emission profile of the emitter */
+            bool onSurface = vpl.emitter->getType() & Emitter::EOnSurface;
+            tree = onSurface ? EOrientedTree : EOmniTree;
+
+            PositionSamplingRecord pRec(vpl.its.time);
+            pRec.p = vpl.its.p;
+            pRec.n = vpl.its.shFrame.n;
+            pRec.measure = onSurface ? EArea : EDiscrete;
+            pRec.object = vpl.emitter;
+
+            Float bound = 0;
+            const int nProbes = 64;
+            for (int i=0; i<=nProbes; ++i) {
+                Vector d = i == 0 ? Vector(vpl.its.shFrame.n)
+                    : warp::squareToUniformSphere(sample02(i));
+                Float cosTheta = dot(d, pRec.n);
+                if (onSurface && cosTheta <= 0)
+                    continue;
+                Float value = vpl.emitter->evalDirection(
+                    DirectionSamplingRecord(d), pRec).max();
+                bound = std::max(bound, onSurface ? value / cosTheta : value);
+            }
+            return bound;
+        }
+    }
+
+    /// Recursively build a light tree over the given VPLs
+    int32_t buildTree(ETreeType type, Random *random, Float sceneRadius,
+            uint32_t *start, uint32_t *end) {
+        int32_t index = (int32_t) m_nodes[type].size();
+        m_nodes[type].push_back(LightNode());
+
+        if (end - start == 1) {
+            const VPL &vpl = m_vpls[*start];
+            LightNode &node = m_nodes[type][index];
+            Point p = type == EDirectionalTree
+                ? Point(-vpl.its.shFrame.n) : vpl.its.p;
+            node.bounds = AABB(p);
+            node.axis = vpl.its.shFrame.n;
+            node.angle = 0;
+            node.intensity = m_intensity[*start];
+            node.rep = *start;
+            node.children[0] = node.children[1] = -1;
+            return index;
+        }
+
+        /* Split along the largest dimension, where the normals of
+           oriented lights are included as three extra dimensions */
+        AABB posBounds, normalBounds;
+        for (uint32_t *it = start; it != end; ++it) {
+            const VPL &vpl = m_vpls[*it];
+            if (type == EDirectionalTree) {
+                posBounds.expandBy(Point(-vpl.its.shFrame.n));
+            } else {
+                posBounds.expandBy(vpl.its.p);
+                if (type == EOrientedTree)
+                    normalBounds.expandBy(Point(vpl.its.shFrame.n));
+            }
+        }
+
+        Float normalScale = 0.25f * sceneRadius;
+        int axis = posBounds.getLargestAxis();
+        Float extent = posBounds.getExtents()[axis];
+        bool splitNormals = false;
+        if (type == EOrientedTree) {
+            int normalAxis = normalBounds.getLargestAxis();
+            if (normalBounds.getExtents()[normalAxis] * normalScale > extent) {
+                axis = normalAxis;
+                splitNormals = true;
+            }
+        }
+
+        uint32_t *mid = start + (end - start) / 2;
+        std::nth_element(start, mid, end,
+            CoordinateOrdering(m_vpls, type, axis, splitNormals));
+
+        int32_t left = buildTree(type, random, sceneRadius, start, mid);
+        int32_t right = buildTree(type, random, sceneRadius, mid, end);
+
+        /* Note: 'm_nodes' may have been reallocated by the recursive calls */
+        const LightNode &c0 = m_nodes[type][left], &c1 = m_nodes[type][right];
+        LightNode &node = m_nodes[type][index];
+        node.bounds = c0.bounds;
+        node.bounds.expandBy(c1.bounds);
+        node.intensity = c0.intensity + c1.intensity;
+        node.rep = random->nextFloat() * node.intensity < c0.intensity ? c0.rep : c1.rep;
+        node.children[0] = left;
+        node.children[1] = right;
+        if (type == EOrientedTree)
+            mergeCones(c0.axis, c0.angle, c1.axis, c1.angle, node.axis, node.angle);
+        else {
+            node.axis = Vector(0.0f);
+            node.angle = M_PI;
+        }
+        return index;
+    }
+
+    /// Sorts VPLs by one coordinate of their position, normal or direction
+    struct CoordinateOrdering : public std::binary_function<uint32_t, uint32_t, bool> {
+        CoordinateOrdering(const std::vector<VPL> &vpls, ETreeType type,
+            int axis, bool normals) : vpls(vpls), type(type), axis(axis),
+            normals(normals) { }
+
+        inline Float coord(uint32_t i) const {
+            const VPL &vpl = vpls[i];
+            if (type == EDirectionalTree)
+                return -vpl.its.shFrame.n[axis];
+            else
+                return normals ? vpl.its.shFrame.n[axis] : vpl.its.p[axis];
+        }
+
+        inline bool operator()(uint32_t a, uint32_t b) const {
+            return coord(a) < coord(b);
+        }
+
+        const std::vector<VPL> &vpls;
+        ETreeType type;
+        int axis;
+        bool normals;
+    };
+
+    /// Compute a cone that contains two other cones
+    static void mergeCones(const Vector &a1, Float t1, const Vector &a2, Float t2,
+            Vector &axis, Float &angle) {
+        if (t1 < t2) {
+            mergeCones(a2, t2, a1, t1, axis, angle);
+            return;
+        }
+
+        Float d = math::safe_acos(dot(a1, a2));
+        if (std::min(d + t2, (Float) M_PI) <= t1) {
+            axis = a1;
+            angle = t1;
+            return;
+        }
+
+        angle = 0.5f * (t1 + d + t2);
+        if (angle >= M_PI) {
+            axis = a1;
+            angle = M_PI;
+            return;
+        }
+
+        /* Rotate 'a1' towards 'a2' */
+        Vector perp = a2 - a1 * dot(a1, a2);
+        Float length = perp.length();
+        if (length < 1e-6f) {
+            axis = a1;
+        } else {
+            Float rot = angle - t1, sinRot, cosRot;
+            math::sincos(rot, &sinRot, &cosRot);
+            axis = normalize(a1 * cosRot + perp * (sinRot / length));
+        }
+    }
+
+    /// Upper bound on the cosine of the angle between \c axis and a cone of directions
+    static inline Float cosineBound(const Vector &axis, const Vector &dir,
+            Float halfAngle, bool twoSided) {
+        Float angle = math::safe_acos(dot(axis, dir));
+        if (twoSided)
+            angle = std::min(angle, (Float) M_PI - angle);
+        angle = std::max((Float) 0, angle - halfAngle);
+        return angle >= 0.5f * M_PI ? (Float) 0 : std::cos(angle);
+    }
+
+    /// Upper bound on the contribution of a light cluster (excluding the material term)
+    Float clusterBound(int tree, const LightNode &node, const Intersection &its,
+            bool twoSided) const {
+        Point center = node.bounds.getCenter();
+        Float radius = (node.bounds.max - center).length();
+
+        if (tree == EDirectionalTree) {
+            /* The bounding box contains unit direction vectors */
+            Float length = Vector(center).length();
+            if (length <= radius)
+                return node.intensity;
+            Float halfAngle = std::asin(std::min((Float) 1, radius / length));
+            return node.intensity * cosineBound(its.shFrame.n,
+                Vector(center) / length, halfAngle, twoSided);
+        }
+
+        Vector d = center - its.p;
+        Float dist = d.length();
+        if (dist <= radius)
+            return std::numeric_limits<Float>::infinity();
+        d /= dist;
+
+        Float halfAngle = std::asin(radius / dist);
+        Float minDist = std::max(dist - radius, m_minDist);
+        Float bound = node.intensity / (minDist * minDist)
+            * cosineBound(its.shFrame.n, d, halfAngle, twoSided);
+
+        if (tree == EOrientedTree && node.angle < M_PI)
+            bound *= cosineBound(node.axis, -d, halfAngle + node.angle, false);
+
+        return bound;
+    }
+
+    /// Upper bound on the value of the BSDF at a shading point (without cosine)
+    Float materialBound(const Intersection &its, const BSDF *bsdf) const {
+        Float bound = bsdf->getDiffuseReflectance(its).max() * INV_PI;
+        Vector wo(-its.wi.x, -its.wi.y, its.wi.z);
+        Float cosTheta = std::abs(Frame::cosTheta(wo));
+        if (cosTheta > 0) {
+            BSDFSamplingRecord bRec(its, its.wi, wo);
+            bRec.typeMask = BSDF::ESmooth;
+            bound = std::max(bound, bsdf->eval(bRec).max() / cosTheta);
+        }
+        if (bsdf->hasComponent(BSDF::ETransmission) && cosTheta > 0) {
+            BSDFSamplingRecord bRec(its, its.wi, -its.wi);
+            bRec.typeMask = BSDF::ESmooth;
+            bound = std::max(bound, bsdf->eval(bRec).max() / cosTheta);
+        }
+        return bound;
+    }
+
+    /**
+     * \brief Combine the material and cluster bounds into a heap key
+     *
+     * A zero material bound times an unbounded cluster is NaN, which would
+     * break the heap ordering; such clusters are treated as unbounded.
+     */
+    static inline Float errorBound(Float matBound, Float lightBound) {
+        Float bound = matBound * lightBound;
+        return std::isnan(bound) ? std::numeric_limits<Float>::infinity() : bound;
+    }
+
+    /// Compute the exact contribution of a single VPL, including visibility
+    Spectrum evalVPL(const Scene *scene, const Intersection &its,
+            const BSDF *bsdf, const VPL &vpl) const {
+        if (vpl.type == EDirectionalEmitterVPL) {
+            Vector d = -vpl.its.shFrame.n;
+            BSDFSamplingRecord bRec(its, its.toLocal(d));
+            bRec.typeMask = BSDF::ESmooth;
+            Spectrum value = bsdf->eval(bRec);
+            if (value.isZero())
+                return Spectrum(0.0f);
+            Ray shadowRay(its.p, d, Epsilon,
+                std::numeric_limits<Float>::infinity(), its.time);
+            if (scene->rayIntersect(shadowRay))
+                return Spectrum(0.0f);
+            return vpl.P * value;
+        }
+
+        Vector d = vpl.its.p - its.p;
+        Float distSqr = d.lengthSquared();
+        if (distSqr == 0)
+            return Spectrum(0.0f);
+        Float dist = std::sqrt(distSqr);
+        d /= dist;
+
+        BSDFSamplingRecord bRec(its, its.toLocal(d));
+        bRec.typeMask = BSDF::ESmooth;
+        Spectrum value = bsdf->eval(bRec);
+        if (value.isZero())
+            return Spectrum(0.0f);
+
+        if (vpl.type == ESurfaceVPL) {
+            BSDFSamplingRecord bRec2(vpl.its, vpl.its.wi,
+                vpl.its.toLocal(-d), EImportance);
+            value *= vpl.its.getBSDF()->eval(bRec2);
+        } else {
+            PositionSamplingRecord pRec(vpl.its.time);
+            pRec.p = vpl.its.p;
+            pRec.n = vpl.its.shFrame.n;
+            pRec.measure = (vpl.emitter->getType() & Emitter::EOnSurface) ? EArea : EDiscrete;
+            pRec.object = vpl.emitter;
+            value *= vpl.emitter->evalDirection(DirectionSamplingRecord(-d), pRec);
+        }
+        if (value.isZero())
+            return Spectrum(0.0f);
+
+        Ray shadowRay(its.p, d, Epsilon, dist * (1-ShadowEpsilon), its.time);
+        if (scene->rayIntersect(shadowRay))
+            return Spectrum(0.0f);
+
+        return vpl.P * value / std::max(distSqr, m_minDist * m_minDist);
+    }
+
+    /// Select a cut through the light trees and return the resulting estimate
+    Spectrum evalLightcut(const Scene *scene, const Intersection &its, const BSDF *bsdf) const {
+        /* Max-heap of refinable cut entries. Every refinement step removes
+           one entry and adds at most two, which bounds its size */
+        MemoryArena &arena = MemoryArena::getThreadArena();
+        MemoryArena::Scope scope(arena);
+        CutEntry *cut = arena.alloc<CutEntry>(ETreeCount + m_maxCutSize);
+        size_t cutEntries = 0;
+
+        Spectrum total(0.0f);
+        bool twoSided = bsdf->hasComponent(BSDF::ETransmission);
+        Float matBound = materialBound(its, bsdf);
+        int cutSize = 0, evaluations = 0;
+
+        for (int i=0; i<ETreeCount; ++i) {
+            if (m_roots[i] < 0)
+                continue;
+            const LightNode &node = m_nodes[i][m_roots[i]];
+            CutEntry entry;
+            entry.tree = i;
+            entry.node = m_roots[i];
+            entry.repContribution = evalVPL(scene, its, bsdf, m_vpls[node.rep]);
+            entry.estimate = entry.repContribution * (node.intensity / m_intensity[node.rep]);
+            entry.bound = node.isLeaf() ? 0 :
+                errorBound(matBound, clusterBound(i, node, its, twoSided));
+            total += entry.estimate;
+            cut[cutEntries++] = entry;
+            std::push_heap(cut, cut + cutEntries);
+            ++cutSize; ++evaluations;
+        }
+
+        while (cutEntries > 0 && cutSize < m_maxCutSize) {
+            if (cut[0].bound <= m_relError * total.getLuminance())
+                break;
+
+            std::pop_heap(cut, cut + cutEntries);
+            CutEntry entry = cut[--cutEntries];
+            total -= entry.estimate;
+
+            const std::vector<LightNode> &nodes = m_nodes[entry.tree];
+            const LightNode &node = nodes[entry.node];
+            for (int i=0; i<2; ++i) {
+                const LightNode &child = nodes[node.children[i]];
+                CutEntry childEntry;
+                childEntry.tree = entry.tree;
+                childEntry.node = node.children[i];
+                if (child.rep == node.rep) {
+                    childEntry.repContribution = entry.repContribution;
+                } else {
+                    childEntry.repContribution = evalVPL(scene, its, bsdf, m_vpls[child.rep]);
+                    ++evaluations;
+                }
+                childEntry.estimate = childEntry.repContribution
+                    * (child.intensity / m_intensity[child.rep]);
+                total += childEntry.estimate;
+
+                if (!child.isLeaf()) {
+                    childEntry.bound = errorBound(matBound,
+                        clusterBound(entry.tree, child, its, twoSided));
+                    cut[cutEntries++] = childEntry;
+                    std::push_heap(cut, cut + cutEntries);
+                }
+            }
+            ++cutSize;
+        }
+
+        avgCutSize.incrementBase();
+        avgCutSize += cutSize;
+        avgShadowRays.incrementBase();
+        avgShadowRays += evaluations;
+
+        total.clampNegative();
+        return total;
+    }
+
+private:
+    std::vector<VPL> m_vpls;
+    std::vector<Float> m_intensity;
+    std::vector<LightNode> m_nodes[ETreeCount];
+    int32_t m_roots[ETreeCount];
+    size_t m_vplCount;
+    int m_maxDepth, m_maxCutSize, m_maxSpecularDepth;
+    Float m_relError, m_clamping, m_minDist;
+};
+
+MTS_IMPLEMENT_CLASS_S(LightcutsIntegrator, false, SamplingIntegrator)
+MTS_EXPORT_PLUGIN(LightcutsIntegrator, "Lightcuts-style VPL integrator");
+MTS_NAMESPACE_END
@@ -77,12 +77,12 @@ void ReplayableSampler::setSampleIndex(size_t sampleIndex) {
     }
 }
 
-Float ReplayableSampler::next1D() {
+Float ReplayableSampler::fetch1D() {
     ++m_sampleIndex;
     return m_random->nextFloat();
 }
 
-Point2 ReplayableSampler::next2D() {
+Point2 ReplayableSampler::fetch2D() {
     /// Enforce a specific order of evaluation
     Float value1 = m_random->nextFloat();
     Float value2 = m_random->nextFloat();
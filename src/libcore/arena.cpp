@@ -0,0 +1,97 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <mitsuba/core/arena.h>
+#include <mitsuba/core/tls.h>
+
+MTS_NAMESPACE_BEGIN
+
+MemoryArena::MemoryArena(size_t blockSize)
+    : m_block(0), m_offset(0), m_blockSize(blockSize) { }
+
+MemoryArena::~MemoryArena() {
+    for (size_t i=0; i<m_blocks.size(); ++i)
+        freeAligned(m_blocks[i].data);
+}
+
+void MemoryArena::nextBlock(size_t size) {
+    /* All blocks after the current one are unused */
+    size_t index = m_block < m_blocks.size() ? m_block + 1 : m_block;
+
+    for (size_t i=index; i<m_blocks.size(); ++i) {
+        if (m_blocks[i].size >= size) {
+            std::swap(m_blocks[i], m_blocks[index]);
+            m_block = index;
+            m_offset = 0;
+            return;
+        }
+    }
+
+    Block block;
+    block.size = std::max(size, m_blockSize);
+    block.data = static_cast<uint8_t *>(allocAligned(block.size));
+    m_blocks.insert(m_blocks.begin() + index, block);
+    m_block = index;
+    m_offset = 0;
+}
+
+void MemoryArena::reset() {
+    m_block = m_offset = 0;
+    if (m_blocks.size() <= 1)
+        return;
+
+    /* Merge the blocks so that the next round fits into a single one */
+    Block block;
+    block.size = getCapacity();
+    for (size_t i=0; i<m_blocks.size(); ++i)
+        freeAligned(m_blocks[i].data);
+    block.data = static_cast<uint8_t *>(allocAligned(block.size));
+    m_blocks.clear();
+    m_blocks.push_back(block);
+}
+
+size_t MemoryArena::getUsedMemory() const {
+    size_t result = m_offset;
+    for (size_t i=0; i<std::min(m_block, m_blocks.size()); ++i)
+        result += m_blocks[i].size;
+    return result;
+}
+
+size_t MemoryArena::getCapacity() const {
+    size_t result = 0;
+    for (size_t i=0; i<m_blocks.size(); ++i)
+        result += m_blocks[i].size;
+    return result;
+}
+
+MemoryArena &MemoryArena::getThreadArena() {
+    /* Constructed upon first use, i.e. after the TLS infrastructure */
+    static PrimitiveThreadLocal<MemoryArena> arenas;
+    return arenas.get();
+}
+
+std::string MemoryArena::toString() const {
+    std::ostringstream oss;
+    oss << "MemoryArena[used=" << memString(getUsedMemory())
+        << ", capacity=" << memString(getCapacity())
+        << ", blocks=" << m_blocks.size() << "]";
+    return oss.str();
+}
+
+MTS_NAMESPACE_END
@@ -179,13 +179,17 @@ PluginManager::~PluginManager() {
 
 ConfigurableObject *PluginManager::createObject(const Class *classType,
     const Properties &props) {
-    ConfigurableObject *object;
+    Plugin *plugin;
 
     {
         LockGuard lock(m_mutex);
         ensurePluginLoaded(props.getPluginName());
-        object = m_plugins[props.getPluginName()]->createInstance(props);
+        plugin = m_plugins[props.getPluginName()];
     }
+
+    /* Plugins are never unloaded while the plugin manager exists, hence the
+       (possibly expensive) constructor can run without holding the lock */
+    ConfigurableObject *object = plugin->createInstance(props);
     if (!object->getClass()->derivesFrom(classType))
         Log(EError, "Type mismatch when loading plugin \"%s\": Expected "
         "an instance of \"%s\"", props.getPluginName().c_str(), classType->getName().c_str());
@@ -196,13 +200,15 @@ ConfigurableObject *PluginManager::createObject(const Class *classType,
 }
 
 ConfigurableObject *PluginManager::createObject(const Properties &props) {
-    ConfigurableObject *object;
+    Plugin *plugin;
 
     {
         LockGuard lock(m_mutex);
         ensurePluginLoaded(props.getPluginName());
-        object = m_plugins[props.getPluginName()]->createInstance(props);
+        plugin = m_plugins[props.getPluginName()];
     }
+
+    ConfigurableObject *object = plugin->createInstance(props);
     if (object->getClass()->isAbstract())
         Log(EError, "Error when loading plugin \"%s\": Identifies itself as an abstract class",
         props.getPluginName().c_str());
@@ -199,6 +199,28 @@ namespace {
         std::ostringstream &oss;
         bool quote;
     };
+
+    class SerializeVisitor : public boost::static_visitor<void> {
+    public:
+        SerializeVisitor(Stream *stream, const std::string &name)
+            : stream(stream), name(name) { }
+
+        void operator()(const bool &v) const              { stream->writeBool(v); }
+        void operator()(const int64_t &v) const           { stream->writeLong(v); }
+        void operator()(const Float &v) const             { stream->writeFloat(v); }
+        void operator()(const Point &v) const             { v.serialize(stream); }
+        void operator()(const Vector &v) const            { v.serialize(stream); }
+        void operator()(const Transform &v) const         { v.serialize(stream); }
+        void operator()(const AnimatedTransform *v) const { v->serialize(stream); }
+        void operator()(const Spectrum &v) const          { v.serialize(stream); }
+        void operator()(const std::string &v) const       { stream->writeString(v); }
+        void operator()(const Properties::Data &v) const  {
+            SLog(EError, "Property \"%s\" holds arbitrary data and cannot be serialized!", name.c_str());
+        }
+    private:
+        Stream *stream;
+        const std::string &name;
+    };
 }
 
 Properties::Properties()
@@ -223,6 +245,37 @@ Properties::Properties(const Properties &props)
     }
 }
 
+Properties::Properties(Stream *stream) {
+    m_elements = new std::map<std::string, PropertyElement>();
+    m_pluginName = stream->readString();
+    m_id = stream->readString();
+
+    size_t count = stream->readSize();
+    for (size_t i=0; i<count; ++i) {
+        std::string name = stream->readString();
+        EPropertyType type = (EPropertyType) stream->readUChar();
+
+        switch (type) {
+            case EBoolean: setBoolean(name, stream->readBool()); break;
+            case EInteger: setLong(name, stream->readLong()); break;
+            case EFloat: setFloat(name, stream->readFloat()); break;
+            case EPoint: setPoint(name, Point(stream)); break;
+            case EVector: setVector(name, Vector(stream)); break;
+            case ETransform: setTransform(name, Transform(stream)); break;
+            case EAnimatedTransform: {
+                    ref<AnimatedTransform> trafo = new AnimatedTransform(stream);
+                    setAnimatedTransform(name, trafo);
+                }
+                break;
+            case ESpectrum: setSpectrum(name, Spectrum(stream)); break;
+            case EString: setString(name, stream->readString()); break;
+            default:
+                SLog(EError, "Properties: encountered an unknown property type "
+                    "(%i) while unserializing \"%s\"!", (int) type, name.c_str());
+        }
+    }
+}
+
 Properties::~Properties() {
     for (std::map<std::string, PropertyElement>::iterator it = m_elements->begin();
             it != m_elements->end(); ++it) {
@@ -330,6 +383,20 @@ std::string Properties::toString() const {
     return oss.str();
 }
 
+void Properties::serialize(Stream *stream) const {
+    stream->writeString(m_pluginName);
+    stream->writeString(m_id);
+    stream->writeSize(m_elements->size());
+
+    for (std::map<std::string, PropertyElement>::const_iterator it = m_elements->begin();
+            it != m_elements->end(); ++it) {
+        const ElementData &data = (*it).second.data;
+        stream->writeString((*it).first);
+        stream->writeUChar((uint8_t) boost::apply_visitor(TypeVisitor(), data));
+        boost::apply_visitor(SerializeVisitor(stream, (*it).first), data);
+    }
+}
+
 void Properties::markQueried(const std::string &name) const {
     std::map<std::string, PropertyElement>::const_iterator it = m_elements->find(name);
     if (it == m_elements->end())
@@ -364,8 +431,11 @@ bool Properties::operator==(const Properties &p) const {
 
     std::map<std::string, PropertyElement>::const_iterator it = m_elements->begin();
     for (; it != m_elements->end(); ++it) {
+        std::map<std::string, PropertyElement>::const_iterator it2 = p.m_elements->find(it->first);
+        if (it2 == p.m_elements->end())
+            return false;
         const PropertyElement &first = it->second;
-        const PropertyElement &second = (*p.m_elements)[it->first];
+        const PropertyElement &second = it2->second;
 
         if (!boost::apply_visitor(EqualityVisitor(&first.data), second.data))
             return false;
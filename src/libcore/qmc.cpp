@@ -2230,4 +2230,99 @@ Float scrambledRadicalInverseFast(uint16_t baseIndex, uint64_t index, uint16_t *
     return std::min(inverse, ONE_MINUS_EPS);
 }
 
+void radicalInverseArray(uint16_t baseIndex, uint64_t offset, uint64_t stride,
+        size_t count, Float *out, const uint16_t *perm) {
+    if (baseIndex >= primeTableSize)
+        SLog(EError, "radicalInverseArray(): base index %i is out of range!", baseIndex);
+    if (count == 0)
+        return;
+
+    const uint32_t base = (uint32_t) primeTable[baseIndex];
+    const Float radical = (Float) 1 / (Float) base;
+    const Float tail = perm ? radical * perm[0] / (1 - radical) : (Float) 0;
+
+    /* Use an identity permutation to avoid branches below */
+    std::vector<uint16_t> identity;
+    if (!perm) {
+        identity.resize(base);
+        for (uint32_t i=0; i<base; ++i)
+            identity[i] = (uint16_t) i;
+    }
+    const uint16_t *p = perm ? perm : &identity[0];
+
+    /* Base-b digits of the current index and of the stride (least
+       significant digit first), and the factors used by RINV() */
+    uint32_t digits[65], strideDigits[65];
+    uint64_t powers[64];
+    Float factors[65];
+    int nDigits = 0, nStrideDigits = 0, firstStrideDigit = 0;
+
+    memset(digits, 0, sizeof(digits));
+    memset(strideDigits, 0, sizeof(strideDigits));
+    for (uint64_t i = offset; i; i /= base)
+        digits[nDigits++] = (uint32_t) (i % base);
+    for (uint64_t i = stride; i; i /= base)
+        strideDigits[nStrideDigits++] = (uint32_t) (i % base);
+    while (firstStrideDigit < nStrideDigits && strideDigits[firstStrideDigit] == 0)
+        ++firstStrideDigit;
+
+    powers[0] = 1; factors[0] = 1.0f;
+    for (int k=1; k<64; ++k)
+        powers[k] = powers[k-1] * base;
+    for (int k=1; k<=64; ++k)
+        factors[k] = factors[k-1] * radical;
+
+    /* Mirrored (and permuted) integer value of the current index */
+    uint64_t value = 0;
+    for (int k=0; k<nDigits; ++k)
+        value = value * base + p[digits[k]];
+    Float factor = factors[nDigits];
+
+    for (size_t i=0; ; ) {
+        /* Same arithmetic as in radicalInverseFast() and
+           scrambledRadicalInverseFast(), hence identical results */
+        Float inverse = perm ? factor * ((Float) value + tail)
+            : (Float) value * factor;
+        out[i] = std::min(inverse, ONE_MINUS_EPS);
+
+        if (++i == count)
+            break;
+
+        /* Add the stride digit by digit and update the mirrored value
+           for each digit that changed. Only few digits are affected on
+           average, hence this is cheaper than recomputing the value
+           using one 64-bit division per digit. */
+        uint32_t carry = 0;
+        int k = firstStrideDigit;
+        const uint64_t *power = powers + nDigits - 1 - k;
+        for (; k < nDigits; ++k, --power) {
+            uint32_t oldDigit = digits[k],
+                     sum = oldDigit + carry + strideDigits[k];
+            carry = sum >= base;
+            uint32_t newDigit = carry ? sum - base : sum;
+            digits[k] = newDigit;
+            value += (uint64_t) ((int64_t) p[newDigit] - (int64_t) p[oldDigit]) * *power;
+            if (k + 1 >= nStrideDigits && !carry)
+                break;
+        }
+
+        if (k >= nDigits && (k < nStrideDigits || carry)) {
+            /* The index gained digits -- add the remaining ones
+               and recompute the mirrored value from scratch */
+            for (; (k < nStrideDigits || carry) && k < 64; ++k) {
+                uint32_t sum = digits[k] + carry + strideDigits[k];
+                carry = sum >= base;
+                digits[k] = carry ? sum - base : sum;
+            }
+            nDigits = 64;
+            while (nDigits > 0 && digits[nDigits-1] == 0)
+                --nDigits;
+            value = 0;
+            for (int j=0; j<nDigits; ++j)
+                value = value * base + p[digits[j]];
+            factor = factors[nDigits];
+        }
+    }
+}
+
 MTS_NAMESPACE_END
@@ -50,8 +50,16 @@ void ReconstructionFilter::configure() {
     m_borderSize = (int) std::ceil(m_radius - 0.5f);
     sum *= 2 * m_radius / MTS_FILTER_RESOLUTION;
     Float normalization = 1.0f / sum;
-    for (size_t i=0; i<MTS_FILTER_RESOLUTION; ++i)
+    m_box = true;
+    for (size_t i=0; i<MTS_FILTER_RESOLUTION; ++i) {
         m_values[i] *= normalization;
+        m_box &= m_values[i] == m_values[0];
+    }
+
+    /* Single-pixel box filters are splatted without a block border (the
+       radius includes a small epsilon, which would otherwise require one) */
+    if (isSinglePixel())
+        m_borderSize = 0;
 }
 
 std::ostream &operator<<(std::ostream &os, const ReconstructionFilter::EBoundaryCondition &value) {
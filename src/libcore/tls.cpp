@@ -18,16 +18,13 @@
 
 #include <mitsuba/core/tls.h>
 
+#include <mitsuba/core/atomic.h>
+
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/unordered_set.hpp>
-
-#include <boost/scoped_ptr.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/member.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/sequenced_index.hpp>
+#include <algorithm>
 
 #if defined(__OSX__)
 # include <pthread.h>
@@ -35,8 +32,6 @@
 
 MTS_NAMESPACE_BEGIN
 
-namespace mi = boost::multi_index;
-
 /* The native TLS classes on Linux/MacOS/Windows only support a limited number
    of dynamically allocated entries (usually 1024 or 1088). Furthermore, they
    do not provide appropriate cleanup semantics when the TLS object or one of
@@ -44,50 +39,51 @@ namespace mi = boost::multi_index;
    such limits (caching in various subsystems of Mitsuba may create a huge amount,
    so this is a big deal) as well as nice cleanup semantics. The implementation
    is designed to make the \c get() operation as fast as as possible at the cost
-   of more involved locking when creating or destroying threads and TLS objects */
+   of more involved locking when creating or destroying threads and TLS objects.
+
+   Every TLS object is assigned a slot index, and every thread owns an array of
+   entries that is indexed by slot. Once an entry exists, \c get() therefore
+   only consists of a native TLS access and an array lookup -- it neither locks
+   nor hashes. Only the owning thread ever resizes its array, while other threads
+   merely clear entries (under the per-thread lock) when a TLS object dies. Slots
+   of destroyed TLS objects are recycled, so the arrays stay as small as the
+   maximum number of TLS objects that were simultaneously alive. */
 namespace detail {
 
 /// A single TLS entry + cleanup hook
 struct TLSEntry {
     void *data;
     void (*destructFunctor)(void *);
+    /// Creation order (used to destroy entries in reverse order)
+    uint64_t serial;
 
-    inline TLSEntry() : data(NULL), destructFunctor(NULL) { }
+    inline TLSEntry() : data(NULL), destructFunctor(NULL), serial(0) { }
 };
 
-/// boost multi-index element to act as replacement of map<Key,T>
-template<typename T1, typename T2>
-struct mutable_pair {
-    mutable_pair(const T1 &f, const T2 &s) : first(f), second(s) { }
+/// Per-thread TLS entry array, indexed by the slot of the TLS object
+struct PerThreadData {
+    std::vector<TLSEntry> entries;
+    uint64_t serial;
+    boost::recursive_mutex mutex;
 
-    T1 first;
-    mutable T2 second;
+    inline PerThreadData() : serial(0) { }
 };
 
-/// Per-thread TLS entry map
-struct PerThreadData {
-    typedef mutable_pair<void *, TLSEntry> MapData;
-    typedef mi::member<MapData, void *, &MapData::first> key_member;
-    struct seq_tag {};
-    struct key_tag {};
-
-    typedef mi::multi_index_container<MapData,
-        mi::indexed_by<
-            mi::hashed_unique<mi::tag<key_tag>, key_member>,
-            mi::sequenced<mi::tag<seq_tag> >
-        >
-    > Map;
-    typedef mi::index<Map, key_tag>::type::iterator         key_iterator;
-    typedef mi::index<Map, seq_tag>::type::reverse_iterator reverse_iterator;
-
-    Map map;
-    boost::recursive_mutex mutex;
+/// Sorts TLS entries by decreasing creation order
+struct ReverseCreationOrder {
+    inline bool operator()(const TLSEntry &a, const TLSEntry &b) const {
+        return a.serial > b.serial;
+    }
 };
 
 /// List of all PerThreadData data structures (one for each thread)
 boost::unordered_set<PerThreadData *> ptdGlobal;
-/// Lock to protect ptdGlobal
+/// Lock to protect ptdGlobal and freeSlots
 boost::mutex ptdGlobalLock;
+/// Slots of destroyed TLS objects that can be reused
+std::vector<uint32_t> freeSlots;
+/// Number of slots that have been handed out so far
+volatile int32_t slotCount = 0;
 
 #if defined(__WINDOWS__)
 __declspec(thread) PerThreadData *ptdLocal = NULL;
@@ -97,13 +93,35 @@ __thread PerThreadData *ptdLocal = NULL;
 pthread_key_t ptdLocal;
 #endif
 
+/// Return the TLS data structures of the current thread
+static inline PerThreadData *getPerThreadData() {
+#if defined(__OSX__)
+    return (PerThreadData *) pthread_getspecific(ptdLocal);
+#else
+    return ptdLocal;
+#endif
+}
+
 struct ThreadLocalBase::ThreadLocalPrivate {
     ConstructFunctor constructFunctor;
     DestructFunctor destructFunctor;
+    uint32_t slot;
 
     ThreadLocalPrivate(const ConstructFunctor &constructFunctor,
             const DestructFunctor &destructFunctor) : constructFunctor(constructFunctor),
-            destructFunctor(destructFunctor) { }
+            destructFunctor(destructFunctor) {
+        /* Recycle the slot of a destroyed TLS object if possible;
+           otherwise, atomically claim a new one */
+        {
+            boost::lock_guard<boost::mutex> guard(ptdGlobalLock);
+            if (!freeSlots.empty()) {
+                slot = freeSlots.back();
+                freeSlots.pop_back();
+                return;
+            }
+        }
+        slot = (uint32_t) (atomicAdd(&slotCount, 1) - 1);
+    }
 
     ~ThreadLocalPrivate() {
         /* The TLS object was destroyed. Walk through all threads
@@ -115,12 +133,10 @@ struct ThreadLocalBase::ThreadLocalPrivate {
             PerThreadData *ptd = *it;
             boost::unique_lock<boost::recursive_mutex> lock(ptd->mutex);
 
-            PerThreadData::Map::iterator it2 = ptd->map.find(this);
             TLSEntry entry;
-
-            if (it2 != ptd->map.end()) {
-                entry = it2->second;
-                ptd->map.erase(it2);
+            if (slot < ptd->entries.size()) {
+                entry = ptd->entries[slot];
+                ptd->entries[slot] = TLSEntry();
             }
 
             lock.unlock();
@@ -128,37 +144,46 @@ struct ThreadLocalBase::ThreadLocalPrivate {
             if (entry.data)
                 destructFunctor(entry.data);
         }
+
+        /* All entries referring to this slot are now cleared */
+        freeSlots.push_back(slot);
     }
 
     /// Look up a TLS entry. The goal is to make this operation very fast!
-    std::pair<void *, bool> get() {
-        bool existed = true;
-        void *data;
+    inline std::pair<void *, bool> get() {
+        PerThreadData *ptd = getPerThreadData();
+
+        /* Fast path: the entry exists. Only the current thread resizes
+           its array, hence no lock is needed */
+        if (EXPECT_TAKEN(ptd != NULL && slot < ptd->entries.size())) {
+            void *data = ptd->entries[slot].data;
+            if (EXPECT_TAKEN(data != NULL))
+                return std::make_pair(data, true);
+        }
 
-#if defined(__OSX__)
-        PerThreadData *ptd = (PerThreadData *) pthread_getspecific(ptdLocal);
-#else
-        PerThreadData *ptd = ptdLocal;
-#endif
+        return getSlow(ptd);
+    }
+
+    /// This is the first access from this thread
+    std::pair<void *, bool> getSlow(PerThreadData *ptd) {
         if (EXPECT_NOT_TAKEN(!ptd))
             throw std::runtime_error("Internal error: call to ThreadLocalPrivate::get() "
                 " precedes the construction of thread-specific data structures!");
 
         /* This is an uncontended thread-local lock (i.e. not to worry) */
         boost::lock_guard<boost::recursive_mutex> guard(ptd->mutex);
-        PerThreadData::key_iterator it = ptd->map.find(this);
-        if (EXPECT_TAKEN(it != ptd->map.end())) {
-            data = it->second.data;
-        } else {
-            /* This is the first access from this thread */
-            TLSEntry entry;
-            entry.data = data = constructFunctor();
-            entry.destructFunctor = destructFunctor;
-            ptd->map.insert(PerThreadData::MapData(this, entry));
-            existed = false;
-        }
 
-        return std::make_pair(data, existed);
+        /* The construct functor may itself access other TLS objects and
+           resize the array, hence the array is only touched afterwards */
+        TLSEntry entry;
+        entry.data = constructFunctor();
+        entry.destructFunctor = destructFunctor;
+        entry.serial = ++ptd->serial;
+        if (slot >= ptd->entries.size())
+            ptd->entries.resize(std::max((size_t) slot + 1, 2 * ptd->entries.size()));
+        ptd->entries[slot] = entry;
+
+        return std::make_pair(entry.data, false);
     }
 };
 
@@ -222,21 +247,21 @@ void initializeLocalTLS() {
 /// A thread has died -- destroy any remaining TLS entries associated with it
 void destroyLocalTLS() {
     boost::lock_guard<boost::mutex> guard(ptdGlobalLock);
-
-#if defined(__OSX__)
-    PerThreadData *ptd = (PerThreadData *) pthread_getspecific(ptdLocal);
-#else
-    PerThreadData *ptd = ptdLocal;
-#endif
+    PerThreadData *ptd = getPerThreadData();
 
     boost::unique_lock<boost::recursive_mutex> lock(ptd->mutex);
 
     // Destroy the data in reverse order of creation
-    for (PerThreadData::reverse_iterator it = mi::get<PerThreadData::seq_tag>(ptd->map).rbegin();
-        it != mi::get<PerThreadData::seq_tag>(ptd->map).rend(); ++it) {
-        TLSEntry &entry = it->second;
-        entry.destructFunctor(entry.data);
+    std::vector<TLSEntry> entries;
+    entries.reserve(ptd->entries.size());
+    for (size_t i=0; i<ptd->entries.size(); ++i) {
+        if (ptd->entries[i].data)
+            entries.push_back(ptd->entries[i]);
     }
+    std::sort(entries.begin(), entries.end(), ReverseCreationOrder());
+
+    for (size_t i=0; i<entries.size(); ++i)
+        entries[i].destructFunctor(entries[i].data);
 
     lock.unlock();
     ptdGlobal.erase(ptd);
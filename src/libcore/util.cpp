@@ -124,7 +124,27 @@ std::string indent(const std::string &string, int amount) {
     return oss.str();
 }
 
+#if defined(MTS_DEBUG_ALLOCATIONS)
+/// Number of heap allocations made by the current thread
+#if defined(__WINDOWS__)
+static __declspec(thread) uint64_t __allocation_count = 0;
+#else
+static __thread uint64_t __allocation_count = 0;
+#endif
+#endif
+
+uint64_t getAllocationCount() {
+#if defined(MTS_DEBUG_ALLOCATIONS)
+    return __allocation_count;
+#else
+    return 0;
+#endif
+}
+
 void * __restrict allocAligned(size_t size) {
+#if defined(MTS_DEBUG_ALLOCATIONS)
+    ++__allocation_count;
+#endif
 #if defined(__WINDOWS__)
     return _aligned_malloc(size, L1_CACHE_LINE_SIZE);
 #elif defined(__OSX__)
@@ -901,3 +921,33 @@ std::string memString(size_t size, bool precise) {
 }
 
 MTS_NAMESPACE_END
+
+#if defined(MTS_DEBUG_ALLOCATIONS) && !defined(__WINDOWS__)
+/* Count every allocation made through operator new. On Linux and OS X,
+   these replacements take effect in the entire process */
+MTS_EXPORT void *operator new(size_t size) {
+    ++mitsuba::__allocation_count;
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+MTS_EXPORT void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+MTS_EXPORT void *operator new(size_t size, const std::nothrow_t &) throw() {
+    ++mitsuba::__allocation_count;
+    return malloc(size == 0 ? 1 : size);
+}
+
+MTS_EXPORT void *operator new[](size_t size, const std::nothrow_t &tag) throw() {
+    return operator new(size, tag);
+}
+
+MTS_EXPORT void operator delete(void *ptr) throw() { free(ptr); }
+MTS_EXPORT void operator delete[](void *ptr) throw() { free(ptr); }
+MTS_EXPORT void operator delete(void *ptr, const std::nothrow_t &) throw() { free(ptr); }
+MTS_EXPORT void operator delete[](void *ptr, const std::nothrow_t &) throw() { free(ptr); }
+#endif
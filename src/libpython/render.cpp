@@ -1,6 +1,7 @@
 #include "base.h"
 #include <mitsuba/render/scene.h>
 #include <mitsuba/render/scenehandler.h>
+#include <mitsuba/render/scenetemplate.h>
 #include <mitsuba/render/renderqueue.h>
 #include <mitsuba/render/renderjob.h>
 #include <mitsuba/render/noise.h>
@@ -137,6 +138,17 @@ static ref<Scene> loadScene2(const fs::path &filename, const StringMap &params)
     return SceneHandler::loadScene(filename, pmap);
 }
 
+static ref<Scene> sceneTemplate_instantiate1(SceneTemplate *sceneTemplate) {
+    return sceneTemplate->instantiate();
+}
+
+static ref<Scene> sceneTemplate_instantiate2(SceneTemplate *sceneTemplate, const StringMap &params) {
+    SceneTemplate::ParameterMap pmap;
+    for (StringMap::const_iterator it = params.begin(); it != params.end(); ++it)
+        pmap[it->first]=it->second;
+    return sceneTemplate->instantiate(pmap);
+}
+
 static bp::list scene_getSensors(Scene *scene) {
     bp::list list;
     ref_vector<Sensor> &sensors = scene->getSensors();
@@ -267,6 +279,26 @@ private:
     bool m_locked;
 };
 
+class FilmSinkWrapper : public FilmSink {
+public:
+    FilmSinkWrapper(PyObject *self) : m_self(self), m_locked(false) { Py_INCREF(m_self); }
+
+    void put(const Film *film, Bitmap *bitmap) {
+        CALLBACK_SYNC_GIL();
+        try {
+            bp::call_method<void>(m_self, "put",
+                bp::ptr(const_cast<Film *>(film)), bp::ptr(bitmap));
+        } catch (bp::error_already_set &) { check_python_exception(); }
+    }
+
+    virtual ~FilmSinkWrapper() {
+        Py_DECREF(m_self);
+    }
+private:
+    PyObject *m_self;
+    bool m_locked;
+};
+
 static void renderQueue_join(RenderQueue *queue) {
     ReleaseGIL gil;
     queue->join();
@@ -422,6 +454,13 @@ void export_render() {
         .def("loadScene", &loadScene2, BP_RETURN_VALUE)
         .staticmethod("loadScene");
 
+    BP_CLASS(SceneTemplate, Object, bp::init<const fs::path &>())
+        .def("instantiate", &sceneTemplate_instantiate1, BP_RETURN_VALUE)
+        .def("instantiate", &sceneTemplate_instantiate2, BP_RETURN_VALUE)
+        .def("getReusedObjectCount", &SceneTemplate::getReusedObjectCount)
+        .def("clearCache", &SceneTemplate::clearCache)
+        .def("getFilename", &SceneTemplate::getFilename, BP_RETURN_CONSTREF);
+
     Scene *(RenderJob::*renderJob_getScene)(void) = &RenderJob::getScene;
     RenderQueue *(RenderJob::*renderJob_getRenderQueue)(void) = &RenderJob::getRenderQueue;
     BP_CLASS(RenderJob, Thread, (bp::init<const std::string &, Scene *, RenderQueue *, bp::optional<int, int, int, bool, bool> >()))
@@ -658,6 +697,7 @@ void export_render() {
     bool (Film::*film_develop2)(const Point2i &offset, const Vector2i &size,
         const Point2i &targetOffset, Bitmap *target) const = &Film::develop;
     ReconstructionFilter *(Film::*film_getreconstructionfilter)() = &Film::getReconstructionFilter;
+    FilmSink *(Film::*film_getSink)() = &Film::getSink;
 
     BP_CLASS(Film, ConfigurableObject, bp::no_init)
         .def("getSize", &Film::getSize, BP_RETURN_VALUE)
@@ -672,7 +712,17 @@ void export_render() {
         .def("destinationExists", &Film::destinationExists)
         .def("hasHighQualityEdges", &Film::hasHighQualityEdges)
         .def("hasAlpha", &Film::hasAlpha)
-        .def("getReconstructionFilter", film_getreconstructionfilter, BP_RETURN_VALUE);
+        .def("getReconstructionFilter", film_getreconstructionfilter, BP_RETURN_VALUE)
+        .def("setSink", &Film::setSink)
+        .def("getSink", film_getSink, BP_RETURN_VALUE);
+
+    BP_WRAPPED_CLASS(FilmSink, FilmSinkWrapper, Object, bp::init<>())
+        .def("put", &FilmSink::put);
+
+    Stream *(StreamFilmSink::*streamFilmSink_getStream)() = &StreamFilmSink::getStream;
+    BP_CLASS(StreamFilmSink, FilmSink, (bp::init<Stream *, bp::optional<Bitmap::EFileFormat> >()))
+        .def("getStream", streamFilmSink_getStream, BP_RETURN_VALUE)
+        .def("getImageCount", &StreamFilmSink::getImageCount);
 
     void (ProjectiveCamera::*projectiveCamera_setWorldTransform1)(const Transform &) = &ProjectiveCamera::setWorldTransform;
     void (ProjectiveCamera::*projectiveCamera_setWorldTransform2)(AnimatedTransform *) = &ProjectiveCamera::setWorldTransform;
@@ -86,6 +86,10 @@ void Film::addChild(const std::string &name, ConfigurableObject *child) {
     }
 }
 
+bool Film::hasStatistics() const {
+    return false;
+}
+
 void Film::configure() {
     if (m_filter == NULL) {
         /* No reconstruction filter has been selected. Load a Gaussian filter by default */
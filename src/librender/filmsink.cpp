@@ -0,0 +1,96 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/render/filmsink.h>
+
+MTS_NAMESPACE_BEGIN
+
+/// Assembles streamed tiles into a bitmap that is handed to a sink on close()
+class SinkTileWriter : public TileWriter {
+public:
+    SinkTileWriter(FilmSink *sink, const Film *film, const Vector2i &size,
+            const Bitmap *tile) : m_sink(sink), m_film(film) {
+        m_bitmap = new Bitmap(tile->getPixelFormat(), tile->getComponentFormat(),
+            size, tile->getChannelCount());
+        m_bitmap->setChannelNames(tile->getChannelNames());
+        m_bitmap->clear();
+    }
+
+    void writeTile(const Point2i &offset, const Vector2i &size, const Bitmap *tile) {
+        m_bitmap->copyFrom(tile, Point2i(0), offset, size);
+    }
+
+    void close() {
+        if (!m_bitmap)
+            return;
+        m_sink->put(m_film, m_bitmap);
+        m_bitmap = NULL;
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    virtual ~SinkTileWriter() { }
+private:
+    ref<FilmSink> m_sink;
+    const Film *m_film;
+    ref<Bitmap> m_bitmap;
+};
+
+ref<TileWriter> FilmSink::createTileWriter(const Film *film,
+        const Vector2i &size, const Bitmap *tile) {
+    return new SinkTileWriter(this, film, size, tile);
+}
+
+StreamFilmSink::StreamFilmSink(Stream *stream, Bitmap::EFileFormat format)
+    : m_stream(stream), m_format(format), m_imageCount(0) {
+    m_buffer = new MemoryStream();
+    m_mutex = new Mutex();
+}
+
+void StreamFilmSink::put(const Film *film, Bitmap *bitmap) {
+    Bitmap::EFileFormat format = m_format;
+    if (format == Bitmap::EAuto) {
+        Bitmap::EComponentFormat cFormat = bitmap->getComponentFormat();
+        format = (cFormat == Bitmap::EUInt8 || cFormat == Bitmap::EUInt16)
+            ? Bitmap::EPNG : Bitmap::EOpenEXR;
+    }
+
+    LockGuard lock(m_mutex);
+    m_buffer->reset();
+    bitmap->write(format, m_buffer);
+
+    m_stream->writeULong((uint64_t) m_buffer->getPos());
+    m_stream->write(m_buffer->getData(), m_buffer->getPos());
+    m_stream->flush();
+    ++m_imageCount;
+}
+
+std::string StreamFilmSink::toString() const {
+    std::ostringstream oss;
+    oss << "StreamFilmSink[" << endl
+        << "  stream = " << indent(m_stream->toString()) << "," << endl
+        << "  format = " << m_format << "," << endl
+        << "  imageCount = " << m_imageCount << endl
+        << "]";
+    return oss.str();
+}
+
+MTS_IMPLEMENT_CLASS(FilmSink, true, Object)
+MTS_IMPLEMENT_CLASS(SinkTileWriter, false, TileWriter)
+MTS_IMPLEMENT_CLASS(StreamFilmSink, false, FilmSink)
+MTS_NAMESPACE_END
@@ -20,10 +20,224 @@
 
 MTS_NAMESPACE_BEGIN
 
+namespace {
+    /// 8x8 Bayer matrix used for ordered dithering
+    static const uint8_t bayerMatrix[8][8] = {
+        {  0, 32,  8, 40,  2, 34, 10, 42 },
+        { 48, 16, 56, 24, 50, 18, 58, 26 },
+        { 12, 44,  4, 36, 14, 46,  6, 38 },
+        { 60, 28, 52, 20, 62, 30, 54, 22 },
+        {  3, 35, 11, 43,  1, 33,  9, 41 },
+        { 51, 19, 59, 27, 49, 17, 57, 25 },
+        { 15, 47,  7, 39, 13, 45,  5, 37 },
+        { 63, 31, 55, 23, 61, 29, 53, 21 }
+    };
+
+    /**
+     * Gamma curve tabulated over the square root of the linear value,
+     * which concentrates the entries near zero, where the curve is
+     * steepest. With linear interpolation, the error is far below
+     * one 8-bit quantization step.
+     */
+    struct GammaTable {
+        enum { ESize = 1024 };
+        float table[ESize + 2];
+
+        GammaTable(Float gamma) {
+            for (int i=0; i<=ESize; ++i) {
+                Float value = (i * (Float) (1.0 / ESize)) * (i * (Float) (1.0 / ESize));
+                if (gamma == -1)
+                    value = (value <= (Float) 0.0031308) ? ((Float) 12.92 * value)
+                        : ((Float) 1.055 * std::pow(value, (Float) (1.0/2.4)) - (Float) 0.055);
+                else if (gamma != 1)
+                    value = std::pow(value, 1 / gamma);
+                table[i] = (float) value;
+            }
+            table[ESize + 1] = table[ESize];
+        }
+
+        /// Evaluate the curve for a value in [0, 1]
+        inline Float eval(Float value) const {
+            Float pos = std::sqrt(value) * ESize;
+            int idx = (int) pos;
+            Float t = pos - idx;
+            return table[idx] + t * (table[idx+1] - table[idx]);
+        }
+    };
+
+    /**
+     * Parameters of the fused develop pass. Every normalized pixel
+     * value is scaled by <tt>multiplier * (1 + a*Y) / (1 + b*Y)</tt>,
+     * where \c Y is its luminance. This is a constant exposure multiplier
+     * when <tt>a=b=0</tt> and Reinhard's global operator otherwise.
+     */
+    struct DevelopParams {
+        const GammaTable *gamma;
+        Float multiplier, a, b;
+        bool luminance, alpha, dither;
+    };
+
+    /// Weight-normalized luminance of an \ref ESpectrumAlphaWeight pixel
+    inline Float pixelLuminance(const Float *src, bool rgb) {
+        Float weight = src[SPECTRUM_SAMPLES + 1],
+              invWeight = (weight != 0) ? 1 / weight : weight;
+#if SPECTRUM_SAMPLES == 3
+        (void) rgb;
+        return (src[0] * (Float) 0.212671 + src[1] * (Float) 0.715160
+            + src[2] * (Float) 0.072169) * invWeight;
+#else
+        Spectrum spec;
+        for (int j=0; j<SPECTRUM_SAMPLES; ++j)
+            spec[j] = src[j];
+        if (!rgb)
+            return spec.getLuminance() * invWeight;
+        Float r, g, b;
+        spec.toLinearRGB(r, g, b);
+        return (r * (Float) 0.212671 + g * (Float) 0.715160
+            + b * (Float) 0.072169) * invWeight;
+#endif
+    }
+
+    /// Develop one row of an \ref ESpectrumAlphaWeight bitmap into 8-bit values
+    void developRow(const Float *src, uint8_t *dest, int width, int y,
+            const DevelopParams &params) {
+        const int channels = (params.luminance ? 1 : 3) + (params.alpha ? 1 : 0);
+        const uint8_t *bayerRow = bayerMatrix[y & 7];
+        const GammaTable &gamma = *params.gamma;
+
+#if defined(MTS_SSE) && defined(SINGLE_PRECISION)
+        /* Color values go through the gamma curve, alpha is stored linearly */
+        const __m128 colorMask = params.luminance
+            ? _mm_castsi128_ps(_mm_set_epi32(0, 0, 0, -1))
+            : _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f),
+            tableSize = _mm_set1_ps((float) GammaTable::ESize),
+            scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+        SSEVector idx, lo, hi, codes;
+#endif
+
+        for (int x=0; x<width; ++x, src += SPECTRUM_SAMPLES + 2, dest += channels) {
+            Float weight = src[SPECTRUM_SAMPLES + 1],
+                  invWeight = (weight != 0) ? 1 / weight : weight,
+                  alpha = src[SPECTRUM_SAMPLES] * invWeight;
+
+            Float v0, v1 = 0, v2 = 0, Y;
+#if SPECTRUM_SAMPLES == 3
+            v0 = src[0]; v1 = src[1]; v2 = src[2];
+            Y = v0 * (Float) 0.212671 + v1 * (Float) 0.715160 + v2 * (Float) 0.072169;
+            if (params.luminance)
+                v0 = Y;
+#else
+            Spectrum spec;
+            for (int j=0; j<SPECTRUM_SAMPLES; ++j)
+                spec[j] = src[j];
+            if (params.luminance) {
+                v0 = Y = spec.getLuminance();
+            } else {
+                spec.toLinearRGB(v0, v1, v2);
+                Y = v0 * (Float) 0.212671 + v1 * (Float) 0.715160 + v2 * (Float) 0.072169;
+            }
+#endif
+            Float factor = params.multiplier;
+            if (params.b != 0) {
+                Y *= invWeight;
+                factor *= (1 + params.a * Y) / (1 + params.b * Y);
+            }
+            factor *= invWeight;
+
+            Float dither = params.dither
+                ? (bayerRow[x & 7] + (Float) 0.5f) * (Float) (1.0 / 64.0) - (Float) 0.5f : 0;
+
+#if defined(MTS_SSE) && defined(SINGLE_PRECISION)
+            __m128 value = params.luminance
+                ? _mm_set_ps(0.0f, 0.0f, alpha, v0 * factor)
+                : _mm_set_ps(alpha, v2 * factor, v1 * factor, v0 * factor);
+            value = _mm_min_ps(_mm_max_ps(value, zero), one);
+
+            /* Look up and interpolate the gamma curve in all lanes */
+            __m128 pos = _mm_mul_ps(_mm_sqrt_ps(value), tableSize);
+            idx.pi = _mm_cvttps_epi32(pos);
+            __m128 t = _mm_sub_ps(pos, _mm_cvtepi32_ps(idx.pi));
+            for (int k=0; k<4; ++k) {
+                lo.f[k] = gamma.table[idx.i[k]];
+                hi.f[k] = gamma.table[idx.i[k] + 1];
+            }
+            __m128 encoded = _mm_add_ps(lo.ps, _mm_mul_ps(t, _mm_sub_ps(hi.ps, lo.ps)));
+            encoded = _mm_or_ps(_mm_and_ps(colorMask, encoded),
+                _mm_andnot_ps(colorMask, value));
+
+            /* Dither the color channels, then round and clamp */
+            __m128 offset = _mm_add_ps(half, _mm_and_ps(colorMask, _mm_set1_ps(dither)));
+            codes.pi = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+                _mm_add_ps(_mm_mul_ps(encoded, scale), offset), zero), scale));
+            for (int k=0; k<channels; ++k)
+                dest[k] = (uint8_t) codes.i[k];
+#else
+            Float values[4];
+            values[0] = v0 * factor;
+            if (params.luminance) {
+                values[1] = alpha;
+            } else {
+                values[1] = v1 * factor;
+                values[2] = v2 * factor;
+                values[3] = alpha;
+            }
+            const int colorChannels = params.luminance ? 1 : 3;
+            for (int k=0; k<channels; ++k) {
+                Float value = std::min((Float) 1, std::max((Float) 0, values[k])), offset = 0.5f;
+                if (k < colorChannels) {
+                    value = gamma.eval(value);
+                    offset += dither;
+                }
+                dest[k] = (uint8_t) std::min((Float) 255,
+                    std::max((Float) 0, value * 255 + offset));
+            }
+#endif
+        }
+    }
+
+    /// Develop the interior of an \ref ESpectrumAlphaWeight bitmap into an 8-bit target
+    void developBitmap(const Bitmap *source, int borderSize, Bitmap *target,
+            Float gamma, DevelopParams &params) {
+        const Bitmap::EPixelFormat fmt = target->getPixelFormat();
+        if (source->getPixelFormat() != Bitmap::ESpectrumAlphaWeight)
+            SLog(EError, "developLDR(): unsupported source pixel format!");
+        if (target->getComponentFormat() != Bitmap::EUInt8 ||
+            (fmt != Bitmap::ELuminance && fmt != Bitmap::ELuminanceAlpha &&
+             fmt != Bitmap::ERGB && fmt != Bitmap::ERGBA))
+            SLog(EError, "developLDR(): unsupported target format!");
+        if (target->getSize() != source->getSize() - Vector2i(2 * borderSize))
+            SLog(EError, "developLDR(): target size mismatch!");
+
+        GammaTable table(gamma);
+        params.gamma = &table;
+        params.luminance = fmt == Bitmap::ELuminance || fmt == Bitmap::ELuminanceAlpha;
+        params.alpha = fmt == Bitmap::ELuminanceAlpha || fmt == Bitmap::ERGBA;
+
+        const int width = target->getWidth(), height = target->getHeight(),
+                  bitmapWidth = source->getWidth();
+        const size_t targetStride = (size_t) width * target->getChannelCount();
+
+        #if defined(MTS_OPENMP)
+            #pragma omp parallel for schedule(static)
+        #endif
+        for (int y=0; y<height; ++y) {
+            const Float *src = source->getFloatData() + ((y + borderSize)
+                * (size_t) bitmapWidth + borderSize) * (SPECTRUM_SAMPLES + 2);
+            developRow(src, target->getUInt8Data() + y * targetStride,
+                width, y, params);
+        }
+
+        target->setGamma(gamma);
+    }
+}
+
 ImageBlock::ImageBlock(Bitmap::EPixelFormat fmt, const Vector2i &size,
         const ReconstructionFilter *filter, int channels, bool warn) : m_offset(0),
-        m_size(size), m_filter(filter), m_weightsX(NULL), m_weightsY(NULL), m_warn(warn) {
+        m_size(size), m_filter(filter), m_weightsX(NULL), m_weightsY(NULL), m_warn(warn),
+        m_lumChannels(0) {
     m_borderSize = filter ? filter->getBorderSize() : 0;
+    m_singlePixel = filter && filter->isSinglePixel();
 
     /* Allocate a small bitmap data structure for the block */
     m_bitmap = new Bitmap(fmt, Bitmap::EFloat,
@@ -42,6 +256,164 @@ ImageBlock::~ImageBlock() {
         delete[] m_weightsX;
 }
 
+void ImageBlock::setStatistics(bool enabled) {
+    if (!enabled) {
+        m_statistics = NULL;
+        return;
+    }
+
+    m_statistics = new Bitmap(Bitmap::EMultiChannel, Bitmap::EFloat,
+        m_bitmap->getSize(), 3);
+    m_statistics->clear();
+
+    /* Determine the luminance of a value as a linear combination of its channels */
+    switch (m_bitmap->getPixelFormat()) {
+        case Bitmap::ELuminance:
+        case Bitmap::ELuminanceAlpha:
+        case Bitmap::EMultiChannel:
+            m_lumChannels = 1;
+            m_lumWeights[0] = 1.0f;
+            break;
+
+        case Bitmap::ERGB:
+        case Bitmap::ERGBA:
+            m_lumChannels = 3;
+            m_lumWeights[0] = 0.212671f;
+            m_lumWeights[1] = 0.715160f;
+            m_lumWeights[2] = 0.072169f;
+            break;
+
+        case Bitmap::EXYZ:
+        case Bitmap::EXYZA:
+            m_lumChannels = 2;
+            m_lumWeights[0] = 0.0f;
+            m_lumWeights[1] = 1.0f;
+            break;
+
+        default:
+            /* Spectral formats (only the first spectrum of multi-spectrum blocks) */
+            m_lumChannels = SPECTRUM_SAMPLES;
+            for (int i=0; i<SPECTRUM_SAMPLES; ++i) {
+                Spectrum basis(0.0f);
+                basis[i] = 1.0f;
+                m_lumWeights[i] = basis.getLuminance();
+            }
+    }
+}
+
+void ImageBlock::splatStatistics(const Point2 &_pos, const Point2i &min,
+        const Point2i &max, const Float *value) {
+    const Float lum = getLuminance(value);
+    const int width = m_statistics->getWidth();
+    Float *data = m_statistics->getFloatData();
+
+    for (int y=min.y, yr=0; y<=max.y; ++y, ++yr) {
+        Float *stats = data + (y * (size_t) width + min.x) * 3;
+        for (int x=min.x, xr=0; x<=max.x; ++x, ++xr, stats += 3) {
+            const Float weight = m_weightsX[xr] * m_weightsY[yr];
+            stats[0] += weight * lum * lum;
+            stats[1] += weight * weight;
+        }
+    }
+
+    /* The sample count only refers to the pixel containing the sample */
+    const int x = math::floorToInt(_pos.x) - m_offset.x + m_borderSize,
+              y = math::floorToInt(_pos.y) - m_offset.y + m_borderSize;
+    if (x >= 0 && y >= 0 && x < width && y < m_statistics->getHeight())
+        data[(y * (size_t) width + x) * 3 + 2] += 1;
+}
+
+Float ImageBlock::getVariance(const Point2i &pos) const {
+    Assert(hasStatistics() && m_bitmap->hasWeight());
+    const size_t index = pos.y * (size_t) m_bitmap->getWidth() + pos.x;
+    const int channels = m_bitmap->getChannelCount();
+    const Float *value = m_bitmap->getFloatData() + index * channels;
+    const Float *stats = m_statistics->getFloatData() + index * 3;
+
+    /* Weighted sample mean and second moment of the luminance. With the
+       effective sample size weight^2 / sum(w^2), this gives the variance
+       of the weighted mean (which reduces to var / n for box filters). */
+    Float weight = value[channels - 1];
+    if (weight <= 0)
+        return 0.0f;
+    Float invWeight = 1.0f / weight;
+    Float mean = getLuminance(value) * invWeight;
+    Float variance = stats[0] * invWeight - mean * mean;
+    return std::max(variance, (Float) 0) * stats[1] * invWeight * invWeight;
+}
+
+void ImageBlock::developLDR(Bitmap *target, Float multiplier, Float gamma,
+        bool dither) const {
+    DevelopParams params;
+    params.multiplier = multiplier;
+    params.a = params.b = 0;
+    params.dither = dither;
+    developBitmap(m_bitmap.get(), m_borderSize, target, gamma, params);
+}
+
+void ImageBlock::developLDRReinhard(Bitmap *target, Float &logAvgLuminance,
+        Float &maxLuminance, Float key, Float burn, Float gamma, bool dither) const {
+    if (m_bitmap->getPixelFormat() != Bitmap::ESpectrumAlphaWeight)
+        Log(EError, "developLDRReinhard(): unsupported source pixel format!");
+
+    if (logAvgLuminance <= 0 || maxLuminance <= 0) {
+        /* Compute the luminance statistics using per-row partial results,
+           which keeps the reduction deterministic */
+        const int width = m_size.x, height = m_size.y,
+                  bitmapWidth = m_bitmap->getWidth();
+        const bool rgb = target->getPixelFormat() == Bitmap::ERGB ||
+                         target->getPixelFormat() == Bitmap::ERGBA;
+        std::vector<Float> rowLogSum(height), rowMax(height);
+
+        #if defined(MTS_OPENMP)
+            #pragma omp parallel for schedule(static)
+        #endif
+        for (int y=0; y<height; ++y) {
+            const Float *src = m_bitmap->getFloatData() + ((y + m_borderSize)
+                * (size_t) bitmapWidth + m_borderSize) * (SPECTRUM_SAMPLES + 2);
+            Float logSum = 0, maxLum = 0;
+            for (int x=0; x<width; ++x, src += SPECTRUM_SAMPLES + 2) {
+                Float luminance = pixelLuminance(src, rgb);
+                maxLum = std::max(maxLum, luminance);
+                logSum += math::fastlog(1e-3f + luminance);
+            }
+            rowLogSum[y] = logSum;
+            rowMax[y] = maxLum;
+        }
+
+        Float logSum = 0;
+        maxLuminance = 0;
+        for (int y=0; y<height; ++y) {
+            logSum += rowLogSum[y];
+            maxLuminance = std::max(maxLuminance, rowMax[y]);
+        }
+        logAvgLuminance = math::fastexp(logSum / ((Float) width * (Float) height));
+    }
+
+    DevelopParams params;
+    params.dither = dither;
+    if (maxLuminance == 0) {
+        /* This is a black image -- no tonemapping needed */
+        params.multiplier = 1;
+        params.a = params.b = 0;
+    } else {
+        burn = std::min((Float) 1, std::max((Float) 1e-8f, 1-burn));
+
+        Float scale = key / logAvgLuminance,
+              Lwhite = maxLuminance * scale;
+
+        /* Having the 'burn' parameter scale as 1/b^4 provides a nicely behaved knob */
+        Float invWp2 = 1 / (Lwhite * Lwhite * std::pow(burn, (Float) 4));
+
+        /* Y' = Lp * (1 + Lp/Lwhite^2) / (1 + Lp) with Lp = scale * Y. The
+           chromaticity is unchanged, hence all channels scale by Y'/Y. */
+        params.multiplier = scale;
+        params.a = scale * invWp2;
+        params.b = scale;
+    }
+    developBitmap(m_bitmap.get(), m_borderSize, target, gamma, params);
+}
+
 void ImageBlock::load(Stream *stream) {
     m_offset = Point2i(stream);
     m_size = Vector2i(stream);
@@ -49,6 +421,9 @@ void ImageBlock::load(Stream *stream) {
         m_bitmap->getFloatData(),
         (size_t) m_bitmap->getSize().x *
         (size_t) m_bitmap->getSize().y * m_bitmap->getChannelCount());
+    if (m_statistics)
+        stream->readFloatArray(m_statistics->getFloatData(),
+            m_statistics->getPixelCount() * 3);
 }
 
 void ImageBlock::save(Stream *stream) const {
@@ -58,6 +433,9 @@ void ImageBlock::save(Stream *stream) const {
         m_bitmap->getFloatData(),
         (size_t) m_bitmap->getSize().x *
         (size_t) m_bitmap->getSize().y * m_bitmap->getChannelCount());
+    if (hasStatistics())
+        stream->writeFloatArray(m_statistics->getFloatData(),
+            m_statistics->getPixelCount() * 3);
 }
 
 
@@ -66,7 +444,9 @@ std::string ImageBlock::toString() const {
     oss << "ImageBlock[" << endl
         << "  offset = " << m_offset.toString() << "," << endl
         << "  size = " << m_size.toString() << "," << endl
-        << "  borderSize = " << m_borderSize << endl
+        << "  borderSize = " << m_borderSize << "," << endl
+        << "  singlePixel = " << m_singlePixel << "," << endl
+        << "  statistics = " << hasStatistics() << endl
         << "]";
     return oss.str();
 }
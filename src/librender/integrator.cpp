@@ -17,11 +17,17 @@
 */
 
 #include <mitsuba/core/statistics.h>
+#include <mitsuba/core/timer.h>
 #include <mitsuba/render/integrator.h>
 #include <mitsuba/render/renderproc.h>
 
 MTS_NAMESPACE_BEGIN
 
+#if defined(MTS_DEBUG_ALLOCATIONS)
+static StatsCounter allocationsPerSample("General",
+    "Heap allocations per sample", EAverage);
+#endif
+
 Integrator::Integrator(const Properties &props)
  : NetworkedObject(props) { }
 
@@ -43,13 +49,44 @@ void Integrator::configureSampler(const Scene *scene, Sampler *sampler) {
 const Integrator *Integrator::getSubIntegrator(int idx) const { return NULL; }
 
 SamplingIntegrator::SamplingIntegrator(const Properties &props)
- : Integrator(props) { }
+ : Integrator(props) {
+    /* Wall-clock budget of a progressive rendering in seconds */
+    m_timeLimit = props.getFloat("timeLimit", 0.0f);
+
+    /* Target relative RMS error of a progressive rendering */
+    m_errorTarget = props.getFloat("errorTarget", 0.0f);
+
+    /* Interval, at which intermediate results are written (in seconds) */
+    m_outputInterval = props.getFloat("outputInterval", 0.0f);
+
+    /* Number of sample passes. When a time limit or error target is
+       specified, the rendering continues until it is reached by default */
+    m_passes = props.getSize("passes",
+        (m_timeLimit > 0 || m_errorTarget > 0) ? 0 : 1);
+
+    if (m_timeLimit < 0 || m_errorTarget < 0 || m_outputInterval < 0)
+        Log(EError, "The 'timeLimit', 'errorTarget' and 'outputInterval' "
+            "parameters must be nonnegative!");
+
+    if (m_passes == 0 && m_timeLimit == 0 && m_errorTarget == 0)
+        Log(EError, "An unlimited number of passes requires a 'timeLimit' "
+            "or an 'errorTarget'!");
+}
 
 SamplingIntegrator::SamplingIntegrator(Stream *stream, InstanceManager *manager)
- : Integrator(stream, manager) { }
+ : Integrator(stream, manager) {
+    m_timeLimit = stream->readFloat();
+    m_errorTarget = stream->readFloat();
+    m_outputInterval = stream->readFloat();
+    m_passes = stream->readSize();
+}
 
 void SamplingIntegrator::serialize(Stream *stream, InstanceManager *manager) const {
     Integrator::serialize(stream, manager);
+    stream->writeFloat(m_timeLimit);
+    stream->writeFloat(m_errorTarget);
+    stream->writeFloat(m_outputInterval);
+    stream->writeSize(m_passes);
 }
 
 Spectrum SamplingIntegrator::E(const Scene *scene, const Intersection &its,
@@ -109,7 +146,7 @@ bool SamplingIntegrator::render(Scene *scene,
         nCores == 1 ? "core" : "cores");
 
     /* This is a sampling-based integrator - parallelize */
-    ref<ParallelProcess> proc = new BlockedRenderProcess(job,
+    ref<BlockedRenderProcess> proc = new BlockedRenderProcess(job,
         queue, scene->getBlockSize());
     int integratorResID = sched->registerResource(this);
     proc->bindResource("integrator", integratorResID);
@@ -118,14 +155,146 @@ bool SamplingIntegrator::render(Scene *scene,
     proc->bindResource("sampler", samplerResID);
     scene->bindUsedResources(proc);
     bindUsedResources(proc);
-    sched->schedule(proc);
 
+    bool success = runProcess(scene, job, film, proc);
+    sched->unregisterResource(integratorResID);
+
+    return success;
+}
+
+/**
+ * Estimate the relative RMS error of a progressive rendering from two
+ * luminance snapshots. Assuming independent passes, the difference between
+ * the averages of \c passes1 and \c passes2 passes has the per-pixel
+ * variance sigma^2 * (1/passes1 - 1/passes2), which provides an estimate
+ * of the per-pass variance sigma^2.
+ */
+static Float estimateRelativeError(const Bitmap *snapshot1, Float passes1,
+        const Bitmap *snapshot2, Float passes2) {
+    const Float *data1 = snapshot1->getFloatData(), *data2 = snapshot2->getFloatData();
+    size_t pixelCount = snapshot1->getPixelCount();
+    double squaredDiff = 0, mean = 0;
+    for (size_t i=0; i<pixelCount; ++i) {
+        double diff = (double) data2[i] - (double) data1[i];
+        squaredDiff += diff*diff;
+        mean += data2[i];
+    }
+    squaredDiff /= pixelCount;
+    mean /= pixelCount;
+
+    if (mean <= 0)
+        return 0.0f;
+
+    double variance = squaredDiff / (1.0 / passes1 - 1.0 / passes2);
+    return (Float) (std::sqrt(variance / passes2) / mean);
+}
+
+bool SamplingIntegrator::runProcess(Scene *scene, const RenderJob *job,
+        Film *film, BlockedRenderProcess *proc) {
+    ref<Scheduler> sched = Scheduler::getInstance();
+
+    if (!isProgressive()) {
+        sched->schedule(proc);
+        m_process = proc;
+        sched->wait(proc);
+        m_process = NULL;
+        return proc->getReturnStatus() == ParallelProcess::ESuccess;
+    }
+
+    /* All passes accumulate into the same film, which must hence be kept in memory */
+    Vector2i cropSize = film->getCropSize();
+    ref<Bitmap> snapshot = new Bitmap(Bitmap::ELuminance, Bitmap::EFloat, cropSize);
+    if (!film->develop(Point2i(0), Vector2i(1), Point2i(0), snapshot))
+        Log(EError, "Progressive rendering requires a film that keeps the "
+            "image in memory (e.g. the hdrfilm plugin with streaming=false)");
+
+    std::ostringstream oss;
+    if (m_passes > 0)
+        oss << m_passes << " passes";
+    else
+        oss << "unlimited passes";
+    if (m_timeLimit > 0)
+        oss << ", time limit: " << timeString(m_timeLimit);
+    if (m_errorTarget > 0)
+        oss << ", error target: " << m_errorTarget;
+    Log(EInfo, "Rendering progressively (%s) ..", oss.str().c_str());
+
+    proc->setProgressive(m_passes);
+    sched->schedule(proc);
     m_process = proc;
+
+    ref<Timer> timer = new Timer();
+    ProgressReporter *progress = NULL;
+    if (m_passes == 0 && m_timeLimit > 0)
+        progress = new ProgressReporter("Rendering",
+            (long long) (m_timeLimit * 1000), job);
+
+    ref<Bitmap> reference;
+    Float referencePasses = 0, nextOutput = m_outputInterval;
+    bool budgetReached = false;
+
+    while (proc->getReturnStatus() == ParallelProcess::EUnknown) {
+        Float elapsed = timer->getSecondsSinceStart();
+        unsigned int sleepTime = 50;
+        if (m_timeLimit > 0)
+            sleepTime = std::min(sleepTime, (unsigned int)
+                std::max((Float) 1, (m_timeLimit - elapsed) * 1000));
+        Thread::sleep(sleepTime);
+
+        elapsed = timer->getSecondsSinceStart();
+        if (progress)
+            progress->update((long long) (std::min(elapsed, m_timeLimit) * 1000));
+
+        if (m_timeLimit > 0 && elapsed >= m_timeLimit) {
+            Log(EInfo, "Reached the time limit after %.1f passes",
+                proc->getCompletedPasses());
+            budgetReached = true;
+            break;
+        }
+
+        if (m_outputInterval > 0 && elapsed >= nextOutput) {
+            Log(EInfo, "Writing an intermediate result (%.1f passes) ..",
+                proc->getCompletedPasses());
+            LockGuard lock(proc->getResultMutex());
+            film->develop(scene, elapsed);
+            nextOutput = elapsed + m_outputInterval;
+        }
+
+        /* Compare snapshots whenever the number of passes has doubled */
+        Float passes = proc->getCompletedPasses();
+        if (m_errorTarget > 0 && passes >= std::max((Float) 1, 2 * referencePasses)) {
+            ref<Bitmap> current = new Bitmap(Bitmap::ELuminance, Bitmap::EFloat, cropSize);
+            {
+                LockGuard lock(proc->getResultMutex());
+                passes = proc->getCompletedPasses();
+                film->develop(Point2i(0), cropSize, Point2i(0), current);
+            }
+
+            if (reference) {
+                Float error = estimateRelativeError(reference, referencePasses,
+                    current, passes);
+                Log(EInfo, "Estimated relative error after %.1f passes: %f", passes, error);
+                if (error <= m_errorTarget) {
+                    Log(EInfo, "Reached the error target");
+                    budgetReached = true;
+                    break;
+                }
+            }
+            reference = current;
+            referencePasses = passes;
+        }
+    }
+
+    /* Blocks that are still in flight stop at the next pixel and are kept */
+    if (budgetReached)
+        sched->cancel(proc);
     sched->wait(proc);
     m_process = NULL;
-    sched->unregisterResource(integratorResID);
 
-    return proc->getReturnStatus() == ParallelProcess::ESuccess;
+    if (progress)
+        delete progress;
+
+    return budgetReached || proc->getReturnStatus() == ParallelProcess::ESuccess;
 }
 
 void SamplingIntegrator::bindUsedResources(ParallelProcess *) const {
@@ -159,6 +328,11 @@ void SamplingIntegrator::renderBlock(const Scene *scene,
     if (!sensor->getFilm()->hasAlpha()) /* Don't compute an alpha channel if we don't have to */
         queryType &= ~RadianceQueryRecord::EOpacity;
 
+#if defined(MTS_DEBUG_ALLOCATIONS)
+    uint64_t allocations = getAllocationCount();
+    size_t sampleCount = 0;
+#endif
+
     for (size_t i = 0; i<points.size(); ++i) {
         Point2i offset = Point2i(points[i]) + Vector2i(block->getOffset());
         if (stop)
@@ -183,8 +357,18 @@ void SamplingIntegrator::renderBlock(const Scene *scene,
             spec *= Li(sensorRay, rRec);
             block->put(samplePos, spec, rRec.alpha);
             sampler->advance();
+#if defined(MTS_DEBUG_ALLOCATIONS)
+            ++sampleCount;
+#endif
         }
     }
+
+#if defined(MTS_DEBUG_ALLOCATIONS)
+    /* Only count the samples that were actually taken, since
+       'stop' may have ended the block early */
+    allocationsPerSample += (size_t) (getAllocationCount() - allocations);
+    allocationsPerSample.incrementBase(sampleCount);
+#endif
 }
 
 MonteCarloIntegrator::MonteCarloIntegrator(const Properties &props) : SamplingIntegrator(props) {
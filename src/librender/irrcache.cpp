@@ -144,6 +144,10 @@ void HemisphereSampler::process(const Intersection &its) {
     m_E *= M_PI / (m_M*m_N);
 }
 
+static StatsCounter irradHits("Irradiance cache", "Hits");
+static StatsCounter irradMisses("Irradiance cache", "Misses");
+static StatsCounter irradStaged("Irradiance cache", "Staged records");
+
 /* First pass of neighbor clamping */
 struct clamp_self_functor {
     clamp_self_functor(const Point &p, Float &R0) : p(p), R0(R0) {
@@ -222,6 +226,7 @@ IrradianceCache::IrradianceCache(const AABB &aabb)
     /* Use the longest AABB axis as an estimate of the scene dimensions */
     m_sceneSize = (aabb.max-aabb.min)[aabb.getLargestAxis()];
     m_mutex = new Mutex();
+    m_generation = 0;
 
     /* Reasonable default settings */
     setQuality(1.0f);
@@ -233,6 +238,7 @@ IrradianceCache::IrradianceCache(const AABB &aabb)
 IrradianceCache::IrradianceCache(Stream *stream, InstanceManager *manager) :
     m_octree(AABB(stream)) {
     m_mutex = new Mutex();
+    m_generation = 0;
     m_kappa = stream->readFloat();
     m_sceneSize = stream->readFloat();
     m_clampScreen = stream->readBool();
@@ -254,6 +260,7 @@ IrradianceCache::IrradianceCache(Stream *stream, InstanceManager *manager) :
 IrradianceCache::~IrradianceCache() {
     for (size_t i=0; i<m_records.size(); ++i)
         delete m_records[i];
+    discardStaged();
 }
 
 void IrradianceCache::serialize(Stream *stream, InstanceManager *manager) const {
@@ -317,13 +324,17 @@ IrradianceCache::Record *IrradianceCache::put(const RayDifferential &ray, const
                 std::min((Float) 1, hs.getMinimumDistance() / R0_min);
     }
 
+    StagingArea *area = getOrCreateStagingArea();
+
     if (m_clampNeighbor) {
         /* Perform neighbor clamping [Krivanek et al.] to distribute
-           geometric feature information amongst neighboring hss */
+           geometric feature information amongst neighboring hss. The
+           shared records are only modified when staged records are merged */
         clamp_self_functor clampSelf(its.p, R0);
         m_octree.searchSphere(BSphere(its.p, R0), clampSelf);
+        area->octree.searchSphere(BSphere(its.p, R0), clampSelf);
         clamp_neighbors_functor clampNeighbors(its.p, R0);
-        m_octree.searchSphere(BSphere(its.p, R0), clampNeighbors);
+        area->octree.searchSphere(BSphere(its.p, R0), clampNeighbors);
     }
 
     Record *record = new Record();
@@ -338,27 +349,98 @@ IrradianceCache::Record *IrradianceCache::put(const RayDifferential &ray, const
         record->rGrad[i] = hs.getRotationalGradient()[i];
         record->tGrad[i] = tGrad[i];
     }
-    insert(record);
+    insert(area->octree, record);
+    area->records.push_back(record);
+    ++irradStaged;
     return record;
 }
 
 void IrradianceCache::insert(Record *record) {
+    insert(m_octree, record);
+    LockGuard lock(m_mutex);
+    m_records.push_back(record);
+}
+
+void IrradianceCache::insert(DynamicOctree<Record *> &octree, Record *record) const {
     Float validRadius = record->R0 / (2*m_kappa);
-    m_octree.insert(record, AABB(
+    octree.insert(record, AABB(
         record->p-Vector(1,1,1)*validRadius,
         record->p+Vector(1,1,1)*validRadius
     ));
+}
+
+const IrradianceCache::StagingArea *IrradianceCache::getStagingArea() const {
+    const StagingArea *area = m_staging.get();
+    if (area && area->generation != m_generation)
+        return NULL;
+    return area;
+}
+
+IrradianceCache::StagingArea *IrradianceCache::getOrCreateStagingArea() {
+    StagingArea *area = m_staging.get();
+    if (area && area->generation == m_generation)
+        return area;
+
+    area = new StagingArea(m_octree.getAABB(), m_generation);
+    m_staging.set(area);
     LockGuard lock(m_mutex);
-    m_records.push_back(record);
+    m_stagingAreas.push_back(area);
+    return area;
 }
 
-static StatsCounter irradHits("Irradiance cache", "Hits");
-static StatsCounter irradMisses("Irradiance cache", "Misses");
+size_t IrradianceCache::mergeStaged() {
+    LockGuard lock(m_mutex);
+    size_t count = 0;
+
+    for (size_t i=0; i<m_stagingAreas.size(); ++i) {
+        std::vector<Record *> &records = m_stagingAreas[i]->records;
+        for (size_t j=0; j<records.size(); ++j) {
+            Record *record = records[j];
+
+            if (m_clampNeighbor) {
+                /* Neighbor clamping against the records of other threads */
+                Float R0 = record->originalR0;
+                clamp_self_functor clampSelf(record->p, R0);
+                m_octree.searchSphere(BSphere(record->p, R0), clampSelf);
+                clamp_neighbors_functor clampNeighbors(record->p, R0);
+                m_octree.searchSphere(BSphere(record->p, R0), clampNeighbors);
+                record->originalR0 = R0;
+                record->R0 = std::min(record->R0_max, std::max(record->R0_min, R0));
+            }
+
+            insert(m_octree, record);
+            m_records.push_back(record);
+        }
+        count += records.size();
+        records.clear();
+    }
+
+    /* Invalidate the per-thread staging areas */
+    m_stagingAreas.clear();
+    ++m_generation;
+    return count;
+}
+
+void IrradianceCache::discardStaged() {
+    LockGuard lock(m_mutex);
+    for (size_t i=0; i<m_stagingAreas.size(); ++i) {
+        std::vector<Record *> &records = m_stagingAreas[i]->records;
+        for (size_t j=0; j<records.size(); ++j)
+            delete records[j];
+        records.clear();
+    }
+    m_stagingAreas.clear();
+    ++m_generation;
+}
 
 bool IrradianceCache::get(const Intersection &its, Spectrum &E) const {
     irr_interp_functor functor(its, m_kappa, m_useGradients);
     m_octree.lookup(its.p, functor);
 
+    const StagingArea *area = getStagingArea();
+    if (area)
+        area->octree.lookup(its.p, functor);
+
     if (functor.weightSum > 0) {
         E = functor.E / functor.weightSum;
         ++irradHits;
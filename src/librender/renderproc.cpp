@@ -18,17 +18,59 @@
 
 #include <mitsuba/core/statistics.h>
 #include <mitsuba/core/sfcurve.h>
+#include <mitsuba/core/arena.h>
 #include <mitsuba/render/renderproc.h>
 #include <mitsuba/render/rectwu.h>
 
 MTS_NAMESPACE_BEGIN
 
+/**
+ * Rectangular work unit that additionally records the sample pass
+ * it belongs to (see \ref BlockedRenderProcess::setProgressive())
+ */
+class RenderPassWorkUnit : public RectangularWorkUnit {
+public:
+    inline RenderPassWorkUnit() : m_pass(0) { }
+
+    void set(const WorkUnit *wu) {
+        RectangularWorkUnit::set(wu);
+        m_pass = static_cast<const RenderPassWorkUnit *>(wu)->m_pass;
+    }
+
+    void load(Stream *stream) {
+        RectangularWorkUnit::load(stream);
+        m_pass = stream->readSize();
+    }
+
+    void save(Stream *stream) const {
+        RectangularWorkUnit::save(stream);
+        stream->writeSize(m_pass);
+    }
+
+    inline size_t getPass() const { return m_pass; }
+    inline void setPass(size_t pass) { m_pass = pass; }
+
+    std::string toString() const {
+        std::ostringstream oss;
+        oss << "RenderPassWorkUnit[offset=" << getOffset().toString()
+            << ", size=" << getSize().toString() << ", pass=" << m_pass << "]";
+        return oss.str();
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    virtual ~RenderPassWorkUnit() { }
+private:
+    size_t m_pass;
+};
+
 class BlockRenderer : public WorkProcessor {
 public:
     BlockRenderer(Bitmap::EPixelFormat pixelFormat, int channelCount, int blockSize,
-        int borderSize, bool warnInvalid) : m_pixelFormat(pixelFormat),
+        int borderSize, bool warnInvalid, bool statistics) : m_pixelFormat(pixelFormat),
         m_channelCount(channelCount), m_blockSize(blockSize),
-        m_borderSize(borderSize), m_warnInvalid(warnInvalid) { }
+        m_borderSize(borderSize), m_warnInvalid(warnInvalid),
+        m_statistics(statistics) { }
 
     BlockRenderer(Stream *stream, InstanceManager *manager) {
         m_pixelFormat = (Bitmap::EPixelFormat) stream->readInt();
@@ -36,17 +78,21 @@ public:
         m_blockSize = stream->readInt();
         m_borderSize = stream->readInt();
         m_warnInvalid = stream->readBool();
+        m_statistics = stream->readBool();
     }
 
     ref<WorkUnit> createWorkUnit() const {
-        return new RectangularWorkUnit();
+        return new RenderPassWorkUnit();
     }
 
     ref<WorkResult> createWorkResult() const {
-        return new ImageBlock(m_pixelFormat,
+        ref<ImageBlock> block = new ImageBlock(m_pixelFormat,
             Vector2i(m_blockSize),
             m_sensor->getFilm()->getReconstructionFilter(),
             m_channelCount, m_warnInvalid);
+        if (m_statistics)
+            block->setStatistics(true);
+        return block.get();
     }
 
     void prepare() {
@@ -67,16 +113,21 @@ public:
 
     void process(const WorkUnit *workUnit, WorkResult *workResult,
         const bool &stop) {
-        const RectangularWorkUnit *rect = static_cast<const RectangularWorkUnit *>(workUnit);
+        const RenderPassWorkUnit *rect = static_cast<const RenderPassWorkUnit *>(workUnit);
         ImageBlock *block = static_cast<ImageBlock *>(workResult);
 
 #ifdef MTS_DEBUG_FP
         enableFPExceptions();
 #endif
 
+        /* Release any scratch memory left over from the previous block */
+        MemoryArena::getThreadArena().reset();
+
         block->setOffset(rect->getOffset());
         block->setSize(rect->getSize());
         m_hilbertCurve.initialize(TVector2<uint8_t>(rect->getSize()));
+        m_sampler->setSamplePass(rect->getPass());
+
         m_integrator->renderBlock(m_scene, m_sensor, m_sampler,
             block, stop, m_hilbertCurve.getPoints());
 
@@ -91,11 +142,12 @@ public:
         stream->writeInt(m_blockSize);
         stream->writeInt(m_borderSize);
         stream->writeBool(m_warnInvalid);
+        stream->writeBool(m_statistics);
     }
 
     ref<WorkProcessor> clone() const {
         return new BlockRenderer(m_pixelFormat, m_channelCount,
-            m_blockSize, m_borderSize, m_warnInvalid);
+            m_blockSize, m_borderSize, m_warnInvalid, m_statistics);
     }
 
     MTS_DECLARE_CLASS()
@@ -111,6 +163,7 @@ private:
     int m_blockSize;
     int m_borderSize;
     bool m_warnInvalid;
+    bool m_statistics;
     HilbertCurve2D<uint8_t> m_hilbertCurve;
 };
 
@@ -121,6 +174,10 @@ BlockedRenderProcess::BlockedRenderProcess(const RenderJob *parent, RenderQueue
     m_pixelFormat = Bitmap::ESpectrumAlphaWeight;
     m_channelCount = -1;
     m_warnInvalid = true;
+    m_statistics = false;
+    m_progressive = false;
+    m_maxPasses = 1;
+    m_pass = 0;
 }
 
 BlockedRenderProcess::~BlockedRenderProcess() {
@@ -134,24 +191,52 @@ void BlockedRenderProcess::setPixelFormat(Bitmap::EPixelFormat pixelFormat, int
     m_warnInvalid = warnInvalid;
 }
 
+void BlockedRenderProcess::setProgressive(size_t maxPasses) {
+    m_progressive = true;
+    m_maxPasses = maxPasses;
+    if (m_film)
+        resetProgress();
+}
+
+void BlockedRenderProcess::resetProgress() {
+    if (m_progress)
+        delete m_progress;
+    /* Unbounded progressive renderings report their progress elsewhere */
+    m_progress = (m_progressive && m_maxPasses == 0) ? NULL : new ProgressReporter(
+        "Rendering", (long long) m_numBlocksTotal * (long long) m_maxPasses, m_parent);
+}
+
 ref<WorkProcessor> BlockedRenderProcess::createWorkProcessor() const {
     return new BlockRenderer(m_pixelFormat, m_channelCount,
-            m_blockSize, m_borderSize, m_warnInvalid);
+            m_blockSize, m_borderSize, m_warnInvalid, m_statistics);
 }
 
 void BlockedRenderProcess::processResult(const WorkResult *result, bool cancelled) {
     const ImageBlock *block = static_cast<const ImageBlock *>(result);
     UniqueLock lock(m_resultMutex);
     m_film->put(block);
-    m_progress->update(++m_resultCount);
+    ++m_resultCount;
+    if (m_progress)
+        m_progress->update(m_resultCount);
     lock.unlock();
     m_queue->signalWorkEnd(m_parent, block, cancelled);
 }
 
 ParallelProcess::EStatus BlockedRenderProcess::generateWork(WorkUnit *unit, int worker) {
     EStatus status = BlockedImageProcess::generateWork(unit, worker);
-    if (status == ESuccess)
+    if (status == EFailure && m_progressive && (m_maxPasses == 0 || m_pass + 1 < m_maxPasses)) {
+        /* Start over with the next sample pass */
+        BlockedImageProcess::init(m_offset, m_size, m_blockSize);
+        ++m_pass;
+        status = BlockedImageProcess::generateWork(unit, worker);
+    }
+
+    if (status == ESuccess) {
+        /* Subclasses with custom work processors only support a single pass */
+        if (m_progressive)
+            static_cast<RenderPassWorkUnit *>(unit)->setPass(m_pass);
         m_queue->signalWorkBegin(m_parent, static_cast<RectangularWorkUnit *>(unit), worker);
+    }
     return status;
 }
 
@@ -159,6 +244,7 @@ void BlockedRenderProcess::bindResource(const std::string &name, int id) {
     if (name == "sensor") {
         m_film = static_cast<Sensor *>(Scheduler::getInstance()->getResource(id))->getFilm();
         m_borderSize = m_film->getReconstructionFilter()->getBorderSize();
+        m_statistics = m_film->hasStatistics();
 
         Point2i offset = Point2i(0, 0);
         Vector2i size = m_film->getCropSize();
@@ -174,13 +260,13 @@ void BlockedRenderProcess::bindResource(const std::string &name, int id) {
             Log(EError, "The block size must be larger than the image reconstruction filter radius!");
 
         BlockedImageProcess::init(offset, size, m_blockSize);
-        if (m_progress)
-            delete m_progress;
-        m_progress = new ProgressReporter("Rendering", m_numBlocksTotal, m_parent);
+        m_pass = 0;
+        resetProgress();
     }
     BlockedImageProcess::bindResource(name, id);
 }
 
+MTS_IMPLEMENT_CLASS(RenderPassWorkUnit, false, RectangularWorkUnit)
 MTS_IMPLEMENT_CLASS(BlockedRenderProcess, false, BlockedImageProcess)
 MTS_IMPLEMENT_CLASS_S(BlockRenderer, false, WorkProcessor)
 MTS_NAMESPACE_END
@@ -21,10 +21,13 @@
 MTS_NAMESPACE_BEGIN
 
 Sampler::Sampler(const Properties &props)
- : ConfigurableObject(props), m_sampleCount(0), m_sampleIndex(0) { }
+ : ConfigurableObject(props), m_cache1D(NULL), m_cacheEnd1D(NULL),
+   m_cache2D(NULL), m_cacheEnd2D(NULL), m_sampleCount(0), m_sampleIndex(0),
+   m_samplePass(0) { }
 
 Sampler::Sampler(Stream *stream, InstanceManager *manager)
- : ConfigurableObject(stream, manager) {
+ : ConfigurableObject(stream, manager), m_cache1D(NULL), m_cacheEnd1D(NULL),
+   m_cache2D(NULL), m_cacheEnd2D(NULL), m_sampleIndex(0), m_samplePass(0) {
     m_sampleCount = stream->readSize();
     size_t n1DArrays = stream->readSize();
     for (size_t i=0; i<n1DArrays; ++i)
@@ -378,6 +378,7 @@ void Scene::initialize() {
             m_emitterPDF.append(it->get()->getSamplingWeight());
 
         m_emitterPDF.normalize();
+        m_emitterPDF.buildAliasTable();
     }
 
     initializeBidirectional();
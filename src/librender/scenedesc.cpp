@@ -0,0 +1,368 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <mitsuba/render/scenedesc.h>
+#include <mitsuba/render/scene.h>
+#include <mitsuba/core/fstream.h>
+#include <mitsuba/core/zstream.h>
+#include <mitsuba/core/plugin.h>
+#include <mitsuba/core/fresolver.h>
+#include <mitsuba/core/lock.h>
+
+#define MTS_SCENEDESC_HEADER     0x5C3E
+#define MTS_SCENEDESC_VERSION_V1 0x0001
+
+MTS_NAMESPACE_BEGIN
+
+/* Defined in scenehandler.cpp */
+extern MTS_EXPORT_RENDER void runSceneCleanupHandlers();
+
+SceneDescription::SceneDescription() { }
+
+SceneDescription::SceneDescription(Stream *_stream) {
+    ref<Stream> stream = _stream;
+
+    if (stream->getByteOrder() != Stream::ELittleEndian)
+        Log(EError, "Tried to unserialize a scene description from a stream, "
+            "which was not previously set to little endian byte order!");
+
+    short format = stream->readShort();
+    if (format != MTS_SCENEDESC_HEADER)
+        Log(EError, "Encountered an invalid scene description!");
+    short version = stream->readShort();
+    if (version != MTS_SCENEDESC_VERSION_V1)
+        Log(EError, "Encountered an incompatible scene description version!");
+
+    stream = new ZStream(stream);
+    stream->setByteOrder(Stream::ELittleEndian);
+
+    uint8_t floatSize = stream->readUChar(),
+            spectrumSamples = stream->readUChar();
+    if (floatSize != sizeof(Float) || spectrumSamples != SPECTRUM_SAMPLES)
+        Log(EError, "The scene description was created by a build with a "
+            "different floating point precision or spectral discretization "
+            "(%i-byte floats, %i spectral samples) and must be regenerated "
+            "from the XML source.", floatSize, spectrumSamples);
+
+    uint32_t nodeCount = stream->readUInt();
+    m_nodes.resize(nodeCount);
+
+    for (uint32_t i=0; i<nodeCount; ++i) {
+        Node &node = m_nodes[i];
+        std::string className = stream->readString();
+        node.cls = Class::forName(className);
+        if (node.cls == NULL || !node.cls->derivesFrom(MTS_CLASS(ConfigurableObject)))
+            Log(EError, "Scene description references the unknown class \"%s\"!",
+                className.c_str());
+        node.configure = stream->readBool();
+        node.props = Properties(stream);
+
+        uint32_t childCount = stream->readUInt();
+        node.children.reserve(childCount);
+        for (uint32_t j=0; j<childCount; ++j) {
+            std::string name = stream->readString();
+            uint32_t child = stream->readUInt();
+            if (child >= i)
+                Log(EError, "Scene description is corrupted (node %i "
+                    "references node %i as a child)", i, child);
+            node.children.push_back(std::make_pair(name, child));
+        }
+    }
+}
+
+void SceneDescription::serialize(Stream *_stream) const {
+    ref<Stream> stream = _stream;
+
+    if (stream->getByteOrder() != Stream::ELittleEndian)
+        Log(EError, "Tried to serialize a scene description to a stream, "
+            "which was not previously set to little endian byte order!");
+
+    stream->writeShort(MTS_SCENEDESC_HEADER);
+    stream->writeShort(MTS_SCENEDESC_VERSION_V1);
+    stream = new ZStream(stream);
+    stream->setByteOrder(Stream::ELittleEndian);
+
+    stream->writeUChar((uint8_t) sizeof(Float));
+    stream->writeUChar((uint8_t) SPECTRUM_SAMPLES);
+    stream->writeUInt((uint32_t) m_nodes.size());
+
+    for (size_t i=0; i<m_nodes.size(); ++i) {
+        const Node &node = m_nodes[i];
+        stream->writeString(node.cls->getName());
+        stream->writeBool(node.configure);
+        node.props.serialize(stream);
+        stream->writeUInt((uint32_t) node.children.size());
+        for (size_t j=0; j<node.children.size(); ++j) {
+            stream->writeString(node.children[j].first);
+            stream->writeUInt(node.children[j].second);
+        }
+    }
+}
+
+void SceneDescription::write(const fs::path &filename) const {
+    ref<FileStream> stream = new FileStream(filename, FileStream::ETruncWrite);
+    stream->setByteOrder(Stream::ELittleEndian);
+    serialize(stream);
+    stream->close();
+}
+
+uint32_t SceneDescription::appendNode(const Class *cls,
+        const Properties &props, bool configure) {
+    m_nodes.push_back(Node());
+    Node &node = m_nodes.back();
+    node.cls = cls;
+    node.props = props;
+    node.configure = configure;
+    return (uint32_t) (m_nodes.size() - 1);
+}
+
+void SceneDescription::addChild(uint32_t parent, const std::string &name, uint32_t child) {
+    Assert(child < parent && parent < m_nodes.size());
+    m_nodes[parent].children.push_back(std::make_pair(name, child));
+}
+
+void SceneDescription::setSource(uint32_t index, const std::string &element,
+        const std::string &file, int line) {
+    Assert(index < m_nodes.size());
+    Node &node = m_nodes[index];
+    node.element = element;
+    node.sourceFile = file;
+    node.sourceLine = line;
+}
+
+/// Prefix that points messages about a node to its XML source
+static std::string getSourcePrefix(const SceneDescription::Node &node) {
+    if (node.sourceFile.empty())
+        return "";
+    return formatString("In file \"%s\" (near line %i): ",
+        node.sourceFile.c_str(), node.sourceLine);
+}
+
+void SceneDescription::resolveFilenames(const FileResolver *resolver) {
+    for (size_t i=0; i<m_nodes.size(); ++i) {
+        Properties &props = m_nodes[i].props;
+        if (!props.hasProperty("filename") ||
+            props.getType("filename") != Properties::EString)
+            continue;
+
+        fs::path path = props.getString("filename");
+        fs::path resolved = resolver->resolve(path);
+        if (!path.is_absolute() && fs::exists(resolved))
+            path = fs::absolute(resolved);
+
+        /* Also clears the queried flag set by getString() */
+        props.setString("filename", path.string(), false);
+    }
+}
+
+ref<ConfigurableObject> SceneDescription::instantiateNode(size_t index,
+        ref_vector<ConfigurableObject> &objects, Mutex *mutex) const {
+    const Node &node = m_nodes[index];
+    ref<ConfigurableObject> object;
+
+    if (node.cls == MTS_CLASS(Scene))
+        object = new Scene(node.props);
+    else
+        object = PluginManager::getInstance()->createObject(node.cls, node.props);
+
+    if (!node.children.empty()) {
+        /* Children may be shared by several parents, which are being
+           instantiated concurrently; addChild() and setParent() are
+           generally not thread-safe with respect to the child */
+        LockGuard lock(mutex);
+        for (size_t i=0; i<node.children.size(); ++i) {
+            ConfigurableObject *child = objects[node.children[i].second];
+            object->addChild(node.children[i].first, child);
+            child->setParent(object);
+        }
+    }
+
+    if (node.configure)
+        object->configure();
+
+    /* Warn about unqueried properties */
+    std::vector<std::string> unq = node.props.getUnqueried();
+    for (size_t i=0; i<unq.size(); ++i)
+        Log(EWarn, "%sUnqueried attribute \"%s\" in element \"%s\" (%s plugin \"%s\")",
+            getSourcePrefix(node).c_str(), unq[i].c_str(), node.element.empty() ?
+            node.cls->getName().c_str() : node.element.c_str(),
+            node.cls->getName().c_str(), node.props.getPluginName().c_str());
+
+    if (object->getClass()->derivesFrom(MTS_CLASS(Texture)))
+        object = static_cast<Texture *>(object.get())->expand();
+
+    return object;
+}
+
+ref<Scene> SceneDescription::instantiate() const {
+    ref_vector<ConfigurableObject> objects;
+    return instantiate(NULL, objects);
+}
+
+ref<Scene> SceneDescription::instantiate(const SceneDescription *previous,
+        ref_vector<ConfigurableObject> &previousObjects) const {
+    if (m_nodes.empty() || m_nodes.back().cls != MTS_CLASS(Scene))
+        Log(EError, "The scene description does not end with a scene node!");
+
+    /* Group the nodes into levels, such that every node only depends
+       on nodes from lower levels. The nodes of a level are independent
+       and are created and configured in parallel. */
+    std::vector<size_t> nodeLevel(m_nodes.size());
+    std::vector<std::vector<int> > levels;
+    for (size_t i=0; i<m_nodes.size(); ++i) {
+        const Node &node = m_nodes[i];
+        size_t level = 0;
+        for (size_t j=0; j<node.children.size(); ++j)
+            level = std::max(level, nodeLevel[node.children[j].second] + 1);
+        nodeLevel[i] = level;
+        if (level >= levels.size())
+            levels.resize(level + 1);
+        levels[level].push_back((int) i);
+    }
+
+    ref_vector<ConfigurableObject> objects(m_nodes.size());
+
+    /* Reuse objects whose node and children are unchanged. Sensors and
+       samplers are always recreated, since every new scene configures
+       its sampler for the integrator (e.g. by requesting sample arrays).
+       Integrators and subsurface integrators are recreated as well: their
+       preprocess() step builds state that depends on the entire scene
+       (e.g. photon maps or irradiance octrees) only once */
+    if (previous) {
+        Assert(previousObjects.size() == previous->m_nodes.size());
+        size_t count = std::min(m_nodes.size(), previous->m_nodes.size());
+        for (size_t i=0; i<count; ++i) {
+            const Node &node = m_nodes[i], &prev = previous->m_nodes[i];
+            if (node.cls == MTS_CLASS(Scene) || node.cls != prev.cls
+                || node.cls->derivesFrom(MTS_CLASS(Sensor))
+                || node.cls->derivesFrom(MTS_CLASS(Sampler))
+                || node.cls->derivesFrom(MTS_CLASS(Integrator))
+                || node.cls->derivesFrom(MTS_CLASS(Subsurface))
+                || node.configure != prev.configure || node.children != prev.children)
+                continue;
+
+            bool reusable = true;
+            for (size_t j=0; j<node.children.size(); ++j)
+                reusable &= objects[node.children[j].second] ==
+                    previousObjects[node.children[j].second];
+
+            if (reusable && node.props == prev.props)
+                objects[i] = previousObjects[i];
+        }
+    }
+
+    ref<Mutex> mutex = new Mutex();
+    std::string errorMessage;
+
+    Thread *parentThread = Thread::getThread();
+    ref<Logger> logger = parentThread->getLogger();
+    ref<FileResolver> fileResolver = parentThread->getFileResolver();
+
+#if defined(MTS_OPENMP)
+    #pragma omp parallel
+#endif
+    {
+        Thread *thread = Thread::getThread();
+        if (!thread)
+            thread = Thread::registerUnmanagedThread("load");
+        if (thread != parentThread) {
+            thread->setLogger(logger);
+            thread->setFileResolver(fileResolver);
+        }
+
+        for (size_t level=0; level<levels.size(); ++level) {
+            const std::vector<int> &nodes = levels[level];
+
+#if defined(MTS_OPENMP)
+            #pragma omp for schedule(dynamic)
+#endif
+            for (int i=0; i<(int) nodes.size(); ++i) {
+                const Node &node = m_nodes[nodes[i]];
+                if (objects[nodes[i]].get() != NULL)
+                    continue;
+
+                /* Skip objects whose children failed to load */
+                bool ready = true;
+                for (size_t j=0; j<node.children.size(); ++j)
+                    ready &= objects[node.children[j].second].get() != NULL;
+                if (!ready)
+                    continue;
+
+                try {
+                    objects[nodes[i]] = instantiateNode(nodes[i], objects, mutex);
+                } catch (const std::exception &ex) {
+                    LockGuard lock(mutex);
+                    if (errorMessage.empty())
+                        errorMessage = formatString("%sError while creating %s plugin "
+                            "\"%s\": %s", getSourcePrefix(node).c_str(),
+                            node.cls->getName().c_str(),
+                            node.props.getPluginName().c_str(), ex.what());
+                }
+            }
+        }
+
+        /* Cleanup handlers are registered per thread (e.g. to release
+           thread-local file caches), hence every worker runs its own */
+        runSceneCleanupHandlers();
+    }
+
+    if (!errorMessage.empty())
+        Log(EError, "%s", errorMessage.c_str());
+
+    previousObjects.swap(objects);
+    return static_cast<Scene *>(previousObjects.back().get());
+}
+
+ref<Scene> SceneDescription::loadScene(const fs::path &filename) {
+    SLog(EDebug, "Loading scene description \"%s\" ..", filename.string().c_str());
+    ref<FileStream> stream = new FileStream(filename, FileStream::EReadOnly);
+    stream->setByteOrder(Stream::ELittleEndian);
+    ref<SceneDescription> description = new SceneDescription(stream);
+    return description->instantiate();
+}
+
+bool SceneDescription::isSceneDescription(const fs::path &filename) {
+    ref<FileStream> stream = new FileStream(filename, FileStream::EReadOnly);
+    if (stream->getSize() < sizeof(short))
+        return false;
+    stream->setByteOrder(Stream::ELittleEndian);
+    return stream->readShort() == MTS_SCENEDESC_HEADER;
+}
+
+std::string SceneDescription::toString() const {
+    std::ostringstream oss;
+    oss << "SceneDescription[" << endl;
+    for (size_t i=0; i<m_nodes.size(); ++i) {
+        const Node &node = m_nodes[i];
+        oss << "  " << i << ": " << node.cls->getName() << " \""
+            << node.props.getPluginName() << "\"";
+        if (!node.children.empty()) {
+            oss << " -> {";
+            for (size_t j=0; j<node.children.size(); ++j)
+                oss << (j > 0 ? ", " : " ") << node.children[j].second;
+            oss << " }";
+        }
+        oss << endl;
+    }
+    oss << "]";
+    return oss.str();
+}
+
+MTS_IMPLEMENT_CLASS(SceneDescription, false, Object)
+MTS_NAMESPACE_END
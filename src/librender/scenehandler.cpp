@@ -29,6 +29,7 @@
 #include <xercesc/util/TransService.hpp>
 #include <xercesc/sax/Locator.hpp>
 #include <mitsuba/render/scenehandler.h>
+#include <mitsuba/render/scenetemplate.h>
 #include <mitsuba/core/fresolver.h>
 #include <mitsuba/render/scene.h>
 #include <boost/algorithm/string.hpp>
@@ -41,25 +42,26 @@ XERCES_CPP_NAMESPACE_USE
 
 #define XMLLog(level, fmt, ...) Thread::getThread()->getLogger()->log(\
     level, NULL, __FILE__, __LINE__, "In file \"%s\" (near line %i): " fmt, \
-    m_locator ? transcode(m_locator->getSystemId()).c_str() : "<unknown>", \
-    m_locator ? m_locator->getLineNumber() : -1, \
-    ## __VA_ARGS__)
+    getSourceFile().c_str(), getSourceLine(), ## __VA_ARGS__)
 
 typedef void (*CleanupFun) ();
 typedef boost::unordered_set<CleanupFun> CleanupSet;
 static PrimitiveThreadLocal<CleanupSet> __cleanup_tls;
 
 SceneHandler::SceneHandler(const ParameterMap &params,
-    NamedObjectMap *namedObjects, bool isIncludedFile) : m_params(params),
-        m_namedObjects(namedObjects), m_isIncludedFile(isIncludedFile) {
-    m_pluginManager = PluginManager::getInstance();
+    NamedNodeMap *namedNodes, bool isIncludedFile) : m_params(params),
+        m_namedNodes(namedNodes), m_isIncludedFile(isIncludedFile),
+        m_instantiate(true) {
     m_locator = NULL;
+    m_template = NULL;
+    m_sceneNode = 0;
+    m_sourceLine = -1;
 
     if (m_isIncludedFile) {
-        SAssert(namedObjects != NULL);
+        SAssert(namedNodes != NULL);
     } else {
-        SAssert(namedObjects == NULL);
-        m_namedObjects = new NamedObjectMap();
+        SAssert(namedNodes == NULL);
+        m_namedNodes = new NamedNodeMap();
     }
 
 #if !defined(WIN32)
@@ -112,9 +114,31 @@ SceneHandler::SceneHandler(const ParameterMap &params,
 
 SceneHandler::~SceneHandler() {
     delete m_transcoder;
-    clear();
     if (!m_isIncludedFile)
-        delete m_namedObjects;
+        delete m_namedNodes;
+}
+
+uint32_t SceneHandler::recordNode(const std::string &element, const Class *cls,
+        const Properties &props,
+        const std::vector<std::pair<std::string, uint32_t> > &children,
+        bool configure) {
+    uint32_t index = m_description->appendNode(cls, props, configure);
+    for (std::vector<std::pair<std::string, uint32_t> >
+            ::const_iterator it = children.begin(); it != children.end(); ++it)
+        m_description->addChild(index, it->first, it->second);
+    m_description->setSource(index, element, getSourceFile(), getSourceLine());
+    return index;
+}
+
+std::string SceneHandler::getSourceFile() const {
+    if (m_locator)
+        return transcode(m_locator->getSystemId());
+    /* When replaying a scene template, the location is set explicitly */
+    return m_sourceFile.empty() ? std::string("<unknown>") : m_sourceFile;
+}
+
+int SceneHandler::getSourceLine() const {
+    return m_locator ? (int) m_locator->getLineNumber() : m_sourceLine;
 }
 
 void SceneHandler::setDocumentLocator(const xercesc::Locator* const locator) {
@@ -123,11 +147,8 @@ void SceneHandler::setDocumentLocator(const xercesc::Locator* const locator) {
 
 void SceneHandler::clear() {
     if (!m_isIncludedFile) {
-        for (NamedObjectMap::iterator it = m_namedObjects->begin();
-                it != m_namedObjects->end(); ++it)
-            if (it->second)
-                it->second->decRef();
-        m_namedObjects->clear();
+        m_namedNodes->clear();
+        m_description = new SceneDescription();
     }
 }
 
@@ -162,14 +183,11 @@ void SceneHandler::startDocument() {
 }
 
 void SceneHandler::endDocument() {
-    SAssert(m_scene != NULL);
+    /* Included files are instantiated as part of the parent document */
+    if (m_isIncludedFile || !m_instantiate)
+        return;
 
-    /* Call cleanup handlers */
-    CleanupSet &cleanup = __cleanup_tls.get();
-    for (CleanupSet::iterator it = cleanup.begin();
-            it != cleanup.end(); ++it)
-        (*it)();
-    cleanup.clear();
+    m_scene = m_description->instantiate();
 }
 
 void SceneHandler::characters(const XMLCh* const name,
@@ -196,7 +214,16 @@ Float SceneHandler::parseFloat(const std::string &name,
 
 void SceneHandler::startElement(const XMLCh* const xmlName,
     AttributeList &xmlAttributes) {
-    std::string name = transcode(xmlName);
+    AttributeVector attributes(xmlAttributes.getLength());
+    for (size_t i=0; i<xmlAttributes.getLength(); i++) {
+        attributes[i].first = transcode(xmlAttributes.getName(i));
+        attributes[i].second = transcode(xmlAttributes.getValue(i));
+    }
+    startElement(transcode(xmlName), attributes);
+}
+
+void SceneHandler::startElement(const std::string &name,
+    const AttributeVector &attributes) {
     TagMap::const_iterator it = m_tags.find(name);
 
     if (it == m_tags.end())
@@ -205,8 +232,8 @@ void SceneHandler::startElement(const XMLCh* const xmlName,
     const TagEntry &tag = it->second;
     ParseContext context((name == "scene") ? NULL : &m_context.top(), tag.first);
 
-    for (size_t i=0; i<xmlAttributes.getLength(); i++) {
-        std::string attrValue = transcode(xmlAttributes.getValue(i));
+    for (size_t i=0; i<attributes.size(); i++) {
+        std::string attrValue = attributes[i].second;
         if (attrValue.length() > 0 && attrValue.find('$') != attrValue.npos) {
             for (ParameterMap::const_reverse_iterator it = m_params.rbegin(); it != m_params.rend(); ++it) {
                 std::string::size_type pos = 0;
@@ -220,7 +247,7 @@ void SceneHandler::startElement(const XMLCh* const xmlName,
                 XMLLog(EError, "The scene referenced an undefined parameter: \"%s\"", attrValue.c_str());
         }
 
-        context.attributes[transcode(xmlAttributes.getName(i))] = attrValue;
+        context.attributes[attributes[i].first] = attrValue;
     }
 
     switch (tag.first) {
@@ -270,15 +297,26 @@ void pushSceneCleanupHandler(void (*cleanup)()) {
     __cleanup_tls.get().insert(cleanup);
 }
 
+void runSceneCleanupHandlers() {
+    CleanupSet &cleanup = __cleanup_tls.get();
+    for (CleanupSet::iterator it = cleanup.begin();
+            it != cleanup.end(); ++it)
+        (*it)();
+    cleanup.clear();
+}
+
 void SceneHandler::endElement(const XMLCh* const xmlName) {
-    std::string name = transcode(xmlName);
+    endElement(transcode(xmlName));
+}
+
+void SceneHandler::endElement(const std::string &name) {
     ParseContext &context = m_context.top();
     std::string type = boost::to_lower_copy(context.attributes["type"]);
     context.properties.setPluginName(type);
     if (context.attributes.find("id") != context.attributes.end())
         context.properties.setID(context.attributes["id"]);
 
-    ref<ConfigurableObject> object;
+    int64_t nodeIndex = -1;
 
     TagMap::const_iterator it = m_tags.find(name);
     if (it == m_tags.end())
@@ -288,18 +326,19 @@ void SceneHandler::endElement(const XMLCh* const xmlName) {
 
     switch (tag.first) {
         case EScene:
-            object = m_scene = new Scene(context.properties);
+            /* Don't configure a scene object if it is from an included file */
+            nodeIndex = m_sceneNode = recordNode(name, tag.second,
+                context.properties, context.children, !m_isIncludedFile);
             break;
 
         case ENull:
-            object = NULL;
             break;
 
         case EReference: {
                 std::string id = context.attributes["id"];
-                if (m_namedObjects->find(id) == m_namedObjects->end())
+                if (m_namedNodes->find(id) == m_namedNodes->end())
                     XMLLog(EError, "Referenced object '%s' not found!", id.c_str());
-                object = (*m_namedObjects)[id];
+                nodeIndex = (*m_namedNodes)[id];
             }
             break;
 
@@ -645,38 +684,44 @@ void SceneHandler::endElement(const XMLCh* const xmlName) {
 
         case EAlias: {
                 std::string id = context.attributes["id"], as = context.attributes["as"];
-                if (m_namedObjects->find(id) == m_namedObjects->end())
+                if (m_namedNodes->find(id) == m_namedNodes->end())
                     XMLLog(EError, "Referenced object '%s' not found!", id.c_str());
-                ConfigurableObject *obj = (*m_namedObjects)[id];
-                if (m_namedObjects->find(as) != m_namedObjects->end())
+                if (m_namedNodes->find(as) != m_namedNodes->end())
                     XMLLog(EError, "Duplicate ID '%s' used in scene description!", id.c_str());
-                obj->incRef();
-                (*m_namedObjects)[as] = obj;
+                (*m_namedNodes)[as] = (*m_namedNodes)[id];
             }
             break;
 
         case EInclude: {
-                SAXParser* parser = new SAXParser();
                 FileResolver *resolver = Thread::getThread()->getFileResolver();
-                fs::path schemaPath = resolver->resolveAbsolute("data/schema/scene.xsd");
-
-                /* Check against the 'scene.xsd' XML Schema */
-                parser->setDoSchema(true);
-                parser->setValidationSchemaFullChecking(true);
-                parser->setValidationScheme(SAXParser::Val_Always);
-                parser->setExternalNoNamespaceSchemaLocation(schemaPath.c_str());
-
-                /* Set the handler and start parsing */
-                SceneHandler *handler = new SceneHandler(m_params, m_namedObjects, true);
-                parser->setDoNamespaces(true);
-                parser->setDocumentHandler(handler);
-                parser->setErrorHandler(handler);
+                SceneHandler *handler = new SceneHandler(m_params, m_namedNodes, true);
+                handler->m_description = m_description;
+                handler->m_template = m_template;
                 fs::path path = resolver->resolve(context.attributes["filename"]);
-                XMLLog(EInfo, "Parsing included file \"%s\" ..", path.filename().string().c_str());
-                parser->parse(path.c_str());
 
-                object = handler->getScene();
-                delete parser;
+                if (m_template) {
+                    /* Replay the pre-parsed document */
+                    m_template->replay(path, handler);
+                } else {
+                    SAXParser* parser = new SAXParser();
+                    fs::path schemaPath = resolver->resolveAbsolute("data/schema/scene.xsd");
+
+                    /* Check against the 'scene.xsd' XML Schema */
+                    parser->setDoSchema(true);
+                    parser->setValidationSchemaFullChecking(true);
+                    parser->setValidationScheme(SAXParser::Val_Always);
+                    parser->setExternalNoNamespaceSchemaLocation(schemaPath.c_str());
+
+                    /* Set the handler and start parsing */
+                    parser->setDoNamespaces(true);
+                    parser->setDocumentHandler(handler);
+                    parser->setErrorHandler(handler);
+                    XMLLog(EInfo, "Parsing included file \"%s\" ..", path.filename().string().c_str());
+                    parser->parse(path.c_str());
+                    delete parser;
+                }
+
+                nodeIndex = handler->m_sceneNode;
                 delete handler;
             }
             break;
@@ -706,94 +751,46 @@ void SceneHandler::endElement(const XMLCh* const xmlName) {
                     ref<const AnimatedTransform> trafo = props.getAnimatedTransform("toWorld");
                     props.removeProperty("toWorld");
 
-                    if (trafo->isStatic())
+                    if (trafo->isStatic()) {
                         props.setTransform("toWorld", trafo->eval(0));
+                    } else {
+                        uint32_t shapeIndex = recordNode(name, tag.second, props,
+                            context.children);
 
-                    object = m_pluginManager->createObject(tag.second, props);
-
-                    if (!trafo->isStatic()) {
-                        object = m_pluginManager->createObject(tag.second, props);
-                        /* If the object has children, append them */
-                        for (std::vector<std::pair<std::string, ConfigurableObject *> >
-                                ::iterator it = context.children.begin();
-                                it != context.children.end(); ++it) {
-                            if (it->second != NULL) {
-                                object->addChild(it->first, it->second);
-                                it->second->setParent(object);
-                                it->second->decRef();
-                            }
-                        }
-                        context.children.clear();
-
-                        object->configure();
-
-                        ref<Shape> shapeGroup = static_cast<Shape *> (
-                            m_pluginManager->createObject(MTS_CLASS(Shape), Properties("shapegroup")));
-                        shapeGroup->addChild(object);
-                        shapeGroup->configure();
+                        std::vector<std::pair<std::string, uint32_t> > children;
+                        children.push_back(std::make_pair(std::string(), shapeIndex));
+                        uint32_t groupIndex = recordNode(name, MTS_CLASS(Shape),
+                            Properties("shapegroup"), children);
 
                         Properties instanceProps("instance");
                         instanceProps.setAnimatedTransform("toWorld", trafo);
-                        object = m_pluginManager->createObject(instanceProps);
-                        object->addChild(shapeGroup);
-
-                    }
-                } else {
-                    try {
-                        object = m_pluginManager->createObject(tag.second, props);
-                    } catch (const std::exception &ex) {
-                        XMLLog(EError, "Error while creating object: %s", ex.what());
+                        children[0].second = groupIndex;
+                        nodeIndex = recordNode(name, MTS_CLASS(Shape), instanceProps, children);
                     }
                 }
+
+                if (nodeIndex < 0)
+                    nodeIndex = recordNode(name, tag.second, props, context.children);
             }
             break;
     }
 
-    if (object != NULL || name == "null") {
+    if (nodeIndex >= 0 || name == "null") {
         std::string id = context.attributes["id"];
         std::string nodeName = context.attributes["name"];
 
-        if (object) {
-            /* If the object has a parent, add it to the parent's children list */
-            if (context.parent != NULL) {
-                object->incRef();
-                context.parent->children.push_back(
-                    std::pair<std::string, ConfigurableObject *>(nodeName, object));
-            }
-
-            /* If the object has children, append them */
-            for (std::vector<std::pair<std::string, ConfigurableObject *> >
-                    ::iterator it = context.children.begin();
-                    it != context.children.end(); ++it) {
-                if (it->second != NULL) {
-                    object->addChild(it->first, it->second);
-                    it->second->setParent(object);
-                    it->second->decRef();
-                }
-            }
-
-            /* Don't configure a scene object if it is from an included file */
-            if (name != "include" && (!m_isIncludedFile || !object->getClass()->derivesFrom(MTS_CLASS(Scene))))
-                object->configure();
-
-            if (object->getClass()->derivesFrom(MTS_CLASS(Texture)))
-                object = static_cast<Texture *>(object.get())->expand();
-        }
+        /* If the object has a parent, add it to the parent's children list */
+        if (nodeIndex >= 0 && context.parent != NULL)
+            context.parent->children.push_back(
+                std::pair<std::string, uint32_t>(nodeName, (uint32_t) nodeIndex));
 
         if (id != "" && name != "ref") {
-            if (m_namedObjects->find(id) != m_namedObjects->end())
+            if (m_namedNodes->find(id) != m_namedNodes->end())
                 XMLLog(EError, "Duplicate ID '%s' used in scene description!", id.c_str());
-            (*m_namedObjects)[id] = object;
-            if (object)
-                object->incRef();
+            (*m_namedNodes)[id] = nodeIndex;
         }
     }
 
-    /* Warn about unqueried properties */
-    std::vector<std::string> unq = context.properties.getUnqueried();
-    for (unsigned int i=0; i<unq.size(); ++i)
-        XMLLog(EWarn, "Unqueried attribute \"%s\" in element \"%s\"", unq[i].c_str(), name.c_str());
-
     m_context.pop();
 }
 
@@ -822,6 +819,13 @@ void SceneHandler::fatalError(const SAXParseException& e) {
 // -----------------------------------------------------------------------
 
 ref<Scene> SceneHandler::loadScene(const fs::path &filename, const ParameterMap &params) {
+    if (SceneDescription::isSceneDescription(filename)) {
+        if (!params.empty())
+            SLog(EWarn, "Scene parameters are ignored when loading the binary "
+                "scene description \"%s\"", filename.string().c_str());
+        return SceneDescription::loadScene(filename);
+    }
+
     /* Prepare for parsing scene descriptions */
     FileResolver *resolver = Thread::getThread()->getFileResolver();
     SAXParser* parser = new SAXParser();
@@ -848,6 +852,35 @@ ref<Scene> SceneHandler::loadScene(const fs::path &filename, const ParameterMap
     return scene;
 }
 
+ref<SceneDescription> SceneHandler::loadSceneDescription(const fs::path &filename,
+        const ParameterMap &params) {
+    /* Prepare for parsing scene descriptions */
+    FileResolver *resolver = Thread::getThread()->getFileResolver();
+    SAXParser* parser = new SAXParser();
+    fs::path schemaPath = resolver->resolveAbsolute("data/schema/scene.xsd");
+    SLog(EDebug, "Converting scene \"%s\" ..", filename.string().c_str());
+
+    /* Check against the 'scene.xsd' XML Schema */
+    parser->setDoSchema(true);
+    parser->setValidationSchemaFullChecking(true);
+    parser->setValidationScheme(SAXParser::Val_Always);
+    parser->setExternalNoNamespaceSchemaLocation(schemaPath.c_str());
+
+    SceneHandler *handler = new SceneHandler(params);
+    handler->m_instantiate = false;
+    parser->setDoNamespaces(true);
+    parser->setDocumentHandler(handler);
+    parser->setErrorHandler(handler);
+
+    parser->parse(filename.c_str());
+    ref<SceneDescription> description = handler->getDescription();
+
+    delete parser;
+    delete handler;
+
+    return description;
+}
+
 ref<Scene> SceneHandler::loadSceneFromString(const std::string &content, const ParameterMap &params) {
     /* Prepare for parsing scene descriptions */
     FileResolver *resolver = Thread::getThread()->getFileResolver();
@@ -0,0 +1,197 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <mitsuba/core/platform.h>
+
+// Mitsuba's "Assert" macro conflicts with Xerces' XSerializeEngine::Assert(...).
+// This becomes a problem when using a PCH which contains mitsuba/core/logger.h
+#if defined(Assert)
+# undef Assert
+#endif
+
+#include <xercesc/parsers/SAXParser.hpp>
+#include <mitsuba/render/scenehandler.h>
+#include <mitsuba/render/scenetemplate.h>
+#include <mitsuba/render/scene.h>
+#include <mitsuba/core/fresolver.h>
+
+MTS_NAMESPACE_BEGIN
+XERCES_CPP_NAMESPACE_USE
+
+namespace {
+    /**
+     * Scene handler, which records the elements of a document instead
+     * of processing them. Error handling and transcoding are inherited.
+     */
+    class DocumentRecorder : public SceneHandler {
+    public:
+        DocumentRecorder(SceneTemplate::Document &document)
+            : SceneHandler(ParameterMap()), m_document(document) { }
+
+        void startDocument() { }
+        void endDocument() { }
+
+        void startElement(const XMLCh* const name, AttributeList &attributes) {
+            SceneTemplate::Event event;
+            event.start = true;
+            event.line = getSourceLine();
+            event.name = transcode(name);
+            event.attributes.resize(attributes.getLength());
+            for (size_t i=0; i<attributes.getLength(); i++) {
+                event.attributes[i].first = transcode(attributes.getName(i));
+                event.attributes[i].second = transcode(attributes.getValue(i));
+            }
+            m_document.push_back(event);
+        }
+
+        void endElement(const XMLCh* const name) {
+            SceneTemplate::Event event;
+            event.start = false;
+            event.line = getSourceLine();
+            event.name = transcode(name);
+            m_document.push_back(event);
+        }
+    private:
+        SceneTemplate::Document &m_document;
+    };
+}
+
+SceneTemplate::SceneTemplate(const fs::path &filename)
+        : m_filename(filename), m_reusedObjectCount(0) {
+    m_mutex = new Mutex();
+
+    /* Parse and validate the top-level document right away */
+    getDocument(m_filename);
+}
+
+const SceneTemplate::Document &SceneTemplate::getDocument(const fs::path &filename) const {
+    LockGuard lock(m_mutex);
+    std::map<fs::path, Document>::const_iterator it = m_documents.find(filename);
+    if (it != m_documents.end())
+        return it->second;
+
+    FileResolver *resolver = Thread::getThread()->getFileResolver();
+    SAXParser* parser = new SAXParser();
+    fs::path schemaPath = resolver->resolveAbsolute("data/schema/scene.xsd");
+    Log(EInfo, "Parsing scene template \"%s\" ..", filename.filename().string().c_str());
+
+    /* Check against the 'scene.xsd' XML Schema */
+    parser->setDoSchema(true);
+    parser->setValidationSchemaFullChecking(true);
+    parser->setValidationScheme(SAXParser::Val_Always);
+    parser->setExternalNoNamespaceSchemaLocation(schemaPath.c_str());
+
+    Document document;
+    DocumentRecorder *recorder = new DocumentRecorder(document);
+    parser->setDoNamespaces(true);
+    parser->setDocumentHandler(recorder);
+    parser->setErrorHandler(recorder);
+
+    try {
+        parser->parse(filename.c_str());
+    } catch (...) {
+        delete parser;
+        delete recorder;
+        throw;
+    }
+
+    delete parser;
+    delete recorder;
+
+    /* std::map never invalidates references to its elements */
+    Document &result = m_documents[filename];
+    result.swap(document);
+    return result;
+}
+
+void SceneTemplate::replay(const fs::path &filename, SceneHandler *handler) const {
+    const Document &document = getDocument(filename);
+
+    handler->startDocument();
+    handler->m_sourceFile = filename.string();
+    for (size_t i=0; i<document.size(); ++i) {
+        const Event &event = document[i];
+        handler->m_sourceLine = event.line;
+        if (event.start)
+            handler->startElement(event.name, event.attributes);
+        else
+            handler->endElement(event.name);
+    }
+    handler->endDocument();
+}
+
+ref<SceneDescription> SceneTemplate::getDescription(const ParameterMap &params) const {
+    SceneHandler *handler = new SceneHandler(params);
+    handler->m_instantiate = false;
+    handler->m_template = this;
+
+    ref<SceneDescription> description;
+    try {
+        replay(m_filename, handler);
+        description = handler->getDescription();
+    } catch (...) {
+        delete handler;
+        throw;
+    }
+    delete handler;
+
+    return description;
+}
+
+ref<Scene> SceneTemplate::instantiate(const ParameterMap &params) {
+    ref<SceneDescription> description = getDescription(params);
+
+    LockGuard lock(m_mutex);
+    ref_vector<ConfigurableObject> previous = m_lastObjects;
+    ref<Scene> scene = description->instantiate(m_lastDescription.get(), m_lastObjects);
+    m_lastDescription = description;
+
+    m_reusedObjectCount = 0;
+    for (size_t i=0; i<std::min(previous.size(), m_lastObjects.size()); ++i) {
+        if (previous[i].get() == m_lastObjects[i].get())
+            ++m_reusedObjectCount;
+    }
+
+    Log(EDebug, "Instantiated scene template \"%s\" (reused %i of %i objects)",
+        m_filename.filename().string().c_str(), (int) m_reusedObjectCount,
+        (int) m_lastObjects.size());
+
+    return scene;
+}
+
+void SceneTemplate::clearCache() {
+    LockGuard lock(m_mutex);
+    m_lastDescription = NULL;
+    m_lastObjects.clear();
+    m_reusedObjectCount = 0;
+}
+
+std::string SceneTemplate::toString() const {
+    LockGuard lock(m_mutex);
+    std::ostringstream oss;
+    oss << "SceneTemplate[" << endl
+        << "  filename = \"" << m_filename.string() << "\"," << endl
+        << "  documents = " << m_documents.size() << "," << endl
+        << "  cachedObjects = " << m_lastObjects.size() << endl
+        << "]";
+    return oss.str();
+}
+
+MTS_IMPLEMENT_CLASS(SceneTemplate, false, Object)
+MTS_NAMESPACE_END
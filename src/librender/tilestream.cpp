@@ -0,0 +1,432 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/render/tilestream.h>
+#include <mitsuba/core/mmap.h>
+#include <mitsuba/core/version.h>
+
+#if defined(MTS_HAS_OPENEXR)
+#if defined(_MSC_VER)
+#pragma warning(disable : 4231) // nonstandard extension used : 'extern' before template explicit instantiation
+#endif
+#include <ImfTiledOutputFile.h>
+#include <ImfChannelList.h>
+#include <ImfStringAttribute.h>
+#include <ImfFrameBuffer.h>
+#include <ImfStandardAttributes.h>
+#endif
+
+MTS_NAMESPACE_BEGIN
+
+#if defined(MTS_HAS_OPENEXR)
+/// Writes tiles into a tiled OpenEXR file
+class OpenEXRTileWriter : public TileWriter {
+public:
+    OpenEXRTileWriter(const fs::path &filename, const Vector2i &size,
+            const Point2i &cropOffset, const Vector2i &cropSize, int blockSize,
+            const Bitmap *tile) : m_output(NULL), m_cropOffset(cropOffset),
+              m_blockSize(blockSize) {
+        const std::vector<std::string> &channelNames = tile->getChannelNames();
+        if (channelNames.size() != (size_t) tile->getChannelCount())
+            Log(EError, "The OpenEXR tile writer requires explicit channel names!");
+
+        Imath::Box2i displayWindow(Imath::V2i(0, 0), Imath::V2i(size.x - 1, size.y - 1));
+        Imath::Box2i dataWindow(Imath::V2i(cropOffset.x, cropOffset.y),
+            Imath::V2i(cropOffset.x + cropSize.x - 1, cropOffset.y + cropSize.y - 1));
+
+        Imf::Header header(displayWindow, dataWindow);
+        header.setTileDescription(Imf::TileDescription(blockSize, blockSize, Imf::ONE_LEVEL));
+        header.insert("generated-by", Imf::StringAttribute("Mitsuba version " MTS_VERSION));
+
+        /* Write a chromaticity tag when this is possible */
+        Bitmap::EPixelFormat pixelFormat = tile->getPixelFormat();
+        if (pixelFormat == Bitmap::EXYZ || pixelFormat == Bitmap::EXYZA) {
+            Imf::addChromaticities(header, Imf::Chromaticities(
+                Imath::V2f(1.0f, 0.0f),
+                Imath::V2f(0.0f, 1.0f),
+                Imath::V2f(0.0f, 0.0f),
+                Imath::V2f(1.0f/3.0f, 1.0f/3.0f)));
+        } else if (pixelFormat == Bitmap::ERGB || pixelFormat == Bitmap::ERGBA) {
+            Imf::addChromaticities(header, Imf::Chromaticities());
+        }
+
+        Imf::PixelType compType;
+        switch (tile->getComponentFormat()) {
+            case Bitmap::EFloat16: compType = Imf::HALF; break;
+            case Bitmap::EFloat32: compType = Imf::FLOAT; break;
+            case Bitmap::EUInt32: compType = Imf::UINT; break;
+            default:
+                Log(EError, "Invalid component type (must be "
+                    "float16, float32, or uint32)");
+                return;
+        }
+
+        Imf::ChannelList &channels = header.channels();
+        for (size_t i=0; i<channelNames.size(); ++i)
+            channels.insert(channelNames[i].c_str(), Imf::Channel(compType));
+
+        m_pixelStride = tile->getBytesPerPixel();
+        m_rowStride = m_pixelStride * tile->getWidth();
+        m_componentStride = tile->getBytesPerComponent();
+        m_channelNames = channelNames;
+        m_compType = compType;
+        m_output = new Imf::TiledOutputFile(filename.string().c_str(), header);
+    }
+
+    void writeTile(const Point2i &offset, const Vector2i &size, const Bitmap *tile) {
+        /* OpenEXR addresses pixels using absolute coordinates -- shift the
+           frame buffer so that the tile's upper left corner maps to its
+           position within the data window */
+        int x = m_cropOffset.x + offset.x, y = m_cropOffset.y + offset.y;
+        char *ptr = (char *) tile->getUInt8Data()
+            - (ptrdiff_t) x * m_pixelStride - (ptrdiff_t) y * m_rowStride;
+
+        Imf::FrameBuffer frameBuffer;
+        for (size_t i=0; i<m_channelNames.size(); ++i) {
+            frameBuffer.insert(m_channelNames[i].c_str(),
+                Imf::Slice(m_compType, ptr, m_pixelStride, m_rowStride));
+            ptr += m_componentStride;
+        }
+
+        m_output->setFrameBuffer(frameBuffer);
+        m_output->writeTile(offset.x / m_blockSize, offset.y / m_blockSize);
+    }
+
+    void close() {
+        delete m_output;
+        m_output = NULL;
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    virtual ~OpenEXRTileWriter() {
+        if (m_output)
+            close();
+    }
+private:
+    Imf::TiledOutputFile *m_output;
+    std::vector<std::string> m_channelNames;
+    Imf::PixelType m_compType;
+    Point2i m_cropOffset;
+    size_t m_pixelStride, m_rowStride, m_componentStride;
+    int m_blockSize;
+};
+#endif
+
+/// Writes tiles into a preallocated memory-mapped NumPy file
+class NumPyTileWriter : public TileWriter {
+public:
+    NumPyTileWriter(const fs::path &filename, const Vector2i &size,
+            const Bitmap *tile) : m_size(size) {
+        char typeChar;
+        switch (tile->getComponentFormat()) {
+            case Bitmap::EFloat16:
+            case Bitmap::EFloat32:
+            case Bitmap::EFloat64: typeChar = 'f'; break;
+            case Bitmap::EUInt32: typeChar = 'u'; break;
+            default:
+                Log(EError, "Invalid component type (must be "
+                    "float16, float32, float64, or uint32)");
+                return;
+        }
+
+        int channels = tile->getChannelCount();
+        std::string header = formatString("{'descr': '%c%c%i', 'fortran_order': False, 'shape': (%i, %i",
+            Stream::getHostByteOrder() == Stream::ELittleEndian ? '<' : '>',
+            typeChar, tile->getBytesPerComponent(), size.y, size.x);
+        if (channels > 1)
+            header += formatString(", %i), }", channels);
+        else
+            header += "), }";
+
+        /* Pad the header so that the array data is 64-byte aligned */
+        size_t headerSize = 10 + header.length() + 1;
+        headerSize = (headerSize + 63) / 64 * 64;
+        header.resize(headerSize - 11, ' ');
+        header += '\n';
+
+        m_pixelStride = tile->getBytesPerPixel();
+        size_t dataSize = (size_t) size.x * (size_t) size.y * m_pixelStride;
+        m_mmap = new MemoryMappedFile(filename, headerSize + dataSize);
+
+        uint8_t *data = (uint8_t *) m_mmap->getData();
+        const char magic[] = "\x93NUMPY";
+        memcpy(data, magic, 6);
+        data[6] = 1; data[7] = 0; /* Version 1.0 */
+        uint16_t headerLength = (uint16_t) header.length();
+        data[8] = (uint8_t) (headerLength & 0xFF);
+        data[9] = (uint8_t) (headerLength >> 8);
+        memcpy(data + 10, header.c_str(), header.length());
+        m_data = data + headerSize;
+    }
+
+    void writeTile(const Point2i &offset, const Vector2i &size, const Bitmap *tile) {
+        const uint8_t *source = tile->getUInt8Data();
+        uint8_t *target = m_data + ((size_t) offset.y * m_size.x + offset.x) * m_pixelStride;
+        size_t sourceStride = tile->getWidth() * m_pixelStride,
+               targetStride = m_size.x * m_pixelStride;
+
+        for (int y=0; y<size.y; ++y) {
+            memcpy(target, source, size.x * m_pixelStride);
+            source += sourceStride;
+            target += targetStride;
+        }
+    }
+
+    void close() {
+        m_mmap = NULL;
+        m_data = NULL;
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    virtual ~NumPyTileWriter() { }
+private:
+    ref<MemoryMappedFile> m_mmap;
+    uint8_t *m_data;
+    Vector2i m_size;
+    size_t m_pixelStride;
+};
+
+ref<TileWriter> TileWriter::createOpenEXR(const fs::path &filename,
+        const Vector2i &size, const Point2i &cropOffset,
+        const Vector2i &cropSize, int blockSize, const Bitmap *tile) {
+#if defined(MTS_HAS_OPENEXR)
+    return new OpenEXRTileWriter(filename, size, cropOffset, cropSize, blockSize, tile);
+#else
+    SLog(EError, "Streaming OpenEXR output requires OpenEXR support!");
+    return NULL;
+#endif
+}
+
+ref<TileWriter> TileWriter::createNumPy(const fs::path &filename,
+        const Vector2i &size, const Bitmap *tile) {
+    return new NumPyTileWriter(filename, size, tile);
+}
+
+TileStream::TileStream(TileWriter *writer, const Vector2i &size, int blockSize,
+        const Bitmap *tile, const std::vector<Bitmap::EPixelFormat> &pixelFormats)
+        : m_writer(writer), m_pixelFormats(pixelFormats), m_size(size),
+          m_blockSize(blockSize), m_peakUsage(0) {
+    if (tile->getWidth() != blockSize || tile->getHeight() != blockSize)
+        Log(EError, "The tile size must match the block size!");
+    m_tile = tile->clone();
+    m_blocksH = (size.x + blockSize - 1) / blockSize;
+    m_blocksV = (size.y + blockSize - 1) / blockSize;
+}
+
+TileStream::~TileStream() {
+    if (m_writer)
+        close();
+}
+
+ref<Bitmap> TileStream::createTile(int blockSize,
+        const std::vector<Bitmap::EPixelFormat> &pixelFormats,
+        Bitmap::EComponentFormat componentFormat,
+        const std::vector<std::string> &channelNames) {
+    ref<Bitmap> tile;
+    if (pixelFormats.size() == 1) {
+        tile = new Bitmap(pixelFormats[0], componentFormat,
+            Vector2i(blockSize, blockSize));
+    } else {
+        tile = new Bitmap(Bitmap::EMultiChannel, componentFormat,
+            Vector2i(blockSize, blockSize), (uint8_t) channelNames.size());
+    }
+    tile->setChannelNames(channelNames);
+    return tile;
+}
+
+ImageBlock *TileStream::acquireCopy(const ImageBlock *block) {
+    ImageBlock *copy;
+    if (!m_freeBlocks.empty()) {
+        copy = m_freeBlocks.back();
+        m_freeBlocks.pop_back();
+        block->copyTo(copy);
+    } else {
+        ref<ImageBlock> clone = block->clone();
+        copy = clone.get();
+        copy->incRef();
+        ++m_peakUsage;
+    }
+    return copy;
+}
+
+void TileStream::put(const ImageBlock *block) {
+    Assert(m_writer != NULL);
+
+    if ((block->getOffset().x % m_blockSize) != 0 ||
+        (block->getOffset().y % m_blockSize) != 0)
+        Log(EError, "Encountered an unaligned block!");
+
+    if (block->getSize().x > m_blockSize ||
+        block->getSize().y > m_blockSize)
+        Log(EError, "Encountered an oversized block!");
+
+    int x = block->getOffset().x / m_blockSize;
+    int y = block->getOffset().y / m_blockSize;
+    uint32_t idx = (uint32_t) x + (uint32_t) y * m_blocksH;
+
+    if (m_origBlocks.find(idx) != m_origBlocks.end())
+        Log(EError, "Block (%i, %i) was submitted twice -- streaming output "
+            "only supports rendering techniques that process each block once!", x, y);
+
+    /* Create two copies: a clean one, and one that is used for accumulation */
+    m_origBlocks[idx]   = acquireCopy(block);
+    m_mergedBlocks[idx] = acquireCopy(block);
+
+    for (int yo = -1; yo <= 1; ++yo)
+        for (int xo = -1; xo <= 1; ++xo)
+            potentiallyWrite(x + xo, y + yo);
+}
+
+void TileStream::potentiallyWrite(int x, int y, bool force) {
+    if (x < 0 || y < 0 || x >= m_blocksH || y >= m_blocksV)
+        return;
+
+    uint32_t idx = (uint32_t) x + (uint32_t) y * m_blocksH;
+    std::map<uint32_t, ImageBlock *>::iterator it = m_origBlocks.find(idx);
+    if (it == m_origBlocks.end() || it->second == NULL)
+        return;
+    ImageBlock *origBlock = it->second;
+
+    if (!force) {
+        /* This could be accelerated using some counters */
+        for (int yo = -1; yo <= 1; ++yo) {
+            for (int xo = -1; xo <= 1; ++xo) {
+                int xp = x + xo, yp = y + yo;
+                if (xp < 0 || yp < 0 || xp >= m_blocksH || yp >= m_blocksV
+                   || (xp == x && yp == y))
+                    continue;
+
+                uint32_t idx2 = (uint32_t) xp + (uint32_t) yp * m_blocksH;
+                if (m_origBlocks.find(idx2) == m_origBlocks.end())
+                    return; /* Not all neighboring blocks are there yet */
+            }
+        }
+    }
+
+    /* Join overlapping regions with the neighbors that have not been
+       written yet (the others already contributed when they were written) */
+    ImageBlock *mergedBlock = m_mergedBlocks[idx];
+    for (int yo = -1; yo <= 1; ++yo) {
+        for (int xo = -1; xo <= 1; ++xo) {
+            int xp = x + xo, yp = y + yo;
+            if (xp < 0 || yp < 0 || xp >= m_blocksH || yp >= m_blocksV
+               || (xp == x && yp == y))
+                continue;
+            uint32_t idx2 = (uint32_t) xp + (uint32_t) yp * m_blocksH;
+            std::map<uint32_t, ImageBlock *>::iterator it2 = m_origBlocks.find(idx2);
+            if (it2 == m_origBlocks.end() || it2->second == NULL)
+                continue;
+
+            mergedBlock->put(it2->second);
+            m_mergedBlocks[idx2]->put(origBlock);
+        }
+    }
+
+    /* Develop the block into the output format */
+    const Bitmap *source = mergedBlock->getBitmap();
+    const Vector2i &size = mergedBlock->getSize();
+    size_t sourceBpp = source->getBytesPerPixel();
+    size_t targetBpp = m_tile->getBytesPerPixel();
+
+    const uint8_t *sourceData = source->getUInt8Data()
+        + mergedBlock->getBorderSize() * sourceBpp * (1 + source->getWidth());
+    uint8_t *targetData = m_tile->getUInt8Data();
+
+    const FormatConverter *cvt = FormatConverter::getInstance(
+        std::make_pair(Bitmap::EFloat, m_tile->getComponentFormat())
+    );
+
+    for (int i=0; i<size.y; ++i) {
+        if (m_pixelFormats.size() == 1)
+            cvt->convert(source->getPixelFormat(), 1.0f, sourceData,
+                m_tile->getPixelFormat(), m_tile->getGamma(), targetData,
+                size.x);
+        else
+            Bitmap::convertMultiSpectrumAlphaWeight(source, sourceData,
+                m_tile, targetData, m_pixelFormats, m_tile->getComponentFormat(),
+                size.x);
+
+        sourceData += source->getWidth() * sourceBpp;
+        targetData += m_tile->getWidth() * targetBpp;
+    }
+
+    m_writer->writeTile(mergedBlock->getOffset(), size, m_tile);
+
+    /* Release the block */
+    m_freeBlocks.push_back(origBlock);
+    m_freeBlocks.push_back(mergedBlock);
+    m_origBlocks[idx] = NULL;
+    m_mergedBlocks[idx] = NULL;
+}
+
+void TileStream::close() {
+    if (!m_writer)
+        return;
+
+    size_t pending = 0;
+    for (std::map<uint32_t, ImageBlock *>::iterator it = m_origBlocks.begin();
+        it != m_origBlocks.end(); ++it) {
+        if (it->second)
+            ++pending;
+    }
+
+    if (pending > 0) {
+        Log(EWarn, "Writing %i tiles with incomplete neighborhoods (was the "
+            "rendering canceled?)", (int) pending);
+        for (std::map<uint32_t, ImageBlock *>::iterator it = m_origBlocks.begin();
+            it != m_origBlocks.end(); ++it) {
+            if (it->second)
+                potentiallyWrite((int) (it->first % m_blocksH),
+                    (int) (it->first / m_blocksH), true);
+        }
+    }
+
+    Log(EInfo, "Closing the output file (%i of %i tiles written, peak memory usage: %i blocks)",
+        (int) m_origBlocks.size(), m_blocksH * m_blocksV, m_peakUsage);
+
+    m_writer->close();
+    m_writer = NULL;
+
+    for (std::vector<ImageBlock *>::iterator it = m_freeBlocks.begin();
+        it != m_freeBlocks.end(); ++it)
+        (*it)->decRef();
+    m_freeBlocks.clear();
+    m_origBlocks.clear();
+    m_mergedBlocks.clear();
+}
+
+std::string TileStream::toString() const {
+    std::ostringstream oss;
+    oss << "TileStream[" << endl
+        << "  size = " << m_size.toString() << "," << endl
+        << "  blockSize = " << m_blockSize << "," << endl
+        << "  pending = " << m_origBlocks.size() << "," << endl
+        << "  peakUsage = " << m_peakUsage << endl
+        << "]";
+    return oss.str();
+}
+
+MTS_IMPLEMENT_CLASS(TileWriter, true, Object)
+#if defined(MTS_HAS_OPENEXR)
+MTS_IMPLEMENT_CLASS(OpenEXRTileWriter, false, TileWriter)
+#endif
+MTS_IMPLEMENT_CLASS(NumPyTileWriter, false, TileWriter)
+MTS_IMPLEMENT_CLASS(TileStream, false, Object)
+MTS_NAMESPACE_END
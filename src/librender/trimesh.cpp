@@ -398,6 +398,8 @@ void TriMesh::prepareSamplingTable() {
         for (size_t i=0; i<m_triangleCount; i++)
             m_areaDistr.append(m_triangles[i].surfaceArea(m_positions));
         m_surfaceArea = m_areaDistr.normalize();
+        /* Constant-time sampling for large emissive meshes */
+        m_areaDistr.buildAliasTable();
         m_invSurfaceArea = 1.0f / m_surfaceArea;
     }
 }
@@ -40,5 +40,10 @@ ref<Scene> Utility::loadSceneFromString(const std::string &content,
     return SceneHandler::loadSceneFromString(content, params);
 }
 
+ref<SceneDescription> Utility::loadSceneDescription(const fs::path &filename,
+        const ParameterMap &params) {
+    return SceneHandler::loadSceneDescription(filename, params);
+}
+
 MTS_IMPLEMENT_CLASS(Utility, true, Object)
 MTS_NAMESPACE_END
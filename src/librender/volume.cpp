@@ -54,6 +54,12 @@ Vector VolumeDataSource::lookupVector(const Point &p) const {
     return Vector();
 }
 
+void VolumeDataSource::getFloatValueRange(const AABB &aabb,
+        Float &minValue, Float &maxValue) const {
+    minValue = 0.0f;
+    maxValue = getMaximumFloatValue();
+}
+
 bool VolumeDataSource::supportsFloatLookups() const {
     return false;
 }
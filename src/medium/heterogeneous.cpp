@@ -42,6 +42,10 @@ static StatsCounter avgRayMarchingStepsSampling("Heterogeneous volume",
         "Avg. # of ray marching steps (sampling)", EAverage);
 static StatsCounter earlyExits("Heterogeneous volume",
         "Number of early exits", EPercentage);
+static StatsCounter avgMajorantCells("Heterogeneous volume",
+        "Avg. # of traversed majorant grid cells", EAverage);
+static StatsCounter emptyMajorantCells("Heterogeneous volume",
+        "Skipped empty majorant grid cells", EPercentage);
 #endif
 
 /*!\plugin{heterogeneous}{Heterogeneous participating medium}
@@ -61,9 +65,21 @@ static StatsCounter earlyExits("Heterogeneous volume",
  *             from good sample generators and not providing
  *             information that is required by bidirectional
  *             rendering techniques.
+ *             \item \code{delta}: Unbiased delta tracking (for sampling)
+ *             and residual ratio tracking (for transmittance estimates)
+ *             driven by a coarse grid of local density bounds. Empty
+ *             regions of the volume are skipped entirely, which makes
+ *             this method much faster than \code{woodcock} for sparse
+ *             volumes. Shares the limitations of \code{woodcock}
+ *             regarding bidirectional rendering techniques.
  *         \end{enumerate}
  *         Default: \texttt{woodcock}
  *     }
+ *     \parameter{majorantResolution}{\Integer}{
+ *         Number of majorant grid cells along the longest axis of
+ *         the density volume. Only used by the \code{delta} method.
+ *         \default{32}
+ *     }
  *     \parameter{density}{\Volume}{
  *         Volumetric data source that supplies the medium densities
  *         (in inverse scene units)
@@ -177,13 +193,24 @@ public:
          * incompatible with bidirectional rendering methods, which
          * usually need to know the probability of a sample.
          */
-        EWoodcockTracking
+        EWoodcockTracking,
+
+        /**
+         * \brief Use delta tracking for sampling and residual ratio
+         * tracking for transmittance estimates. Both use local density
+         * bounds from a coarse majorant grid, which is traversed using
+         * a 3D-DDA so that empty space can be skipped.
+         */
+        EDeltaTracking
     };
 
     HeterogeneousMedium(const Properties &props)
         : Medium(props) {
         m_stepSize = props.getFloat("stepSize", 0);
         m_scale = props.getFloat("scale", 1);
+        m_majorantResolution = props.getInteger("majorantResolution", 32);
+        if (m_majorantResolution <= 0)
+            Log(EError, "The 'majorantResolution' parameter must be positive!");
         if (props.hasProperty("sigmaS") || props.hasProperty("sigmaA"))
             Log(EError, "The 'sigmaS' and 'sigmaA' properties are only supported by "
                 "homogeneous media. Please use nested volume instances to supply "
@@ -197,6 +224,8 @@ public:
             m_method = EWoodcockTracking;
         else if (method == "simpson")
             m_method = ESimpsonQuadrature;
+        else if (method == "delta")
+            m_method = EDeltaTracking;
         else
             Log(EError, "Unsupported integration method \"%s\"!", method.c_str());
     }
@@ -210,6 +239,7 @@ public:
         m_albedo = static_cast<VolumeDataSource *>(manager->getInstance(stream));
         m_orientation = static_cast<VolumeDataSource *>(manager->getInstance(stream));
         m_stepSize = stream->readFloat();
+        m_majorantResolution = stream->readInt();
         configure();
     }
 
@@ -222,6 +252,7 @@ public:
         manager->serialize(stream, m_albedo.get());
         manager->serialize(stream, m_orientation.get());
         stream->writeFloat(m_stepSize);
+        stream->writeInt(m_majorantResolution);
     }
 
     void configure() {
@@ -257,6 +288,68 @@ public:
         if (m_anisotropicMedium && m_orientation.get() == NULL)
             Log(EError, "Cannot use anisotropic phase function: "
                 "did not specify a particle orientation field!");
+
+        if (m_method == EDeltaTracking)
+            buildMajorantGrid();
+    }
+
+    /**
+     * \brief Precompute a coarse grid of conservative density bounds
+     * over the bounding box of the density volume
+     */
+    void buildMajorantGrid() {
+        /* Clamp the extents so that a flat or empty bounding box
+           doesn't produce infinite or NaN cell indices */
+        Vector extents = m_densityAABB.getExtents();
+        for (int i=0; i<3; ++i)
+            extents[i] = std::max(extents[i], Epsilon);
+        Float maxExtent = std::max(std::max(extents.x, extents.y), extents.z);
+        size_t nCells = 1;
+        for (int i=0; i<3; ++i) {
+            m_majorantRes[i] = std::max(1, (int) std::ceil(
+                m_majorantResolution * extents[i] / maxExtent));
+            m_majorantCellSize[i] = extents[i] / m_majorantRes[i];
+            nCells *= m_majorantRes[i];
+        }
+        m_majorantGrid.resize(nCells);
+
+        /* The minimum is only meaningful when the density does not
+           depend on the direction of propagation */
+        const Float maxScale = m_scale *
+            (m_anisotropicMedium ? m_phaseFunction->sigmaDirMax() : 1.0f);
+        const Float minScale = m_anisotropicMedium ? 0.0f : m_scale;
+
+        #if defined(MTS_OPENMP)
+            #pragma omp parallel for schedule(dynamic)
+        #endif
+        for (int z=0; z<m_majorantRes.z; ++z) {
+            for (int y=0; y<m_majorantRes.y; ++y) {
+                for (int x=0; x<m_majorantRes.x; ++x) {
+                    Point cellMin = m_densityAABB.min + Vector(
+                        x * m_majorantCellSize.x,
+                        y * m_majorantCellSize.y,
+                        z * m_majorantCellSize.z);
+                    AABB cellAABB(cellMin, cellMin + m_majorantCellSize);
+                    Float minValue, maxValue;
+                    m_density->getFloatValueRange(cellAABB, minValue, maxValue);
+
+                    MajorantCell &cell = m_majorantGrid[
+                        (z * m_majorantRes.y + y) * m_majorantRes.x + x];
+                    cell.minDensity = std::max((Float) 0.0f, minValue * minScale);
+                    cell.maxDensity = std::max(cell.minDensity, maxValue * maxScale);
+                }
+            }
+        }
+
+        size_t nEmpty = 0;
+        for (size_t i=0; i<nCells; ++i)
+            if (m_majorantGrid[i].maxDensity == 0)
+                ++nEmpty;
+
+        Log(EDebug, "Built a %ix%ix%i majorant grid (%s, %.1f%% empty)",
+            m_majorantRes.x, m_majorantRes.y, m_majorantRes.z,
+            memString(nCells * sizeof(MajorantCell)).c_str(),
+            100.0f * nEmpty / (Float) nCells);
     }
 
     void addChild(const std::string &name, ConfigurableObject *child) {
@@ -546,6 +639,16 @@ public:
     Spectrum evalTransmittance(const Ray &ray, Sampler *sampler) const {
         if (m_method == ESimpsonQuadrature || sampler == NULL) {
             return Spectrum(math::fastexp(-integrateDensity(ray)));
+        } else if (m_method == EDeltaTracking) {
+            Float mint, maxt;
+            if (!m_densityAABB.rayIntersect(ray, mint, maxt))
+                return Spectrum(1.0f);
+            mint = std::max(mint, ray.mint);
+            maxt = std::min(maxt, ray.maxt);
+            if (mint >= maxt)
+                return Spectrum(1.0f);
+
+            return Spectrum(ratioTracking(ray, mint, maxt, sampler));
         } else {
             /* When Woodcock tracking is selected as the sampling method,
                we can use this method to get a noisy (but unbiased) estimate
@@ -630,32 +733,42 @@ public:
             maxt = std::min(maxt, ray.maxt);
 
             Float t = mint, densityAtT = 0;
-            while (true) {
-                t -= math::fastlog(1-sampler->next1D()) * m_invMaxDensity;
-                if (t >= maxt)
-                    break;
+            bool collided = false;
+            if (m_method == EDeltaTracking) {
+                if (mint < maxt)
+                    collided = deltaTracking(ray, mint, maxt, sampler, t, densityAtT);
+            } else {
+                while (true) {
+                    t -= math::fastlog(1-sampler->next1D()) * m_invMaxDensity;
+                    if (t >= maxt)
+                        break;
 
-                Point p = ray(t);
-                densityAtT = lookupDensity(p, ray.d) * m_scale;
-                #if defined(HETVOL_STATISTICS)
-                    ++avgRayMarchingStepsSampling;
-                #endif
-                if (densityAtT * m_invMaxDensity > sampler->next1D()) {
-                    mRec.t = t;
-                    mRec.p = p;
-                    Spectrum albedo = m_albedo->lookupSpectrum(p);
-                    mRec.sigmaS = albedo * densityAtT;
-                    mRec.sigmaA = Spectrum(densityAtT) - mRec.sigmaS;
-                    mRec.transmittance = Spectrum(densityAtT != 0.0f ? 1.0f / densityAtT : 0);
-                    if (!std::isfinite(mRec.transmittance[0])) // prevent rare overflow warnings
-                        mRec.transmittance = Spectrum(0.0f);
-                    mRec.orientation = m_orientation != NULL
-                        ? m_orientation->lookupVector(p) : Vector(0.0f);
-                    mRec.medium = this;
-                    success = true;
-                    break;
+                    densityAtT = lookupDensity(ray(t), ray.d) * m_scale;
+                    #if defined(HETVOL_STATISTICS)
+                        ++avgRayMarchingStepsSampling;
+                    #endif
+                    if (densityAtT * m_invMaxDensity > sampler->next1D()) {
+                        collided = true;
+                        break;
+                    }
                 }
             }
+
+            if (collided) {
+                Point p = ray(t);
+                mRec.t = t;
+                mRec.p = p;
+                Spectrum albedo = m_albedo->lookupSpectrum(p);
+                mRec.sigmaS = albedo * densityAtT;
+                mRec.sigmaA = Spectrum(densityAtT) - mRec.sigmaS;
+                mRec.transmittance = Spectrum(densityAtT != 0.0f ? 1.0f / densityAtT : 0);
+                if (!std::isfinite(mRec.transmittance[0])) // prevent rare overflow warnings
+                    mRec.transmittance = Spectrum(0.0f);
+                mRec.orientation = m_orientation != NULL
+                    ? m_orientation->lookupVector(p) : Vector(0.0f);
+                mRec.medium = this;
+                success = true;
+            }
         }
         mRec.medium = this;
 
@@ -701,6 +814,7 @@ public:
             << "  albedo = " << indent(m_albedo.toString()) << "," << endl
             << "  orientation = " << indent(m_orientation.toString()) << "," << endl
             << "  stepSize = " << m_stepSize << "," << endl
+            << "  majorantResolution = " << m_majorantResolution << "," << endl
             << "  scale = " << m_scale << endl
             << "]";
         return oss.str();
@@ -708,6 +822,201 @@ public:
 
     MTS_DECLARE_CLASS()
 protected:
+    /// Conservative bounds on the (scaled) density within a majorant grid cell
+    struct MajorantCell {
+        Float minDensity;
+        Float maxDensity;
+    };
+
+    /**
+     * \brief Visits the majorant grid cells pierced by a ray segment
+     * in front-to-back order using a 3D-DDA (Amanatides and Woo)
+     */
+    class MajorantIterator {
+    public:
+        MajorantIterator(const HeterogeneousMedium *medium, const Ray &ray,
+                Float mint, Float maxt) : m_medium(medium), m_t(mint), m_maxt(maxt) {
+            const AABB &aabb = medium->m_densityAABB;
+            const Vector &cellSize = medium->m_majorantCellSize;
+            const Vector3i &res = medium->m_majorantRes;
+            Point p = ray(mint);
+
+            for (int i=0; i<3; ++i) {
+                int cell = math::floorToInt((p[i] - aabb.min[i]) / cellSize[i]);
+                m_cell[i] = std::min(std::max(cell, 0), res[i] - 1);
+                Float invD = 1.0f / ray.d[i];
+
+                if (ray.d[i] > 0) {
+                    m_step[i] = 1;
+                    m_next[i] = mint + (aabb.min[i] + (m_cell[i] + 1) * cellSize[i] - p[i]) * invD;
+                    m_delta[i] = cellSize[i] * invD;
+                } else if (ray.d[i] < 0) {
+                    m_step[i] = -1;
+                    m_next[i] = mint + (aabb.min[i] + m_cell[i] * cellSize[i] - p[i]) * invD;
+                    m_delta[i] = -cellSize[i] * invD;
+                } else {
+                    m_step[i] = 0;
+                    m_next[i] = std::numeric_limits<Float>::infinity();
+                    m_delta[i] = 0;
+                }
+            }
+        }
+
+        /**
+         * \brief Advance to the next cell
+         *
+         * \return \c false when the end of the segment has been reached
+         */
+        inline bool next(Float &t0, Float &t1, const MajorantCell *&cell) {
+            if (m_t >= m_maxt)
+                return false;
+
+            const Vector3i &res = m_medium->m_majorantRes;
+            int axis = (m_next[0] < m_next[1])
+                ? ((m_next[0] < m_next[2]) ? 0 : 2)
+                : ((m_next[1] < m_next[2]) ? 1 : 2);
+
+            cell = &m_medium->m_majorantGrid[
+                (m_cell[2] * res.y + m_cell[1]) * res.x + m_cell[0]];
+            t0 = m_t;
+            t1 = std::max(t0, std::min(m_next[axis], m_maxt));
+            m_t = t1;
+
+            m_cell[axis] += m_step[axis];
+            m_next[axis] += m_delta[axis];
+            if (m_cell[axis] < 0 || m_cell[axis] >= res[axis])
+                m_t = m_maxt;
+
+            #if defined(HETVOL_STATISTICS)
+                ++avgMajorantCells;
+            #endif
+            return true;
+        }
+
+    private:
+        const HeterogeneousMedium *m_medium;
+        Float m_t, m_maxt;
+        int m_cell[3], m_step[3];
+        Float m_next[3], m_delta[3];
+    };
+
+    /**
+     * \brief Sample a free-flight distance within <tt>[mint, maxt]</tt>
+     * using delta tracking against the local majorants
+     *
+     * \return \c true if a real collision was sampled. In this case,
+     * \c t and \c densityAtT store its location and the density there.
+     */
+    bool deltaTracking(const Ray &ray, Float mint, Float maxt,
+            Sampler *sampler, Float &t, Float &densityAtT) const {
+        MajorantIterator it(this, ray, mint, maxt);
+        const MajorantCell *cell;
+        Float t0, t1;
+
+        #if defined(HETVOL_STATISTICS)
+            avgMajorantCells.incrementBase();
+        #endif
+
+        /* Optical depth (w.r.t. the majorant) until the next tentative collision */
+        Float tau = -math::fastlog(1-sampler->next1D());
+
+        while (it.next(t0, t1, cell)) {
+            const Float majorant = cell->maxDensity;
+            #if defined(HETVOL_STATISTICS)
+                emptyMajorantCells.incrementBase();
+            #endif
+            if (majorant == 0) {
+                #if defined(HETVOL_STATISTICS)
+                    ++emptyMajorantCells;
+                #endif
+                continue;
+            }
+
+            t = t0;
+            while (true) {
+                Float segmentTau = (t1 - t) * majorant;
+                if (tau >= segmentTau) {
+                    tau -= segmentTau;
+                    break;
+                }
+
+                t += tau / majorant;
+                densityAtT = lookupDensity(ray(t), ray.d) * m_scale;
+                #if defined(HETVOL_STATISTICS)
+                    ++avgRayMarchingStepsSampling;
+                #endif
+                if (densityAtT > majorant * sampler->next1D())
+                    return true;
+
+                tau = -math::fastlog(1-sampler->next1D());
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * \brief Estimate the transmittance along <tt>[mint, maxt]</tt>
+     * using residual ratio tracking
+     *
+     * The lower density bound of each majorant cell is handled
+     * analytically, and only the residual density is tracked.
+     * Russian roulette terminates low-throughput estimates.
+     */
+    Float ratioTracking(const Ray &ray, Float mint, Float maxt,
+            Sampler *sampler) const {
+        MajorantIterator it(this, ray, mint, maxt);
+        const MajorantCell *cell;
+        Float t0, t1, transmittance = 1.0f;
+
+        #if defined(HETVOL_STATISTICS)
+            avgMajorantCells.incrementBase();
+            avgRayMarchingStepsTransmittance.incrementBase();
+        #endif
+
+        while (it.next(t0, t1, cell)) {
+            #if defined(HETVOL_STATISTICS)
+                emptyMajorantCells.incrementBase();
+            #endif
+            if (cell->maxDensity == 0) {
+                #if defined(HETVOL_STATISTICS)
+                    ++emptyMajorantCells;
+                #endif
+                continue;
+            }
+
+            transmittance *= math::fastexp(-cell->minDensity * (t1 - t0));
+
+            const Float residualMajorant = cell->maxDensity - cell->minDensity;
+            if (residualMajorant > 0) {
+                const Float invResidualMajorant = 1.0f / residualMajorant;
+                Float t = t0;
+                while (true) {
+                    t -= math::fastlog(1-sampler->next1D()) * invResidualMajorant;
+                    if (t >= t1)
+                        break;
+
+                    Float density = lookupDensity(ray(t), ray.d) * m_scale;
+                    transmittance *= std::max((Float) 0.0f,
+                        1.0f - (density - cell->minDensity) * invResidualMajorant);
+
+                    #if defined(HETVOL_STATISTICS)
+                        ++avgRayMarchingStepsTransmittance;
+                    #endif
+                }
+            }
+
+            if (transmittance < 0.1f) {
+                Float q = std::max((Float) 0.05f, 1.0f - transmittance);
+                if (sampler->next1D() < q)
+                    return 0.0f;
+                transmittance /= 1.0f - q;
+            }
+        }
+
+        return transmittance;
+    }
+
     inline Float lookupDensity(const Point &p, const Vector &d) const {
         Float density = m_density->lookupFloat(p);
         if (m_anisotropicMedium && density != 0) {
@@ -730,6 +1039,10 @@ protected:
     AABB m_densityAABB;
     Float m_maxDensity;
     Float m_invMaxDensity;
+    int m_majorantResolution;
+    Vector3i m_majorantRes;
+    Vector m_majorantCellSize;
+    std::vector<MajorantCell> m_majorantGrid;
 };
 
 MTS_IMPLEMENT_CLASS_S(HeterogeneousMedium, false, Medium)
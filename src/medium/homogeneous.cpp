@@ -265,6 +265,10 @@ public:
 
     Spectrum evalTransmittance(const Ray &ray, Sampler *) const {
         Float negLength = ray.mint - ray.maxt;
+        if (EXPECT_TAKEN(std::isfinite(negLength)))
+            return (m_sigmaT * negLength).exp();
+
+        /* Avoid 0*inf in channels without extinction */
         Spectrum transmittance;
         for (int i=0; i<SPECTRUM_SAMPLES; ++i)
             transmittance[i] = m_sigmaT[i] != 0
@@ -314,21 +318,17 @@ public:
             success = false;
         }
 
+        mRec.transmittance = (m_sigmaT * (-sampledDistance)).exp();
+
         switch (m_strategy) {
             case EMaximum:
                 mRec.pdfFailure = 1-m_maxExpDist->cdf(sampledDistance);
                 break;
 
             case EBalance:
-                mRec.pdfFailure = 0;
-                mRec.pdfSuccess = 0;
-                for (int i=0; i<SPECTRUM_SAMPLES; ++i) {
-                    Float tmp = math::fastexp(-m_sigmaT[i] * sampledDistance);
-                    mRec.pdfFailure += tmp;
-                    mRec.pdfSuccess += m_sigmaT[i] * tmp;
-                }
-                mRec.pdfFailure /= SPECTRUM_SAMPLES;
-                mRec.pdfSuccess /= SPECTRUM_SAMPLES;
+                /* Average of the per-channel densities, reusing the transmittance */
+                mRec.pdfFailure = mRec.transmittance.average();
+                mRec.pdfSuccess = (m_sigmaT * mRec.transmittance).average();
                 break;
 
             case ESingle:
@@ -341,7 +341,6 @@ public:
                 Log(EError, "Unknown sampling strategy!");
         }
 
-        mRec.transmittance = (m_sigmaT * (-sampledDistance)).exp();
         mRec.pdfSuccessRev = mRec.pdfSuccess = mRec.pdfSuccess * m_mediumSamplingWeight;
         mRec.pdfFailure = m_mediumSamplingWeight * mRec.pdfFailure + (1-m_mediumSamplingWeight);
         mRec.medium = this;
@@ -353,6 +352,8 @@ public:
 
     void eval(const Ray &ray, MediumSamplingRecord &mRec) const {
         Float distance = ray.maxt - ray.mint;
+        mRec.transmittance = (m_sigmaT * (-distance)).exp();
+
         switch (m_strategy) {
             case EManual:
             case ESingle: {
@@ -362,17 +363,9 @@ public:
                 }
                 break;
 
-            case EBalance: {
-                    mRec.pdfSuccess = 0;
-                    mRec.pdfFailure = 0;
-                    for (int i=0; i<SPECTRUM_SAMPLES; ++i) {
-                        Float temp = math::fastexp(-m_sigmaT[i] * distance);
-                        mRec.pdfSuccess += m_sigmaT[i] * temp;
-                        mRec.pdfFailure += temp;
-                    }
-                    mRec.pdfSuccess /= SPECTRUM_SAMPLES;
-                    mRec.pdfFailure /= SPECTRUM_SAMPLES;
-                }
+            case EBalance:
+                mRec.pdfSuccess = (m_sigmaT * mRec.transmittance).average();
+                mRec.pdfFailure = mRec.transmittance.average();
                 break;
 
             case EMaximum:
@@ -384,7 +377,6 @@ public:
                 Log(EError, "Unknown sampling strategy!");
         }
 
-        mRec.transmittance = (m_sigmaT * (-distance)).exp();
         mRec.pdfSuccess = mRec.pdfSuccessRev = mRec.pdfSuccess * m_mediumSamplingWeight;
         mRec.pdfFailure = mRec.pdfFailure * m_mediumSamplingWeight + (1-m_mediumSamplingWeight);
         mRec.sigmaA = m_sigmaA;
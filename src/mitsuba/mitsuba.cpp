@@ -376,8 +376,13 @@ int mitsuba_app(int argc, char **argv) {
 
             SLog(EInfo, "Parsing scene description from \"%s\" ..", argv[i]);
 
-            parser->parse(filename.c_str());
-            ref<Scene> scene = handler->getScene();
+            ref<Scene> scene;
+            if (SceneDescription::isSceneDescription(filename)) {
+                scene = SceneDescription::loadScene(filename);
+            } else {
+                parser->parse(filename.c_str());
+                scene = handler->getScene();
+            }
 
             scene->setSourceFile(filename);
             scene->setDestinationFile(destFile.length() > 0 ?
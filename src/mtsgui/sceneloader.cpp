@@ -117,15 +117,20 @@ void SceneLoader::run() {
                 SLog(EError, "Unable to load scene \"%s\": file not found!",
                     filename.string().c_str());
 
-            try {
-                parser->parse(filename.c_str());
-            } catch (const VersionException &ex) {
-                m_versionError = true;
-                m_version = ex.getVersion();
-                throw;
-            }
+            ref<Scene> scene;
+            if (SceneDescription::isSceneDescription(filename)) {
+                scene = SceneDescription::loadScene(filename);
+            } else {
+                try {
+                    parser->parse(filename.c_str());
+                } catch (const VersionException &ex) {
+                    m_versionError = true;
+                    m_version = ex.getVersion();
+                    throw;
+                }
 
-            ref<Scene> scene = handler->getScene();
+                scene = handler->getScene();
+            }
 
             scene->setSourceFile(filename);
             scene->setDestinationFile(m_destFile.empty() ? (filePath / baseName) : m_destFile);
@@ -0,0 +1,403 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/render/sampler.h>
+#include <mitsuba/core/lock.h>
+#include <mitsuba/core/qmc.h>
+#include <mitsuba/core/random.h>
+#include "sobolseq.h"
+
+/* Edge length of the (tileable) blue noise mask */
+#define MASK_SIZE 64
+
+/* Number of bits of the mask ranks */
+#define MASK_BITS 12
+
+MTS_NAMESPACE_BEGIN
+
+/**
+ * \brief Tileable blue noise dither mask created using the
+ * void-and-cluster method by Ulichney
+ *
+ * The mask stores the rank (0, ..., MASK_SIZE^2-1) of each pixel as a
+ * 16-bit integer. Thresholding it at any level produces a blue noise
+ * point pattern.
+ */
+class BlueNoiseMask : public Object {
+public:
+    BlueNoiseMask() {
+        const int pixels = MASK_SIZE * MASK_SIZE;
+        const Float sigma = 1.5f;
+
+        /* Toroidal Gaussian energy kernel */
+        m_kernel.resize(pixels);
+        for (int y=0; y<MASK_SIZE; ++y) {
+            for (int x=0; x<MASK_SIZE; ++x) {
+                int dx = std::min(x, MASK_SIZE - x),
+                    dy = std::min(y, MASK_SIZE - y);
+                m_kernel[y * MASK_SIZE + x] = std::exp(-(dx*dx + dy*dy) / (2 * sigma * sigma));
+            }
+        }
+
+        /* Random initial pattern with a density of 10% */
+        std::vector<uint8_t> initial(pixels, 0);
+        std::vector<Float> initialEnergy(pixels, 0.0f);
+        ref<Random> random = new Random((uint64_t) 5489);
+        int ones = 0;
+        while (ones < pixels / 10) {
+            int index = (int) random->nextUInt(pixels);
+            if (!initial[index]) {
+                toggle(initial, initialEnergy, index);
+                ++ones;
+            }
+        }
+
+        /* Iteratively move the point in the tightest cluster
+           to the largest void until the pattern converges. Ties in
+           the energy could make this cycle, hence the iteration cap */
+        const int maxIterations = 4 * pixels;
+        int iteration = 0;
+        for (; iteration < maxIterations; ++iteration) {
+            int cluster = findExtremum(initial, initialEnergy, true);
+            toggle(initial, initialEnergy, cluster);
+            int largestVoid = findExtremum(initial, initialEnergy, false);
+            toggle(initial, initialEnergy, largestVoid);
+            if (cluster == largestVoid)
+                break;
+        }
+        if (iteration == maxIterations)
+            SLog(EWarn, "The blue noise initial pattern did not converge "
+                "within %i iterations", maxIterations);
+
+        m_ranks.resize(pixels);
+
+        /* Phase 1: remove the initial points in order of decreasing density */
+        std::vector<uint8_t> pattern(initial);
+        std::vector<Float> energy(initialEnergy);
+        for (int rank = ones - 1; rank >= 0; --rank) {
+            int cluster = findExtremum(pattern, energy, true);
+            toggle(pattern, energy, cluster);
+            m_ranks[cluster] = (uint16_t) rank;
+        }
+
+        /* Phases 2 and 3: fill the largest voids. Once the majority of the
+           pixels is set, Ulichney's method looks for the tightest cluster of
+           unset pixels, which is the same pixel since the energies of set and
+           unset pixels add up to a constant. */
+        for (int rank = ones; rank < pixels; ++rank) {
+            int largestVoid = findExtremum(initial, initialEnergy, false);
+            toggle(initial, initialEnergy, largestVoid);
+            m_ranks[largestVoid] = (uint16_t) rank;
+        }
+
+        m_kernel.clear();
+    }
+
+    /// Return the rank of the given pixel (with periodic wrapping)
+    inline uint32_t getRank(int x, int y) const {
+        return m_ranks[(y & (MASK_SIZE - 1)) * MASK_SIZE + (x & (MASK_SIZE - 1))];
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    virtual ~BlueNoiseMask() { }
+
+    /// Set or clear a pixel and update the energy of all pixels
+    void toggle(std::vector<uint8_t> &pattern, std::vector<Float> &energy, int index) {
+        Float sign = pattern[index] ? -1.0f : 1.0f;
+        pattern[index] = !pattern[index];
+        int px = index % MASK_SIZE, py = index / MASK_SIZE;
+        for (int y=0; y<MASK_SIZE; ++y) {
+            const Float *kernel = &m_kernel[((y - py) & (MASK_SIZE - 1)) * MASK_SIZE];
+            Float *target = &energy[y * MASK_SIZE];
+            for (int x=0; x<MASK_SIZE; ++x)
+                target[x] += sign * kernel[(x - px) & (MASK_SIZE - 1)];
+        }
+    }
+
+    /// Find the set pixel of maximal energy or the unset pixel of minimal energy
+    int findExtremum(const std::vector<uint8_t> &pattern,
+            const std::vector<Float> &energy, bool cluster) const {
+        int result = -1;
+        for (int i=0; i<(int) pattern.size(); ++i) {
+            if ((pattern[i] != 0) != cluster)
+                continue;
+            if (result < 0 || (cluster ? energy[i] > energy[result]
+                                       : energy[i] < energy[result]))
+                result = i;
+        }
+        return result;
+    }
+
+private:
+    std::vector<Float> m_kernel;
+    std::vector<uint16_t> m_ranks;
+};
+
+/*!\plugin{bluenoise}{Blue noise dithered Sobol sampler}
+ * \order{8}
+ * \parameters{
+ *     \parameter{sampleCount}{\Integer}{
+ *       Number of samples per pixel. Any value can be used, but powers
+ *       of two produce the best stratification \default{4}
+ *     }
+ *     \parameter{seed}{\Integer}{
+ *       Seed value, which can be used to break up temporally coherent noise
+ *       when rendering the frames of an animation \default{0}
+ *     }
+ * }
+ * This plugin generates the Sobol sequence (see \pluginref{sobol}) in
+ * every pixel, but scrambles it differently in each pixel and dimension
+ * so that the remaining Monte Carlo error is distributed as
+ * \emph{blue noise} in screen space \cite{Georgiev2016Blue}. Neighboring
+ * pixels then tend to have errors of opposite sign, which is perceived
+ * as much less objectionable than white noise and is removed
+ * particularly well by low-pass filters and denoisers. The effect is
+ * most pronounced at low sample counts.
+ *
+ * The scrambling is a digital shift (XOR) of the Sobol points. Its most
+ * significant bits are taken from a tileable $64\times 64$ blue noise
+ * dither mask, which is created once using the void-and-cluster method
+ * \cite{Ulichney1993Void} and stored as a table of 16-bit ranks. Every
+ * dimension reads the mask at a different toroidal offset, and the less
+ * significant bits are random. Digital shifts preserve the elementary
+ * interval stratification of the Sobol sequence, hence every power-of-two
+ * prefix of the samples of a pixel remains well-distributed, and the sample
+ * count can be increased progressively.
+ *
+ * Like the \pluginref{sobol} sampler, this plugin provides up to 1024
+ * dimensions, and its output is deterministic.
+ */
+class BlueNoiseSampler : public Sampler {
+public:
+    BlueNoiseSampler() : Sampler(Properties()) { }
+
+    BlueNoiseSampler(const Properties &props) : Sampler(props) {
+        /* Number of samples per pixel */
+        m_sampleCount = props.getSize("sampleCount", 4);
+
+        /* Seed value, which can be used to break up temporally coherent
+           noise patterns when rendering the frames of an animation. */
+        m_seed = (uint32_t) props.getInteger("seed", 0);
+
+        m_arrayStartDim = m_arrayEndDim = 5;
+        m_pixelPosition = Point2i(0);
+        m_pixelSeed = 0;
+        m_indexOffset = 0;
+    }
+
+    BlueNoiseSampler(Stream *stream, InstanceManager *manager)
+     : Sampler(stream, manager) {
+        m_seed = stream->readUInt();
+        m_arrayStartDim = stream->readUInt();
+        m_arrayEndDim = stream->readUInt();
+        m_pixelPosition = Point2i(0);
+        m_pixelSeed = 0;
+        m_indexOffset = 0;
+        configure();
+    }
+
+    void serialize(Stream *stream, InstanceManager *manager) const {
+        Sampler::serialize(stream, manager);
+        stream->writeUInt(m_seed);
+        stream->writeUInt(m_arrayStartDim);
+        stream->writeUInt(m_arrayEndDim);
+    }
+
+    void configure() {
+        Sampler::configure();
+
+        /* Only create one mask per address space */
+        LockGuard guard(m_globalMaskMutex);
+        if (m_globalMask == NULL)
+            m_globalMask = new BlueNoiseMask();
+        m_mask = m_globalMask;
+    }
+
+    ref<Sampler> clone() {
+        ref<BlueNoiseSampler> sampler = new BlueNoiseSampler();
+        sampler->m_sampleCount = m_sampleCount;
+        sampler->m_sampleIndex = m_sampleIndex;
+        sampler->m_dimension = m_dimension;
+        sampler->m_seed = m_seed;
+        sampler->m_pixelSeed = m_pixelSeed;
+        sampler->m_indexOffset = m_indexOffset;
+        sampler->m_pixelPosition = m_pixelPosition;
+        sampler->m_arrayStartDim = m_arrayStartDim;
+        sampler->m_arrayEndDim = m_arrayEndDim;
+        sampler->m_mask = m_mask;
+        for (size_t i=0; i<m_req1D.size(); ++i)
+            sampler->request1DArray(m_req1D[i]);
+        for (size_t i=0; i<m_req2D.size(); ++i)
+            sampler->request2DArray(m_req2D[i]);
+        return sampler.get();
+    }
+
+    void generate(const Point2i &pos) {
+        m_pixelPosition = pos;
+        uint64_t hash = sampleTEA((uint32_t) pos.x, (uint32_t) pos.y);
+        m_pixelSeed = (uint32_t) sampleTEA((uint32_t) hash ^ (uint32_t) (hash >> 32), m_seed);
+        m_indexOffset = getPassOffset(m_sampleCount);
+
+        /* Dimensions reserved to sample array requests */
+        m_arrayStartDim = 5;
+        m_arrayEndDim = m_arrayStartDim +
+                static_cast<uint32_t>(m_req1D.size() + 2 * m_req2D.size());
+
+        if (m_arrayEndDim > sobol::Matrices::num_dimensions)
+            Log(EError, "Too many sample arrays were requested!");
+
+        /* Consecutive blocks of the Sobol sequence are assigned to the samples */
+        uint64_t offsets[32];
+        sobol::look_up_offsets(0, offsets);
+
+        uint32_t dim = m_arrayStartDim;
+        for (size_t i=0; i<m_req1D.size(); i++) {
+            size_t count = m_sampleCount * m_req1D[i];
+            sobol::sampleBatch(getPassOffset(count), offsets, (uint32_t) count,
+                dim, getScramble(dim), m_sampleArrays1D[i]);
+            dim += 1;
+        }
+
+        for (size_t i=0; i<m_req2D.size(); i++) {
+            size_t count = m_sampleCount * m_req2D[i];
+            if (m_column.size() < 2 * count)
+                m_column.resize(2 * count);
+            uint64_t base = getPassOffset(count);
+            sobol::sampleBatch(base, offsets, (uint32_t) count, dim,
+                getScramble(dim), &m_column[0]);
+            sobol::sampleBatch(base, offsets, (uint32_t) count, dim+1,
+                getScramble(dim+1), &m_column[count]);
+            for (size_t j=0; j<count; ++j)
+                m_sampleArrays2D[i][j] = Point2(m_column[j], m_column[count+j]);
+            dim += 2;
+        }
+
+        setSampleIndex(0);
+    }
+
+    void advance() {
+        m_sampleIndex++;
+        m_dimension = 0;
+        m_dimension1DArray = m_dimension2DArray = 0;
+    }
+
+    void setSampleIndex(size_t sampleIndex) {
+        m_sampleIndex = sampleIndex;
+        m_dimension = 0;
+        m_dimension1DArray = m_dimension2DArray = 0;
+    }
+
+    Float fetch1D() {
+        /* Skip over dimensions that were reserved to arrays */
+        if (m_dimension >= m_arrayStartDim && m_dimension < m_arrayEndDim)
+            m_dimension = m_arrayEndDim;
+
+        if (m_dimension >= sobol::Matrices::num_dimensions)
+            Log(EError, "Lookup dimension exceeds the direction number table size! You "
+                "may have to reduce the 'maxDepth' parameter of your integrator.");
+
+        uint32_t dim = m_dimension++;
+        return sobol::sample(m_indexOffset + m_sampleIndex, dim, getScramble(dim));
+    }
+
+    Point2 fetch2D() {
+        /* Skip over dimensions that were reserved to arrays */
+        if (m_dimension + 1 >= m_arrayStartDim && m_dimension < m_arrayEndDim)
+            m_dimension = m_arrayEndDim;
+
+        if (m_dimension + 1 >= sobol::Matrices::num_dimensions)
+            Log(EError, "Lookup dimension exceeds the direction number table size! You "
+                "may have to reduce the 'maxDepth' parameter of your integrator.");
+
+        uint32_t dim = m_dimension;
+        m_dimension += 2;
+        return Point2(
+            sobol::sample(m_indexOffset + m_sampleIndex, dim, getScramble(dim)),
+            sobol::sample(m_indexOffset + m_sampleIndex, dim+1, getScramble(dim+1)));
+    }
+
+    std::string toString() const {
+        std::ostringstream oss;
+        oss << "BlueNoiseSampler[" << endl
+            << "  sampleCount = " << m_sampleCount << "," << endl
+            << "  sampleIndex = " << m_sampleIndex << "," << endl
+            << "  seed = " << m_seed << endl
+            << "]";
+        return oss.str();
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    /**
+     * \brief Compute the digital shift of a dimension in the current pixel
+     *
+     * The most significant bits are the rank of the pixel in the blue
+     * noise mask, which is offset along a 2D golden ratio sequence for
+     * every dimension. This decorrelates the dimensions while
+     * preserving the spectral properties of each one.
+     */
+    inline uint64_t getScramble(uint32_t dim) const {
+        uint32_t index = dim + m_seed * 1024;
+        /* Multiples of 1/p and 1/p^2 modulo one, where p is the plastic number */
+        int offsetX = (int) (((uint64_t) (index * 0xC13FA9A9U) * MASK_SIZE) >> 32),
+            offsetY = (int) (((uint64_t) (index * 0x91E10DA5U) * MASK_SIZE) >> 32);
+        uint64_t rank = m_mask->getRank(m_pixelPosition.x + offsetX,
+            m_pixelPosition.y + offsetY);
+        uint64_t random = sampleTEA(m_pixelSeed, dim);
+
+#if defined(SINGLE_PRECISION)
+        return (rank << (32 - MASK_BITS)) | (random & ((1ULL << (32 - MASK_BITS)) - 1));
+#else
+        const int bits = sobol::Matrices::size;
+        return (rank << (bits - MASK_BITS)) | (random & ((1ULL << (bits - MASK_BITS)) - 1));
+#endif
+    }
+
+    /**
+     * \brief Return the index of the first point of the current sample
+     * pass when \c count points are drawn per pass
+     *
+     * Passes are aligned to powers of two so that the points of each one
+     * form a well-stratified block of the Sobol sequence.
+     */
+    inline uint64_t getPassOffset(size_t count) const {
+        return (uint64_t) m_samplePass * math::roundToPowerOfTwo(count);
+    }
+
+private:
+    uint32_t m_dimension;
+    uint32_t m_seed;
+    uint32_t m_pixelSeed;
+    uint64_t m_indexOffset;
+    uint32_t m_arrayStartDim;
+    uint32_t m_arrayEndDim;
+    Point2i m_pixelPosition;
+    std::vector<Float> m_column;
+    ref<const BlueNoiseMask> m_mask;
+    static ref<const BlueNoiseMask> m_globalMask;
+    static ref<Mutex> m_globalMaskMutex;
+};
+
+ref<Mutex> BlueNoiseSampler::m_globalMaskMutex = new Mutex();
+ref<const BlueNoiseMask> BlueNoiseSampler::m_globalMask = NULL;
+
+MTS_IMPLEMENT_CLASS(BlueNoiseMask, false, Object)
+MTS_IMPLEMENT_CLASS_S(BlueNoiseSampler, false, Sampler)
+MTS_EXPORT_PLUGIN(BlueNoiseSampler, "Blue noise dithered Sobol sampler");
+MTS_NAMESPACE_END
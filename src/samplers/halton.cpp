@@ -28,6 +28,9 @@
 
 #define MAX_RESOLUTION 128
 
+/* Upper bound on the number of entries of the per-pixel sample table */
+#define TABLE_BUDGET (1 << 18)
+
 MTS_NAMESPACE_BEGIN
 
 /*!\plugin{halton}{Halton QMC sampler}
@@ -114,7 +117,7 @@ MTS_NAMESPACE_BEGIN
  */
 class HaltonSampler : public Sampler {
 public:
-    HaltonSampler() : Sampler(Properties()) { }
+    HaltonSampler() : Sampler(Properties()), m_stamp(0) { }
 
     HaltonSampler(const Properties &props) : Sampler(props) {
         /* Number of samples per pixel */
@@ -126,6 +129,7 @@ public:
 
         setFilmResolution(Vector2i(1), false);
         m_arrayStartDim = m_arrayEndDim = 5;
+        m_stamp = 0;
     }
 
     HaltonSampler(Stream *stream, InstanceManager *manager)
@@ -140,6 +144,7 @@ public:
         m_primePowers = Vector2i(stream);
         m_primeExponents = Vector2i(stream);
         m_pixelPosition = Point2i(0);
+        m_stamp = 0;
         configure();
     }
 
@@ -293,35 +298,37 @@ public:
             m_offset %= m_stride;
         }
 
+        /* Later sample passes continue with the following points of the pixel */
+        m_offset += m_stride * (uint64_t) (m_sampleCount * m_samplePass);
+
+        /* Invalidate the per-pixel sample table */
+        size_t tableDims = m_sampleCount > TABLE_BUDGET ? 0 : std::min(
+            primeTableSize, TABLE_BUDGET / m_sampleCount);
+        if (m_table.size() != tableDims * m_sampleCount) {
+            m_table.resize(tableDims * m_sampleCount);
+            m_tableStamp.clear();
+            m_tableStamp.resize(tableDims, 0);
+            m_stamp = 0;
+        }
+        ++m_stamp;
+
         uint32_t dim = m_arrayStartDim;
         for (size_t i=0; i<m_req1D.size(); i++) {
-            if (!m_permutations.get()) {
-                for (size_t j=0; j<m_sampleCount * m_req1D[i]; ++j)
-                    m_sampleArrays1D[i][j] = radicalInverseFast(dim, m_offset + j * m_stride);
-            } else {
-                uint16_t *perm = m_permutations->getPermutation(dim);
-                for (size_t j=0; j<m_sampleCount * m_req1D[i]; ++j)
-                    m_sampleArrays1D[i][j] = scrambledRadicalInverseFast(dim, m_offset + j * m_stride, perm);
-            }
+            radicalInverseArray(dim, m_offset, m_stride, m_sampleCount * m_req1D[i],
+                m_sampleArrays1D[i], getPermutation(dim));
             dim += 1;
         }
 
         for (size_t i=0; i<m_req2D.size(); i++) {
-            if (!m_permutations.get()) {
-                for (size_t j=0; j<m_sampleCount * m_req2D[i]; ++j) {
-                    m_sampleArrays2D[i][j] = Point2(
-                        radicalInverseFast(dim,   m_offset + j * m_stride),
-                        radicalInverseFast(dim+1, m_offset + j * m_stride));
-                }
-            } else {
-                uint16_t *perm1 = m_permutations->getPermutation(dim);
-                uint16_t *perm2 = m_permutations->getPermutation(dim+1);
-                for (size_t j=0; j<m_sampleCount * m_req2D[i]; ++j) {
-                    m_sampleArrays2D[i][j] = Point2(
-                        scrambledRadicalInverseFast(dim,   m_offset + j * m_stride, perm1),
-                        scrambledRadicalInverseFast(dim+1, m_offset + j * m_stride, perm2));
-                }
-            }
+            size_t count = m_sampleCount * m_req2D[i];
+            if (m_column.size() < 2 * count)
+                m_column.resize(2 * count);
+            radicalInverseArray(dim, m_offset, m_stride, count,
+                &m_column[0], getPermutation(dim));
+            radicalInverseArray(dim+1, m_offset, m_stride, count,
+                &m_column[count], getPermutation(dim+1));
+            for (size_t j=0; j<count; ++j)
+                m_sampleArrays2D[i][j] = Point2(m_column[j], m_column[count+j]);
             dim += 2;
         }
 
@@ -340,8 +347,24 @@ public:
         m_dimension1DArray = m_dimension2DArray = 0;
     }
 
+    inline uint16_t *getPermutation(uint32_t dim) const {
+        return m_permutations.get() ? m_permutations->getPermutation(dim) : NULL;
+    }
+
     inline Float nextFloat(uint64_t idx) {
         uint32_t dim = m_dimension++;
+
+        if (dim < m_tableStamp.size() && m_sampleIndex < m_sampleCount) {
+            /* Compute this dimension for all samples of the pixel at once */
+            Float *column = &m_table[dim * m_sampleCount];
+            if (m_tableStamp[dim] != m_stamp) {
+                radicalInverseArray(dim, m_offset, m_stride, m_sampleCount,
+                    column, getPermutation(dim));
+                m_tableStamp[dim] = m_stamp;
+            }
+            return column[m_sampleIndex];
+        }
+
         if (m_permutations != NULL)
             return scrambledRadicalInverseFast(dim, idx,
                 m_permutations->getPermutation(dim));
@@ -349,7 +372,7 @@ public:
             return radicalInverseFast(dim, idx);
     }
 
-    Float next1D() {
+    Float fetch1D() {
         /* Skip over dimensions that were reserved to arrays */
         if (m_dimension >= m_arrayStartDim && m_dimension < m_arrayEndDim)
             m_dimension = m_arrayEndDim;
@@ -361,7 +384,7 @@ public:
         return nextFloat(index);
     }
 
-    Point2 next2D() {
+    Point2 fetch2D() {
         /* Skip over dimensions that were reserved to arrays */
         if (m_dimension + 1 >= m_arrayStartDim && m_dimension < m_arrayEndDim)
             m_dimension = m_arrayEndDim;
@@ -415,6 +438,12 @@ private:
     Vector2i m_primePowers;
     Vector2i m_primeExponents;
     Point2i m_pixelPosition;
+
+    /* Lazily generated dimensions of the current pixel (dimension-major) */
+    std::vector<Float> m_table;
+    std::vector<size_t> m_tableStamp;
+    std::vector<Float> m_column;
+    size_t m_stamp;
 };
 
 ref<Mutex> HaltonSampler::m_globalPermutationsMutex = new Mutex();
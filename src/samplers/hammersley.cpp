@@ -232,6 +232,21 @@ public:
         m_sampleIndex = sampleIndex;
     }
 
+    /**
+     * \brief Rotate a sample value of the given dimension (Cranley-Patterson)
+     *
+     * A Hammersley point set can't be extended by further points of the
+     * same pixel. Later sample passes therefore use the same points, each
+     * pass shifted by a different pseudorandom offset. The first pass
+     * is left unchanged.
+     */
+    inline Float rotate(Float value, uint32_t dim) const {
+        if (m_samplePass == 0)
+            return value;
+        value += sampleTEAFloat(dim, (uint32_t) m_samplePass);
+        return value < 1 ? value : value - 1;
+    }
+
     inline Float nextFloat(uint64_t idx) {
         uint32_t dim = m_dimension++;
         if (dim == 0)
@@ -243,7 +258,7 @@ public:
             return radicalInverseFast(dim-1, idx);
     }
 
-    Float next1D() {
+    Float fetch1D() {
         /* Skip over dimensions that were reserved to arrays */
         if (m_dimension >= m_arrayStartDim && m_dimension < m_arrayEndDim)
             m_dimension = m_arrayEndDim;
@@ -253,10 +268,11 @@ public:
         if (m_sampleIndex >= m_samplesPerBatch)
             Log(EError, "Sample index exceeded the maximum count!");
 
-        return nextFloat(m_offset + m_stride * m_sampleIndex);
+        uint32_t dim = m_dimension;
+        return rotate(nextFloat(m_offset + m_stride * m_sampleIndex), dim);
     }
 
-    Point2 next2D() {
+    Point2 fetch2D() {
         /* Skip over dimensions that were reserved to arrays */
         if (m_dimension + 1 >= m_arrayStartDim && m_dimension < m_arrayEndDim)
             m_dimension = m_arrayEndDim;
@@ -267,9 +283,11 @@ public:
             Log(EError, "Sample index exceeded the maximum count!");
 
         uint64_t index = m_offset + m_stride * m_sampleIndex;
+        uint32_t dim = m_dimension;
 
+        /* The first two dimensions are rotated within the pixel */
         Float value1, value2;
-        if (m_dimension == 0) {
+        if (dim == 0) {
             value1 = nextFloat(index) * m_resolution.x - m_pixelPosition.x;
             value2 = nextFloat(index) * m_resolution.y - m_pixelPosition.y;
         } else {
@@ -277,7 +295,7 @@ public:
             value2 = nextFloat(index);
         }
 
-        return Point2(value1, value2);
+        return Point2(rotate(value1, dim), rotate(value2, dim + 1));
     }
 
     std::string toString() const {
@@ -92,14 +92,26 @@ public:
         m_dimension1DArray = m_dimension2DArray = 0;
     }
 
-    Float next1D() {
-        return m_random->nextFloat();
+    /* Random numbers are generated in batches, which lets Sampler::next1D()
+       and Sampler::next2D() serve most requests without a virtual call */
+    Float fetch1D() {
+        for (int i=0; i<EBatchSize; ++i)
+            m_batch1D[i] = m_random->nextFloat();
+        m_cache1D = m_batch1D + 1;
+        m_cacheEnd1D = m_batch1D + EBatchSize;
+        return m_batch1D[0];
     }
 
-    Point2 next2D() {
-        Float value1 = m_random->nextFloat();
-        Float value2 = m_random->nextFloat();
-        return Point2(value1, value2);
+    Point2 fetch2D() {
+        for (int i=0; i<EBatchSize; ++i) {
+            /// Enforce a specific order of evaluation
+            Float value1 = m_random->nextFloat();
+            Float value2 = m_random->nextFloat();
+            m_batch2D[i] = Point2(value1, value2);
+        }
+        m_cache2D = m_batch2D + 1;
+        m_cacheEnd2D = m_batch2D + EBatchSize;
+        return m_batch2D[0];
     }
 
     std::string toString() const {
@@ -112,7 +124,11 @@ public:
 
     MTS_DECLARE_CLASS()
 private:
+    enum { EBatchSize = 64 };
+
     ref<Random> m_random;
+    Float m_batch1D[EBatchSize];
+    Point2 m_batch2D[EBatchSize];
 };
 
 MTS_IMPLEMENT_CLASS_S(IndependentSampler, false, Sampler)
@@ -58,6 +58,8 @@ MTS_NAMESPACE_BEGIN
  * using numbers generated by a Mersenne Twister pseudorandom number generator \cite{Saito2008SIMD}.
  * Note that due to internal storage costs, low discrepancy samples are only provided
  * up to a certain dimension, after which independent sampling takes over.
+ * The point sets of the individual dimensions are only generated once a
+ * dimension is actually requested within a pixel.
  * The name of this plugin stems from the fact that (0, 2) sequences minimize the so-called
  * \emph{star disrepancy}, which is a quality criterion on their spatial distribution. By
  * now, the name has become slightly misleading since there are other samplers in Mitsuba
@@ -86,14 +88,7 @@ public:
                     SIZE_T_FMT, m_sampleCount);
         }
 
-        m_samples1D = new Float*[m_maxDimension];
-        m_samples2D = new Point2*[m_maxDimension];
-
-        for (size_t i=0; i<m_maxDimension; i++) {
-            m_samples1D[i] = new Float[m_sampleCount];
-            m_samples2D[i] = new Point2[m_sampleCount];
-        }
-
+        allocate();
         m_random = new Random();
     }
 
@@ -101,22 +96,14 @@ public:
      : Sampler(stream, manager) {
         m_random = static_cast<Random *>(manager->getInstance(stream));
         m_maxDimension = stream->readSize();
-
-        m_samples1D = new Float*[m_maxDimension];
-        m_samples2D = new Point2*[m_maxDimension];
-        for (size_t i=0; i<m_maxDimension; i++) {
-            m_samples1D[i] = new Float[(size_t) m_sampleCount];
-            m_samples2D[i] = new Point2[(size_t) m_sampleCount];
-        }
+        allocate();
     }
 
     virtual ~LowDiscrepancySampler() {
-        for (size_t i=0; i<m_maxDimension; i++) {
-            delete[] m_samples1D[i];
-            delete[] m_samples2D[i];
-        }
         delete[] m_samples1D;
         delete[] m_samples2D;
+        delete[] m_column1D;
+        delete[] m_column2D;
     }
 
     void serialize(Stream *stream, InstanceManager *manager) const {
@@ -131,12 +118,7 @@ public:
         sampler->m_sampleCount = m_sampleCount;
         sampler->m_maxDimension = m_maxDimension;
         sampler->m_random = new Random(m_random);
-        sampler->m_samples1D = new Float*[m_maxDimension];
-        sampler->m_samples2D = new Point2*[m_maxDimension];
-        for (size_t i=0; i<m_maxDimension; i++) {
-            sampler->m_samples1D[i] = new Float[m_sampleCount];
-            sampler->m_samples2D[i] = new Point2[m_sampleCount];
-        }
+        sampler->allocate();
         for (size_t i=0; i<m_req1D.size(); ++i)
             sampler->request1DArray(m_req1D[i]);
         for (size_t i=0; i<m_req2D.size(); ++i)
@@ -145,6 +127,19 @@ public:
         return sampler.get();
     }
 
+    /**
+     * Allocate the sample tables. They are stored in sample-major order
+     * (i.e. all dimensions of a sample are adjacent in memory), which
+     * allows Sampler::next1D() and Sampler::next2D() to read them directly.
+     */
+    void allocate() {
+        m_samples1D = new Float[m_sampleCount * m_maxDimension];
+        m_samples2D = new Point2[m_sampleCount * m_maxDimension];
+        m_column1D = new Float[m_sampleCount];
+        m_column2D = new Point2[m_sampleCount];
+        m_generated1D = m_generated2D = 0;
+    }
+
     inline void generate1D(Float *samples, size_t sampleCount) {
         #if defined(SINGLE_PRECISION)
             uint32_t scramble = m_random->nextULong() & 0xFFFFFFFF;
@@ -182,11 +177,24 @@ public:
         m_random->shuffle(samples, samples + sampleCount);
     }
 
-    void generate(const Point2i &) {
-        for (size_t i=0; i<m_maxDimension; ++i) {
-            generate1D(m_samples1D[i], m_sampleCount);
-            generate2D(m_samples2D[i], m_sampleCount);
+    /// Point the cache of the base class to the current sample
+    inline void resetCache() {
+        if (EXPECT_NOT_TAKEN(m_sampleIndex >= m_sampleCount)) {
+            /* Let fetch1D() and fetch2D() catch the out-of-bounds access */
+            m_cache1D = m_cacheEnd1D = NULL;
+            m_cache2D = m_cacheEnd2D = NULL;
+            return;
         }
+        m_cache1D = m_samples1D + m_sampleIndex * m_maxDimension;
+        m_cacheEnd1D = m_cache1D + m_generated1D;
+        m_cache2D = m_samples2D + m_sampleIndex * m_maxDimension;
+        m_cacheEnd2D = m_cache2D + m_generated2D;
+    }
+
+    void generate(const Point2i &) {
+        /* The per-dimension point sets are created lazily by fetch1D()
+           and fetch2D() when a dimension is first used within the pixel */
+        m_generated1D = m_generated2D = 0;
 
         for (size_t i=0; i<m_req1D.size(); i++)
             generate1D(m_sampleArrays1D[i], m_sampleCount * m_req1D[i]);
@@ -195,36 +203,49 @@ public:
             generate2D(m_sampleArrays2D[i], m_sampleCount * m_req2D[i]);
 
         m_sampleIndex = 0;
-        m_dimension1D = m_dimension2D = 0;
         m_dimension1DArray = m_dimension2DArray = 0;
+        resetCache();
     }
 
     void advance() {
         m_sampleIndex++;
-        m_dimension1D = m_dimension2D = 0;
         m_dimension1DArray = m_dimension2DArray = 0;
+        resetCache();
     }
 
     void setSampleIndex(size_t sampleIndex) {
         m_sampleIndex = sampleIndex;
-        m_dimension1D = m_dimension2D = 0;
         m_dimension1DArray = m_dimension2DArray = 0;
+        resetCache();
     }
 
-    Float next1D() {
+    Float fetch1D() {
         Assert(m_sampleIndex < m_sampleCount);
-        if (m_dimension1D < m_maxDimension)
-            return m_samples1D[m_dimension1D++][m_sampleIndex];
-        else
+        if (m_generated1D < m_maxDimension) {
+            /* First use of this dimension within the pixel: create its point set */
+            generate1D(m_column1D, m_sampleCount);
+            Float *target = m_samples1D + m_generated1D++;
+            for (size_t i=0; i<m_sampleCount; ++i)
+                target[i * m_maxDimension] = m_column1D[i];
+            ++m_cacheEnd1D;
+            return *m_cache1D++;
+        } else {
             return m_random->nextFloat();
+        }
     }
 
-    Point2 next2D() {
+    Point2 fetch2D() {
         Assert(m_sampleIndex < m_sampleCount);
-        if (m_dimension2D < m_maxDimension)
-            return m_samples2D[m_dimension2D++][m_sampleIndex];
-        else
+        if (m_generated2D < m_maxDimension) {
+            generate2D(m_column2D, m_sampleCount);
+            Point2 *target = m_samples2D + m_generated2D++;
+            for (size_t i=0; i<m_sampleCount; ++i)
+                target[i * m_maxDimension] = m_column2D[i];
+            ++m_cacheEnd2D;
+            return *m_cache2D++;
+        } else {
             return Point2(m_random->nextFloat(), m_random->nextFloat());
+        }
     }
 
     std::string toString() const {
@@ -240,10 +261,9 @@ public:
 private:
     ref<Random> m_random;
     size_t m_maxDimension;
-    size_t m_dimension1D;
-    size_t m_dimension2D;
-    Float **m_samples1D;
-    Point2 **m_samples2D;
+    size_t m_generated1D, m_generated2D;
+    Float *m_samples1D, *m_column1D;
+    Point2 *m_samples2D, *m_column2D;
 };
 
 MTS_IMPLEMENT_CLASS_S(LowDiscrepancySampler, false, Sampler)
@@ -0,0 +1,341 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/render/sampler.h>
+#include <mitsuba/core/lock.h>
+#include <mitsuba/core/qmc.h>
+
+/* Number of independently scrambled point sets */
+#define PMJ02_SET_COUNT 8
+
+/* Maximum number of precomputed points per set. Points beyond
+   this limit are computed on the fly. */
+#define PMJ02_MAX_TABLE_SIZE (1 << 16)
+
+MTS_NAMESPACE_BEGIN
+
+/// Reverse the bits of a 32-bit integer
+static inline uint32_t reverseBits(uint32_t n) {
+    n = (n << 16) | (n >> 16);
+    n = ((n & 0x00ff00ff) << 8) | ((n & 0xff00ff00) >> 8);
+    n = ((n & 0x0f0f0f0f) << 4) | ((n & 0xf0f0f0f0) >> 4);
+    n = ((n & 0x33333333) << 2) | ((n & 0xcccccccc) >> 2);
+    n = ((n & 0x55555555) << 1) | ((n & 0xaaaaaaaa) >> 1);
+    return n;
+}
+
+/**
+ * Hash-based permutation by Laine and Karras. Every output bit only
+ * depends on the input bits of equal or lower significance, hence the
+ * lower k bits of the result are a permutation of the lower k input bits.
+ */
+static inline uint32_t lainePermutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+/// Owen-scramble a 32-bit fixed point value (see Burley 2020)
+static inline uint32_t owenScramble(uint32_t value, uint32_t seed) {
+    return reverseBits(lainePermutation(reverseBits(value), seed));
+}
+
+/**
+ * \brief Precomputed pmj02 point sets, which are shared by all sampler
+ * instances with the same table size
+ *
+ * The points are stored as pairs of 32-bit fixed point numbers.
+ */
+class PMJ02Table : public Object {
+public:
+    PMJ02Table(size_t size) : m_size(size) {
+        m_points.resize(2 * size * PMJ02_SET_COUNT);
+        for (int set=0; set<PMJ02_SET_COUNT; ++set) {
+            uint32_t *points = &m_points[2 * size * set];
+            for (size_t i=0; i<size; ++i)
+                evalPoint((uint32_t) i, set, points[2*i], points[2*i+1]);
+        }
+    }
+
+    /**
+     * \brief Compute a point of the given set
+     *
+     * The first two dimensions of the Sobol sequence form a (0,2)-sequence,
+     * whose Owen-scrambled variant satisfies all stratification properties
+     * of a progressive multi-jittered (0,2) sequence.
+     */
+    static inline void evalPoint(uint32_t index, int set, uint32_t &x, uint32_t &y) {
+        uint64_t seed = sampleTEA((uint32_t) set, 0x2f0b9f3dU);
+
+        uint32_t sobol = 0;
+        for (uint32_t i = index, v = 1U << 31; i != 0; i >>= 1, v ^= v >> 1)
+            if (i & 1)
+                sobol ^= v;
+
+        x = owenScramble(reverseBits(index), (uint32_t) seed);
+        y = owenScramble(sobol, (uint32_t) (seed >> 32));
+    }
+
+    /// Look up (or compute) a point of the given set
+    inline void getPoint(uint32_t index, int set, uint32_t &x, uint32_t &y) const {
+        if (EXPECT_TAKEN(index < m_size)) {
+            const uint32_t *point = &m_points[2 * (m_size * set + index)];
+            x = point[0]; y = point[1];
+        } else {
+            evalPoint(index, set, x, y);
+        }
+    }
+
+    /// Return the number of precomputed points per set
+    inline size_t getSize() const { return m_size; }
+
+    MTS_DECLARE_CLASS()
+protected:
+    virtual ~PMJ02Table() { }
+private:
+    size_t m_size;
+    std::vector<uint32_t> m_points;
+};
+
+/*!\plugin{pmj02}{Progressive multi-jittered (0,2) sampler}
+ * \order{7}
+ * \parameters{
+ *     \parameter{sampleCount}{\Integer}{
+ *       Number of samples per pixel. Any value can be used, but powers
+ *       of two produce the best stratification \default{4}
+ *     }
+ *     \parameter{seed}{\Integer}{
+ *       Seed value, which can be used to break up temporally coherent noise
+ *       when rendering the frames of an animation \default{0}
+ *     }
+ * }
+ * This plugin generates progressive multi-jittered (0,2) sequences (pmj02)
+ * as proposed by Christensen et al. \cite{Christensen2018Progressive}.
+ * Every prefix of the sequence whose length is a power of two is a
+ * $(0,m,2)$-net, i.e. it is stratified with respect to all elementary
+ * intervals of the unit square, including the 1D, 2D jittered and
+ * multi-jittered strata. The error of low sample count renderings
+ * therefore converges considerably faster than with the
+ * \pluginref{independent} or \pluginref{stratified} samplers, and the
+ * sample count can be increased progressively without losing
+ * this property.
+ *
+ * The point sets are constructed by Owen-scrambling the first two
+ * dimensions of the Sobol sequence using the hashing scheme proposed
+ * by Burley \cite{Burley2020Practical}, which satisfies the same
+ * stratification properties. A small number of such sets is precomputed
+ * once and stored compactly in fixed point format. Each dimension of each pixel
+ * then selects one of them, shuffles the sample order in a way that
+ * preserves the progressive stratification, and applies a random
+ * digital shift. This decorrelates the dimensions from each other.
+ *
+ * The output of this sampler is deterministic, hence subsequent runs
+ * and multicore or network renderings will always compute the same image.
+ */
+class PMJ02Sampler : public Sampler {
+public:
+    PMJ02Sampler() : Sampler(Properties()) { }
+
+    PMJ02Sampler(const Properties &props) : Sampler(props) {
+        /* Number of samples per pixel */
+        m_sampleCount = props.getSize("sampleCount", 4);
+
+        /* Seed value, which can be used to break up temporally coherent
+           noise patterns when rendering the frames of an animation. */
+        m_seed = (uint32_t) props.getInteger("seed", 0);
+        m_pixelSeed = 0;
+        m_indexOffset = 0;
+    }
+
+    PMJ02Sampler(Stream *stream, InstanceManager *manager)
+     : Sampler(stream, manager) {
+        m_seed = stream->readUInt();
+        m_pixelSeed = 0;
+        m_indexOffset = 0;
+        configure();
+    }
+
+    void serialize(Stream *stream, InstanceManager *manager) const {
+        Sampler::serialize(stream, manager);
+        stream->writeUInt(m_seed);
+    }
+
+    void configure() {
+        Sampler::configure();
+
+        size_t tableSize = std::min((size_t) PMJ02_MAX_TABLE_SIZE,
+            (size_t) math::roundToPowerOfTwo((uint32_t) m_sampleCount));
+
+        /* Only create one set of tables per address space */
+        LockGuard guard(m_globalTableMutex);
+        if (m_globalTable == NULL || m_globalTable->getSize() != tableSize)
+            m_globalTable = new PMJ02Table(tableSize);
+        m_table = m_globalTable;
+    }
+
+    ref<Sampler> clone() {
+        ref<PMJ02Sampler> sampler = new PMJ02Sampler();
+        sampler->m_sampleCount = m_sampleCount;
+        sampler->m_sampleIndex = m_sampleIndex;
+        sampler->m_dimension = m_dimension;
+        sampler->m_seed = m_seed;
+        sampler->m_pixelSeed = m_pixelSeed;
+        sampler->m_indexOffset = m_indexOffset;
+        sampler->m_table = m_table;
+        for (size_t i=0; i<m_req1D.size(); ++i)
+            sampler->request1DArray(m_req1D[i]);
+        for (size_t i=0; i<m_req2D.size(); ++i)
+            sampler->request2DArray(m_req2D[i]);
+        return sampler.get();
+    }
+
+    void generate(const Point2i &pos) {
+        uint64_t hash = sampleTEA((uint32_t) pos.x, (uint32_t) pos.y);
+        m_pixelSeed = (uint32_t) sampleTEA((uint32_t) hash ^ (uint32_t) (hash >> 32), m_seed);
+        m_indexOffset = getPassOffset(m_sampleCount);
+
+        /* Sample arrays use separate point sets, whose consecutive
+           power-of-two sized blocks are assigned to the samples */
+        uint32_t id = 0x80000000U;
+        for (size_t i=0; i<m_req1D.size(); i++) {
+            size_t count = m_sampleCount * m_req1D[i];
+            uint32_t offset = getPassOffset(count);
+            for (size_t j=0; j<count; ++j) {
+                uint32_t x, y;
+                samplePoint(id, offset + (uint32_t) j, count, x, y);
+                m_sampleArrays1D[i][j] = toFloat(x);
+            }
+            ++id;
+        }
+
+        for (size_t i=0; i<m_req2D.size(); i++) {
+            size_t count = m_sampleCount * m_req2D[i];
+            uint32_t offset = getPassOffset(count);
+            for (size_t j=0; j<count; ++j) {
+                uint32_t x, y;
+                samplePoint(id, offset + (uint32_t) j, count, x, y);
+                m_sampleArrays2D[i][j] = Point2(toFloat(x), toFloat(y));
+            }
+            ++id;
+        }
+
+        setSampleIndex(0);
+    }
+
+    void advance() {
+        m_sampleIndex++;
+        m_dimension = 0;
+        m_dimension1DArray = m_dimension2DArray = 0;
+    }
+
+    void setSampleIndex(size_t sampleIndex) {
+        m_sampleIndex = sampleIndex;
+        m_dimension = 0;
+        m_dimension1DArray = m_dimension2DArray = 0;
+    }
+
+    Float fetch1D() {
+        uint32_t x, y;
+        samplePoint(m_dimension++, m_indexOffset + (uint32_t) m_sampleIndex, m_sampleCount, x, y);
+        return toFloat(x);
+    }
+
+    Point2 fetch2D() {
+        uint32_t x, y;
+        samplePoint(m_dimension++, m_indexOffset + (uint32_t) m_sampleIndex, m_sampleCount, x, y);
+        return Point2(toFloat(x), toFloat(y));
+    }
+
+    std::string toString() const {
+        std::ostringstream oss;
+        oss << "PMJ02Sampler[" << endl
+            << "  sampleCount = " << m_sampleCount << "," << endl
+            << "  sampleIndex = " << m_sampleIndex << "," << endl
+            << "  seed = " << m_seed << endl
+            << "]";
+        return oss.str();
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    /**
+     * \brief Return point \c index of the pmj02 sequence that is used by
+     * the given dimension of the current pixel
+     *
+     * The sample order is shuffled within aligned blocks of the next
+     * power of two above \c count by Owen-scrambling the index bits: every
+     * bit is flipped depending on the more significant bits only. Each
+     * aligned block of 2^k indices (in particular, each power-of-two prefix)
+     * is thus mapped onto another aligned block, whose points form a
+     * (0,m,2)-net as well. The digital shift (XOR) maps elementary intervals
+     * onto elementary intervals and preserves this property too.
+     */
+    inline void samplePoint(uint32_t dimension, uint32_t index, size_t count,
+            uint32_t &x, uint32_t &y) const {
+        uint64_t hash1 = sampleTEA(m_pixelSeed, dimension),
+                 hash2 = sampleTEA(m_pixelSeed ^ 0x5bd1e995U, dimension);
+
+        uint32_t mask = math::roundToPowerOfTwo((uint32_t) count) - 1;
+        index = (owenScramble(index & mask, (uint32_t) hash1) & mask) | (index & ~mask);
+
+        m_table->getPoint(index, (int) ((hash1 >> 32) % PMJ02_SET_COUNT), x, y);
+        x ^= (uint32_t) hash2;
+        y ^= (uint32_t) (hash2 >> 32);
+    }
+
+    /**
+     * \brief Return the index of the first point of the current sample
+     * pass when \c count points are drawn per pass
+     *
+     * Since pmj02 sequences are progressive, every power-of-two sized block
+     * of points is itself well-stratified, and later passes simply continue
+     * with the next block.
+     */
+    inline uint32_t getPassOffset(size_t count) const {
+        return (uint32_t) (m_samplePass * math::roundToPowerOfTwo(count));
+    }
+
+    /// Convert a 32-bit fixed point value into a floating point value in [0, 1)
+    inline static Float toFloat(uint32_t value) {
+#if defined(SINGLE_PRECISION)
+        return (Float) (value >> 8) * (1.0f / (1 << 24));
+#else
+        return (Float) value * (1.0 / (1ULL << 32));
+#endif
+    }
+
+private:
+    uint32_t m_dimension;
+    uint32_t m_seed;
+    uint32_t m_pixelSeed;
+    uint32_t m_indexOffset;
+    ref<const PMJ02Table> m_table;
+    static ref<const PMJ02Table> m_globalTable;
+    static ref<Mutex> m_globalTableMutex;
+};
+
+ref<Mutex> PMJ02Sampler::m_globalTableMutex = new Mutex();
+ref<const PMJ02Table> PMJ02Sampler::m_globalTable = NULL;
+
+MTS_IMPLEMENT_CLASS(PMJ02Table, false, Object)
+MTS_IMPLEMENT_CLASS_S(PMJ02Sampler, false, Sampler)
+MTS_EXPORT_PLUGIN(PMJ02Sampler, "Progressive multi-jittered (0,2) sampler");
+MTS_NAMESPACE_END
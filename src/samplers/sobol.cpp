@@ -20,6 +20,9 @@
 #include <mitsuba/core/qmc.h>
 #include "sobolseq.h"
 
+/* Upper bound on the number of entries of the per-pixel sample table */
+#define TABLE_BUDGET (1 << 18)
+
 MTS_NAMESPACE_BEGIN
 
 /*!\plugin{sobol}{Sobol QMC sampler}
@@ -75,13 +78,15 @@ MTS_NAMESPACE_BEGIN
  * When this sampler is used to perform parallel block-based renderings,
  * the sequence is internally enumerated using a scheme proposed and implemented
  * by Gr\"unschlo\ss\ et al. \cite{Grunschloss2010Enumerating}.
+ * The points of a pixel are generated one dimension at a time for all
+ * samples at once, which is much faster than evaluating them individually.
  * \remarks{
  *   \item This sampler is incompatible with Metropolis Light Transport (all variants).
  * }
  */
 class SobolSampler : public Sampler {
 public:
-    SobolSampler() : Sampler(Properties()) { }
+    SobolSampler() : Sampler(Properties()), m_stamp(0) { }
 
     SobolSampler(const Properties &props) : Sampler(props) {
         /* Number of samples per pixel when used with a sampling-based integrator */
@@ -104,6 +109,8 @@ public:
         m_resolution = 1; m_logResolution = 0;
         m_arrayStartDim = m_arrayEndDim = 5;
         m_pixelPosition = Point2i(0);
+        m_frameOffset = 0;
+        m_stamp = 0;
     }
 
     SobolSampler(Stream *stream, InstanceManager *manager)
@@ -114,6 +121,8 @@ public:
         m_arrayStartDim = stream->readUInt();
         m_arrayEndDim = stream->readUInt();
         m_pixelPosition = Point2i(0);
+        m_frameOffset = 0;
+        m_stamp = 0;
     }
 
     void serialize(Stream *stream, InstanceManager *manager) const {
@@ -130,6 +139,7 @@ public:
         sampler->m_sampleCount = m_sampleCount;
         sampler->m_sampleIndex = m_sampleIndex;
         sampler->m_sobolSampleIndex = m_sobolSampleIndex;
+        sampler->m_frameOffset = m_frameOffset;
         sampler->m_dimension = m_dimension;
         sampler->m_scramble = m_scramble;
         sampler->m_resolution = m_resolution;
@@ -170,8 +180,25 @@ public:
 
     void generate(const Point2i &pos) {
         m_pixelPosition = pos;
+        m_frameOffset = getFrameOffset(m_sampleCount);
         setSampleIndex(0);
 
+        /* The indices of the samples within the current pixel have the form
+           m_pixelBase ^ delta(j), see sobol::look_up_offsets() */
+        sobol::look_up_offsets(isPixelLookup() ? m_logResolution : 0, m_indexOffsets);
+        m_pixelBase = getFrameIndex(m_frameOffset);
+
+        /* Invalidate the per-pixel sample table */
+        size_t tableDims = m_sampleCount > TABLE_BUDGET ? 0 : std::min(
+            (size_t) sobol::Matrices::num_dimensions, TABLE_BUDGET / m_sampleCount);
+        if (m_table.size() != tableDims * m_sampleCount) {
+            m_table.resize(tableDims * m_sampleCount);
+            m_tableStamp.clear();
+            m_tableStamp.resize(tableDims, 0);
+            m_stamp = 0;
+        }
+        ++m_stamp;
+
         /* Dimensions reserved to sample array requests */
         m_arrayStartDim = 5;
         m_arrayEndDim = m_arrayStartDim +
@@ -179,20 +206,23 @@ public:
 
         uint32_t dim = m_arrayStartDim;
         for (size_t i=0; i<m_req1D.size(); i++) {
-            for (size_t j=0; j<m_sampleCount * m_req1D[i]; ++j) {
-                uint64_t idx = sobol::look_up(m_logResolution, (uint32_t) j, m_pixelPosition.x, m_pixelPosition.y, m_scramble);
-                m_sampleArrays1D[i][j] = sobol::sample(idx, dim, m_scramble);
-            }
+            size_t count = m_sampleCount * m_req1D[i];
+            sobol::sampleBatch(getFrameIndex(getFrameOffset(count)), m_indexOffsets,
+                (uint32_t) count, dim, m_scramble, m_sampleArrays1D[i]);
             dim += 1;
         }
 
         for (size_t i=0; i<m_req2D.size(); i++) {
-            for (size_t j=0; j<m_sampleCount * m_req2D[i]; ++j) {
-                uint64_t idx = sobol::look_up(m_logResolution, (uint32_t) j, m_pixelPosition.x, m_pixelPosition.y, m_scramble);
-                m_sampleArrays2D[i][j] = Point2(
-                    sobol::sample(idx, dim, m_scramble),
-                    sobol::sample(idx, dim+1, m_scramble));
-            }
+            size_t count = m_sampleCount * m_req2D[i];
+            uint64_t base = getFrameIndex(getFrameOffset(count));
+            if (m_column.size() < 2 * count)
+                m_column.resize(2 * count);
+            sobol::sampleBatch(base, m_indexOffsets,
+                (uint32_t) count, dim, m_scramble, &m_column[0]);
+            sobol::sampleBatch(base, m_indexOffsets,
+                (uint32_t) count, dim+1, m_scramble, &m_column[count]);
+            for (size_t j=0; j<count; ++j)
+                m_sampleArrays2D[i][j] = Point2(m_column[j], m_column[count+j]);
             dim += 2;
         }
     }
@@ -205,17 +235,55 @@ public:
         m_dimension = 0;
         m_dimension1DArray = m_dimension2DArray = 0;
         m_sampleIndex = sampleIndex;
+        m_sobolSampleIndex = getFrameIndex(m_frameOffset + (uint32_t) m_sampleIndex);
+    }
 
-        if (m_logResolution > 1 && m_pixelPosition.x >= 0) {
-            /* Find the next sample that is located in the current pixel */
-            m_sobolSampleIndex = sobol::look_up(m_logResolution, (uint32_t) m_sampleIndex,
-                    m_pixelPosition.x, m_pixelPosition.y, m_scramble);
+    /// Are the samples of each pixel found by inverting the pixel coordinates?
+    inline bool isPixelLookup() const {
+        return m_logResolution > 1 && m_pixelPosition.x >= 0;
+    }
+
+    /**
+     * \brief Return the Sobol sequence index of the given
+     * sample (or "frame") of the current pixel
+     */
+    inline uint64_t getFrameIndex(uint32_t frame) const {
+        if (isPixelLookup()) {
+            /* Find the frame-th sample that is located in the current pixel */
+            return sobol::look_up(m_logResolution, frame,
+                m_pixelPosition.x, m_pixelPosition.y, m_scramble);
         } else {
-            m_sobolSampleIndex = (uint64_t) m_sampleIndex;
+            return (uint64_t) frame;
         }
     }
 
-    Float next1D() {
+    /**
+     * \brief Return the first frame of the current sample pass when
+     * \c count frames are drawn per pass
+     *
+     * Passes are aligned to powers of two, which keeps the frames of
+     * a pass in the form base ^ delta(j) (see sobol::look_up_offsets()).
+     */
+    inline uint32_t getFrameOffset(size_t count) const {
+        return (uint32_t) (m_samplePass * math::roundToPowerOfTwo(count));
+    }
+
+    /// Return the given dimension of the current sample
+    inline Float sample(uint32_t dim) {
+        if (dim >= m_tableStamp.size() || m_sampleIndex >= m_sampleCount)
+            return sobol::sample(m_sobolSampleIndex, dim, m_scramble);
+
+        /* Compute this dimension for all samples of the pixel at once */
+        Float *column = &m_table[dim * m_sampleCount];
+        if (m_tableStamp[dim] != m_stamp) {
+            sobol::sampleBatch(m_pixelBase, m_indexOffsets,
+                (uint32_t) m_sampleCount, dim, m_scramble, column);
+            m_tableStamp[dim] = m_stamp;
+        }
+        return column[m_sampleIndex];
+    }
+
+    Float fetch1D() {
         /* Skip over dimensions that were reserved to arrays */
         if (m_dimension >= m_arrayStartDim && m_dimension < m_arrayEndDim)
             m_dimension = m_arrayEndDim;
@@ -224,10 +292,10 @@ public:
             Log(EError, "Lookup dimension exceeds the direction number table size! You "
                 "may have to reduce the 'maxDepth' parameter of your integrator.");
 
-        return sobol::sample(m_sobolSampleIndex, m_dimension++, m_scramble);
+        return sample(m_dimension++);
     }
 
-    Point2 next2D() {
+    Point2 fetch2D() {
         Float value1, value2;
 
         /* Skip over dimensions that were reserved to arrays */
@@ -238,12 +306,12 @@ public:
             Log(EError, "Lookup dimension exceeds the direction number table size! You "
                 "may have to reduce the 'maxDepth' parameter of your integrator.");
 
-        if (m_dimension == 0 && m_sobolSampleIndex != (uint64_t) m_sampleIndex) {
-            value1 = sobol::sample(m_sobolSampleIndex, m_dimension++, m_scramble) * m_resolution - m_pixelPosition.x;
-            value2 = sobol::sample(m_sobolSampleIndex, m_dimension++, m_scramble) * m_resolution - m_pixelPosition.y;
+        if (m_dimension == 0 && isPixelLookup()) {
+            value1 = sample(m_dimension++) * m_resolution - m_pixelPosition.x;
+            value2 = sample(m_dimension++) * m_resolution - m_pixelPosition.y;
         } else {
-            value1 = sobol::sample(m_sobolSampleIndex, m_dimension++, m_scramble);
-            value2 = sobol::sample(m_sobolSampleIndex, m_dimension++, m_scramble);
+            value1 = sample(m_dimension++);
+            value2 = sample(m_dimension++);
         }
 
         return Point2(value1, value2);
@@ -265,11 +333,22 @@ private:
     uint32_t m_dimension;
     uint64_t m_scramble;
     uint64_t m_sobolSampleIndex;
+    uint32_t m_frameOffset;
     Float m_resolution;
     uint32_t m_logResolution;
     uint32_t m_arrayStartDim;
     uint32_t m_arrayEndDim;
     Point2i m_pixelPosition;
+
+    /* Sample index map of the current pixel */
+    uint64_t m_pixelBase;
+    uint64_t m_indexOffsets[32];
+
+    /* Lazily generated dimensions of the current pixel (dimension-major) */
+    std::vector<Float> m_table;
+    std::vector<size_t> m_tableStamp;
+    std::vector<Float> m_column;
+    size_t m_stamp;
 };
 
 MTS_IMPLEMENT_CLASS_S(SobolSampler, false, Sampler)
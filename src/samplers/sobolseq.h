@@ -22,6 +22,7 @@
 #define __SOBOL_H
 
 #include <mitsuba/mitsuba.h>
+#include <mitsuba/core/sse.h>
 #include <cassert>
 
 namespace sobol {
@@ -93,6 +94,173 @@ inline mitsuba::Float sample(
 #endif
 }
 
+// Multiply the generator matrix of the given dimension with an index
+// (i.e. compute sampleSingle() without the final float conversion)
+inline uint32_t sampleInt32(
+    uint64_t index,
+    const uint32_t dimension,
+    const uint32_t scramble = 0U)
+{
+    assert(dimension < Matrices::num_dimensions);
+
+    uint32_t result = scramble;
+    for (uint32_t i = dimension * Matrices::size; index; index >>= 1, ++i)
+    {
+        if (index & 1)
+            result ^= Matrices::matrices32[i];
+    }
+    return result;
+}
+
+// Multiply the generator matrix of the given dimension with an index
+// (i.e. compute sampleDouble() without the final double conversion)
+inline uint64_t sampleInt64(
+    uint64_t index,
+    const uint32_t dimension,
+    const uint64_t scramble = 0ULL)
+{
+    assert(dimension < Matrices::num_dimensions);
+
+    uint64_t result = scramble & ~-(1LL << Matrices::size);
+    for (uint32_t i = dimension * Matrices::size; index; index >>= 1, ++i)
+    {
+        if (index & 1)
+            result ^= Matrices::matrices64[i];
+    }
+    return result;
+}
+
+// Number of trailing zero bits of a nonzero value
+inline uint32_t trailingZeros(uint32_t value)
+{
+    uint32_t count = 0;
+    for (; !(value & 1); value >>= 1)
+        ++count;
+    return count;
+}
+
+// Compute one component of the Sobol'-sequence for a batch of 'count'
+// points. The j-th point has the index base ^ delta(j), where delta(j)
+// is the XOR of offsets[c] over all set bits c of j. Consecutive points
+// are obtained with offsets[c] = 1 << c, and the enumeration of the
+// points within a pixel (look_up) has this form as well, see
+// look_up_offsets(). The offsets array must provide an entry for
+// every bit of count - 1.
+//
+// Since the sequence is linear in the index over GF(2), neighboring
+// values differ by a single XOR with a precomputed column sum, which
+// replaces the per-point matrix-vector product of sampleSingle(). The
+// results are bit-identical to the scalar function.
+inline void sampleSingleBatch(
+    const uint64_t base,
+    const uint64_t *offsets,
+    const uint32_t count,
+    const uint32_t dimension,
+    const uint32_t scramble,
+    float *out)
+{
+    if (count == 0)
+        return;
+
+    // Images of the offsets and their prefix sums (zero-padded)
+    uint32_t columns[33], prefix[33];
+    uint32_t nbits = 0;
+    while (nbits < 32 && (1ULL << nbits) < count)
+        ++nbits;
+    for (uint32_t c = 0; c < 33; ++c)
+    {
+        columns[c] = c < nbits ? sampleInt32(offsets[c], dimension) : 0U;
+        prefix[c] = c > 0 ? (prefix[c-1] ^ columns[c]) : columns[c];
+    }
+
+    uint32_t result = sampleInt32(base, dimension, scramble), j = 0;
+
+#if defined(MTS_SSE)
+    // Process four points at a time: lane i holds the point 4k + i
+    const __m128i lanes = _mm_set_epi32((int) (columns[0] ^ columns[1]),
+        (int) columns[1], (int) columns[0], 0);
+    const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+    const __m128 scaleHigh = _mm_set1_ps(1.0f / (1 << 16)),
+        scaleLow = _mm_set1_ps(1.0f / (1ULL << 32)),
+        maxValue = _mm_set1_ps(ONE_MINUS_EPS_FLT);
+
+    for (uint32_t k = 1; j + 4 <= count; j += 4, ++k)
+    {
+        __m128i value = _mm_xor_si128(_mm_set1_epi32((int) result), lanes);
+
+        // Exact unsigned conversion: both halves are representable,
+        // hence the sum is rounded only once (like the scalar version)
+        __m128 high = _mm_cvtepi32_ps(_mm_srli_epi32(value, 16));
+        __m128 low  = _mm_cvtepi32_ps(_mm_and_si128(value, lowMask));
+        __m128 f = _mm_add_ps(_mm_mul_ps(high, scaleHigh), _mm_mul_ps(low, scaleLow));
+        _mm_storeu_ps(out + j, _mm_min_ps(f, maxValue));
+
+        // Bits 2, ..., t + 2 of the point index change, where t
+        // is the number of trailing zeros of k
+        result ^= prefix[trailingZeros(k) + 2] ^ prefix[1];
+    }
+
+    const uint32_t tail[4] = { 0U, columns[0], columns[1], columns[0] ^ columns[1] };
+    for (uint32_t i = 0; j < count; ++j, ++i)
+        out[j] = std::min((result ^ tail[i]) * (1.0f / (1ULL << 32)), ONE_MINUS_EPS_FLT);
+#else
+    for (;;)
+    {
+        out[j] = std::min(result * (1.0f / (1ULL << 32)), ONE_MINUS_EPS_FLT);
+        if (++j == count)
+            break;
+        result ^= prefix[trailingZeros(j)];
+    }
+#endif
+}
+
+// Double precision version of sampleSingleBatch()
+inline void sampleDoubleBatch(
+    const uint64_t base,
+    const uint64_t *offsets,
+    const uint32_t count,
+    const uint32_t dimension,
+    const uint64_t scramble,
+    double *out)
+{
+    if (count == 0)
+        return;
+
+    uint64_t prefix[32];
+    uint64_t columnSum = 0;
+    for (uint32_t c = 0; c < 32; ++c)
+    {
+        if ((1ULL << c) < count)
+            columnSum ^= sampleInt64(offsets[c], dimension);
+        prefix[c] = columnSum;
+    }
+
+    uint64_t result = sampleInt64(base, dimension, scramble);
+    for (uint32_t j = 0;;)
+    {
+        out[j] = std::min(result * (1.0 / (1ULL << Matrices::size)), ONE_MINUS_EPS_DBL);
+        if (++j == count)
+            break;
+        result ^= prefix[trailingZeros(j)];
+    }
+}
+
+// Call sampleSingleBatch or sampleDoubleBatch depending on the compilation options
+inline void sampleBatch(
+    const uint64_t base,
+    const uint64_t *offsets,
+    const uint32_t count,
+    const uint32_t dimension,
+    const uint64_t scramble,
+    mitsuba::Float *out)
+{
+#if defined(SINGLE_PRECISION)
+    sampleSingleBatch(base, offsets, count, dimension, (uint32_t) scramble, out);
+#else
+    sampleDoubleBatch(base, offsets, count, dimension, (uint64_t) scramble, out);
+#endif
+}
+
 // Return the index of the frame-th sample falling
 // into the square elementary interval (px, py),
 // without using look-up tables.
@@ -130,6 +298,19 @@ inline uint64_t look_up(
     return index;
 }
 
+// Determine the offsets that express the enumeration of look_up() in the
+// form expected by sampleBatch(): the index of the frame-th sample in
+// pixel (px, py) equals look_up(m, 0, px, py, scramble) ^ delta(frame),
+// where delta(frame) is the XOR of offsets[c] over the set bits c of frame.
+// This holds since all involved operations are linear over GF(2). When
+// m = 0, the samples are instead enumerated in sequence order.
+inline void look_up_offsets(
+    const uint32_t m,
+    uint64_t offsets[32])
+{
+    for (uint32_t c = 0; c < 32; ++c)
+        offsets[c] = m == 0 ? (1ULL << c) : look_up(m, 1U << c, 0, 0, 0);
+}
 
 } // namespace sobol
 
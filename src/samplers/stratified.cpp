@@ -178,7 +178,7 @@ public:
         m_dimension1DArray = m_dimension2DArray = 0;
     }
 
-    Float next1D() {
+    Float fetch1D() {
         Assert(m_sampleIndex < m_sampleCount);
         if (m_dimension1D < m_maxDimension) {
             int k = m_permutations1D[m_dimension1D++][m_sampleIndex];
@@ -188,7 +188,7 @@ public:
         }
     }
 
-    Point2 next2D() {
+    Point2 fetch2D() {
         Assert(m_sampleIndex < m_sampleCount);
         if (m_dimension2D < m_maxDimension) {
             int k = m_permutations2D[m_dimension2D++][m_sampleIndex];
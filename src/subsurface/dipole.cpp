@@ -17,7 +17,11 @@
 */
 
 #include <mitsuba/render/scene.h>
+#include <mitsuba/render/trimesh.h>
 #include <mitsuba/core/plugin.h>
+#include <mitsuba/core/fstream.h>
+#include <mitsuba/core/hash.h>
+#include <mitsuba/core/mstream.h>
 #include <mitsuba/core/sse.h>
 #include <mitsuba/core/ssemath.h>
 #include "../medium/materials.h"
@@ -107,6 +111,69 @@ struct IsotropicDipoleQuery {
     Point p;
 };
 
+/// Version of the file format used by the 'irrCache' parameter
+#define DIPOLE_IRRCACHE_VERSION 0x02
+
+/**
+ * \brief Hash of all inputs that determine the contents of an irradiance
+ * cache file
+ */
+class IrradianceCacheKey : public FNV1aHash {
+public:
+    using FNV1aHash::append;
+
+    IrradianceCacheKey() {
+        append((int) SPECTRUM_SAMPLES);
+        append((int) sizeof(Float));
+    }
+
+    /// Append the type and parameters of a plugin
+    void append(const ConfigurableObject *object) {
+        append(object->getClass()->getName());
+
+        /* Binary data can't be serialized; only its size is hashed */
+        Properties props(object->getProperties());
+        std::vector<std::string> names;
+        props.putPropertyNames(names);
+        for (size_t i=0; i<names.size(); ++i) {
+            if (props.getType(names[i]) != Properties::EData)
+                continue;
+            append(names[i]);
+            append((uint64_t) props.getData(names[i]).size);
+            props.removeProperty(names[i]);
+        }
+
+        ref<MemoryStream> stream = new MemoryStream();
+        stream->setByteOrder(Stream::ELittleEndian);
+        props.serialize(stream);
+        append(stream->getData(), stream->getPos());
+    }
+
+    /**
+     * \brief Append a shape and its material. When \c full is set,
+     * the complete triangle geometry is included.
+     */
+    void append(const Shape *shape, bool full) {
+        append((const ConfigurableObject *) shape);
+        AABB aabb = shape->getAABB();
+        append(aabb.min);
+        append(aabb.max);
+        append((uint64_t) shape->getPrimitiveCount());
+        if (shape->getBSDF())
+            append((const ConfigurableObject *) shape->getBSDF());
+
+        if (full) {
+            ref<TriMesh> mesh = const_cast<Shape *>(shape)->createTriMesh();
+            if (mesh) {
+                const Point *positions = mesh->getVertexPositions();
+                for (size_t i=0; i<mesh->getVertexCount(); ++i)
+                    append(positions[i]);
+                append(mesh->getTriangles(), mesh->getTriangleCount() * sizeof(Triangle));
+            }
+        }
+    }
+};
+
 static ref<Mutex> irrOctreeMutex = new Mutex();
 static int irrOctreeIndex = 0;
 
@@ -140,6 +207,14 @@ static int irrOctreeIndex = 0;
  *         Number of samples to use when estimating the
  *         irradiance at a point on the surface \default{16}
  *     }
+ *     \parameter{irrCache}{\String}{
+ *         Optional file that stores the irradiance samples. When it exists,
+ *         the samples are loaded from it instead of being recomputed, which
+ *         is useful when rendering animations in which only the camera moves.
+ *         The file also records a hash of the material parameters, geometry,
+ *         materials, and emitters, and it is recomputed when any of them change.
+ *         \default{none}
+ *     }
  * }
  *
  * \renderings{
@@ -289,6 +364,9 @@ public:
         /* Error threshold - lower means better quality */
         m_quality = props.getFloat("quality", 0.2f);
 
+        /* Optional file for reusing the irradiance samples in later renderings */
+        m_irrCache = props.getString("irrCache", "");
+
         /* Asymmetry parameter of the phase function */
         m_octreeResID = -1;
 
@@ -388,10 +466,46 @@ public:
         AABB aabb;
         Float sa;
 
-        ref<PositionSampleVector> points = new PositionSampleVector();
         /* It is necessary to increase the sampling resolution to
            prevent low-frequency noise in the output */
         Float actualRadius = m_radius / std::sqrt(m_sampleMultiplier * 20);
+
+        uint64_t cacheKey = 0;
+        if (!m_irrCache.empty())
+            cacheKey = computeCacheKey(scene, actualRadius);
+
+        /* A missing, damaged or stale cache file is simply recomputed */
+        if (!m_irrCache.empty() && fs::exists(m_irrCache)) {
+            try {
+                ref<FileStream> fs = new FileStream(m_irrCache, FileStream::EReadOnly);
+                fs->setByteOrder(Stream::ELittleEndian);
+                char header[3];
+                fs->read(header, 3);
+                if (header[0] != 'I' || header[1] != 'R' || header[2] != 'R') {
+                    Log(EWarn, "\"%s\" is not a valid irradiance cache file "
+                        "-- recomputing.", m_irrCache.string().c_str());
+                } else if (fs->readUChar() != DIPOLE_IRRCACHE_VERSION || fs->readULong() != cacheKey) {
+                    Log(EWarn, "The irradiance cache \"%s\" was created with a different "
+                        "version, different material parameters, or a different scene "
+                        "-- recomputing.", m_irrCache.string().c_str());
+                } else {
+                    m_octree = new IrradianceOctree(fs, NULL);
+                }
+            } catch (const std::exception &ex) {
+                Log(EWarn, "Could not read the irradiance cache \"%s\" (%s) "
+                    "-- recomputing.", m_irrCache.string().c_str(), ex.what());
+                m_octree = NULL;
+            }
+
+            if (m_octree) {
+                Log(EInfo, "Loaded the irradiance cache \"%s\" (took %i ms)",
+                    m_irrCache.filename().string().c_str(), timer->getMilliseconds());
+                m_octreeResID = sched->registerResource(m_octree);
+                return true;
+            }
+        }
+
+        ref<PositionSampleVector> points = new PositionSampleVector();
         blueNoisePointSet(scene, m_shapes, actualRadius, points, sa, aabb, job);
 
         /* 2. Gather irradiance in parallel */
@@ -442,11 +556,65 @@ public:
         m_octree = new IrradianceOctree(aabb, m_quality, samples);
 
         Log(EDebug, "Done clustering (took %i ms).", timer->getMilliseconds());
+
+        if (!m_irrCache.empty()) {
+            /* Write to a temporary file first, so that an interrupted
+               rendering never leaves a partially written cache behind */
+            fs::path tempFile = m_irrCache.parent_path()
+                / fs::unique_path("%%%%-%%%%-%%%%.irr");
+            try {
+                ref<FileStream> fs = new FileStream(tempFile, FileStream::ETruncReadWrite);
+                fs->setByteOrder(Stream::ELittleEndian);
+                fs->write("IRR", 3);
+                fs->writeUChar(DIPOLE_IRRCACHE_VERSION);
+                fs->writeULong(cacheKey);
+                m_octree->serialize(fs, NULL);
+                fs->close();
+                fs::rename(tempFile, m_irrCache);
+            } catch (const std::exception &ex) {
+                Log(EWarn, "Could not write the irradiance cache \"%s\": %s",
+                    m_irrCache.string().c_str(), ex.what());
+                boost::system::error_code ec;
+                fs::remove(tempFile, ec);
+            }
+        }
+
         m_octreeResID = Scheduler::getInstance()->registerResource(m_octree);
 
         return true;
     }
 
+    /**
+     * \brief Hash the inputs that determine the irradiance samples:
+     * the parameters of this model, the geometry that receives the
+     * samples, as well as all other shapes, materials and emitters
+     * of the scene (which contribute light and occlusion)
+     */
+    uint64_t computeCacheKey(const Scene *scene, Float actualRadius) const {
+        IrradianceCacheKey key;
+        key.append(actualRadius);
+        key.append(m_quality);
+        key.append(m_irrSamples);
+        key.append((int) m_irrIndirect);
+        key.append(m_sigmaS);
+        key.append(m_sigmaA);
+        key.append(m_g);
+        key.append(m_eta);
+
+        for (size_t i=0; i<m_shapes.size(); ++i)
+            key.append(m_shapes[i], true);
+
+        const ref_vector<Shape> &shapes = scene->getShapes();
+        for (size_t i=0; i<shapes.size(); ++i)
+            key.append(shapes[i].get(), false);
+
+        const ref_vector<Emitter> &emitters = scene->getEmitters();
+        for (size_t i=0; i<emitters.size(); ++i)
+            key.append((const ConfigurableObject *) emitters[i].get());
+
+        return key.getValue();
+    }
+
     void wakeup(ConfigurableObject *parent,
         std::map<std::string, SerializableObject *> &params) {
         std::string octreeName = formatString("irrOctree%i", m_octreeIndex);
@@ -469,6 +637,7 @@ private:
     Spectrum m_sigmaSPrime, m_sigmaTPrime;
     ref<IrradianceOctree> m_octree;
     ref<ParallelProcess> m_proc;
+    fs::path m_irrCache;
     int m_octreeResID, m_octreeIndex;
     int m_irrSamples;
     bool m_irrIndirect;
@@ -17,20 +17,42 @@
 */
 
 #include <mitsuba/core/statistics.h>
+#include <mitsuba/core/timer.h>
 #include "irrtree.h"
 
+/// Number of bits per axis in the Morton codes (limits the tree depth)
+#define IRRTREE_MORTON_BITS 21
+
+/// Subtrees below this depth are built in parallel (up to 8^3 tasks)
+#define IRRTREE_PARALLEL_DEPTH 3
+
 MTS_NAMESPACE_BEGIN
 
 static StatsCounter statsNumSamples("SSS Irradiance Octree", "Created samples");
 static StatsCounter statsNumNodes("SSS Irradiance Octree", "Created nodes");
 
+/// Insert two zero bits between each of the lower 21 bits of \c v
+static inline uint64_t mortonSpread(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | (v << 32)) & 0x1f00000000ffffULL;
+    v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+    v = (v | (v << 8))  & 0x100f00f00f00f00fULL;
+    v = (v | (v << 4))  & 0x10c30c30c30c30c3ULL;
+    v = (v | (v << 2))  & 0x1249249249249249ULL;
+    return v;
+}
+
+/// Return the child index that a Morton code selects at the given depth
+static inline int mortonDigit(uint64_t code, uint32_t depth) {
+    return (int) ((code >> (3 * (IRRTREE_MORTON_BITS - 1 - depth))) & 7);
+}
+
 IrradianceOctree::IrradianceOctree(const AABB &bounds, Float solidAngleThreshold, std::vector<IrradianceSample> &records)
     : StaticOctree<IrradianceSample, IrradianceSample>(bounds), m_solidAngleThreshold(solidAngleThreshold) {
 
     m_items.swap(records);
 
-    build();
-    propagate(m_root);
+    buildParallel();
 }
 
 IrradianceOctree::IrradianceOctree(Stream *stream, InstanceManager *manager) {
@@ -45,8 +67,7 @@ IrradianceOctree::IrradianceOctree(Stream *stream, InstanceManager *manager) {
     for (size_t i=0; i<items; ++i)
         m_items[i] = IrradianceSample(stream);
 
-    build();
-    propagate(m_root);
+    buildParallel();
 }
 
 void IrradianceOctree::serialize(Stream *stream, InstanceManager *manager) const {
@@ -60,7 +81,163 @@ void IrradianceOctree::serialize(Stream *stream, InstanceManager *manager) const
         m_items[i].serialize(stream);
 }
 
+void IrradianceOctree::buildParallel() {
+    Log(EDebug, "Building an irradiance octree over " SIZE_T_FMT " samples (%s)..",
+        m_items.size(), memString(m_items.size() * sizeof(IrradianceSample)).c_str());
+    ref<Timer> timer = new Timer();
+
+    const int64_t nItems = (int64_t) m_items.size();
+    if (nItems == 0)
+        return;
+
+    /* Compute the Morton codes of all samples. The bit order (x, y, z)
+       within each digit matches the child numbering of StaticOctree */
+    const Float maxCoord = (Float) ((1 << IRRTREE_MORTON_BITS) - 1);
+    const Vector extents = m_aabb.getExtents();
+    Vector scale;
+    for (int i=0; i<3; ++i)
+        scale[i] = extents[i] > 0 ? (1 << IRRTREE_MORTON_BITS) / extents[i] : 0.0f;
+
+    std::vector<std::pair<uint64_t, uint32_t> > keys(m_items.size());
+
+    #if defined(MTS_OPENMP)
+        #pragma omp parallel for schedule(static)
+    #endif
+    for (int64_t i=0; i<nItems; ++i) {
+        const Point &p = m_items[i].getPosition();
+        uint64_t q[3];
+        for (int j=0; j<3; ++j)
+            q[j] = (uint64_t) std::min(std::max((p[j] - m_aabb.min[j]) * scale[j],
+                (Float) 0), maxCoord);
+        keys[i] = std::make_pair(
+            (mortonSpread(q[0]) << 2) | (mortonSpread(q[1]) << 1) | mortonSpread(q[2]),
+            (uint32_t) i);
+    }
+
+    /* Bucket the samples by the top levels of the tree, then sort the
+       buckets in parallel */
+    const int bucketShift = 3 * (IRRTREE_MORTON_BITS - IRRTREE_PARALLEL_DEPTH);
+    const int nBuckets = 1 << (3 * IRRTREE_PARALLEL_DEPTH);
+    std::vector<uint32_t> bucketOffsets(nBuckets + 1, 0);
+    for (int64_t i=0; i<nItems; ++i)
+        bucketOffsets[(keys[i].first >> bucketShift) + 1]++;
+    for (int i=0; i<nBuckets; ++i)
+        bucketOffsets[i+1] += bucketOffsets[i];
+
+    std::vector<std::pair<uint64_t, uint32_t> > sorted(m_items.size());
+    {
+        std::vector<uint32_t> offsets(bucketOffsets.begin(), bucketOffsets.end() - 1);
+        for (int64_t i=0; i<nItems; ++i)
+            sorted[offsets[keys[i].first >> bucketShift]++] = keys[i];
+    }
+
+    #if defined(MTS_OPENMP)
+        #pragma omp parallel for schedule(dynamic)
+    #endif
+    for (int i=0; i<nBuckets; ++i)
+        std::sort(sorted.begin() + bucketOffsets[i], sorted.begin() + bucketOffsets[i+1]);
+
+    /* Reorder the samples along the Morton curve */
+    std::vector<IrradianceSample> items(m_items.size());
+    std::vector<uint64_t> codes(m_items.size());
+
+    #if defined(MTS_OPENMP)
+        #pragma omp parallel for schedule(static)
+    #endif
+    for (int64_t i=0; i<nItems; ++i) {
+        items[i] = m_items[sorted[i].second];
+        codes[i] = sorted[i].first;
+    }
+    m_items.swap(items);
+
+    /* Create the top of the tree, then build and propagate
+       the remaining subtrees in parallel */
+    std::vector<BuildTask> tasks;
+    m_root = buildMorton(&codes[0], 0, (uint32_t) nItems, 0, &tasks);
+
+    #if defined(MTS_OPENMP)
+        #pragma omp parallel for schedule(dynamic)
+    #endif
+    for (int i=0; i<(int) tasks.size(); ++i) {
+        const BuildTask &task = tasks[i];
+        OctreeNode *node = buildMorton(&codes[0], task.start, task.end,
+            IRRTREE_PARALLEL_DEPTH, NULL);
+        propagate(node);
+        *task.slot = node;
+    }
+
+    propagateTop(m_root, 0);
+
+    Log(EDebug, "Done (took %i ms, %i parallel subtrees)",
+        timer->getMilliseconds(), (int) tasks.size());
+}
+
+IrradianceOctree::OctreeNode *IrradianceOctree::buildMorton(const uint64_t *codes,
+        uint32_t start, uint32_t end, uint32_t depth, std::vector<BuildTask> *tasks) {
+    if (start == end) {
+        return NULL;
+    } else if (end-start < m_maxItems || depth > m_maxDepth
+            || depth >= IRRTREE_MORTON_BITS) {
+        OctreeNode *result = new OctreeNode();
+        result->count = end-start;
+        result->offset = start;
+        result->leaf = true;
+        return result;
+    }
+
+    OctreeNode *result = new OctreeNode();
+    result->leaf = false;
+
+    /* The samples of each child form a contiguous range of the Morton
+       order -- find its end using a binary search */
+    for (int i=0; i<8; ++i) {
+        uint32_t lo = start, hi = end;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (mortonDigit(codes[mid], depth) <= i)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (tasks && depth + 1 == IRRTREE_PARALLEL_DEPTH && start != lo) {
+            BuildTask task;
+            task.slot = &result->children[i];
+            task.start = start;
+            task.end = lo;
+            tasks->push_back(task);
+            result->children[i] = NULL;
+        } else {
+            result->children[i] = buildMorton(codes, start, lo, depth + 1, tasks);
+        }
+        start = lo;
+    }
+
+    return result;
+}
+
+void IrradianceOctree::propagateTop(OctreeNode *node, uint32_t depth) {
+    if (!node || depth == IRRTREE_PARALLEL_DEPTH)
+        return;
+
+    if (!node->leaf) {
+        for (int i=0; i<8; i++)
+            propagateTop(node->children[i], depth + 1);
+    }
+    aggregate(node);
+}
+
 void IrradianceOctree::propagate(OctreeNode *node) {
+    if (!node->leaf) {
+        for (int i=0; i<8; i++) {
+            if (node->children[i])
+                propagate(node->children[i]);
+        }
+    }
+    aggregate(node);
+}
+
+void IrradianceOctree::aggregate(OctreeNode *node) {
     IrradianceSample &repr = node->data;
 
     /* Initialize the cluster values */
@@ -86,7 +263,6 @@ void IrradianceOctree::propagate(OctreeNode *node) {
             OctreeNode *child = node->children[i];
             if (!child)
                 continue;
-            propagate(child);
             repr.E += child->data.E * child->data.area;
             repr.area += child->data.area;
             Float weight = child->data.E.getLuminance() * child->data.area;
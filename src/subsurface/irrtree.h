@@ -44,9 +44,36 @@ public:
 
     MTS_DECLARE_CLASS()
 protected:
+    /// Subtree that is built by one thread during \ref buildParallel()
+    struct BuildTask {
+        OctreeNode **slot;
+        uint32_t start, end;
+    };
+
+    /**
+     * \brief Sort the samples along a Morton curve and build the octree in
+     * parallel. This replaces \ref StaticOctree::build() and also computes
+     * the representatives of all nodes.
+     */
+    void buildParallel();
+
+    /**
+     * \brief Recursively create the nodes covering a range of Morton-sorted
+     * samples. When \c tasks is provided, the subtrees at depth
+     * \c IRRTREE_PARALLEL_DEPTH are not built but recorded for later.
+     */
+    OctreeNode *buildMorton(const uint64_t *codes, uint32_t start, uint32_t end,
+        uint32_t depth, std::vector<BuildTask> *tasks);
+
     /// Propagate irradiance approximations througout the tree
     void propagate(OctreeNode *node);
 
+    /// Propagate irradiance approximations through the top of the tree
+    void propagateTop(OctreeNode *node, uint32_t depth);
+
+    /// Compute the representative of a node from its children or samples
+    void aggregate(OctreeNode *node);
+
     /// Query the octree using a customizable functor, while representatives for distant nodes
     template <typename QueryType> void performQuery(const AABB &aabb, OctreeNode *node, QueryType &query) const {
         /* Compute the approximate solid angle subtended by samples within this node */
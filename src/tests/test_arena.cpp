@@ -0,0 +1,87 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <mitsuba/render/testcase.h>
+#include <mitsuba/core/arena.h>
+
+MTS_NAMESPACE_BEGIN
+
+class TestArena : public TestCase {
+public:
+    MTS_BEGIN_TESTCASE()
+    MTS_DECLARE_TEST(test01_alignment)
+    MTS_DECLARE_TEST(test02_scopes)
+    MTS_DECLARE_TEST(test03_reset)
+    MTS_END_TESTCASE()
+
+    void test01_alignment() {
+        MemoryArena arena(1024);
+        for (size_t size = 1; size < 300; size += 7) {
+            uint8_t *ptr = static_cast<uint8_t *>(arena.alloc(size));
+            assertTrue(((uintptr_t) ptr) % MTS_ARENA_ALIGNMENT == 0);
+            memset(ptr, 0xFF, size);
+        }
+
+        /* Requests that exceed the block size get a block of their own */
+        Float *large = arena.alloc<Float>(4096);
+        assertTrue(((uintptr_t) large) % MTS_ARENA_ALIGNMENT == 0);
+        assertTrue(arena.getCapacity() >= 4096 * sizeof(Float) + 1024);
+    }
+
+    void test02_scopes() {
+        MemoryArena arena(1024);
+        int *outer = arena.alloc<int>(16);
+        size_t used = arena.getUsedMemory();
+
+        for (int i=0; i<10; ++i) {
+            MemoryArena::Scope scope(arena);
+            int *inner = arena.alloc<int>(1000);
+            inner[999] = i;
+            assertTrue(inner != outer);
+        }
+
+        /* Rewinding keeps earlier allocations and recycles the blocks */
+        assertTrue(arena.getUsedMemory() == used);
+        assertTrue(arena.getBlockCount() == 2);
+        assertTrue(arena.alloc<int>(16) == outer + 16);
+    }
+
+    void test03_reset() {
+        MemoryArena arena(1024);
+        for (int i=0; i<10; ++i)
+            arena.alloc(1000);
+        size_t capacity = arena.getCapacity();
+        assertTrue(arena.getBlockCount() == 10);
+
+        /* After a reset, the same workload fits into a single block */
+        arena.reset();
+        assertTrue(arena.getBlockCount() == 1);
+        assertTrue(arena.getCapacity() == capacity);
+        assertTrue(arena.getUsedMemory() == 0);
+
+        uint64_t allocations = getAllocationCount();
+        for (int i=0; i<10; ++i)
+            arena.alloc(1000);
+        assertTrue(arena.getBlockCount() == 1);
+        assertTrue(getAllocationCount() == allocations);
+    }
+};
+
+MTS_EXPORT_TESTCASE(TestArena, "Testcase for memory arenas")
+MTS_NAMESPACE_END
@@ -60,13 +60,13 @@ public:
         FakeSampler(Sampler *sampler)
             : Sampler(Properties()), m_sampler(sampler) { }
 
-        Float next1D() {
+        Float fetch1D() {
             while (m_sampleIndex >= m_values.size())
                 m_values.push_back(m_sampler->next1D());
             return m_values[m_sampleIndex++];
         }
 
-        Point2 next2D() {
+        Point2 fetch2D() {
             return Point2(next1D(), next1D());
         }
 
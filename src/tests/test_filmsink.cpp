@@ -0,0 +1,159 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/render/testcase.h>
+#include <mitsuba/render/film.h>
+#include <mitsuba/core/plugin.h>
+#include <mitsuba/core/random.h>
+#include <mitsuba/core/mstream.h>
+
+MTS_NAMESPACE_BEGIN
+
+/// Keeps all images that it receives
+class CollectingSink : public FilmSink {
+public:
+    void put(const Film *film, Bitmap *bitmap) {
+        bitmaps.push_back(bitmap);
+    }
+
+    ref_vector<Bitmap> bitmaps;
+};
+
+class TestFilmSink : public TestCase {
+public:
+    MTS_BEGIN_TESTCASE()
+    MTS_DECLARE_TEST(test01_developToSink)
+    MTS_DECLARE_TEST(test02_streamingToSink)
+    MTS_DECLARE_TEST(test03_streamSink)
+    MTS_END_TESTCASE()
+
+    ref<Film> createFilm(Properties props) {
+        props.setInteger("width", 32);
+        props.setInteger("height", 24);
+        ref<Film> film = static_cast<Film *> (PluginManager::getInstance()->
+            createObject(MTS_CLASS(Film), props));
+        film->configure();
+        return film;
+    }
+
+    /// Submit a full image's worth of random 8x8 blocks to the given films
+    void render(Film *film1, Film *film2 = NULL) {
+        ref<Random> random = new Random();
+        const Vector2i size = film1->getCropSize();
+        for (int y=0; y<size.y; y += 8) {
+            for (int x=0; x<size.x; x += 8) {
+                ref<ImageBlock> block = new ImageBlock(Bitmap::ESpectrumAlphaWeight,
+                    Vector2i(8), film1->getReconstructionFilter());
+                block->setOffset(Point2i(x, y));
+                block->clear();
+                for (int i=0; i<100; ++i)
+                    block->put(Point2(x + 8 * random->nextFloat(), y + 8 * random->nextFloat()),
+                        Spectrum(random->nextFloat()), 1.0f);
+                film1->put(block);
+                if (film2)
+                    film2->put(block);
+            }
+        }
+    }
+
+    void test01_developToSink() {
+        fs::path destFile = fs::temp_directory_path() / "mitsuba_test_filmsink.png";
+        fs::remove(destFile);
+
+        Properties props("ldrfilm");
+        props.setBoolean("banner", false);
+        ref<Film> film = createFilm(props);
+        ref<CollectingSink> sink = new CollectingSink();
+        film->setSink(sink);
+        film->setDestinationFile(destFile, 8);
+        film->clear();
+        render(film);
+        film->develop(NULL, 0);
+
+        /* The image ends up in the sink, and no file is written */
+        assertTrue(sink->bitmaps.size() == 1);
+        assertFalse(fs::exists(destFile));
+        const Bitmap *bitmap = sink->bitmaps[0];
+        assertTrue(bitmap->getSize() == Vector2i(32, 24));
+        assertTrue(bitmap->getPixelFormat() == Bitmap::ERGB);
+        assertTrue(bitmap->getComponentFormat() == Bitmap::EUInt8);
+
+        /* The sink also works without a destination file */
+        film->setDestinationFile(fs::path(), 8);
+        film->develop(NULL, 0);
+        assertTrue(sink->bitmaps.size() == 2);
+    }
+
+    void test02_streamingToSink() {
+        /* A streaming film assembles its tiles into the same image */
+        Properties props("mfilm");
+        props.setString("fileFormat", "numpy");
+        props.setString("pixelFormat", "rgb");
+        ref<Film> film = createFilm(props);
+        props.setBoolean("streaming", true);
+        ref<Film> streamingFilm = createFilm(props);
+
+        ref<CollectingSink> sink = new CollectingSink();
+        film->setSink(sink);
+        streamingFilm->setSink(sink);
+        film->setDestinationFile(fs::path(), 8);
+        streamingFilm->setDestinationFile(fs::path(), 8);
+        film->clear();
+        render(film, streamingFilm);
+        film->develop(NULL, 0);
+        assertTrue(sink->bitmaps.size() == 1);
+        streamingFilm->develop(NULL, 0);
+        assertTrue(sink->bitmaps.size() == 2);
+
+        const Bitmap *reference = sink->bitmaps[0], *streamed = sink->bitmaps[1];
+        assertTrue(reference->getSize() == streamed->getSize());
+        assertTrue(reference->getChannelCount() == streamed->getChannelCount());
+        const Float *data1 = reference->getFloatData(), *data2 = streamed->getFloatData();
+        size_t count = reference->getPixelCount() * reference->getChannelCount();
+        for (size_t i=0; i<count; ++i)
+            assertEqualsEpsilon(data1[i], data2[i], 1e-4f);
+    }
+
+    void test03_streamSink() {
+        /* Consecutive images are prefixed by their size */
+        ref<MemoryStream> stream = new MemoryStream();
+        ref<StreamFilmSink> sink = new StreamFilmSink(stream);
+
+        ref<Bitmap> bitmap = new Bitmap(Bitmap::ERGB, Bitmap::EUInt8, Vector2i(5, 3));
+        for (size_t i=0; i<bitmap->getBufferSize(); ++i)
+            bitmap->getUInt8Data()[i] = (uint8_t) (i * 7);
+        sink->put(NULL, bitmap);
+        sink->put(NULL, bitmap);
+        assertTrue(sink->getImageCount() == 2);
+
+        stream->seek(0);
+        for (int i=0; i<2; ++i) {
+            size_t size = (size_t) stream->readULong(), start = stream->getPos();
+            ref<Bitmap> decoded = new Bitmap(Bitmap::EPNG, stream);
+            assertTrue(stream->getPos() <= start + size);
+            stream->seek(start + size);
+            assertTrue(decoded->getSize() == bitmap->getSize());
+            assertTrue(memcmp(decoded->getUInt8Data(), bitmap->getUInt8Data(),
+                bitmap->getBufferSize()) == 0);
+        }
+        assertTrue(stream->getPos() == stream->getSize());
+    }
+};
+
+MTS_EXPORT_TESTCASE(TestFilmSink, "Testcase for film output sinks")
+MTS_NAMESPACE_END
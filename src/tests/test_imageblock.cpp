@@ -0,0 +1,334 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/render/testcase.h>
+#include <mitsuba/render/imageblock.h>
+#include <mitsuba/core/plugin.h>
+#include <mitsuba/core/random.h>
+#include <mitsuba/core/timer.h>
+
+MTS_NAMESPACE_BEGIN
+
+class TestImageBlock : public TestCase {
+public:
+    MTS_BEGIN_TESTCASE()
+    MTS_DECLARE_TEST(test01_splat)
+    MTS_DECLARE_TEST(test02_invalidSamples)
+    MTS_DECLARE_TEST(test03_benchmark)
+    MTS_DECLARE_TEST(test04_statistics)
+    MTS_DECLARE_TEST(test05_developLDR)
+    MTS_DECLARE_TEST(test06_developBenchmark)
+    MTS_END_TESTCASE()
+
+    ref<ReconstructionFilter> createFilter(const std::string &name) {
+        ref<ReconstructionFilter> rfilter = static_cast<ReconstructionFilter *> (
+            PluginManager::getInstance()->createObject(
+            MTS_CLASS(ReconstructionFilter), Properties(name)));
+        rfilter->configure();
+        return rfilter;
+    }
+
+    ref<ImageBlock> createRandomBlock(const Vector2i &size, const ReconstructionFilter *rfilter,
+            int sampleCount, Random *random) {
+        ref<ImageBlock> block = new ImageBlock(Bitmap::ESpectrumAlphaWeight, size, rfilter);
+        block->clear();
+        for (int i=0; i<sampleCount; ++i) {
+            Spectrum value;
+            for (int k=0; k<SPECTRUM_SAMPLES; ++k)
+                value[k] = std::pow(random->nextFloat(), 3) * 4;
+            block->put(Point2(random->nextFloat() * size.x, random->nextFloat() * size.y),
+                value, random->nextFloat());
+        }
+        return block;
+    }
+
+    /// Largest difference between two 8-bit bitmaps with the same layout
+    int maxDifference(const Bitmap *a, const Bitmap *b) {
+        const uint8_t *dataA = a->getUInt8Data(), *dataB = b->getUInt8Data();
+        int result = 0;
+        for (size_t i=0; i<a->getBufferSize(); ++i)
+            result = std::max(result, std::abs((int) dataA[i] - (int) dataB[i]));
+        return result;
+    }
+
+    /// Straightforward scalar implementation of ImageBlock::put()
+    void referencePut(std::vector<Float> &target, const Vector2i &size, int borderSize,
+            const ReconstructionFilter *rfilter, const Point2 &_pos, const Float *value,
+            int channels) {
+        const Float radius = rfilter->getRadius();
+        const Point2 pos(_pos.x - 0.5f + borderSize, _pos.y - 0.5f + borderSize);
+
+        for (int y=0; y<size.y; ++y) {
+            for (int x=0; x<size.x; ++x) {
+                if (std::abs(x - pos.x) > radius || std::abs(y - pos.y) > radius)
+                    continue;
+                Float weight = rfilter->evalDiscretized(x - pos.x)
+                    * rfilter->evalDiscretized(y - pos.y);
+                for (int k=0; k<channels; ++k)
+                    target[(y*size.x + x)*channels + k] += weight * value[k];
+            }
+        }
+    }
+
+    /// Is a coordinate within the filter's epsilon of a pixel boundary?
+    bool nearPixelEdge(Float coord, const ReconstructionFilter *rfilter) {
+        Float frac = coord - std::floor(coord),
+              margin = 2 * (rfilter->getRadius() - 0.5f);
+        return frac <= margin || frac >= 1 - margin;
+    }
+
+    void test01_splat() {
+        const char *filters[] = { "box", "gaussian", "mitchell" };
+        const int channelCounts[] = { 2, 5, 7, SPECTRUM_SAMPLES + 2, 11, 24 };
+        const Vector2i size(16, 12);
+        ref<Random> random = new Random();
+
+        for (int f=0; f<3; ++f) {
+            ref<ReconstructionFilter> rfilter = createFilter(filters[f]);
+            for (int c=0; c<6; ++c) {
+                int channels = channelCounts[c];
+                ref<ImageBlock> block = new ImageBlock(Bitmap::EMultiChannel,
+                    size, rfilter, channels);
+                block->clear();
+                if (rfilter->isSinglePixel())
+                    assertEquals(block->getBorderSize(), 0);
+
+                Vector2i fullSize = block->getBitmap()->getSize();
+                std::vector<Float> reference(fullSize.x * fullSize.y * channels, 0.0f);
+                std::vector<Float> value(channels);
+
+                for (int i=0; i<200; ++i) {
+                    Point2 pos(random->nextFloat() * size.x, random->nextFloat() * size.y);
+
+                    /* The single-pixel fast path ignores the epsilon that the box
+                       filter adds to its radius. Keep samples away from pixel
+                       edges, where the general filter would touch two pixels */
+                    if (rfilter->isSinglePixel() && (nearPixelEdge(pos.x, rfilter)
+                            || nearPixelEdge(pos.y, rfilter))) {
+                        --i;
+                        continue;
+                    }
+                    for (int k=0; k<channels; ++k)
+                        value[k] = random->nextFloat();
+                    assertTrue(block->put(pos, &value[0]));
+                    referencePut(reference, fullSize, block->getBorderSize(),
+                        rfilter, pos, &value[0], channels);
+                }
+
+                const Float *data = block->getBitmap()->getFloatData();
+                for (size_t i=0; i<reference.size(); ++i)
+                    assertEqualsEpsilon(data[i], reference[i], 1e-4f);
+            }
+        }
+    }
+
+    void test02_invalidSamples() {
+        ref<ReconstructionFilter> rfilter = createFilter("box");
+        ref<ImageBlock> block = new ImageBlock(Bitmap::EMultiChannel,
+            Vector2i(4, 4), rfilter, 7);
+        block->clear();
+
+        Float value[7] = { 1, 2, 3, 4, 5, 6, 7 };
+        assertTrue(block->put(Point2(1.5f, 1.5f), value));
+
+        ref<Logger> logger = Thread::getThread()->getLogger();
+        ELogLevel logLevel = logger->getLogLevel();
+        logger->setLogLevel(EError);
+
+        const Float invalid[] = { -1.0f, std::numeric_limits<Float>::quiet_NaN(),
+            std::numeric_limits<Float>::infinity() };
+        for (int i=0; i<3; ++i) {
+            for (int k=0; k<7; ++k) {
+                Float temp[7];
+                memcpy(temp, value, sizeof(value));
+                temp[k] = invalid[i];
+                assertFalse(block->put(Point2(1.5f, 1.5f), temp));
+            }
+        }
+        logger->setLogLevel(logLevel);
+    }
+
+    void test03_benchmark() {
+        const char *filters[] = { "box", "gaussian" };
+        const int channelCounts[] = { 5, 7, SPECTRUM_SAMPLES + 2, 24 };
+        const int sampleCount = 1000000;
+        const Vector2i size(32, 32);
+        ref<Random> random = new Random();
+
+        std::vector<Point2> positions(sampleCount);
+        for (int i=0; i<sampleCount; ++i)
+            positions[i] = Point2(random->nextFloat() * size.x, random->nextFloat() * size.y);
+
+        for (int f=0; f<2; ++f) {
+            ref<ReconstructionFilter> rfilter = createFilter(filters[f]);
+            for (int c=0; c<4; ++c) {
+                int channels = channelCounts[c];
+                ref<ImageBlock> block = new ImageBlock(Bitmap::EMultiChannel,
+                    size, rfilter, channels);
+                block->clear();
+
+                std::vector<Float> value(channels);
+                for (int k=0; k<channels; ++k)
+                    value[k] = random->nextFloat();
+
+                ref<Timer> timer = new Timer();
+                for (int i=0; i<sampleCount; ++i)
+                    block->put(positions[i], &value[0]);
+                Float seconds = timer->getSecondsSinceStart();
+
+                Log(EInfo, "%s filter, %i channels: %.1f Msamples/s", filters[f],
+                    channels, sampleCount / (seconds * 1e6f));
+            }
+        }
+    }
+
+    void test04_statistics() {
+        /* Box filter: the variance of a pixel is the sample variance divided by n */
+        ref<ReconstructionFilter> box = createFilter("box");
+        ref<ImageBlock> block = new ImageBlock(Bitmap::ESpectrumAlphaWeight,
+            Vector2i(4, 4), box);
+        block->setStatistics(true);
+        block->clear();
+
+        const Float values[] = { 1, 2, 3, 4 };
+        for (int i=0; i<4; ++i)
+            assertTrue(block->put(Point2(2.25f + 0.1f*i, 1.5f), Spectrum(values[i]), 1.0f));
+
+        const Float *stats = block->getStatistics()->getFloatData() + (1*4 + 2) * 3;
+        assertEquals(stats[2], (Float) 4);
+        assertEqualsEpsilon(block->getVariance(Point2i(2, 1)), (Float) (1.25 / 4), 1e-4f);
+        assertEquals(block->getVariance(Point2i(0, 0)), (Float) 0);
+
+        /* Gaussian filter: every sample is counted once, and merging blocks
+           accumulates the statistics */
+        ref<ReconstructionFilter> gaussian = createFilter("gaussian");
+        ref<ImageBlock> target = new ImageBlock(Bitmap::ESpectrumAlphaWeight,
+            Vector2i(16, 16), gaussian);
+        target->setStatistics(true);
+        target->clear();
+        ref<Random> random = new Random();
+
+        const int sampleCount = 500;
+        for (int pass=0; pass<2; ++pass) {
+            ref<ImageBlock> source = new ImageBlock(Bitmap::ESpectrumAlphaWeight,
+                Vector2i(16, 16), gaussian);
+            source->setStatistics(true);
+            source->clear();
+            for (int i=0; i<sampleCount; ++i)
+                source->put(Point2(random->nextFloat() * 16, random->nextFloat() * 16),
+                    Spectrum(random->nextFloat()), 1.0f);
+            target->put(source);
+        }
+
+        Vector2i size = target->getStatistics()->getSize();
+        stats = target->getStatistics()->getFloatData();
+        Float total = 0;
+        for (int y=0; y<size.y; ++y) {
+            for (int x=0; x<size.x; ++x) {
+                total += stats[(y*size.x + x) * 3 + 2];
+                assertTrue(target->getVariance(Point2i(x, y)) >= 0);
+            }
+        }
+        assertEquals(total, (Float) (2 * sampleCount));
+    }
+
+    void test05_developLDR() {
+        /* Compare the fused develop pass against separate conversion and
+           tonemapping passes. Both may round differently by one step. */
+        const Bitmap::EPixelFormat formats[] = { Bitmap::ELuminance,
+            Bitmap::ELuminanceAlpha, Bitmap::ERGB, Bitmap::ERGBA };
+        const Float gammas[] = { -1, 2.2f, 1 };
+        const Vector2i size(37, 23);
+        ref<Random> random = new Random();
+        ref<ReconstructionFilter> rfilter = createFilter("gaussian");
+        ref<ImageBlock> block = createRandomBlock(size, rfilter, 5000, random);
+        ref<Bitmap> interior = block->getBitmap()->crop(
+            Point2i(block->getBorderSize()), size);
+
+        for (int f=0; f<4; ++f) {
+            for (int g=0; g<3; ++g) {
+                ref<Bitmap> result = new Bitmap(formats[f], Bitmap::EUInt8, size);
+                block->developLDR(result, 1.5f, gammas[g], false);
+                ref<Bitmap> reference = interior->convert(formats[f],
+                    Bitmap::EUInt8, gammas[g], 1.5f);
+                assertEquals(result->getGamma(), gammas[g]);
+                assertTrue(maxDifference(result, reference) <= 1);
+
+                /* Dithering changes every value by at most one step */
+                ref<Bitmap> dithered = new Bitmap(formats[f], Bitmap::EUInt8, size);
+                block->developLDR(dithered, 1.5f, gammas[g], true);
+                assertTrue(maxDifference(dithered, result) <= 1);
+
+                Float logAvgLuminance = 0, maxLuminance = 0,
+                      refLogAvgLuminance = 0, refMaxLuminance = 0;
+                block->developLDRReinhard(result, logAvgLuminance, maxLuminance,
+                    0.18f, 0.1f, gammas[g], false);
+                reference = interior->convert(formats[f], Bitmap::EFloat);
+                reference->tonemapReinhard(refLogAvgLuminance, refMaxLuminance, 0.18f, 0.1f);
+                reference = reference->convert(formats[f], Bitmap::EUInt8, gammas[g]);
+                assertEqualsEpsilon(logAvgLuminance, refLogAvgLuminance, 1e-3f);
+                assertEqualsEpsilon(maxLuminance, refMaxLuminance, 1e-4f);
+                assertTrue(maxDifference(result, reference) <= 1);
+            }
+        }
+    }
+
+    void test06_developBenchmark() {
+        const Vector2i size(256, 256);
+        const int iterations = 50;
+        ref<Random> random = new Random();
+        ref<ReconstructionFilter> rfilter = createFilter("box");
+        ref<ImageBlock> block = createRandomBlock(size, rfilter, 200000, random);
+        ref<Bitmap> result = new Bitmap(Bitmap::ERGB, Bitmap::EUInt8, size);
+
+        ref<Timer> timer = new Timer();
+        for (int i=0; i<iterations; ++i)
+            block->getBitmap()->convert(Bitmap::ERGB, Bitmap::EUInt8, -1, 1.0f);
+        Float convertTime = timer->getSecondsSinceStart();
+
+        timer->reset();
+        for (int i=0; i<iterations; ++i)
+            block->developLDR(result, 1.0f, -1, false);
+        Float developTime = timer->getSecondsSinceStart();
+
+        timer->reset();
+        for (int i=0; i<iterations; ++i) {
+            ref<Bitmap> temp = block->getBitmap()->convert(Bitmap::ERGB, Bitmap::EFloat);
+            Float logAvgLuminance = 0, maxLuminance = 0;
+            temp->tonemapReinhard(logAvgLuminance, maxLuminance, 0.18f, 0.0f);
+            temp->convert(Bitmap::ERGB, Bitmap::EUInt8, -1);
+        }
+        Float reinhardTime = timer->getSecondsSinceStart();
+
+        timer->reset();
+        for (int i=0; i<iterations; ++i) {
+            Float logAvgLuminance = 0, maxLuminance = 0;
+            block->developLDRReinhard(result, logAvgLuminance, maxLuminance,
+                0.18f, 0.0f, -1, false);
+        }
+        Float fusedReinhardTime = timer->getSecondsSinceStart();
+
+        Log(EInfo, "256x256 sRGB develop: %.2f ms (convert) vs %.2f ms (fused)",
+            convertTime * 1000 / iterations, developTime * 1000 / iterations);
+        Log(EInfo, "256x256 Reinhard develop: %.2f ms (separate passes) vs %.2f ms (fused)",
+            reinhardTime * 1000 / iterations, fusedReinhardTime * 1000 / iterations);
+    }
+};
+
+MTS_EXPORT_TESTCASE(TestImageBlock, "Testcase for image block splatting")
+MTS_NAMESPACE_END
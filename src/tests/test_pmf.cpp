@@ -0,0 +1,152 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <mitsuba/render/testcase.h>
+#include <mitsuba/core/pmf.h>
+#include <mitsuba/core/random.h>
+
+MTS_NAMESPACE_BEGIN
+
+/* Skewed distribution with zero and near-one entries */
+static const Float skewedPMF[] = {
+    0.0f, 0.97f, 0.001f, 0.0f, 0.02f, 0.0f, 0.009f
+};
+
+static const size_t skewedSize = sizeof(skewedPMF) / sizeof(Float);
+
+class TestPMF : public TestCase {
+public:
+    MTS_BEGIN_TESTCASE()
+    MTS_DECLARE_TEST(test01_aliasTable)
+    MTS_DECLARE_TEST(test02_aliasSampling)
+    MTS_DECLARE_TEST(test03_aliasSampleReuse)
+    MTS_END_TESTCASE()
+
+    void createDistribution(DiscreteDistribution &dist) {
+        dist.clear();
+        for (size_t i=0; i<skewedSize; ++i)
+            dist.append(skewedPMF[i]);
+        dist.normalize();
+    }
+
+    void test01_aliasTable() {
+        typedef math::AliasTableEntry<Float, uint32_t> Entry;
+        std::vector<Float> pmf(skewedPMF, skewedPMF + skewedSize);
+        std::vector<Entry> table(skewedSize);
+        uint32_t n = (uint32_t) skewedSize;
+
+        Float sum = math::makeAliasTable(&table[0], &pmf[0], n);
+        assertEqualsEpsilon(sum, (Float) 1, 1e-5f);
+
+        /* The probability mass implied by the table must match the PMF */
+        std::vector<Float> mass(skewedSize, 0.0f);
+        for (uint32_t i=0; i<n; ++i) {
+            Float prob = std::min(table[i].prob, (Float) 1);
+            assertTrue(table[i].index < n);
+            mass[i] += prob / n;
+            mass[table[i].index] += (1 - prob) / n;
+        }
+        for (size_t i=0; i<skewedSize; ++i)
+            assertEqualsEpsilon(mass[i], skewedPMF[i], 1e-5f);
+    }
+
+    void test02_aliasSampling() {
+        DiscreteDistribution cdf, alias;
+        createDistribution(cdf);
+        createDistribution(alias);
+        alias.buildAliasTable();
+        assertFalse(cdf.hasAliasTable());
+        assertTrue(alias.hasAliasTable());
+
+        const size_t sampleCount = 1000000;
+        std::vector<size_t> cdfHist(skewedSize, 0), aliasHist(skewedSize, 0);
+        ref<Random> random = new Random();
+
+        for (size_t i=0; i<sampleCount; ++i) {
+            Float sample = random->nextFloat(), cdfPdf, aliasPdf;
+            size_t cdfIndex = cdf.sample(sample, cdfPdf);
+            size_t aliasIndex = alias.sample(sample, aliasPdf);
+
+            assertTrue(aliasIndex < skewedSize);
+            assertEqualsEpsilon(cdfPdf, cdf[cdfIndex], 1e-6f);
+            assertEqualsEpsilon(aliasPdf, cdf[aliasIndex], 1e-6f);
+            assertTrue(aliasPdf > 0);
+            cdfHist[cdfIndex]++;
+            aliasHist[aliasIndex]++;
+        }
+
+        for (size_t i=0; i<skewedSize; ++i) {
+            /* Allow for five standard deviations of binomial noise */
+            Float p = skewedPMF[i],
+                  tolerance = 5 * std::sqrt(p * (1-p) / sampleCount) + 1e-5f;
+            assertEqualsEpsilon(cdfHist[i] / (Float) sampleCount, p, tolerance);
+            assertEqualsEpsilon(aliasHist[i] / (Float) sampleCount, p, tolerance);
+            if (p == 0) {
+                assertTrue(cdfHist[i] == 0);
+                assertTrue(aliasHist[i] == 0);
+            }
+        }
+    }
+
+    void test03_aliasSampleReuse() {
+        DiscreteDistribution cdf, alias;
+        createDistribution(cdf);
+        createDistribution(alias);
+        alias.buildAliasTable();
+
+        const size_t sampleCount = 1000000;
+        std::vector<size_t> cdfHist(skewedSize, 0), aliasHist(skewedSize, 0);
+        std::vector<double> cdfMean(skewedSize, 0.0), aliasMean(skewedSize, 0.0);
+        ref<Random> random = new Random();
+
+        for (size_t i=0; i<sampleCount; ++i) {
+            Float cdfSample = random->nextFloat(), aliasSample = cdfSample;
+            Float cdfPdf, aliasPdf;
+            size_t cdfIndex = cdf.sampleReuse(cdfSample, cdfPdf);
+            size_t aliasIndex = alias.sampleReuse(aliasSample, aliasPdf);
+
+            assertEqualsEpsilon(cdfPdf, cdf[cdfIndex], 1e-6f);
+            assertEqualsEpsilon(aliasPdf, cdf[aliasIndex], 1e-6f);
+            assertTrue(cdfSample >= 0 && cdfSample <= 1);
+            assertTrue(aliasSample >= 0 && aliasSample <= 1);
+            cdfHist[cdfIndex]++;
+            aliasHist[aliasIndex]++;
+            cdfMean[cdfIndex] += cdfSample;
+            aliasMean[aliasIndex] += aliasSample;
+        }
+
+        for (size_t i=0; i<skewedSize; ++i) {
+            Float p = skewedPMF[i],
+                  tolerance = 5 * std::sqrt(p * (1-p) / sampleCount) + 1e-5f;
+            assertEqualsEpsilon(cdfHist[i] / (Float) sampleCount, p, tolerance);
+            assertEqualsEpsilon(aliasHist[i] / (Float) sampleCount, p, tolerance);
+            if (p == 0)
+                continue;
+
+            /* The reused sample must again be uniform on [0, 1] */
+            Float meanTolerance = 5 * std::sqrt(1.0f / (12 * cdfHist[i]));
+            assertEqualsEpsilon((Float) (cdfMean[i] / cdfHist[i]), (Float) 0.5f, meanTolerance);
+            meanTolerance = 5 * std::sqrt(1.0f / (12 * aliasHist[i]));
+            assertEqualsEpsilon((Float) (aliasMean[i] / aliasHist[i]), (Float) 0.5f, meanTolerance);
+        }
+    }
+};
+
+MTS_EXPORT_TESTCASE(TestPMF, "Testcase for discrete distribution sampling")
+MTS_NAMESPACE_END
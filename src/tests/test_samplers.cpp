@@ -19,6 +19,7 @@
 #include <mitsuba/render/testcase.h>
 #include <mitsuba/core/plugin.h>
 #include <mitsuba/core/qmc.h>
+#include <mitsuba/core/timer.h>
 
 MTS_NAMESPACE_BEGIN
 
@@ -28,8 +29,22 @@ public:
     MTS_DECLARE_TEST(test01_Halton)
     MTS_DECLARE_TEST(test02_Hammersley)
     MTS_DECLARE_TEST(test03_radicalInverseIncr)
+    MTS_DECLARE_TEST(test04_radicalInverseArray)
+    MTS_DECLARE_TEST(test05_batchConsistency)
+    MTS_DECLARE_TEST(test06_benchmark)
+    MTS_DECLARE_TEST(test07_elementaryIntervals)
+    MTS_DECLARE_TEST(test08_samplePasses)
     MTS_END_TESTCASE()
 
+    ref<Sampler> createSampler(const std::string &name, size_t sampleCount) {
+        Properties props(name);
+        props.setSize("sampleCount", sampleCount);
+        ref<Sampler> sampler = static_cast<Sampler *> (PluginManager::getInstance()->
+                createObject(MTS_CLASS(Sampler), props));
+        sampler->configure();
+        return sampler;
+    }
+
     void test01_Halton() {
         ref<Sampler> sampler = static_cast<Sampler *> (PluginManager::getInstance()->
                 createObject(MTS_CLASS(Sampler), Properties("halton")));
@@ -84,6 +99,224 @@ public:
             x = radicalInverseIncremental(2, x);
         }
     }
+
+    void test04_radicalInverseArray() {
+        const uint16_t bases[] = { 0, 1, 4, 37, 1023 };
+        const uint64_t offsets[] = { 0, 5, 123456789 };
+        const uint64_t strides[] = { 1, 6, 31104 };
+        const size_t count = 2000;
+        std::vector<Float> values(count);
+        std::vector<uint16_t> perm(8192);
+
+        for (int b=0; b<5; ++b) {
+            int base = primeTable[bases[b]];
+            for (int i=0; i<base; ++i)
+                perm[i] = (uint16_t) ((i * 7 + 3) % base);
+
+            for (int o=0; o<3; ++o) {
+                for (int s=0; s<3; ++s) {
+                    radicalInverseArray(bases[b], offsets[o], strides[s],
+                        count, &values[0]);
+                    for (size_t j=0; j<count; ++j)
+                        assertEquals(values[j], radicalInverseFast(bases[b],
+                            offsets[o] + j*strides[s]));
+
+                    radicalInverseArray(bases[b], offsets[o], strides[s],
+                        count, &values[0], &perm[0]);
+                    for (size_t j=0; j<count; ++j)
+                        assertEquals(values[j], scrambledRadicalInverseFast(bases[b],
+                            offsets[o] + j*strides[s], &perm[0]));
+                }
+            }
+        }
+    }
+
+    void test05_batchConsistency() {
+        /* The QMC samplers generate the points of a pixel in batches, except
+           for samples beyond the sample count. Compare the two code paths. */
+        const char *names[] = { "sobol", "halton" };
+        const size_t sampleCount = 64;
+
+        for (int n=0; n<2; ++n) {
+            ref<Sampler> batch = createSampler(names[n], sampleCount);
+            ref<Sampler> scalar = createSampler(names[n], 1);
+            batch->request1DArray(3);
+            scalar->request1DArray(3);
+            batch->setFilmResolution(Vector2i(200, 150), true);
+            scalar->setFilmResolution(Vector2i(200, 150), true);
+            batch->generate(Point2i(37, 91));
+            scalar->generate(Point2i(37, 91));
+
+            for (size_t i=0; i<sampleCount; ++i) {
+                scalar->setSampleIndex(i);
+                for (int j=0; j<20; ++j) {
+                    if (j % 3 == 0) {
+                        Point2 p1 = batch->next2D(), p2 = scalar->next2D();
+                        assertEquals(p1.x, p2.x);
+                        assertEquals(p1.y, p2.y);
+                        if (j == 0) {
+                            /* The first two dimensions cover the pixel */
+                            assertTrue(p1.x >= 0 && p1.x < 1 && p1.y >= 0 && p1.y < 1);
+                        }
+                    } else {
+                        assertEquals(batch->next1D(), scalar->next1D());
+                    }
+                }
+                batch->advance();
+            }
+        }
+    }
+
+    void test06_benchmark() {
+        const char *names[] = { "independent", "ldsampler", "halton", "sobol",
+            "pmj02", "bluenoise" };
+        const size_t sampleCount = 1024;
+        const int pixelCount = 64, dimensionCount = 64;
+
+        for (int n=0; n<6; ++n) {
+            ref<Sampler> sampler = createSampler(names[n], sampleCount);
+            sampler->setFilmResolution(Vector2i(512), true);
+
+            Float sum = 0;
+            ref<Timer> timer = new Timer();
+            for (int p=0; p<pixelCount; ++p) {
+                sampler->generate(Point2i(p, p * 3));
+                for (size_t i=0; i<sampleCount; ++i) {
+                    for (int d=0; d<dimensionCount / 4; ++d) {
+                        Point2 sample = sampler->next2D();
+                        sum += sample.x + sample.y + sampler->next1D() + sampler->next1D();
+                    }
+                    sampler->advance();
+                }
+            }
+            Float seconds = timer->getSecondsSinceStart();
+
+            Log(EInfo, "%s: %.1f M components/s (checksum %f)", names[n],
+                pixelCount * sampleCount * dimensionCount / (seconds * 1e6f), sum);
+        }
+
+        /* Raw throughput of the radical inverse for a bucketed Halton stride */
+        const size_t count = 1 << 16;
+        std::vector<Float> values(count);
+        ref<Timer> timer = new Timer();
+        for (uint16_t d=0; d<dimensionCount; ++d)
+            radicalInverseArray(d, 12345, 31104, count, &values[0]);
+        Float batchSeconds = timer->getSecondsSinceStart();
+
+        timer->reset();
+        for (uint16_t d=0; d<dimensionCount; ++d)
+            for (size_t j=0; j<count; ++j)
+                values[j] = radicalInverseFast(d, 12345 + j * 31104);
+        Float scalarSeconds = timer->getSecondsSinceStart();
+
+        Log(EInfo, "radicalInverseArray: %.1f M values/s, radicalInverseFast: %.1f M values/s",
+            count * dimensionCount / (batchSeconds * 1e6f),
+            count * dimensionCount / (scalarSeconds * 1e6f));
+    }
+
+    /// Check whether the given points form a (0,m,2)-net in base 2
+    bool isNet(const std::vector<Point2> &points) {
+        int m = math::log2i((uint32_t) points.size());
+        for (int a=0; a<=m; ++a) {
+            std::vector<int> counts(points.size(), 0);
+            for (size_t i=0; i<points.size(); ++i) {
+                int x = (int) (points[i].x * (1 << a)),
+                    y = (int) (points[i].y * (1 << (m-a)));
+                if (counts[(x << (m-a)) + y]++ > 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void test07_elementaryIntervals() {
+        /* Every power-of-two prefix of the samples of a pixel must be
+           stratified with respect to all elementary intervals. This holds
+           for all pmj02 dimensions, but only for the first two dimensions
+           of the (digitally shifted) Sobol sequence. */
+        const char *names[] = { "pmj02", "bluenoise" };
+        const int dimensions[] = { 3, 1 };
+        const size_t sampleCount = 256;
+
+        for (int n=0; n<2; ++n) {
+            ref<Sampler> sampler = createSampler(names[n], sampleCount);
+            sampler->generate(Point2i(13, 7));
+
+            std::vector<std::vector<Point2> > points(3);
+            for (size_t i=0; i<sampleCount; ++i) {
+                for (int d=0; d<3; ++d)
+                    points[d].push_back(sampler->next2D());
+                sampler->advance();
+            }
+
+            for (int d=0; d<dimensions[n]; ++d) {
+                for (size_t count=1; count<=sampleCount; count *= 2) {
+                    std::vector<Point2> prefix(points[d].begin(), points[d].begin() + count);
+                    assertTrue(isNet(prefix));
+                }
+            }
+        }
+    }
+
+    /// Collect the first few 2D values of all samples of a pixel
+    void collectSamples(Sampler *sampler, const Point2i &pixel,
+            std::vector<std::pair<Float, Float> > &values) {
+        sampler->generate(pixel);
+        for (size_t i=0; i<sampler->getSampleCount(); ++i) {
+            for (int d=0; d<3; ++d) {
+                Point2 p = sampler->next2D();
+                values.push_back(std::make_pair(p.x, p.y));
+            }
+            sampler->advance();
+        }
+    }
+
+    void test08_samplePasses() {
+        /* Two sample passes of a deterministic sampler must produce the same
+           points as a single pass with twice the number of samples. A
+           Hammersley point set can't be extended in this way, hence its
+           passes are only checked for being distinct and within range. */
+        const char *names[] = { "sobol", "halton", "pmj02", "bluenoise", "hammersley" };
+        const bool extensible[] = { true, true, true, true, false };
+        const size_t sampleCount = 16;
+        const Point2i pixel(37, 91);
+
+        for (int n=0; n<5; ++n) {
+            ref<Sampler> single = createSampler(names[n], 2 * sampleCount);
+            ref<Sampler> progressive = createSampler(names[n], sampleCount);
+            single->setFilmResolution(Vector2i(200, 150), true);
+            progressive->setFilmResolution(Vector2i(200, 150), true);
+
+            std::vector<std::pair<Float, Float> > values1, values2, pass0;
+            collectSamples(single, pixel, values1);
+            for (size_t pass=0; pass<2; ++pass) {
+                progressive->setSamplePass(pass);
+                collectSamples(progressive, pixel, values2);
+            }
+
+            /* The passes must not repeat each other */
+            pass0.assign(values2.begin(), values2.begin() + values2.size() / 2);
+            assertFalse(std::equal(pass0.begin(), pass0.end(),
+                values2.begin() + values2.size() / 2));
+
+            if (!extensible[n]) {
+                /* Each pass must keep its samples within the pixel */
+                for (size_t i=0; i<values2.size(); ++i) {
+                    assertTrue(values2[i].first >= 0 && values2[i].first < 1);
+                    assertTrue(values2[i].second >= 0 && values2[i].second < 1);
+                }
+                continue;
+            }
+
+            std::sort(values1.begin(), values1.end());
+            std::sort(values2.begin(), values2.end());
+            assertTrue(values1.size() == values2.size());
+            for (size_t i=0; i<values1.size(); ++i) {
+                assertEqualsEpsilon(values1[i].first, values2[i].first, 1e-6f);
+                assertEqualsEpsilon(values1[i].second, values2[i].second, 1e-6f);
+            }
+        }
+    }
 };
 
 MTS_EXPORT_TESTCASE(TestSamplers, "Testcase for sampling-related code")
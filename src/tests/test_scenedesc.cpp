@@ -0,0 +1,313 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <mitsuba/render/testcase.h>
+#include <mitsuba/render/scenedesc.h>
+#include <mitsuba/render/scenetemplate.h>
+#include <mitsuba/core/mstream.h>
+#include <mitsuba/core/track.h>
+#include <mitsuba/core/version.h>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem.hpp>
+
+MTS_NAMESPACE_BEGIN
+
+class TestSceneDescription : public TestCase {
+public:
+    MTS_BEGIN_TESTCASE()
+    MTS_DECLARE_TEST(test01_propertiesRoundTrip)
+    MTS_DECLARE_TEST(test02_descriptionRoundTrip)
+    MTS_DECLARE_TEST(test03_convertXML)
+    MTS_DECLARE_TEST(test04_parallelInstantiation)
+    MTS_DECLARE_TEST(test05_sceneTemplate)
+    MTS_DECLARE_TEST(test06_sceneTemplateSampler)
+    MTS_DECLARE_TEST(test07_sceneTemplateIntegrator)
+    MTS_END_TESTCASE()
+
+    void test01_propertiesRoundTrip() {
+        Properties props("sphere");
+        props.setID("mySphere");
+        props.setBoolean("flipNormals", true);
+        props.setLong("count", (int64_t) 1 << 40);
+        props.setFloat("radius", 0.25f);
+        props.setPoint("center", Point(1, 2, 3));
+        props.setVector("direction", Vector(0, 0, -1));
+        props.setTransform("toWorld", Transform::translate(Vector(4, 5, 6)));
+        props.setSpectrum("reflectance", Spectrum(0.5f));
+        props.setString("filename", "mesh.serialized");
+
+        ref<MemoryStream> stream = new MemoryStream();
+        props.serialize(stream);
+        stream->seek(0);
+        Properties props2(stream);
+
+        assertTrue(props == props2);
+        assertTrue(stream->getPos() == stream->getSize());
+
+        ref<AnimatedTransform> trafo = new AnimatedTransform();
+        trafo->appendTransform(0, Transform::translate(Vector(1, 0, 0)));
+        trafo->appendTransform(1, Transform::translate(Vector(2, 0, 0)));
+        Properties props3("instance");
+        props3.setAnimatedTransform("toWorld", trafo);
+
+        stream->reset();
+        props3.serialize(stream);
+        stream->seek(0);
+        Properties props4(stream);
+
+        assertTrue(props4.getType("toWorld") == Properties::EAnimatedTransform);
+        ref<const AnimatedTransform> trafo2 = props4.getAnimatedTransform("toWorld");
+        assertTrue(trafo2->eval(0.5f) == trafo->eval(0.5f));
+    }
+
+    void test02_descriptionRoundTrip() {
+        ref<SceneDescription> description = new SceneDescription();
+
+        Properties bsdfProps("diffuse");
+        bsdfProps.setSpectrum("reflectance", Spectrum(0.2f));
+        uint32_t bsdf = description->appendNode(MTS_CLASS(BSDF), bsdfProps);
+
+        Properties sphereProps("sphere");
+        sphereProps.setFloat("radius", 2.0f);
+        uint32_t sphere1 = description->appendNode(MTS_CLASS(Shape), sphereProps);
+        description->addChild(sphere1, "", bsdf);
+        sphereProps.setPoint("center", Point(5, 0, 0));
+        uint32_t sphere2 = description->appendNode(MTS_CLASS(Shape), sphereProps);
+        description->addChild(sphere2, "", bsdf);
+
+        uint32_t scene = description->appendNode(MTS_CLASS(Scene), Properties());
+        description->addChild(scene, "", sphere1);
+        description->addChild(scene, "", sphere2);
+
+        ref<MemoryStream> stream = new MemoryStream();
+        stream->setByteOrder(Stream::ELittleEndian);
+        description->serialize(stream);
+        stream->seek(0);
+        ref<SceneDescription> description2 = new SceneDescription(stream);
+
+        assertTrue(description2->getNodeCount() == 4);
+        for (size_t i=0; i<4; ++i) {
+            const SceneDescription::Node &n1 = description->getNode(i),
+                                         &n2 = description2->getNode(i);
+            assertTrue(n1.cls == n2.cls);
+            assertTrue(n1.props == n2.props);
+            assertTrue(n1.children == n2.children);
+        }
+
+        ref<Scene> result = description2->instantiate();
+        const ref_vector<Shape> &shapes = result->getShapes();
+        assertTrue(shapes.size() == 2);
+        assertTrue(shapes[0]->getBSDF() == shapes[1]->getBSDF());
+        assertEqualsEpsilon(shapes[0]->getSurfaceArea(), (Float) (16 * M_PI), 1e-3f);
+    }
+
+    void test03_convertXML() {
+        fs::path xmlFile = fs::temp_directory_path() / "mitsuba_test_scenedesc.xml",
+                 binFile = fs::temp_directory_path() / "mitsuba_test_scenedesc.msb";
+
+        fs::ofstream os(xmlFile);
+        os << "<scene version=\"" MTS_VERSION "\">" << endl
+           << "    <bsdf type=\"diffuse\" id=\"white\">" << endl
+           << "        <rgb name=\"reflectance\" value=\"$albedo\"/>" << endl
+           << "    </bsdf>" << endl
+           << "    <shape type=\"sphere\">" << endl
+           << "        <ref id=\"white\"/>" << endl
+           << "    </shape>" << endl
+           << "    <shape type=\"rectangle\">" << endl
+           << "        <transform name=\"toWorld\">" << endl
+           << "            <scale value=\"3\"/>" << endl
+           << "        </transform>" << endl
+           << "        <ref id=\"white\"/>" << endl
+           << "    </shape>" << endl
+           << "</scene>" << endl;
+        os.close();
+
+        ParameterMap params;
+        params["albedo"] = "0.5";
+        ref<SceneDescription> description = loadSceneDescription(xmlFile, params);
+        description->write(binFile);
+        assertTrue(SceneDescription::isSceneDescription(binFile));
+        assertFalse(SceneDescription::isSceneDescription(xmlFile));
+
+        ref<Scene> scene = loadScene(binFile);
+        const ref_vector<Shape> &shapes = scene->getShapes();
+        assertTrue(shapes.size() == 2);
+        assertTrue(shapes[0]->getBSDF() == shapes[1]->getBSDF());
+        assertEqualsEpsilon(shapes[1]->getSurfaceArea(), (Float) 36, 1e-3f);
+
+        fs::remove(xmlFile);
+        fs::remove(binFile);
+    }
+
+    void test04_parallelInstantiation() {
+        /* Many independent shapes that share a textured BSDF; the
+           shapes must appear in the scene in document order */
+        const int shapeCount = 256;
+        ref<SceneDescription> description = new SceneDescription();
+
+        Properties textureProps("checkerboard");
+        uint32_t texture = description->appendNode(MTS_CLASS(Texture), textureProps);
+        uint32_t bsdf = description->appendNode(MTS_CLASS(BSDF), Properties("diffuse"));
+        description->addChild(bsdf, "reflectance", texture);
+
+        std::vector<uint32_t> shapes;
+        for (int i=0; i<shapeCount; ++i) {
+            Properties props("sphere");
+            props.setFloat("radius", 1.0f + i);
+            uint32_t shape = description->appendNode(MTS_CLASS(Shape), props);
+            description->addChild(shape, "", bsdf);
+            shapes.push_back(shape);
+        }
+
+        uint32_t scene = description->appendNode(MTS_CLASS(Scene), Properties());
+        for (int i=0; i<shapeCount; ++i)
+            description->addChild(scene, "", shapes[i]);
+
+        ref<Scene> result = description->instantiate();
+        const ref_vector<Shape> &sceneShapes = result->getShapes();
+        assertTrue(sceneShapes.size() == (size_t) shapeCount);
+        for (int i=0; i<shapeCount; ++i) {
+            Float radius = 1.0f + i;
+            assertEqualsEpsilon(sceneShapes[i]->getSurfaceArea(),
+                (Float) (4 * M_PI) * radius * radius, 1e-2f * radius * radius);
+            assertTrue(sceneShapes[i]->getBSDF() == sceneShapes[0]->getBSDF());
+        }
+    }
+
+    void test05_sceneTemplate() {
+        fs::path xmlFile = fs::temp_directory_path() / "mitsuba_test_scenetemplate.xml";
+
+        fs::ofstream os(xmlFile);
+        os << "<scene version=\"" MTS_VERSION "\">" << endl
+           << "    <bsdf type=\"diffuse\" id=\"white\"/>" << endl
+           << "    <shape type=\"sphere\">" << endl
+           << "        <float name=\"radius\" value=\"$radius\"/>" << endl
+           << "        <ref id=\"white\"/>" << endl
+           << "    </shape>" << endl
+           << "    <shape type=\"rectangle\">" << endl
+           << "        <ref id=\"white\"/>" << endl
+           << "    </shape>" << endl
+           << "</scene>" << endl;
+        os.close();
+
+        ref<SceneTemplate> sceneTemplate = new SceneTemplate(xmlFile);
+        fs::remove(xmlFile);
+
+        SceneTemplate::ParameterMap params;
+        params["radius"] = "1";
+        ref<Scene> scene1 = sceneTemplate->instantiate(params);
+        assertTrue(sceneTemplate->getReusedObjectCount() == 0);
+
+        /* Only the sphere (and the scene itself) must be created again */
+        params["radius"] = "2";
+        ref<Scene> scene2 = sceneTemplate->instantiate(params);
+        assertTrue(sceneTemplate->getReusedObjectCount() == 2);
+
+        const ref_vector<Shape> &shapes1 = scene1->getShapes(),
+                                &shapes2 = scene2->getShapes();
+        assertTrue(shapes1.size() == 2 && shapes2.size() == 2);
+        assertEqualsEpsilon(shapes1[0]->getSurfaceArea(), (Float) (4 * M_PI), 1e-2f);
+        assertEqualsEpsilon(shapes2[0]->getSurfaceArea(), (Float) (16 * M_PI), 1e-2f);
+        assertTrue(shapes1[0] != shapes2[0]);
+        assertTrue(shapes1[1] == shapes2[1]);
+        assertTrue(shapes2[0]->getBSDF() == shapes1[0]->getBSDF());
+
+        sceneTemplate->clearCache();
+        ref<Scene> scene3 = sceneTemplate->instantiate(params);
+        assertTrue(sceneTemplate->getReusedObjectCount() == 0);
+        assertTrue(scene3->getShapes()[1] != shapes2[1]);
+    }
+
+    void test06_sceneTemplateSampler() {
+        fs::path xmlFile = fs::temp_directory_path() / "mitsuba_test_scenetemplate.xml";
+
+        fs::ofstream os(xmlFile);
+        os << "<scene version=\"" MTS_VERSION "\">" << endl
+           << "    <integrator type=\"direct\">" << endl
+           << "        <integer name=\"emitterSamples\" value=\"4\"/>" << endl
+           << "    </integrator>" << endl
+           << "    <sensor type=\"perspective\">" << endl
+           << "        <sampler type=\"independent\"/>" << endl
+           << "    </sensor>" << endl
+           << "    <shape type=\"sphere\">" << endl
+           << "        <bsdf type=\"diffuse\">" << endl
+           << "            <spectrum name=\"reflectance\" value=\"$albedo\"/>" << endl
+           << "        </bsdf>" << endl
+           << "    </shape>" << endl
+           << "    <shape type=\"rectangle\"/>" << endl
+           << "</scene>" << endl;
+        os.close();
+
+        ref<SceneTemplate> sceneTemplate = new SceneTemplate(xmlFile);
+        fs::remove(xmlFile);
+
+        SceneTemplate::ParameterMap params;
+        params["albedo"] = "0.5";
+        ref<Scene> scene1 = sceneTemplate->instantiate(params);
+        size_t arrayCount = scene1->getSampler()->get2DArrayCount();
+        assertTrue(arrayCount > 0);
+
+        /* The sampler must be configured from scratch instead of
+           accumulating further sample arrays */
+        params["albedo"] = "0.8";
+        ref<Scene> scene2 = sceneTemplate->instantiate(params);
+        assertTrue(sceneTemplate->getReusedObjectCount() == 1);
+        assertTrue(scene2->getSampler() != scene1->getSampler());
+        assertTrue(scene1->getSampler()->get2DArrayCount() == arrayCount);
+        assertTrue(scene2->getSampler()->get2DArrayCount() == arrayCount);
+    }
+
+    void test07_sceneTemplateIntegrator() {
+        fs::path xmlFile = fs::temp_directory_path() / "mitsuba_test_scenetemplate.xml";
+
+        fs::ofstream os(xmlFile);
+        os << "<scene version=\"" MTS_VERSION "\">" << endl
+           << "    <integrator type=\"photonmapper\"/>" << endl
+           << "    <shape type=\"sphere\">" << endl
+           << "        <float name=\"radius\" value=\"$radius\"/>" << endl
+           << "        <subsurface type=\"dipole\"/>" << endl
+           << "    </shape>" << endl
+           << "    <shape type=\"rectangle\"/>" << endl
+           << "</scene>" << endl;
+        os.close();
+
+        ref<SceneTemplate> sceneTemplate = new SceneTemplate(xmlFile);
+        fs::remove(xmlFile);
+
+        SceneTemplate::ParameterMap params;
+        params["radius"] = "1";
+        ref<Scene> scene1 = sceneTemplate->instantiate(params);
+
+        /* Photon maps and irradiance octrees are built once per object
+           and depend on the entire scene, hence the integrators of the
+           new geometry must not be carried over */
+        params["radius"] = "2";
+        ref<Scene> scene2 = sceneTemplate->instantiate(params);
+        assertTrue(sceneTemplate->getReusedObjectCount() == 1);
+        assertTrue(scene2->getShapes()[1] == scene1->getShapes()[1]);
+        assertTrue(scene2->getIntegrator() != scene1->getIntegrator());
+
+        const Subsurface *ss1 = scene1->getShapes()[0]->getSubsurface(),
+                         *ss2 = scene2->getShapes()[0]->getSubsurface();
+        assertTrue(ss1 != NULL && ss2 != NULL && ss1 != ss2);
+    }
+};
+
+MTS_EXPORT_TESTCASE(TestSceneDescription, "Testcase for binary scene descriptions")
+MTS_NAMESPACE_END
@@ -0,0 +1,157 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <mitsuba/render/testcase.h>
+#include <mitsuba/render/tilestream.h>
+#include <mitsuba/core/plugin.h>
+#include <mitsuba/core/random.h>
+#include <mitsuba/core/fstream.h>
+
+MTS_NAMESPACE_BEGIN
+
+class TestTileStream : public TestCase {
+public:
+    MTS_BEGIN_TESTCASE()
+    MTS_DECLARE_TEST(test01_numpy)
+#if defined(MTS_HAS_OPENEXR)
+    MTS_DECLARE_TEST(test02_openexr)
+#endif
+    MTS_END_TESTCASE()
+
+    /**
+     * Render random samples into blocks, submit them to a tile stream in
+     * a random order, and return the conventional full-image develop
+     */
+    ref<Bitmap> streamBlocks(TileWriter *writer, const Vector2i &size, int blockSize) {
+        ref<ReconstructionFilter> rfilter = static_cast<ReconstructionFilter *> (
+            PluginManager::getInstance()->createObject(
+            MTS_CLASS(ReconstructionFilter), Properties("gaussian")));
+        rfilter->configure();
+        assertTrue(rfilter->getBorderSize() > 0);
+
+        std::vector<Bitmap::EPixelFormat> pixelFormats(1, Bitmap::ERGB);
+        std::vector<std::string> channelNames;
+        channelNames.push_back("R");
+        channelNames.push_back("G");
+        channelNames.push_back("B");
+        ref<Bitmap> tile = TileStream::createTile(blockSize, pixelFormats,
+            Bitmap::EFloat32, channelNames);
+        ref<TileStream> stream = new TileStream(writer, size, blockSize,
+            tile, pixelFormats);
+
+        ref<ImageBlock> reference = new ImageBlock(Bitmap::ESpectrumAlphaWeight,
+            size, rfilter);
+        reference->clear();
+
+        std::vector<Point2i> offsets;
+        for (int y=0; y<size.y; y += blockSize)
+            for (int x=0; x<size.x; x += blockSize)
+                offsets.push_back(Point2i(x, y));
+
+        ref<Random> random = new Random();
+        for (size_t i=offsets.size()-1; i>0; --i)
+            std::swap(offsets[i], offsets[random->nextUInt((uint32_t) i + 1)]);
+
+        ref<ImageBlock> block = new ImageBlock(Bitmap::ESpectrumAlphaWeight,
+            Vector2i(blockSize), rfilter);
+        for (size_t i=0; i<offsets.size(); ++i) {
+            const Point2i &offset = offsets[i];
+            Vector2i validSize(std::min(blockSize, size.x - offset.x),
+                std::min(blockSize, size.y - offset.y));
+            block->setOffset(offset);
+            block->setSize(validSize);
+            block->clear();
+
+            for (int j=0; j<validSize.x * validSize.y * 4; ++j) {
+                Point2 pos(offset.x + random->nextFloat() * validSize.x,
+                           offset.y + random->nextFloat() * validSize.y);
+                block->put(pos, Spectrum(random->nextFloat() * 4), 1.0f);
+            }
+
+            reference->put(block);
+            stream->put(block);
+        }
+
+        stream->close();
+        assertTrue(stream->isClosed());
+
+        return reference->getBitmap()->crop(Point2i(reference->getBorderSize()),
+            size)->convert(Bitmap::ERGB, Bitmap::EFloat32);
+    }
+
+    void compare(const Bitmap *result, const Bitmap *reference) {
+        assertTrue(result->getSize() == reference->getSize());
+        assertTrue(result->getChannelCount() == reference->getChannelCount());
+        const float *a = result->getFloat32Data(), *b = reference->getFloat32Data();
+        for (size_t i=0; i<reference->getPixelCount() * reference->getChannelCount(); ++i)
+            assertEqualsEpsilon((Float) a[i], (Float) b[i], 1e-4f);
+    }
+
+    void test01_numpy() {
+        const Vector2i size(83, 45);
+        fs::path filename = fs::temp_directory_path() / "mitsuba_test_tilestream.npy";
+        ref<Bitmap> prototype = TileStream::createTile(16,
+            std::vector<Bitmap::EPixelFormat>(1, Bitmap::ERGB), Bitmap::EFloat32,
+            std::vector<std::string>());
+        ref<Bitmap> reference = streamBlocks(
+            TileWriter::createNumPy(filename, size, prototype), size, 16);
+
+        ref<FileStream> fstream = new FileStream(filename);
+        char magic[6];
+        fstream->read(magic, 6);
+        assertTrue(memcmp(magic, "\x93NUMPY", 6) == 0);
+        fstream->seek(8);
+        uint16_t headerLength = fstream->readUChar();
+        headerLength |= (uint16_t) fstream->readUChar() << 8;
+        std::string header(headerLength, '\0');
+        fstream->read(&header[0], headerLength);
+        assertTrue(header.find("'shape': (45, 83, 3)") != std::string::npos);
+        assertTrue((10 + headerLength) % 64 == 0);
+
+        ref<Bitmap> result = new Bitmap(Bitmap::ERGB, Bitmap::EFloat32, size);
+        fstream->read(result->getFloat32Data(), result->getBufferSize());
+        fstream->close();
+        fs::remove(filename);
+
+        compare(result, reference);
+    }
+
+#if defined(MTS_HAS_OPENEXR)
+    void test02_openexr() {
+        const Vector2i size(83, 45);
+        fs::path filename = fs::temp_directory_path() / "mitsuba_test_tilestream.exr";
+        std::vector<std::string> channelNames;
+        channelNames.push_back("R");
+        channelNames.push_back("G");
+        channelNames.push_back("B");
+        ref<Bitmap> prototype = TileStream::createTile(16,
+            std::vector<Bitmap::EPixelFormat>(1, Bitmap::ERGB), Bitmap::EFloat32,
+            channelNames);
+        ref<Bitmap> reference = streamBlocks(TileWriter::createOpenEXR(filename,
+            size, Point2i(0), size, 16, prototype), size, 16);
+
+        ref<Bitmap> result = new Bitmap(filename);
+        fs::remove(filename);
+        compare(result->convert(Bitmap::ERGB, Bitmap::EFloat32), reference);
+    }
+#endif
+};
+
+MTS_EXPORT_TESTCASE(TestTileStream, "Testcase for streaming tiled film output")
+MTS_NAMESPACE_END
@@ -0,0 +1,130 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/render/testcase.h>
+#include <mitsuba/core/timer.h>
+#include <mitsuba/core/atomic.h>
+
+MTS_NAMESPACE_BEGIN
+
+/// Counts the number of live instances
+struct TLSCounter {
+    static volatile int32_t instances;
+    int value;
+
+    TLSCounter() : value(0) { atomicAdd(&instances, 1); }
+    ~TLSCounter() { atomicAdd(&instances, -1); }
+};
+
+volatile int32_t TLSCounter::instances = 0;
+
+typedef std::vector<PrimitiveThreadLocal<TLSCounter> *> TLSVector;
+
+/// Repeatedly looks up a set of TLS objects
+class TLSLookupThread : public Thread {
+public:
+    TLSLookupThread(TLSVector &tls, size_t lookups)
+        : Thread("tls"), m_tls(tls), m_lookups(lookups), m_sum(0) { }
+
+    void run() {
+        const size_t count = m_tls.size();
+        uint64_t sum = 0;
+        for (size_t i=0; i<m_lookups; ++i)
+            sum += ++m_tls[i % count]->get().value;
+        m_sum = sum;
+    }
+
+    inline uint64_t getSum() const { return m_sum; }
+private:
+    TLSVector &m_tls;
+    size_t m_lookups;
+    uint64_t m_sum;
+};
+
+class TestTLS : public TestCase {
+public:
+    MTS_BEGIN_TESTCASE()
+    MTS_DECLARE_TEST(test01_cleanup)
+    MTS_DECLARE_TEST(test02_contention)
+    MTS_END_TESTCASE()
+
+    void runThreads(TLSVector &tls, int threadCount, size_t lookups) {
+        ref_vector<TLSLookupThread> threads;
+        for (int i=0; i<threadCount; ++i) {
+            threads.push_back(new TLSLookupThread(tls, lookups));
+            threads[i]->start();
+        }
+        for (int i=0; i<threadCount; ++i)
+            threads[i]->join();
+    }
+
+    void test01_cleanup() {
+        const int32_t baseline = TLSCounter::instances;
+        TLSVector tls;
+        for (int i=0; i<100; ++i)
+            tls.push_back(new PrimitiveThreadLocal<TLSCounter>());
+
+        /* Entries are destroyed when their thread dies */
+        runThreads(tls, 4, 1000);
+        assertEquals(TLSCounter::instances - baseline, 0);
+
+        /* .. or when the TLS object is destroyed */
+        for (int i=0; i<100; ++i)
+            tls[i]->get().value = 1;
+        assertEquals(TLSCounter::instances - baseline, 100);
+        for (int i=0; i<50; ++i)
+            delete tls[i];
+        assertEquals(TLSCounter::instances - baseline, 50);
+
+        /* TLS objects that reuse the slots of destroyed ones start out fresh */
+        for (int i=0; i<50; ++i)
+            tls[i] = new PrimitiveThreadLocal<TLSCounter>();
+        for (int i=0; i<100; ++i)
+            assertEquals(tls[i]->get().value, i < 50 ? 0 : 1);
+        assertEquals(TLSCounter::instances - baseline, 100);
+
+        for (int i=0; i<100; ++i)
+            delete tls[i];
+        assertEquals(TLSCounter::instances - baseline, 0);
+    }
+
+    void test02_contention() {
+        const size_t lookups = 10000000;
+        TLSVector tls;
+        for (int i=0; i<64; ++i)
+            tls.push_back(new PrimitiveThreadLocal<TLSCounter>());
+
+        int maxThreads = std::max(getCoreCount(), 1);
+        for (int threadCount = 1; ; threadCount = std::min(2 * threadCount, maxThreads)) {
+            ref<Timer> timer = new Timer();
+            runThreads(tls, threadCount, lookups);
+            Float seconds = timer->getSecondsSinceStart();
+            Log(EInfo, "%i thread(s): %.2f ns per lookup, %.1f M lookups/s in total",
+                threadCount, seconds * 1e9f / lookups,
+                threadCount * lookups / (seconds * 1e6f));
+            if (threadCount == maxThreads)
+                break;
+        }
+
+        for (size_t i=0; i<tls.size(); ++i)
+            delete tls[i];
+    }
+};
+
+MTS_EXPORT_TESTCASE(TestTLS, "Testcase for thread local storage")
+MTS_NAMESPACE_END
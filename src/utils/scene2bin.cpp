@@ -0,0 +1,111 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <mitsuba/render/util.h>
+#include <mitsuba/render/scenedesc.h>
+#include <mitsuba/core/timer.h>
+#include <mitsuba/core/fresolver.h>
+#if defined(WIN32)
+#include <mitsuba/core/getopt.h>
+#endif
+
+MTS_NAMESPACE_BEGIN
+
+class Scene2Bin : public Utility {
+public:
+    void help() {
+        cout << endl;
+        cout << "Synopsis: Converts an XML scene into a compact binary scene description, which" << endl;
+        cout << "can be loaded by 'mitsuba' and 'mtsgui' without parsing and validating XML." << endl;
+        cout << "Parameters are substituted during the conversion, and the result is tied to" << endl;
+        cout << "the floating point precision and spectral discretization of this build." << endl;
+        cout << endl;
+        cout << "Usage: mtsutil scene2bin [options] <Scene XML file> <Output file>" << endl;
+        cout << "Options/Arguments:" << endl;
+        cout << "   -h             Display this help text" << endl << endl;
+        cout << "   -D key=val     Define a constant, which can be referenced as \"$key\" in the scene" << endl << endl;
+        cout << "   -v             Verify the output by loading it again and report the timings" << endl << endl;
+    }
+
+    int run(int argc, char **argv) {
+        ref<FileResolver> fileResolver = Thread::getThread()->getFileResolver();
+        ParameterMap parameters;
+        bool verify = false;
+        int optchar;
+        optind = 1;
+
+        /* Parse command-line arguments */
+        while ((optchar = getopt(argc, argv, "hvD:")) != -1) {
+            switch (optchar) {
+                case 'h': {
+                        help();
+                        return 0;
+                    }
+                    break;
+                case 'D': {
+                        std::vector<std::string> param = tokenize(optarg, "=");
+                        if (param.size() != 2)
+                            Log(EError, "Invalid parameter specification \"%s\"", optarg);
+                        parameters[param[0]] = param[1];
+                    }
+                    break;
+                case 'v':
+                    verify = true;
+                    break;
+            };
+        }
+
+        if (optind + 2 != argc) {
+            help();
+            return 0;
+        }
+
+        fs::path
+            filename = fileResolver->resolve(argv[optind]),
+            filePath = fs::absolute(filename).parent_path(),
+            outputFilename = argv[optind+1];
+        ref<FileResolver> frClone = fileResolver->clone();
+        frClone->prependPath(filePath);
+        Thread::getThread()->setFileResolver(frClone);
+
+        ref<Timer> timer = new Timer();
+        ref<SceneDescription> description = loadSceneDescription(filename, parameters);
+        Log(EInfo, "Parsed \"%s\" in %i ms (%i objects)", filename.filename().string().c_str(),
+            timer->getMilliseconds(), (int) description->getNodeCount());
+
+        /* The output may be loaded from a different directory */
+        description->resolveFilenames(frClone);
+        description->write(outputFilename);
+        Log(EInfo, "Wrote \"%s\"", outputFilename.string().c_str());
+
+        if (verify) {
+            timer->reset();
+            ref<Scene> scene = SceneDescription::loadScene(outputFilename);
+            Log(EInfo, "Loaded the binary scene description in %i ms",
+                timer->getMilliseconds());
+        }
+
+        return 0;
+    }
+
+    MTS_DECLARE_UTILITY()
+};
+
+MTS_EXPORT_UTILITY(Scene2Bin, "Convert an XML scene into a binary scene description");
+MTS_NAMESPACE_END
@@ -0,0 +1,143 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/core/plugin.h>
+#include <mitsuba/core/fstream.h>
+#include <mitsuba/core/mstream.h>
+#include <mitsuba/core/mmap.h>
+#include <mitsuba/render/util.h>
+
+MTS_NAMESPACE_BEGIN
+
+/**
+ * Converts a dense scalar 'gridvolume' file (float32 or uint8 encoding)
+ * into the brick-based format of the 'sparsevolume' plugin. Bricks whose
+ * grid points are all zero are omitted.
+ */
+class Vol2Sparse : public Utility {
+public:
+    int run(int argc, char **argv) {
+        if (argc != 3 && argc != 4) {
+            cout << "Convert a dense grid volume into a sparse brick volume" << endl;
+            cout << "Syntax: mtsutil vol2sparse <input.vol> <output.svol> [brick size, default: 8]" << endl;
+            return -1;
+        }
+
+        int brickSize = 8;
+        if (argc == 4) {
+            char *end_ptr = NULL;
+            brickSize = (int) strtol(argv[3], &end_ptr, 10);
+            if (*end_ptr != '\0')
+                Log(EError, "Could not parse the brick size");
+        }
+        if (brickSize < 2 || !math::isPowerOfTwo(brickSize))
+            Log(EError, "The brick size must be a power of two!");
+
+        ref<MemoryMappedFile> mmap = new MemoryMappedFile(argv[1]);
+        ref<MemoryStream> in = new MemoryStream(mmap->getData(), mmap->getSize());
+        in->setByteOrder(Stream::ELittleEndian);
+
+        char header[3];
+        in->read(header, 3);
+        uint8_t version;
+        in->read(&version, 1);
+        if (header[0] != 'V' || header[1] != 'O' || header[2] != 'L' || version != 3)
+            Log(EError, "\"%s\" is not a valid volume data file!", argv[1]);
+
+        int type = in->readInt();
+        Vector3i res(in);
+        int channels = in->readInt();
+        if ((type != 1 && type != 3) || channels != 1)
+            Log(EError, "Only scalar float32 and uint8 volumes can be converted!");
+        float aabb[6];
+        in->readSingleArray(aabb, 6);
+
+        const uint8_t *data = (const uint8_t *) mmap->getData() + in->getPos();
+        const int brickRes = brickSize + 1;
+        const size_t brickVoxels = (size_t) brickRes * brickRes * brickRes;
+        Vector3i brickCount;
+        for (int i=0; i<3; ++i)
+            brickCount[i] = std::max(1, (res[i] - 2) / brickSize + 1);
+
+        std::vector<int32_t> coords;
+        std::vector<float> ranges, brickData;
+        std::vector<float> brick(brickVoxels);
+
+        for (int bz=0; bz<brickCount.z; ++bz) {
+            for (int by=0; by<brickCount.y; ++by) {
+                for (int bx=0; bx<brickCount.x; ++bx) {
+                    float minValue = std::numeric_limits<float>::infinity(),
+                          maxValue = -std::numeric_limits<float>::infinity();
+                    bool nonempty = false;
+                    size_t idx = 0;
+                    for (int z=0; z<brickRes; ++z) {
+                        for (int y=0; y<brickRes; ++y) {
+                            for (int x=0; x<brickRes; ++x) {
+                                int gx = bx*brickSize + x, gy = by*brickSize + y,
+                                    gz = bz*brickSize + z;
+                                float value = 0.0f;
+                                if (gx < res.x && gy < res.y && gz < res.z) {
+                                    size_t index = ((size_t) gz*res.y + gy)*res.x + gx;
+                                    value = type == 1 ? ((const float *) data)[index]
+                                        : data[index] / 255.0f;
+                                }
+                                brick[idx++] = value;
+                                minValue = std::min(minValue, value);
+                                maxValue = std::max(maxValue, value);
+                                nonempty |= value != 0;
+                            }
+                        }
+                    }
+                    if (!nonempty)
+                        continue;
+                    coords.push_back(bx); coords.push_back(by); coords.push_back(bz);
+                    ranges.push_back(minValue); ranges.push_back(maxValue);
+                    brickData.insert(brickData.end(), brick.begin(), brick.end());
+                }
+            }
+        }
+
+        size_t nBricks = coords.size() / 3;
+        ref<FileStream> out = new FileStream(argv[2], FileStream::ETruncReadWrite);
+        out->setByteOrder(Stream::ELittleEndian);
+        out->write("SVL", 3);
+        out->writeChar(1);
+        out->writeInt(brickSize);
+        res.serialize(out);
+        out->writeInt(1);
+        out->writeSingleArray(aabb, 6);
+        out->writeInt((int) nBricks);
+        if (nBricks > 0) {
+            out->writeIntArray(&coords[0], coords.size());
+            out->writeSingleArray(&ranges[0], ranges.size());
+            out->writeSingleArray(&brickData[0], brickData.size());
+        }
+
+        size_t totalBricks = (size_t) brickCount.x * brickCount.y * brickCount.z;
+        Log(EInfo, "Wrote %i of %i bricks (%.1f%%), %s -> %s", (int) nBricks, (int) totalBricks,
+            100.0f * nBricks / (Float) totalBricks, memString(mmap->getSize()).c_str(),
+            memString(out->getSize()).c_str());
+        out->close();
+        return 0;
+    }
+
+    MTS_DECLARE_UTILITY()
+};
+
+MTS_EXPORT_UTILITY(Vol2Sparse, "Convert a dense grid volume into a sparse brick volume")
+MTS_NAMESPACE_END
@@ -128,6 +128,10 @@ public:
         return m_float;
     }
 
+    void getFloatValueRange(const AABB &aabb, Float &minValue, Float &maxValue) const {
+        minValue = maxValue = m_float;
+    }
+
     std::string toString() const {
         std::ostringstream oss;
         oss << "ConstantDataSource[value=";
@@ -584,6 +584,53 @@ public:
         return 1.0f;
     }
 
+    void getFloatValueRange(const AABB &aabb, Float &minValue, Float &maxValue) const {
+        if (m_channels != 1 || (m_volumeType != EFloat32 && m_volumeType != EUInt8)) {
+            VolumeDataSource::getFloatValueRange(aabb, minValue, maxValue);
+            return;
+        }
+
+        /* Bound the query region in grid coordinates */
+        AABB gridAABB;
+        for (int i=0; i<8; ++i)
+            gridAABB.expandBy(m_worldToGrid(aabb.getCorner(i)));
+
+        /* Determine all grid points that can contribute to a trilinear
+           lookup within the region. Lookups that touch the boundary
+           layer return zero, which must be included in the range. */
+        int start[3], end[3];
+        bool touchesBoundary = false;
+        for (int i=0; i<3; ++i) {
+            start[i] = math::floorToInt(gridAABB.min[i]);
+            end[i] = math::floorToInt(gridAABB.max[i]) + 1;
+            if (start[i] < 0 || end[i] >= m_res[i])
+                touchesBoundary = true;
+            start[i] = std::max(start[i], 0);
+            end[i] = std::min(end[i], m_res[i] - 1);
+        }
+
+        minValue = std::numeric_limits<Float>::infinity();
+        maxValue = -std::numeric_limits<Float>::infinity();
+        if (touchesBoundary)
+            minValue = maxValue = 0.0f;
+
+        if (start[0] > end[0] || start[1] > end[1] || start[2] > end[2])
+            return;
+
+        const float *floatData = (const float *) m_data;
+        for (int z=start[2]; z<=end[2]; ++z) {
+            for (int y=start[1]; y<=end[1]; ++y) {
+                size_t idx = (z*m_res.y + y)*m_res.x + start[0];
+                for (int x=start[0]; x<=end[0]; ++x, ++idx) {
+                    Float value = m_volumeType == EFloat32
+                        ? (Float) floatData[idx] : m_densityMap[m_data[idx]];
+                    minValue = std::min(minValue, value);
+                    maxValue = std::max(maxValue, value);
+                }
+            }
+        }
+    }
+
     std::string toString() const {
         std::ostringstream oss;
         oss << "GridVolume[" << endl
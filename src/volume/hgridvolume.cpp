@@ -196,6 +196,48 @@ public:
         return m_maxFloatValue;
     }
 
+    void getFloatValueRange(const AABB &aabb, Float &minValue, Float &maxValue) const {
+        AABB gridAABB;
+        for (int i=0; i<8; ++i)
+            gridAABB.expandBy(m_worldToGrid(aabb.getCorner(i)));
+
+        int start[3], end[3];
+        bool touchesEmpty = false;
+        for (int i=0; i<3; ++i) {
+            start[i] = math::floorToInt(gridAABB.min[i]);
+            end[i] = math::floorToInt(gridAABB.max[i]);
+            if (start[i] < 0 || end[i] >= m_res[i])
+                touchesEmpty = true;
+            start[i] = std::max(start[i], 0);
+            end[i] = std::min(end[i], m_res[i] - 1);
+        }
+
+        minValue = std::numeric_limits<Float>::infinity();
+        maxValue = -std::numeric_limits<Float>::infinity();
+
+        for (int z=start[2]; z<=end[2]; ++z) {
+            for (int y=start[1]; y<=end[1]; ++y) {
+                for (int x=start[0]; x<=end[0]; ++x) {
+                    const VolumeDataSource *block =
+                        m_blocks[((z * m_res.y) + y) * m_res.x + x];
+                    if (block == NULL) {
+                        touchesEmpty = true;
+                        continue;
+                    }
+                    Float blockMin, blockMax;
+                    block->getFloatValueRange(aabb, blockMin, blockMax);
+                    minValue = std::min(minValue, blockMin);
+                    maxValue = std::max(maxValue, blockMax);
+                }
+            }
+        }
+
+        if (touchesEmpty) {
+            minValue = std::min(minValue, (Float) 0.0f);
+            maxValue = std::max(maxValue, (Float) 0.0f);
+        }
+    }
+
     MTS_DECLARE_CLASS()
 protected:
     std::string m_filename, m_prefix, m_postfix;
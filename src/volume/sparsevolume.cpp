@@ -0,0 +1,463 @@
+/*
+    This file is part of Mitsuba, a physically based rendering system.
+
+    Copyright (c) 2007-2014 by Wenzel Jakob and others.
+
+    Mitsuba is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Mitsuba is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mitsuba/render/volume.h>
+#include <mitsuba/core/mstream.h>
+#include <mitsuba/core/fresolver.h>
+#include <mitsuba/core/properties.h>
+#include <mitsuba/core/mmap.h>
+
+/// Log2 of the number of bricks per axis referenced by an internal node
+#define SPARSE_NODE_SHIFT 4
+#define SPARSE_NODE_SIZE  (1 << SPARSE_NODE_SHIFT)
+#define SPARSE_NODE_MASK  (SPARSE_NODE_SIZE - 1)
+
+MTS_NAMESPACE_BEGIN
+
+/*!\plugin{sparsevolume}{Sparse brick-based volume data source}
+ * \parameters{
+ *     \parameter{filename}{\String}{
+ *       Specifies the filename of the sparse volume data file to be loaded
+ *     }
+ *     \parameter{sendData}{\Boolean}{
+ *       When this parameter is set to \code{true}, the implementation will
+ *       send all volume data to other network render nodes. Otherwise, they
+ *       are expected to have access to an identical volume data file that can be
+ *       mapped into memory. \default{\code{false}}
+ *     }
+ *     \parameter{toWorld}{\Transform}{
+ *         Optional linear transformation that should be applied to the data
+ *     }
+ *     \parameter{min, max}{\Point}{
+ *         Optional parameter that can be used to re-scale the data so that
+ *         it lies in the bounding box between \code{min} and \code{max}.
+ *     }
+ * }
+ *
+ * This class provides access to memory-mapped scalar volume data that is
+ * stored sparsely as a set of fixed-size bricks. Only bricks containing
+ * nonzero values are stored, which makes this data source much more compact
+ * than \pluginref{gridvolume} for large and mostly empty volumes (e.g. smoke).
+ *
+ * In memory, the bricks are organized into a shallow tree: a dense root
+ * grid references internal nodes, each of which covers $16^3$ bricks. Both
+ * internal nodes and bricks store the minimum and maximum of the values
+ * they contain. These bounds are exposed to participating media (e.g. the
+ * \code{delta} method of \pluginref{heterogeneous}) so that empty regions
+ * can be skipped without performing any lookups.
+ *
+ * The grid points are placed like those of \pluginref{gridvolume}, and
+ * lookups perform trilinear interpolation. Every brick of size $B$ covers
+ * the grid points $[iB, iB+B]$ along each axis, i.e. neighboring bricks
+ * share one layer of grid points. This allows each lookup to be served
+ * from a single brick.
+ *
+ * The file format uses a little endian encoding and is specified as
+ * follows:\vspace{3mm}
+ *
+ * \begin{center}
+ * \begin{tabular}{>{\bfseries}p{2cm}p{11cm}}
+ * \toprule
+ * Position & Content\\
+ * \midrule
+ * Bytes 1-3&   ASCII Bytes '\code{S}', '\code{V}', and '\code{L}' \\
+ * Byte  4&     File format version number (currently 1)\\
+ * Bytes 5-8&   Brick size $B$ (32 bit integer, must be a power of two)\\
+ * Bytes 9-20 & Number of grid points along the X, Y and Z axes (32 bit integers)\\
+ * Bytes 21-24& Number of channels (32 bit integer, currently must be 1)\\
+ * Bytes 25-48& Axis-aligned bounding box of the data stored in single
+ *                precision (order: xmin, ymin, zmin, xmax, ymax, zmax)\\
+ * Bytes 49-52& Number of stored bricks $N$ (32 bit integer)\\
+ * Next $12N$ bytes & Integer brick coordinates (x, y, z) of every stored brick\\
+ * Next $8N$ bytes & Minimum and maximum value of every stored brick (\code{float32})\\
+ * Remainder & $N(B+1)^3$ \code{float32} values. The grid points of each brick
+ *             are ordered so that \code{data[(z*(B+1) + y)*(B+1) + x]}
+ *             refers to the local position \code{(x, y, z)}.\\
+ * \bottomrule
+ * \end{tabular}
+ * \end{center}
+ *
+ * Dense \code{float32} volumes in the \pluginref{gridvolume} format can be
+ * converted using \code{mtsutil vol2sparse}.
+ */
+class SparseGridDataSource : public VolumeDataSource {
+public:
+    /// Internal tree node referencing a block of bricks
+    struct Node {
+        float minValue, maxValue;
+        int32_t bricks[SPARSE_NODE_SIZE * SPARSE_NODE_SIZE * SPARSE_NODE_SIZE];
+    };
+
+    SparseGridDataSource(const Properties &props)
+        : VolumeDataSource(props), m_buffer(NULL) {
+        m_volumeToWorld = props.getTransform("toWorld", Transform());
+
+        if (props.hasProperty("min") && props.hasProperty("max")) {
+            m_dataAABB.min = props.getPoint("min");
+            m_dataAABB.max = props.getPoint("max");
+        }
+
+        m_sendData = props.getBoolean("sendData", false);
+        loadFromFile(props.getString("filename"));
+    }
+
+    SparseGridDataSource(Stream *stream, InstanceManager *manager)
+            : VolumeDataSource(stream, manager), m_buffer(NULL) {
+        m_volumeToWorld = Transform(stream);
+        m_dataAABB = AABB(stream);
+        m_sendData = stream->readBool();
+        m_filename = stream->readString();
+        if (m_sendData) {
+            size_t size = stream->readSize();
+            m_buffer = new uint8_t[size];
+            stream->read(m_buffer, size);
+            parse(m_buffer, size);
+        } else {
+            loadFromFile(m_filename);
+        }
+        configure();
+    }
+
+    virtual ~SparseGridDataSource() {
+        if (m_buffer)
+            delete[] m_buffer;
+    }
+
+    void serialize(Stream *stream, InstanceManager *manager) const {
+        VolumeDataSource::serialize(stream, manager);
+
+        m_volumeToWorld.serialize(stream);
+        m_dataAABB.serialize(stream);
+        stream->writeBool(m_sendData);
+        stream->writeString(m_filename.string());
+
+        if (m_sendData) {
+            const uint8_t *data = m_buffer ? m_buffer
+                : (const uint8_t *) m_mmap->getData();
+            stream->writeSize(m_dataSize);
+            stream->write(data, m_dataSize);
+        }
+    }
+
+    void configure() {
+        Vector extents(m_dataAABB.getExtents());
+        m_worldToVolume = m_volumeToWorld.inverse();
+        m_worldToGrid = Transform::scale(Vector(
+                (m_res[0] - 1) / extents[0],
+                (m_res[1] - 1) / extents[1],
+                (m_res[2] - 1) / extents[2])
+            ) * Transform::translate(-Vector(m_dataAABB.min)) * m_worldToVolume;
+        m_stepSize = std::numeric_limits<Float>::infinity();
+        for (int i=0; i<3; ++i)
+            m_stepSize = std::min(m_stepSize, 0.5f * extents[i] / (Float) (m_res[i]-1));
+        m_aabb.reset();
+        for (int i=0; i<8; ++i)
+            m_aabb.expandBy(m_volumeToWorld(m_dataAABB.getCorner(i)));
+    }
+
+    void loadFromFile(const fs::path &filename) {
+        m_filename = filename;
+        fs::path resolved = Thread::getThread()->getFileResolver()->resolve(filename);
+        m_mmap = new MemoryMappedFile(resolved);
+        parse((const uint8_t *) m_mmap->getData(), m_mmap->getSize());
+
+        Log(EDebug, "Mapped \"%s\" into memory: %ix%ix%i, %i bricks of size %i^3 "
+            "in %i nodes, %s, %s", resolved.filename().string().c_str(),
+            m_res.x, m_res.y, m_res.z, m_brickCount, m_brickSize, (int) m_nodes.size(),
+            memString(m_mmap->getSize()).c_str(), m_dataAABB.toString().c_str());
+    }
+
+    /// Parse the header and brick table, and build the node hierarchy
+    void parse(const uint8_t *data, size_t size) {
+        m_dataSize = size;
+        ref<MemoryStream> stream = new MemoryStream(const_cast<uint8_t *>(data), size);
+        stream->setByteOrder(Stream::ELittleEndian);
+
+        char header[3];
+        stream->read(header, 3);
+        if (header[0] != 'S' || header[1] != 'V' || header[2] != 'L')
+            Log(EError, "Encountered an invalid sparse volume data file "
+                "(incorrect header identifier)");
+        uint8_t version;
+        stream->read(&version, 1);
+        if (version != 1)
+            Log(EError, "Encountered an invalid sparse volume data file "
+                "(incorrect file version)");
+
+        m_brickSize = stream->readInt();
+        if (m_brickSize < 2 || !math::isPowerOfTwo(m_brickSize))
+            Log(EError, "Sparse volume data file: brick size must be a power of two!");
+        m_brickShift = math::log2i((uint32_t) m_brickSize);
+        m_brickMask = m_brickSize - 1;
+        m_brickRes = m_brickSize + 1;
+
+        m_res = Vector3i(stream);
+        if (m_res.x <= 0 || m_res.y <= 0 || m_res.z <= 0)
+            Log(EError, "Sparse volume data file: invalid resolution %ix%ix%i!",
+                m_res.x, m_res.y, m_res.z);
+        int channels = stream->readInt();
+        if (channels != 1)
+            Log(EError, "Encountered an unsupported sparse volume data "
+                "file (%i channels, only 1 is supported)", channels);
+
+        Float xmin = stream->readSingle(),
+              ymin = stream->readSingle(),
+              zmin = stream->readSingle();
+        Float xmax = stream->readSingle(),
+              ymax = stream->readSingle(),
+              zmax = stream->readSingle();
+        if (!m_dataAABB.isValid())
+            m_dataAABB = AABB(Point(xmin, ymin, zmin), Point(xmax, ymax, zmax));
+
+        /* A volume without any non-empty bricks is valid and stores a count of zero */
+        m_brickCount = stream->readInt();
+        if (m_brickCount < 0)
+            Log(EError, "Sparse volume data file: invalid brick count (%i)!",
+                m_brickCount);
+        const size_t brickVoxels = (size_t) m_brickRes * m_brickRes * m_brickRes;
+        const size_t tableOffset = stream->getPos();
+        const size_t dataOffset = tableOffset + (size_t) m_brickCount * 20;
+        if (dataOffset + m_brickCount * brickVoxels * sizeof(float) > size)
+            Log(EError, "Sparse volume data file is truncated!");
+
+        const int32_t *coords = (const int32_t *) (data + tableOffset);
+        m_brickRange = (const float *) (data + tableOffset + m_brickCount * 12);
+        m_brickData = (const float *) (data + dataOffset);
+        m_brickVoxels = brickVoxels;
+
+        /* Build the root grid and internal nodes */
+        Vector3i brickCount;
+        for (int i=0; i<3; ++i) {
+            brickCount[i] = std::max(1, (m_res[i] - 2) / m_brickSize + 1);
+            m_rootRes[i] = (brickCount[i] + SPARSE_NODE_MASK) >> SPARSE_NODE_SHIFT;
+        }
+        m_root.clear();
+        m_root.resize((size_t) m_rootRes.x * m_rootRes.y * m_rootRes.z, -1);
+        m_nodes.clear();
+        m_maxValue = 0.0f;
+
+        for (int i=0; i<m_brickCount; ++i) {
+            int bx = coords[3*i], by = coords[3*i+1], bz = coords[3*i+2];
+            if (bx < 0 || by < 0 || bz < 0 || bx >= brickCount.x ||
+                by >= brickCount.y || bz >= brickCount.z)
+                Log(EError, "Sparse volume data file: brick %i has invalid "
+                    "coordinates (%i, %i, %i)", i, bx, by, bz);
+
+            int32_t &nodeIndex = m_root[
+                ((bz >> SPARSE_NODE_SHIFT) * m_rootRes.y + (by >> SPARSE_NODE_SHIFT))
+                    * m_rootRes.x + (bx >> SPARSE_NODE_SHIFT)];
+            if (nodeIndex < 0) {
+                nodeIndex = (int32_t) m_nodes.size();
+                m_nodes.push_back(Node());
+                Node &node = m_nodes.back();
+                node.minValue = std::numeric_limits<float>::infinity();
+                node.maxValue = -std::numeric_limits<float>::infinity();
+                for (int j=0; j<SPARSE_NODE_SIZE*SPARSE_NODE_SIZE*SPARSE_NODE_SIZE; ++j)
+                    node.bricks[j] = -1;
+            }
+
+            Node &node = m_nodes[nodeIndex];
+            node.bricks[getChildIndex(bx, by, bz)] = i;
+            node.minValue = std::min(node.minValue, m_brickRange[2*i]);
+            node.maxValue = std::max(node.maxValue, m_brickRange[2*i+1]);
+            m_maxValue = std::max(m_maxValue, (Float) m_brickRange[2*i+1]);
+        }
+
+        /* Nodes with missing bricks also contain zero-valued regions */
+        for (size_t i=0; i<m_nodes.size(); ++i) {
+            Node &node = m_nodes[i];
+            for (int j=0; j<SPARSE_NODE_SIZE*SPARSE_NODE_SIZE*SPARSE_NODE_SIZE; ++j) {
+                if (node.bricks[j] < 0) {
+                    node.minValue = std::min(node.minValue, 0.0f);
+                    break;
+                }
+            }
+        }
+    }
+
+    Float lookupFloat(const Point &_p) const {
+        const Point p = m_worldToGrid.transformAffine(_p);
+        const int x = math::floorToInt(p.x),
+              y = math::floorToInt(p.y),
+              z = math::floorToInt(p.z);
+
+        if (x < 0 || y < 0 || z < 0 || x+1 >= m_res.x ||
+            y+1 >= m_res.y || z+1 >= m_res.z)
+            return 0;
+
+        const float *brick = getBrick(x >> m_brickShift,
+            y >> m_brickShift, z >> m_brickShift);
+        if (brick == NULL)
+            return 0;
+
+        const int x1 = x & m_brickMask, y1 = y & m_brickMask, z1 = z & m_brickMask,
+                  x2 = x1 + 1, y2 = y1 + 1, z2 = z1 + 1;
+
+        const Float fx = p.x - x, fy = p.y - y, fz = p.z - z,
+                _fx = 1.0f - fx, _fy = 1.0f - fy, _fz = 1.0f - fz;
+
+        const Float
+            d000 = brick[(z1*m_brickRes + y1)*m_brickRes + x1],
+            d001 = brick[(z1*m_brickRes + y1)*m_brickRes + x2],
+            d010 = brick[(z1*m_brickRes + y2)*m_brickRes + x1],
+            d011 = brick[(z1*m_brickRes + y2)*m_brickRes + x2],
+            d100 = brick[(z2*m_brickRes + y1)*m_brickRes + x1],
+            d101 = brick[(z2*m_brickRes + y1)*m_brickRes + x2],
+            d110 = brick[(z2*m_brickRes + y2)*m_brickRes + x1],
+            d111 = brick[(z2*m_brickRes + y2)*m_brickRes + x2];
+
+        return ((d000*_fx + d001*fx)*_fy +
+                (d010*_fx + d011*fx)*fy)*_fz +
+               ((d100*_fx + d101*fx)*_fy +
+                (d110*_fx + d111*fx)*fy)*fz;
+    }
+
+    void getFloatValueRange(const AABB &aabb, Float &minValue, Float &maxValue) const {
+        AABB gridAABB;
+        for (int i=0; i<8; ++i)
+            gridAABB.expandBy(m_worldToGrid(aabb.getCorner(i)));
+
+        /* Range of lower grid point indices used by lookups in the region */
+        int start[3], end[3];
+        bool touchesEmpty = false;
+        for (int i=0; i<3; ++i) {
+            start[i] = math::floorToInt(gridAABB.min[i]);
+            end[i] = math::floorToInt(gridAABB.max[i]);
+            if (start[i] < 0 || end[i] + 1 >= m_res[i])
+                touchesEmpty = true;
+            start[i] = std::max(start[i], 0) >> m_brickShift;
+            end[i] = std::min(end[i], m_res[i] - 2) >> m_brickShift;
+        }
+
+        minValue = std::numeric_limits<Float>::infinity();
+        maxValue = -std::numeric_limits<Float>::infinity();
+
+        if (start[0] <= end[0] && start[1] <= end[1] && start[2] <= end[2]) {
+            for (int nz=start[2] >> SPARSE_NODE_SHIFT; nz<=end[2] >> SPARSE_NODE_SHIFT; ++nz) {
+                for (int ny=start[1] >> SPARSE_NODE_SHIFT; ny<=end[1] >> SPARSE_NODE_SHIFT; ++ny) {
+                    for (int nx=start[0] >> SPARSE_NODE_SHIFT; nx<=end[0] >> SPARSE_NODE_SHIFT; ++nx) {
+                        int32_t nodeIndex = m_root[(nz * m_rootRes.y + ny) * m_rootRes.x + nx];
+                        if (nodeIndex < 0) {
+                            touchesEmpty = true;
+                            continue;
+                        }
+                        const Node &node = m_nodes[nodeIndex];
+
+                        /* Brick range covered by this node and the query */
+                        int lo[3] = { nx << SPARSE_NODE_SHIFT, ny << SPARSE_NODE_SHIFT, nz << SPARSE_NODE_SHIFT };
+                        int hi[3] = { lo[0] + SPARSE_NODE_MASK, lo[1] + SPARSE_NODE_MASK, lo[2] + SPARSE_NODE_MASK };
+                        bool contained = true;
+                        for (int i=0; i<3; ++i) {
+                            contained &= start[i] <= lo[i] && end[i] >= hi[i];
+                            lo[i] = std::max(lo[i], start[i]);
+                            hi[i] = std::min(hi[i], end[i]);
+                        }
+
+                        if (contained) {
+                            /* Use the bounds stored in the node */
+                            minValue = std::min(minValue, (Float) node.minValue);
+                            maxValue = std::max(maxValue, (Float) node.maxValue);
+                            continue;
+                        }
+
+                        for (int bz=lo[2]; bz<=hi[2]; ++bz) {
+                            for (int by=lo[1]; by<=hi[1]; ++by) {
+                                for (int bx=lo[0]; bx<=hi[0]; ++bx) {
+                                    int32_t brickIndex = node.bricks[getChildIndex(bx, by, bz)];
+                                    if (brickIndex < 0) {
+                                        touchesEmpty = true;
+                                        continue;
+                                    }
+                                    minValue = std::min(minValue, (Float) m_brickRange[2*brickIndex]);
+                                    maxValue = std::max(maxValue, (Float) m_brickRange[2*brickIndex+1]);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        if (touchesEmpty) {
+            minValue = std::min(minValue, (Float) 0.0f);
+            maxValue = std::max(maxValue, (Float) 0.0f);
+        }
+    }
+
+    bool supportsFloatLookups() const { return true; }
+    Float getStepSize() const { return m_stepSize; }
+    Float getMaximumFloatValue() const { return m_maxValue; }
+
+    std::string toString() const {
+        std::ostringstream oss;
+        oss << "SparseGridVolume[" << endl
+            << "  res = " << m_res.toString() << "," << endl
+            << "  brickSize = " << m_brickSize << "," << endl
+            << "  brickCount = " << m_brickCount << "," << endl
+            << "  nodeCount = " << m_nodes.size() << "," << endl
+            << "  aabb = " << m_dataAABB.toString() << endl
+            << "]";
+        return oss.str();
+    }
+
+    MTS_DECLARE_CLASS()
+protected:
+    /// Return the index of a brick within its parent node
+    inline static int getChildIndex(int bx, int by, int bz) {
+        return ((((bz & SPARSE_NODE_MASK) << SPARSE_NODE_SHIFT)
+            + (by & SPARSE_NODE_MASK)) << SPARSE_NODE_SHIFT) + (bx & SPARSE_NODE_MASK);
+    }
+
+    /// Return the data of a brick, or \c NULL if it is empty
+    inline const float *getBrick(int bx, int by, int bz) const {
+        int32_t nodeIndex = m_root[((bz >> SPARSE_NODE_SHIFT) * m_rootRes.y
+            + (by >> SPARSE_NODE_SHIFT)) * m_rootRes.x + (bx >> SPARSE_NODE_SHIFT)];
+        if (nodeIndex < 0)
+            return NULL;
+        int32_t brickIndex = m_nodes[nodeIndex].bricks[getChildIndex(bx, by, bz)];
+        if (brickIndex < 0)
+            return NULL;
+        return m_brickData + (size_t) brickIndex * m_brickVoxels;
+    }
+
+protected:
+    fs::path m_filename;
+    bool m_sendData;
+    ref<MemoryMappedFile> m_mmap;
+    uint8_t *m_buffer;
+    size_t m_dataSize;
+    Vector3i m_res;
+    int m_brickSize, m_brickShift, m_brickMask, m_brickRes;
+    int m_brickCount;
+    size_t m_brickVoxels;
+    const float *m_brickRange;
+    const float *m_brickData;
+    Vector3i m_rootRes;
+    std::vector<int32_t> m_root;
+    std::vector<Node> m_nodes;
+    Transform m_worldToGrid;
+    Transform m_worldToVolume;
+    Transform m_volumeToWorld;
+    Float m_stepSize;
+    Float m_maxValue;
+    AABB m_dataAABB;
+};
+
+MTS_IMPLEMENT_CLASS_S(SparseGridDataSource, false, VolumeDataSource);
+MTS_EXPORT_PLUGIN(SparseGridDataSource, "Sparse grid data source");
+MTS_NAMESPACE_END
@@ -21,11 +21,23 @@
 #include <mitsuba/core/statistics.h>
 #include <mitsuba/core/sched.h>
 #include <mitsuba/core/lrucache.h>
+#include <mitsuba/core/lock.h>
 #include <fstream>
+#include <deque>
 
 MTS_NAMESPACE_BEGIN
 
-static StatsCounter statsHitRate("Volume cache", "Cache hit rate", EPercentage);
+/// Number of shards of the shared block cache
+#define VOLCACHE_SHARDS 64
+/// Number of entries in the direct-mapped per-thread caches (power of two)
+#define VOLCACHE_LOCAL_SIZE 32
+/// Maximum number of outstanding prefetch requests
+#define VOLCACHE_PREFETCH_QUEUE 256
+
+static StatsCounter statsLocalHitRate("Volume cache", "Per-thread cache hit rate", EPercentage);
+static StatsCounter statsSharedHitRate("Volume cache", "Shared cache hit rate", EPercentage);
+static StatsCounter statsContention("Volume cache", "Contended shard locks", EPercentage);
+static StatsCounter statsPrefetch("Volume cache", "Prefetched blocks");
 static StatsCounter statsCreate("Volume cache", "Block creations");
 static StatsCounter statsDestruct("Volume cache", "Block destructions");
 static StatsCounter statsEmpty("Volume cache", "Empty blocks", EPercentage);
@@ -57,6 +69,10 @@ struct Vector3iKeyOrder : public std::binary_function<Vector3i, Vector3i, bool>
  *     \parameter{memoryLimit}{\Integer}{
  *         Maximum allowed memory usage in MiB. \default{1024, i.e. 1 GiB}
  *     }
+ *     \parameter{prefetch}{\Boolean}{
+ *         Rasterize blocks that rendering threads are predicted to
+ *         enter next on a background thread? \default{\code{true}}
+ *     }
  *     \parameter{toWorld}{\Transform}{
  *         Optional linear transformation that should be applied
  *         to the volume data
@@ -76,10 +92,116 @@ struct Vector3iKeyOrder : public std::binary_function<Vector3i, Vector3i, bool>
  * These are kept in memory until a user-specifiable threshold is exeeded,
  * after which point a \emph{least recently used} (LRU) policy removes
  * records that haven't been accessed in a long time.
+ *
+ * The blocks are shared between all rendering threads. To keep lock
+ * contention low, the shared cache is split into independently locked
+ * shards, and each thread additionally keeps a small direct-mapped cache
+ * of recently used blocks that is consulted without any locking.
  */
 class CachingDataSource : public VolumeDataSource {
 public:
-    typedef LRUCache<Vector3i, Vector3iKeyOrder, float *> BlockCache;
+    /// Reference-counted storage of a rasterized block (\c NULL data if empty)
+    struct Block : public Object {
+        float *data;
+
+        inline Block(float *data) : data(data) { }
+
+        virtual ~Block() {
+            ++statsDestruct;
+            delete[] data;
+        }
+    };
+
+    typedef LRUCache<Vector3i, Vector3iKeyOrder, ref<Block> > BlockCache;
+
+    /// One shard of the shared block cache
+    struct CacheShard {
+        ref<Mutex> mutex;
+        ref<BlockCache> cache;
+    };
+
+    /**
+     * \brief Small direct-mapped per-thread cache in front of the
+     * shared cache. Also tracks the recent block traversal of
+     * the thread for the purpose of prefetching.
+     */
+    struct LocalCache : public Object {
+        struct Entry {
+            Vector3i key;
+            ref<Block> block;
+        };
+
+        Entry entries[VOLCACHE_LOCAL_SIZE];
+        Vector3i lastKey;
+
+        inline LocalCache() : lastKey(-1) {
+            for (int i=0; i<VOLCACHE_LOCAL_SIZE; ++i)
+                entries[i].key = Vector3i(-1);
+        }
+
+        inline Entry &lookup(const Vector3i &key) {
+            uint32_t hash = ((uint32_t) key.x * 73856093u)
+                ^ ((uint32_t) key.y * 19349663u) ^ ((uint32_t) key.z * 83492791u);
+            return entries[hash & (VOLCACHE_LOCAL_SIZE - 1)];
+        }
+    };
+
+    /**
+     * \brief Background thread that rasterizes blocks which rendering
+     * threads are predicted to enter next
+     */
+    class PrefetchThread : public Thread {
+    public:
+        PrefetchThread(const CachingDataSource *source)
+            : Thread("volcache"), m_source(source), m_terminate(false) {
+            m_mutex = new Mutex();
+            m_cond = new ConditionVariable(m_mutex);
+        }
+
+        /// Enqueue a block without blocking (requests are dropped under contention)
+        void enqueue(const Vector3i &key) {
+            if (!m_mutex->tryLock())
+                return;
+            if (m_queue.size() < VOLCACHE_PREFETCH_QUEUE) {
+                m_queue.push_back(key);
+                m_cond->signal();
+            }
+            m_mutex->unlock();
+        }
+
+        void terminate() {
+            LockGuard lock(m_mutex);
+            m_terminate = true;
+            m_cond->broadcast();
+        }
+
+        void run() {
+            while (true) {
+                m_mutex->lock();
+                while (m_queue.empty() && !m_terminate)
+                    m_cond->wait();
+                if (m_terminate) {
+                    m_mutex->unlock();
+                    break;
+                }
+                Vector3i key = m_queue.front();
+                m_queue.pop_front();
+                m_mutex->unlock();
+
+                m_source->getBlock(key, true);
+            }
+        }
+
+        MTS_DECLARE_CLASS()
+    protected:
+        virtual ~PrefetchThread() { }
+    private:
+        const CachingDataSource *m_source;
+        ref<Mutex> m_mutex;
+        ref<ConditionVariable> m_cond;
+        std::deque<Vector3i> m_queue;
+        bool m_terminate;
+    };
 
     CachingDataSource(const Properties &props)
         : VolumeDataSource(props) {
@@ -99,20 +221,39 @@ public:
         m_stepSizeMultiplier = (Float) props.getFloat("stepSizeMultiplier", 1.0f);
 
         m_volumeToWorld = props.getTransform("toWorld", Transform());
+
+        /* Rasterize blocks ahead of time on a background thread? */
+        m_prefetch = props.getBoolean("prefetch", true);
     }
 
     CachingDataSource(Stream *stream, InstanceManager *manager)
     : VolumeDataSource(stream, manager) {
         m_nested = static_cast<VolumeDataSource *>(manager->getInstance(stream));
+        m_blockSize = stream->readInt();
+        m_voxelWidth = stream->readFloat();
+        m_memoryLimit = stream->readSize();
+        m_stepSizeMultiplier = stream->readFloat();
+        m_volumeToWorld = Transform(stream);
+        m_prefetch = stream->readBool();
         configure();
     }
 
     virtual ~CachingDataSource() {
+        if (m_prefetchThread) {
+            m_prefetchThread->terminate();
+            m_prefetchThread->join();
+        }
     }
 
     void serialize(Stream *stream, InstanceManager *manager) const {
         VolumeDataSource::serialize(stream, manager);
         manager->serialize(stream, m_nested.get());
+        stream->writeInt(m_blockSize);
+        stream->writeFloat(m_voxelWidth);
+        stream->writeSize(m_memoryLimit);
+        stream->writeFloat(m_stepSizeMultiplier);
+        m_volumeToWorld.serialize(stream);
+        stream->writeBool(m_prefetch);
     }
 
     void configure() {
@@ -125,9 +266,6 @@ public:
         if (m_voxelWidth == -1)
             m_voxelWidth = m_nested->getStepSize();
 
-        size_t memoryLimitPerCore = m_memoryLimit
-            / std::max((size_t) 1, Scheduler::getInstance()->getLocalWorkerCount());
-
         Vector totalCells  = m_aabb.getExtents() / m_voxelWidth;
         for (int i=0; i<3; ++i)
             m_cellCount[i] = (int) std::ceil(totalCells[i]);
@@ -143,7 +281,14 @@ public:
 
         m_blockRes = m_blockSize+1;
         int blockMemoryUsage = (int) std::pow((Float) m_blockRes, 3) * m_channels * sizeof(float);
-        m_blocksPerCore = memoryLimitPerCore / blockMemoryUsage;
+        size_t blocksPerShard = std::max((size_t) 1,
+            m_memoryLimit / blockMemoryUsage / VOLCACHE_SHARDS);
+
+        for (int i=0; i<VOLCACHE_SHARDS; ++i) {
+            m_shards[i].mutex = new Mutex();
+            m_shards[i].cache = new BlockCache(blocksPerShard,
+                boost::bind(&CachingDataSource::renderBlock, this, _1));
+        }
 
         m_worldToVolume = m_volumeToWorld.inverse();
         m_worldToGrid = Transform::scale(Vector(1/m_voxelWidth))
@@ -152,13 +297,19 @@ public:
         m_blockMask = ~(m_blockSize-1);
         m_blockShift = math::log2i((uint32_t) m_blockSize);
 
+        if (m_prefetch && !m_prefetchThread) {
+            m_prefetchThread = new PrefetchThread(this);
+            m_prefetchThread->start();
+        }
+
         Log(EInfo, "Volume cache configuration");
         Log(EInfo, "   Block size in voxels      = %i", m_blockSize);
         Log(EInfo, "   Voxel width               = %f", m_voxelWidth);
         Log(EInfo, "   Memory usage of one block = %s", memString(blockMemoryUsage).c_str());
         Log(EInfo, "   Memory limit              = %s", memString(m_memoryLimit).c_str());
-        Log(EInfo, "   Memory limit per core     = %s", memString(memoryLimitPerCore).c_str());
-        Log(EInfo, "   Max. blocks per core      = %i", m_blocksPerCore);
+        Log(EInfo, "   Max. blocks               = %i", (int) (blocksPerShard * VOLCACHE_SHARDS));
+        Log(EInfo, "   Cache shards              = %i", VOLCACHE_SHARDS);
+        Log(EInfo, "   Prefetching               = %s", m_prefetch ? "yes" : "no");
         Log(EInfo, "   Effective resolution      = %s", totalCells.toString().c_str());
         Log(EInfo, "   Effective storage         = %s", memString((size_t)
             (totalCells[0]*totalCells[1]*totalCells[2]*sizeof(float)*m_channels)).c_str());
@@ -174,52 +325,44 @@ public:
             z < 0 || z >= m_cellCount.z))
             return 0.0f;
 
-        BlockCache *cache = m_cache.get();
-        if (EXPECT_NOT_TAKEN(cache == NULL)) {
-            cache = new BlockCache(m_blocksPerCore,
-                boost::bind(&CachingDataSource::renderBlock, this, _1),
-                boost::bind(&CachingDataSource::destroyBlock, this, _1));
-            m_cache.set(cache);
+        LocalCache *localCache = m_localCache.get();
+        if (EXPECT_NOT_TAKEN(localCache == NULL)) {
+            localCache = new LocalCache();
+            m_localCache.set(localCache);
         }
 
-#if defined(VOLCACHE_DEBUG)
-        if (cache->isFull()) {
-            /* For debugging: when the cache is full, dump locations
-               of all cache records into an OBJ file and exit */
-            std::vector<Vector3i> keys;
-            cache->get_keys(std::back_inserter(keys));
-
-            std::ofstream os("keys.obj");
-            os << "o Keys" << endl;
-            for (size_t i=0; i<keys.size(); i++) {
-                Vector3i key = keys[i];
-                key = key * m_blockSize + Vector3i(m_blockSize/2);
-
-                Point p(key.x * m_voxelWidth + m_aabb.min.x,
-                    key.y * m_voxelWidth + m_aabb.min.y,
-                    key.z * m_voxelWidth + m_aabb.min.z);
-
-                os << "v " << p.x << " " << p.y << " " << p.z << endl;
-            }
-
-            /// Need to generate some fake geometry so that blender will import the points
-            for (size_t i=3; i<=keys.size(); i++)
-                os << "f " << i << " " << i-1 << " " << i-2 << endl;
-            os.close();
-            _exit(-1);
-        }
-#endif
-
-        bool hit = false;
-        float *blockData = cache->get(Vector3i(
+        const Vector3i key(
             (x & m_blockMask) >> m_blockShift,
             (y & m_blockMask) >> m_blockShift,
-            (z & m_blockMask) >> m_blockShift), hit);
+            (z & m_blockMask) >> m_blockShift);
+
+        LocalCache::Entry &entry = localCache->lookup(key);
+        statsLocalHitRate.incrementBase();
+        if (EXPECT_TAKEN(entry.key == key)) {
+            ++statsLocalHitRate;
+        } else {
+            entry.block = getBlock(key, false);
+            entry.key = key;
+        }
 
-        statsHitRate.incrementBase();
-        if (hit)
-            ++statsHitRate;
+        /* When moving into an adjacent block, ask for the one
+           after it along the same direction to be prefetched */
+        if (m_prefetchThread.get() != NULL && key != localCache->lastKey) {
+            Vector3i delta = key - localCache->lastKey;
+            if (localCache->lastKey.x >= 0 && std::abs(delta.x) <= 1
+                    && std::abs(delta.y) <= 1 && std::abs(delta.z) <= 1) {
+                Vector3i next = key + delta;
+                if (next.x >= 0 && next.y >= 0 && next.z >= 0 &&
+                    (next.x << m_blockShift) < m_cellCount.x &&
+                    (next.y << m_blockShift) < m_cellCount.y &&
+                    (next.z << m_blockShift) < m_cellCount.z &&
+                    localCache->lookup(next).key != next)
+                    m_prefetchThread->enqueue(next);
+            }
+            localCache->lastKey = key;
+        }
 
+        const float *blockData = entry.block->data;
         if (blockData == NULL)
             return 0.0f;
 
@@ -247,6 +390,50 @@ public:
         return result;
     }
 
+    /**
+     * \brief Fetch a block from the shared cache, rasterizing it on a miss
+     *
+     * Rasterization happens outside of the shard lock, hence two threads
+     * may occasionally render the same block. Only one copy is kept.
+     */
+    ref<Block> getBlock(const Vector3i &key, bool prefetch) const {
+        uint32_t hash = ((uint32_t) key.x * 73856093u)
+            ^ ((uint32_t) key.y * 19349663u) ^ ((uint32_t) key.z * 83492791u);
+        CacheShard &shard = m_shards[hash % VOLCACHE_SHARDS];
+        ref<Block> block;
+
+        lockShard(shard);
+        bool found = shard.cache->find(key, block);
+#if defined(VOLCACHE_DEBUG)
+        if (shard.cache->isFull())
+            dumpKeys(shard.cache);
+#endif
+        shard.mutex->unlock();
+
+        if (!prefetch) {
+            statsSharedHitRate.incrementBase();
+            if (found)
+                ++statsSharedHitRate;
+        }
+        if (found)
+            return block;
+
+        ref<Block> newBlock = renderBlock(key);
+        if (prefetch)
+            ++statsPrefetch;
+
+        lockShard(shard);
+        if (shard.cache->find(key, block)) {
+            /* Another thread was faster */
+            newBlock = block;
+        } else {
+            shard.cache->insert(key, newBlock);
+        }
+        shard.mutex->unlock();
+
+        return newBlock;
+    }
+
     Spectrum lookupSpectrum(const Point &_p) const {
         return Spectrum(0.0f);
     }
@@ -280,7 +467,7 @@ public:
         }
     }
 
-    float *renderBlock(const Vector3i &blockIdx) const {
+    ref<Block> renderBlock(const Vector3i &blockIdx) const {
         float *result = new float[m_blockRes*m_blockRes*m_blockRes];
         Point offset = m_aabb.min + Vector(
             blockIdx.x * m_blockSize * m_voxelWidth,
@@ -304,24 +491,70 @@ public:
         statsEmpty.incrementBase();
 
         if (nonempty) {
-            return result;
+            return new Block(result);
         } else {
             ++statsEmpty;
             delete[] result;
-            return NULL;
+            return new Block(NULL);
         }
     }
 
-    void destroyBlock(float *ptr) const {
-        ++statsDestruct;
-        delete[] ptr;
-    }
-
     Float getMaximumFloatValue() const {
         return m_nested->getMaximumFloatValue();
     }
 
+    void getFloatValueRange(const AABB &aabb, Float &minValue, Float &maxValue) const {
+        /* Cached lookups interpolate nested values that were rasterized
+           up to one voxel away from the query region. Lookups outside of
+           the cached domain return zero. */
+        AABB nestedAABB;
+        for (int i=0; i<8; ++i)
+            nestedAABB.expandBy(m_worldToVolume(aabb.getCorner(i)));
+        nestedAABB.min -= Vector(m_voxelWidth);
+        nestedAABB.max += Vector(m_voxelWidth);
+        m_nested->getFloatValueRange(nestedAABB, minValue, maxValue);
+        minValue = std::min(minValue, (Float) 0.0f);
+    }
+
     MTS_DECLARE_CLASS()
+protected:
+    /// Acquire a shard lock and keep track of contention
+    inline void lockShard(CacheShard &shard) const {
+        statsContention.incrementBase();
+        if (!shard.mutex->tryLock()) {
+            ++statsContention;
+            shard.mutex->lock();
+        }
+    }
+
+#if defined(VOLCACHE_DEBUG)
+    /* For debugging: when a cache shard is full, dump locations
+       of all of its records into an OBJ file and exit */
+    void dumpKeys(const BlockCache *cache) const {
+        std::vector<Vector3i> keys;
+        cache->get_keys(std::back_inserter(keys));
+
+        std::ofstream os("keys.obj");
+        os << "o Keys" << endl;
+        for (size_t i=0; i<keys.size(); i++) {
+            Vector3i key = keys[i];
+            key = key * m_blockSize + Vector3i(m_blockSize/2);
+
+            Point p(key.x * m_voxelWidth + m_aabb.min.x,
+                key.y * m_voxelWidth + m_aabb.min.y,
+                key.z * m_voxelWidth + m_aabb.min.z);
+
+            os << "v " << p.x << " " << p.y << " " << p.z << endl;
+        }
+
+        /// Need to generate some fake geometry so that blender will import the points
+        for (size_t i=3; i<=keys.size(); i++)
+            os << "f " << i << " " << i-1 << " " << i-2 << endl;
+        os.close();
+        _exit(-1);
+    }
+#endif
+
 protected:
     ref<VolumeDataSource> m_nested;
     Transform m_volumeToWorld;
@@ -330,14 +563,17 @@ protected:
     Float m_voxelWidth;
     Float m_stepSizeMultiplier;
     size_t m_memoryLimit;
-    size_t m_blocksPerCore;
+    bool m_prefetch;
     int m_channels;
     int m_blockSize, m_blockRes;
     int m_blockMask, m_voxelMask, m_blockShift;
     Vector3i m_cellCount;
-    mutable ThreadLocal<BlockCache> m_cache;
+    mutable CacheShard m_shards[VOLCACHE_SHARDS];
+    mutable ThreadLocal<LocalCache> m_localCache;
+    mutable ref<PrefetchThread> m_prefetchThread;
 };
 
+MTS_IMPLEMENT_CLASS(CachingDataSource::PrefetchThread, false, Thread);
 MTS_IMPLEMENT_CLASS_S(CachingDataSource, false, VolumeDataSource);
 MTS_EXPORT_PLUGIN(CachingDataSource, "Caching data source");
 MTS_NAMESPACE_END